@@ -16,18 +16,47 @@ typedef short pdint16;
 typedef unsigned short pduint16;
 typedef long pdint32;
 typedef unsigned long pduint32;
+typedef __int64 pdint64;
+typedef unsigned __int64 pduint64;
 typedef float pdfloat32;
 typedef double pddouble;
 typedef pduint32 pdbool;
 
 #define PD_FALSE ((pdbool)0)
 #define PD_TRUE ((pdbool)!0)
-#endif
 
 #include <float.h>
 
 #define pdisinf(x) (!_finite(x))
 #define pdisnan(x) (_isnan(x))
+#endif
+
+#ifndef PDFPLATFORM
+#if defined(__unix__) || defined(__APPLE__)
+#define PDFPLATFORM "POSIX"
+#include <stdint.h>
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
+typedef int8_t pdint8;
+typedef uint8_t pduint8;
+typedef int16_t pdint16;
+typedef uint16_t pduint16;
+typedef int32_t pdint32;
+typedef uint32_t pduint32;
+typedef int64_t pdint64;
+typedef uint64_t pduint64;
+typedef float pdfloat32;
+typedef double pddouble;
+typedef int pdbool;
+
+#define PD_FALSE ((pdbool)0)
+#define PD_TRUE ((pdbool)!0)
+
+#define pdisinf(x) isinf(x)
+#define pdisnan(x) isnan(x)
+#endif
+#endif
 
 #ifndef PDFPLATFORM
 #error Target platform not defined.
@@ -1,87 +1,402 @@
 #include "pdfrasread.h"
+#include "pdfrasread_scan.h"
+#include "pdfrasread_ccitt.h"
+#include "pdfrasread_pixels.h"
+#ifndef PDFRAS_NO_STATS
+#include "pdfrasread_clock.h"
+#endif
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
 #include <assert.h>
+#include <limits.h>
 
 ///////////////////////////////////////////////////////////////////////
 // Data Structures & Types
 
-// Cross-reference table entry
-// This is the exact byte-aligned layout present in PDF files,
-// a fact that the code relies on.
-typedef struct t_xref_entry {
-	char		offset[10];					// 10-digit byte offset
-	char		gen[6];						// space + 5-digit generation number
-	char		status[2];					// " n" (in use) or " f" (free)
-	char		eol[2];
-};
-typedef struct t_xref_entry t_xref_entry;
+// Size of a cross-reference table entry in a PDF file:
+// 10-digit offset, space, 5-digit generation, space, n or f, 2-char EOL.
+#define XREF_ENTRY_SIZE		20
+
+// Instrumentation counters (see pdfrasread_get_stats), compiled out with PDFRAS_NO_STATS.
+// A shared reader doesn't count: its cursors read from several threads at once.
+#ifndef PDFRAS_NO_STATS
+#define STAT_ADD(reader, counter, n)	((reader)->bShared ? (void)0 : (void)((reader)->stats.counter += (n)))
+#define STAT_CLOCK()					pdfras_clock_ns()
+#else
+#define STAT_ADD(reader, counter, n)	((void)(n))
+#define STAT_CLOCK()					0
+#endif
+
+// Dictionary keys the reader looks up.
+// Keys are recognized by a perfect hash over this fixed set, see key_lookup.
+typedef enum {
+	KEY_BitsPerComponent,
+	KEY_BlackIs1,
+	KEY_ColorSpace,
+	KEY_Count,
+	KEY_DecodeParms,
+	KEY_Filter,
+	KEY_Height,
+	KEY_K,
+	KEY_Kids,
+	KEY_Length,
+	KEY_MediaBox,
+	KEY_Pages,
+	KEY_Resources,
+	KEY_Root,
+	KEY_Rotate,
+	KEY_Subtype,
+	KEY_Type,
+	KEY_Width,
+	KEY_XObject,
+	KEY_COUNT,						// number of known keys
+	KEY_NONE = KEY_COUNT			// not a known key
+} t_pdfkey;
+// Index of a dictionary: where the value of each known key is.
+// Built in one pass over the dictionary, then kept for later lookups.
+typedef struct t_pdfdictindex {
+	pduint64			off;				// position of dictionary (0 = empty slot)
+	pduint64			values[KEY_COUNT];	// position of each key's value (0 = key not present)
+} t_pdfdictindex;
+
+// Number of dictionary indexes kept, most recently built ones.
+// Enough to cover a page, its resources and a strip while the page is loaded.
+#define DICT_CACHE_SIZE		4
 
 // Structure that represents a PDF/raster byte-stream that is open for reading
 typedef struct t_pdfrasreader {
 	int					apiLevel;			// caller's specified API level.
-	pdfras_freader		fread;				// function for reading from source
+	pdfras_freader64	fread;				// function for reading from source
+	pdfras_freader		fread32;			// API level 1 reader function, used if fread is NULL
 	pdfras_fcloser		fclose;				// source closer
+	pdfras_fviewer		fview;				// optional direct-access function (NULL if none)
+	pdfras_freaderv		freadv;				// optional vectored read function (NULL if none)
+	pdfras_fsizer		fsize;				// optional source-size function (NULL if none)
 	bool				bOpen;				// whether this reader is open
+	bool				bShared;			// fully indexed & read-only, for cursors (see pdfrasread_share)
 	void*				source;				// cookie/handle to caller-defined source
-	pduint32			filesize;			// source size, in bytes
+	pduint64			filesize;			// source size, in bytes
 	struct {
-		char			data[1024];
-		pduint32		off;
-		size_t			len;
+		const char*		data;				// buffered bytes: either store, or a view of the source
+		pduint64		off;				// source position of data[0]
+		size_t			len;				// number of bytes at data
+		char*			store;				// buffer storage, for sources that can't be viewed
+		size_t			size;				// size of store, in bytes
+		bool			callers;			// store was supplied by the caller (don't free it)
+		size_t			minread;			// smallest read into store (after a seek)
+		size_t			maxread;			// largest read into store (after sequential reads)
+		size_t			nextread;			// size of next read into store
+		unsigned long	refills;			// number of reads into store, since open
 	}					buffer;
 	// cross-reference table
-	t_xref_entry*		xrefs;				// xref table (initially NULL)
-	unsigned long		numxrefs;			// number of entries in xref table
+	pduint64*			xrefs;				// object offsets, 0 if free (initially NULL)
+	unsigned long		numxrefs;			// number of entries in xref table (0 = not loaded yet)
+	unsigned long		maxxrefs;			// number of entries allocated
 	// page table
+	RasterOpenMode		open_mode;			// eager or lazy page lookup
 	long				page_count;			// actual page count, or -1 for 'unknown'
-	pduint32*			page_table;			// table of page positions
+	pduint64*			page_table;			// table of page positions (0 = not located yet)
+	long				page_table_size;	// number of entries allocated
+	struct t_pdfpagenode*	page_tree;		// root of page tree, as far as resolved (lazy mode)
+	// page index
+	struct t_pdfpageinfo*	page_info;		// table of page info, indexed by page# (initially NULL)
+	long				page_info_size;		// number of entries allocated
+	// dictionary index cache
+	t_pdfdictindex		dicts[DICT_CACHE_SIZE];	// recently indexed dictionaries
+	unsigned			next_dict;			// cache slot to replace next
+	// decoded strip cache
+	struct t_pdfstripcache*	strip_cache;	// NULL if none (see pdfrasread_set_strip_cache)
+	// sequential scan
+	struct t_pdfskeleton*	skeleton;		// while a scan open parses, the file as scanned (else NULL)
+#ifndef PDFRAS_NO_STATS
+	// instrumentation
+	t_pdfrasstats		stats;				// counters (see pdfrasread_get_stats)
+#endif
 } t_pdfrasreader;
 
+// Strip index entry
+// Everything needed to read a strip without re-parsing its stream object.
+typedef struct t_pdfstripinfo {
+	pduint64			pos;				// file position of strip data
+	size_t				len;				// length of strip data, in bytes
+	unsigned long		rows;				// height of strip, in rows
+	unsigned long		top;				// page row of its first row
+	RasterCompression	compression;		// how the strip data is compressed (NULL = a filter the reader doesn't know)
+	bool				bBlackIs1;			// CCITT strip with /BlackIs1 true
+} t_pdfstripinfo;
+
+// Page index entry
+// Built once, on first access to a page, then served from memory.
+typedef struct t_pdfpageinfo {
+	pduint64			off;				// offset of page object in file (0 = not loaded yet)
+	unsigned long		BitsPerComponent;
+	double				MediaBox[4];
+	RasterPixelFormat	format;
+	unsigned long		width;
+	unsigned long		height;
+	unsigned long		rotation;
+	double				xdpi, ydpi;
+	int					strip_count;		// number of strips in this page
+	size_t				max_strip_size;		// largest (raw) strip size
+	t_pdfstripinfo*		strips;				// table of strip_count strip entries
+	int					strip_capacity;		// number of entries allocated
+} t_pdfpageinfo;
+
+// Cursor: one thread's handle on a shared reader
+typedef struct t_pdfrascursor {
+	t_pdfrasreader*		reader;				// the shared reader
+	char*				strip;				// buffer for strip data, if the source can't be viewed
+	size_t				strip_size;			// size of strip buffer, in bytes
+} t_pdfrascursor;
+
+// Row iterator: how far it has got through a page
+typedef struct t_pdfrasrowiter {
+	t_pdfrasreader*		reader;
+	const t_pdfpageinfo*	pinfo;			// the page
+	size_t				row_size;			// bytes per decoded row
+	int					strip;				// current strip
+	unsigned long		row;				// next row in current strip
+	t_pdfrasccitt*		ccitt;				// decoder of the current strip if it's CCITT (NULL = not started)
+	pduint64			next_pos;			// source position of the CCITT data not fed to the decoder yet
+	size_t				left;				// and its length
+	char*				chunk;				// buffer for CCITT data, if the source can't be viewed
+} t_pdfrasrowiter;
+
+// Decoded strip cache entry.
+// Allocated in one block with its pixels, which follow it.
+typedef struct t_pdfcachedstrip {
+	int					page;				// page number
+	int					strip;				// strip number on page
+	RasterOutputFormat	out;				// what its pixels were converted to
+	int					factor;				// and reduced by
+	size_t				stride;				// bytes per row of pixels
+	unsigned long		rows;				// number of rows of pixels
+	size_t				size;				// bytes of pixels
+	unsigned			pins;				// times pinned and not unpinned yet
+	struct t_pdfcachedstrip*	newer;		// next more recently used strip (NULL = newest)
+	struct t_pdfcachedstrip*	older;		// next less recently used strip (NULL = oldest)
+	struct t_pdfcachedstrip*	next;		// next strip in the same hash bucket
+} t_pdfcachedstrip;
+
+// Decoded strip cache: a hash table of strips, on a list in order of use
+typedef struct t_pdfstripcache {
+	size_t				budget;				// most bytes of pixels kept, unless pinned
+	size_t				bytes;				// bytes of pixels cached
+	unsigned long		count;				// number of strips cached
+	unsigned long		pinned;				// number of those pinned
+	unsigned long		hits, misses, evictions;
+	t_pdfcachedstrip*	newest;				// most recently used strip
+	t_pdfcachedstrip*	oldest;				// least recently used strip
+	t_pdfcachedstrip**	buckets;			// hash table
+	unsigned			nbuckets;			// size of hash table, a power of 2
+} t_pdfstripcache;
+
+// Page tree node, as resolved by lazy page lookup.
+// Only the nodes on the way to pages looked up so far are resolved.
+typedef struct t_pdfpagenode {
+	pduint64			off;				// position of the node object
+	long				count;				// its /Count, number of pages under it
+	int					kid_count;			// number of kids
+	struct t_pdfpagekid*	kids;			// its /Kids (NULL = not parsed yet)
+} t_pdfpagenode;
+
+// Kid of a page tree node
+typedef struct t_pdfpagekid {
+	unsigned long		num;				// object number of the kid
+	pduint64			off;				// position of the kid object (0 = not looked up yet)
+	long				count;				// pages under it: 1 for a page, -1 = not known yet
+	t_pdfpagenode*		node;				// if it's an intermediate node, the node (else NULL)
+} t_pdfpagekid;
+
+// Sequential scan: a stretch of the file kept in the skeleton
+typedef struct t_pdfsegment {
+	pduint64			off;				// file position of its first byte
+	size_t				len;				// its length, in bytes
+	size_t				at;					// where its bytes are in the skeleton's bytes
+} t_pdfsegment;
+
+// Sequential scan: the file as one pass over it found it (see scan_open).
+// Everything but stream data is kept, so the file can be parsed from memory.
+typedef struct t_pdfskeleton {
+	pduint64			filesize;			// size of the file, in bytes
+	char*				bytes;				// the bytes of all the segments, one after another
+	size_t				size;				// bytes used
+	size_t				capacity;			// bytes allocated
+	t_pdfsegment*		segs;				// segments, in file order
+	unsigned long		nsegs;				// number of segments
+	unsigned long		maxsegs;			// number allocated
+	pduint64*			objpos;				// position of each "num 0 obj" found (0 = none), by num
+	unsigned long		numobjs;			// one more than the highest object number found
+	unsigned long		maxobjs;			// number of entries allocated
+} t_pdfskeleton;
+
 ///////////////////////////////////////////////////////////////////////
 // Functions
 
 ///////////////////////////////////////////////////////////////////////
 // Utility Functions
 
-// Find last occurrence of string in string
-static char * strrstr(char * haystack, const char * needle)
+// Find last occurrence of string in a block of memory (which can contain NULs)
+static const char * memrstr(const char * haystack, size_t len, const char * needle)
 {
-	char *temp = haystack, *before = NULL;
-	while (temp = strstr(temp, needle)) before = temp++;
-	return before;
+	size_t n = strlen(needle);
+	const char *temp = haystack + len;
+	while (temp - haystack >= (ptrdiff_t)n) {
+		temp--;
+		if (*temp == needle[n - 1] && 0 == memcmp(temp - (n - 1), needle, n)) {
+			return temp - (n - 1);
+		}
+	}
+	return NULL;
 }
 
-static unsigned long ulmax(unsigned long a, unsigned long b)
+static size_t szmax(size_t a, size_t b)
 {
 	return (a >= b) ? a : b;
 }
 
-// Read the next buffer-full into the buffer, or up to EOF.
-// Append a NUL.
-// Set *poff to the offset in the file of the first byte in the buffer.
+// Read length bytes at offset off in the scanned file into buffer, as source_read would.
+// Stream data wasn't kept, and reads as 0xFF bytes: nothing the parser takes for PDF syntax.
+static size_t skeleton_read(const t_pdfskeleton* sk, pduint64 off, size_t length, char* buffer)
+{
+	if (off >= sk->filesize) {
+		return 0;
+	}
+	if (length > sk->filesize - off) {
+		length = (size_t)(sk->filesize - off);
+	}
+	memset(buffer, 0xFF, length);
+	// binary search for the first segment that ends after off
+	unsigned long lo = 0, hi = sk->nsegs;
+	while (lo < hi) {
+		unsigned long mid = lo + (hi - lo) / 2;
+		if (sk->segs[mid].off + sk->segs[mid].len <= off) {
+			lo = mid + 1;
+		}
+		else {
+			hi = mid;
+		}
+	}
+	// and copy the parts of the segments from there that overlap the read
+	for (; lo < sk->nsegs && sk->segs[lo].off < off + length; lo++) {
+		const t_pdfsegment* seg = &sk->segs[lo];
+		pduint64 start = (seg->off > off) ? seg->off : off;
+		pduint64 end = (seg->off + seg->len < off + length) ? seg->off + seg->len : off + length;
+		memcpy(buffer + (size_t)(start - off), sk->bytes + seg->at + (size_t)(start - seg->off), (size_t)(end - start));
+	}
+	return length;
+}
+
+// Read length bytes at offset off in the source into buffer.
+// Return the number of bytes actually read.
+static size_t source_read(t_pdfrasreader* reader, pduint64 off, size_t length, void* buffer)
+{
+	if (reader->skeleton) {
+		// parsing a scanned file, from memory
+		return skeleton_read(reader->skeleton, off, length, (char*)buffer);
+	}
+	pduint64 t0 = STAT_CLOCK();
+	size_t n;
+	if (reader->fread) {
+		n = reader->fread(reader->source, off, length, (char*)buffer);
+	}
+	// API level 1 reader function, which only takes 32-bit offsets.
+	else if (off > 0xFFFFFFFFu) {
+		// can't get there from here
+		return 0;
+	}
+	else {
+		n = reader->fread32(reader->source, (pduint32)off, length, (char*)buffer);
+	}
+	STAT_ADD(reader, source_reads, 1);
+	STAT_ADD(reader, bytes_read, n);
+	STAT_ADD(reader, source_ns, STAT_CLOCK() - t0);
+	return n;
+}
+
+// Make sure the buffer store can hold size bytes plus a trailing NUL.
+// Return TRUE if successful, FALSE if out of memory or over the size of a caller's buffer.
+static int reserve_store(t_pdfrasreader* reader, size_t size)
+{
+	if (size + 1 <= reader->buffer.size) {
+		return TRUE;
+	}
+	if (reader->buffer.callers) {
+		return FALSE;
+	}
+	char* store = (char*)realloc(reader->buffer.store, size + 1);
+	if (!store) {
+		return FALSE;
+	}
+	reader->buffer.store = store;
+	reader->buffer.size = size + 1;
+	return TRUE;
+}
+
+// Fill the buffer with the source contents starting at off, up to EOF.
+// If the source can be viewed, the buffer becomes a view of the rest of the source,
+// otherwise bytes are read into the buffer's store and a NUL appended.
+// Reads start small after a seek, and double in size (up to a limit) while
+// reading sequentially.
 // If nothing read (at EOF) return FALSE, otherwise return TRUE.
-static int advance_buffer(t_pdfrasreader* reader, pduint32* poff)
+static int fill_buffer(t_pdfrasreader* reader, pduint64 off)
 {
-	// Compute file position of next byte after current buffer:
-	*poff = reader->buffer.off + reader->buffer.len;
+	if (reader->buffer.len != 0 && off > reader->buffer.off && off <= reader->buffer.off + reader->buffer.len) {
+		// sequential access, read further ahead this time
+		if (reader->buffer.nextread < reader->buffer.maxread / 2) {
+			reader->buffer.nextread *= 2;
+		}
+		else {
+			reader->buffer.nextread = reader->buffer.maxread;
+		}
+	}
+	else {
+		reader->buffer.nextread = reader->buffer.minread;
+	}
+	reader->buffer.off = off;
+	reader->buffer.len = 0;
+	if (reader->fview && off < reader->filesize) {
+		pduint64 rest = reader->filesize - off;
+		size_t len = (rest > (size_t)-1) ? (size_t)-1 : (size_t)rest;
+		const void* view = reader->fview(reader->source, off, len);
+		if (view) {
+			reader->buffer.data = (const char*)view;
+			reader->buffer.len = len;
+			return TRUE;
+		}
+	}
+	if (!reserve_store(reader, reader->buffer.nextread)) {
+		return FALSE;
+	}
+	reader->buffer.data = reader->buffer.store;
 	// Read into buffer as much as will fit (with trailing NUL) or up to EOF:
-	reader->buffer.len = reader->fread(reader->source, *poff, sizeof reader->buffer.data - 1, reader->buffer.data);
+	reader->buffer.len = source_read(reader, off, reader->buffer.nextread, reader->buffer.store);
+	reader->buffer.refills++;
+	STAT_ADD(reader, refills, 1);
 	// NUL-terminate the buffer
-	reader->buffer.data[reader->buffer.len] = 0;
+	reader->buffer.store[reader->buffer.len] = 0;
 	// TRUE if something was read, FALSE if nothing read (presumably EOF)
 	return reader->buffer.len != 0;
 }
 
-static int seek_to(t_pdfrasreader* reader, pduint32 off)
+// Read length bytes at offset off into dst.
+// Served from the parse buffer if they are all in it, otherwise read from the source.
+// Return the number of bytes actually read.
+static size_t read_bytes(t_pdfrasreader* reader, pduint64 off, size_t length, void* dst)
+{
+	if (off >= reader->buffer.off && off + length <= reader->buffer.off + reader->buffer.len) {
+		memcpy(dst, reader->buffer.data + (size_t)(off - reader->buffer.off), length);
+		return length;
+	}
+	return source_read(reader, off, length, dst);
+}
+
+static int seek_to(t_pdfrasreader* reader, pduint64 off)
 {
 	if (off < reader->buffer.off || off >= reader->buffer.off + reader->buffer.len) {
-		reader->buffer.off = off;
-		reader->buffer.len = 0;
-		if (!advance_buffer(reader, &off)) {
-			assert(off = reader->buffer.off + reader->buffer.len);
+		if (!fill_buffer(reader, off)) {
 			return FALSE;
 		}
 	}
@@ -90,26 +405,54 @@ static int seek_to(t_pdfrasreader* reader, pduint32 off)
 	return TRUE;
 }
 
+// Return a pointer to the buffered bytes starting at file position off,
+// and set *plen to how many there are (always at least 1).
+// Return NULL (and set *plen to 0) if at EOF.
+// For bulk scanning: the bytes at off+*plen and beyond are fetched by
+// calling again with that offset.
+static const char* scan_window(t_pdfrasreader* reader, pduint64 off, size_t* plen)
+{
+	if (!seek_to(reader, off)) {
+		*plen = 0;
+		return NULL;
+	}
+	size_t i = (size_t)(off - reader->buffer.off);
+	*plen = reader->buffer.len - i;
+	return reader->buffer.data + i;
+}
+
 ///////////////////////////////////////////////////////////////////////
 // Single-character scanning methods
 
+// TRUE if ch is a white-space character per PDF, FALSE otherwise (including EOF)
+static int iswhite(int ch)
+{
+	return ch >= 0 && ch <= 255 && (pdfras_charclass[ch] & PDFRAS_CC_SPACE);
+}
+
+// TRUE if ch is a delimiter character per PDF, FALSE otherwise
+static int isdelim(int ch)
+{
+	return ch >= 0 && ch <= 255 && (pdfras_charclass[ch] & PDFRAS_CC_DELIM);
+}
+
 // Return the character at the current file position.
 // Return -1 if at EOF.
 // Does not move the file position.
-static int peekch(t_pdfrasreader* reader, pduint32 off)
+static int peekch(t_pdfrasreader* reader, pduint64 off)
 {
 	if (!seek_to(reader, off)) {
 		return -1;
 	}
 	assert(off >= reader->buffer.off);
 	assert(off < reader->buffer.off + reader->buffer.len);
-	return reader->buffer.data[off - reader->buffer.off];
+	return (pduint8)reader->buffer.data[off - reader->buffer.off];
 }
 
 // Get the next character in the file.
 // Return -1 if at EOF, otherwise
 // increments the file position and returns the char at the new position.
-static int nextch(t_pdfrasreader* reader, pduint32* poff)
+static int nextch(t_pdfrasreader* reader, pduint64* poff)
 {
 	if (!seek_to(reader, *poff + 1)) {
 		return -1;
@@ -122,107 +465,72 @@ static int nextch(t_pdfrasreader* reader, pduint32* poff)
 // Return FALSE if we end up at EOF (or have a read error)
 // otherwise return TRUE.
 // In EITHER CASE *poff is updated to skip over any whitespace chars.
-static int skip_whitespace(t_pdfrasreader* reader, pduint32* poff)
+static int skip_whitespace(t_pdfrasreader* reader, pduint64* poff)
 {
-	if (!seek_to(reader, *poff)) {
-		return FALSE;
-	}
-	unsigned i = (*poff - reader->buffer.off);
-	assert(i <= reader->buffer.len);
-	while (TRUE) {
-		if (i == reader->buffer.len) {
-			if (!advance_buffer(reader, poff)) {
-				// end of file
-				return FALSE;
-			}
-			i = 0;
+	const char* p;
+	size_t n;
+	while ((p = scan_window(reader, *poff, &n)) != NULL) {
+		size_t k = pdfras_scan_space(p, n);
+		*poff += k;
+		if (k < n) {
+			// stopped on a non-whitespace char
+			return TRUE;
 		}
-		assert(i < reader->buffer.len);
-		if (!isspace(reader->buffer.data[i])) {
+	}
+	// end of file
+	return FALSE;
+}
+
+// Advance *poff over any regular characters (anything but whitespace and delimiters)
+static void skip_regular(t_pdfrasreader* reader, pduint64* poff)
+{
+	const char* p;
+	size_t n;
+	while ((p = scan_window(reader, *poff, &n)) != NULL) {
+		size_t k = pdfras_scan_regular(p, n);
+		*poff += k;
+		if (k < n) {
 			break;
 		}
-		// advance over whitespace character:
-		i++; *poff += 1;
 	}
-	assert(i + reader->buffer.off == *poff);
-	return TRUE;
 }
 
 ///////////////////////////////////////////////////////////////////////
 // Single token parsing methods
 
-// TRUE if ch is a delimiter character per PDF, FALSE otherwise
-static int isdelim(int ch)
-{
-	switch (ch) {
-	case '(':
-	case ')':
-	case '<':
-	case '>':
-	case '[':
-	case ']':
-	case '{':
-	case '}':
-	case '/':
-	case '%':
-		return TRUE;
-	default:
-		return FALSE;
-	}
-}
-
-static int token_skip(t_pdfrasreader* reader, pduint32* poff)
+static int token_skip(t_pdfrasreader* reader, pduint64* poff)
 {
+	STAT_ADD(reader, tokens, 1);
 	// skip over whitespace
 	if (!skip_whitespace(reader, poff)) {
 		// EOF hit
 		return FALSE;
 	}
 	// skip over non-whitespace stuff (roughly, 'a token')
-	unsigned i = (*poff - reader->buffer.off);
 	// skip_whitespace always leaves us looking at a valid (non-whitespace) character
 	// If it can't, it returns FALSE which normally indicates EOF.
-	assert(i < reader->buffer.len);
-	// capture the starting char of the token
-	char ch0 = reader->buffer.data[i];
-	while (TRUE) {
-		// accept current char, look at next
-		i++;
-		if (i == reader->buffer.len) {
-			if (!advance_buffer(reader, poff)) {
-				// end of file, end of token
-				break;
-			}
-			i = 0;
-		}
-		assert(i < reader->buffer.len);
-		// check for a 'token break'
-		char ch = reader->buffer.data[i];
-		if ('/' == ch0) {
-			// A Name is a solidus followed by 'regular characters'
-			// terminated by delimiter or whitespace
-			if (isspace(ch) || isdelim(ch)) {
-				break;
-			}
-		}
-		else if (ch0 == ch && ('<' == ch0 || '>' == ch0)) {
-			// we treat << and >> as the only double-delimiter token
-			i++;
-			break;
-		}
-		// for our purposes, we consider the delimiters to
-		// be tokens, even though '(' for example actually starts a string token
-		else if (isdelim(ch0)) {
-			break;
+	// capture the starting char of the token, and accept it
+	int ch0 = peekch(reader, *poff);
+	assert(ch0 >= 0);
+	*poff += 1;
+	if ('/' == ch0) {
+		// A Name is a solidus followed by 'regular characters'
+		// terminated by delimiter or whitespace
+		skip_regular(reader, poff);
+	}
+	else if ('<' == ch0 || '>' == ch0) {
+		// we treat << and >> as the only double-delimiter token
+		if (peekch(reader, *poff) == ch0) {
+			*poff += 1;
 		}
+	}
+	// for our purposes, we consider the delimiters to
+	// be tokens, even though '(' for example actually starts a string token
+	else if (!isdelim(ch0)) {
 		// token started with a regular character
-		else if (isspace(ch) || isdelim(ch)) {
-			// so delim or whitespace ends it
-			break;
-		}
-		// Not a token break, accept this char and continue.
+		// so delim or whitespace ends it
+		skip_regular(reader, poff);
 	}
-	*poff = i + reader->buffer.off;;
 	// position offset at start of next token
 	skip_whitespace(reader, poff);
 	return TRUE;
@@ -231,68 +539,56 @@ static int token_skip(t_pdfrasreader* reader, pduint32* poff)
 // If the next token is the given literal string, skip over it (and following whitespace)
 // and return TRUE.  Otherwise leave the offset at the start of the next token and
 // return FALSE.  
-static int token_match(t_pdfrasreader* reader, pduint32* poff, const char* lit)
+static int token_match(t_pdfrasreader* reader, pduint64* poff, const char* lit)
 {
+	STAT_ADD(reader, tokens, 1);
 	// TODO: doesn't handle comments
-	char ch0 = *lit;
 	// skip over whitespace
 	if (!skip_whitespace(reader, poff)) {
 		// EOF hit
 		return FALSE;
 	}
-	unsigned i = (*poff - reader->buffer.off);
-	assert(i <= reader->buffer.len);
-	while (TRUE) {
-		if (i == reader->buffer.len) {
-			if (!advance_buffer(reader, poff)) {
-				// end of file
-				return FALSE;
-			}
-			i = 0;
-		}
-		assert(i < reader->buffer.len);
-		// get the current char from the stream:
-		char ch = reader->buffer.data[i];
-		if (0 == *lit) {
-			// end of string-to-match, check for a 'token break'
-			if ('/' == ch0) {
-				// Name: solidus followed by 'regular characters'
-				// terminated by delimiter or whitespace
-				if (isspace(ch) || isdelim(ch)) {
-					break;
-				}
-			}
-			else if ('<' == ch0 || '>' == ch0) {
-				// assume the match was either to '<<' or '>>'
-				// in which case it doesn't matter what follows.
-				break;
-			}
-			// for our purposes, we consider the delimiters to
-			// be tokens, even though '(' for example actually starts a string token
-			else if (isdelim(ch0)) {
-				break;
-			}
-			// token started with a regular character
-			else if (isspace(ch) || isdelim(ch)) {
-				// so delim or whitespace ends it
-				break;
-			}
+	// compare the literal with the source, a buffer-full at a time
+	pduint64 off = *poff;
+	size_t len = strlen(lit), i = 0;
+	while (i < len) {
+		size_t n;
+		const char* p = scan_window(reader, off + i, &n);
+		if (!p) {
+			// end of file
+			return FALSE;
+		}
+		if (n > len - i) {
+			n = len - i;
+		}
+		if (0 != memcmp(p, lit + i, n)) {
 			return FALSE;
 		}
-		if (*lit++ != ch) {
+		i += n;
+	}
+	off += len;
+	// end of string-to-match, check for a 'token break'
+	char ch0 = lit[0];
+	if ('/' == ch0 || !isdelim(ch0)) {
+		// A Name (solidus followed by 'regular characters') or a token that
+		// started with a regular character, must be terminated by
+		// delimiter or whitespace.
+		// Delimiters are tokens by themselves, and '<<' and '>>' are
+		// the only double-delimiter tokens, so it doesn't matter what follows those.
+		int ch = peekch(reader, off);
+		if (ch != -1 && !iswhite(ch) && !isdelim(ch)) {
 			return FALSE;
 		}
-		i++;
 	}
-	*poff = i + reader->buffer.off;
+	*poff = off;
 	skip_whitespace(reader, poff);
 	return TRUE;
 }
 
-static int token_eol(t_pdfrasreader* reader, pduint32 *poff)
+static int token_eol(t_pdfrasreader* reader, pduint64 *poff)
 {
 	int ch = peekch(reader, *poff);
-	while (isspace(ch)) { ch = nextch(reader, poff); }
+	while (iswhite(ch)) { ch = nextch(reader, poff); }
 	// EOL is CR LF, CR or LF
 	if (ch == 0x0D) {
 		ch = nextch(reader, poff);
@@ -310,21 +606,47 @@ static int token_eol(t_pdfrasreader* reader, pduint32 *poff)
 	return TRUE;
 }
 
+// Parse an unsigned 64-bit integer.
+// Skips leading and trailing whitespace
+static int token_uint64(t_pdfrasreader* reader, pduint64* poff, pduint64 *pvalue)
+{
+	STAT_ADD(reader, tokens, 1);
+	*pvalue = 0;
+	skip_whitespace(reader, poff);
+	if (!isdigit(peekch(reader, *poff))) {
+		return FALSE;
+	}
+	// accumulate digits, a buffer-full at a time
+	const char* p;
+	size_t n;
+	while ((p = scan_window(reader, *poff, &n)) != NULL) {
+		size_t i;
+		for (i = 0; i < n && isdigit((pduint8)p[i]); i++) {
+			if (*pvalue > ((pduint64)-1 - 9) / 10) {
+				// too big
+				return FALSE;
+			}
+			*pvalue = *pvalue * 10 + (p[i] - '0');
+		}
+		*poff += i;
+		if (i < n) {
+			break;
+		}
+	}
+	skip_whitespace(reader, poff);
+	return TRUE;
+}
+
 // Parse an unsigned long integer.
 // Skips leading and trailing whitespace
-static int token_ulong(t_pdfrasreader* reader, pduint32* poff, unsigned long *pvalue)
+static int token_ulong(t_pdfrasreader* reader, pduint64* poff, unsigned long *pvalue)
 {
-	int ch = peekch(reader, *poff);
-	while (isspace(ch)) { ch = nextch(reader, poff); }
+	pduint64 value;
 	*pvalue = 0;
-	if (!isdigit(ch)) {
+	if (!token_uint64(reader, poff, &value) || value > ULONG_MAX) {
 		return FALSE;
 	}
-	do {
-		*pvalue = *pvalue * 10 + (ch - '0');
-		ch = nextch(reader, poff);
-	} while (isdigit(ch));
-	while (isspace(ch)) { ch = nextch(reader, poff); }
+	*pvalue = (unsigned long)value;
 	return TRUE;
 }
 
@@ -332,12 +654,13 @@ static int token_ulong(t_pdfrasreader* reader, pduint32* poff, unsigned long *pv
 // If successful, put the numeric value in *pdvalue, advance *poff and return TRUE.
 // Ignores leading whitespace, and if successful skips over trailing whitespace.
 // Otherwise leave *poff unchanged, set *pdvalue to 0 and return FALSE.
-static int token_number(t_pdfrasreader* reader, pduint32 *poff, double* pdvalue)
+static int token_number(t_pdfrasreader* reader, pduint64 *poff, double* pdvalue)
 {
+	STAT_ADD(reader, tokens, 1);
 	// ISO says: "...one or more decimal digits with an optional sign and a leading,
 	// trailing, or embedded PERIOD (2Eh) (decimal point)."
 	//
-	pduint32 off = *poff;
+	pduint64 off = *poff;
 	skip_whitespace(reader, &off);
 	*pdvalue = 0.0;
 	double intpart = 0.0, fraction = 0.0;
@@ -378,15 +701,27 @@ static int token_number(t_pdfrasreader* reader, pduint32 *poff, double* pdvalue)
 // and the backslash (REVERSE SOLIDUS (5Ch)), which shall be treated specially as described in this sub-clause.
 // Balanced pairs of parentheses within a string require no special treatment.
 
-static int token_literal_string(t_pdfrasreader* reader, pduint32* poff)
+static int token_literal_string(t_pdfrasreader* reader, pduint64* poff)
 {
-	pduint32 off = *poff;
+	STAT_ADD(reader, tokens, 1);
+	pduint64 off = *poff;
 	int ch = peekch(reader, off);
 	if ('(' != ch) {
 		return FALSE;
 	}
 	int nesting = 0;
 	do {
+		// skip over ordinary string content in bulk
+		const char* p;
+		size_t n;
+		while ((p = scan_window(reader, off, &n)) != NULL) {
+			size_t k = pdfras_scan_string(p, n);
+			off += k;
+			if (k < n) {
+				break;
+			}
+		}
+		ch = peekch(reader, off);
 		switch (ch) {
 		case ')':
 			--nesting;
@@ -423,16 +758,17 @@ static int token_literal_string(t_pdfrasreader* reader, pduint32* poff)
 		default:
 			break;
 		} // switch
-		ch = nextch(reader, &off);
+		off++;
 	} while (nesting > 0);
 	skip_whitespace(reader, &off);
 	*poff = off;
 	return TRUE;
 }
 
-static int token_hex_string(t_pdfrasreader* reader, pduint32* poff)
+static int token_hex_string(t_pdfrasreader* reader, pduint64* poff)
 {
-	pduint32 off = *poff;
+	STAT_ADD(reader, tokens, 1);
+	pduint64 off = *poff;
 	int ch = peekch(reader, off);
 	if ('<' != ch) {
 		return FALSE;
@@ -442,7 +778,7 @@ static int token_hex_string(t_pdfrasreader* reader, pduint32* poff)
 	} while (ch >= '0' && ch <= '9' ||
 		(ch >= 'A' && ch <= 'F') ||
 		(ch >= 'a' && ch <= 'f') ||
-		isspace(ch));
+		iswhite(ch));
 	if (ch != '>') {
 		// unexpected character in hexadecimal string
 		return FALSE;
@@ -458,13 +794,14 @@ static int token_hex_string(t_pdfrasreader* reader, pduint32* poff)
 
 // Look up the indirect object (num,gen) in the cross-ref table and return its file position *pobjpos.
 // Returns TRUE if successful, FALSE if not.
-static int xref_lookup(t_pdfrasreader* reader, unsigned num, unsigned gen, pduint32 *pobjpos)
+static int xref_lookup(t_pdfrasreader* reader, unsigned num, unsigned gen, pduint64 *pobjpos)
 {
+	STAT_ADD(reader, xref_lookups, 1);
 	if (gen != 0) {
 		// not in PDF/raster
 		return FALSE;
 	}
-	if (!reader->xrefs) {
+	if (!reader->numxrefs) {
 		// internal error: no xref table loaded
 		return FALSE;
 	}
@@ -472,8 +809,11 @@ static int xref_lookup(t_pdfrasreader* reader, unsigned num, unsigned gen, pduin
 		// invalid PDF: indirect object number is outside xref table
 		return FALSE;
 	}
-	// parse the offset out of the indicated xref entry
-	pduint32 off = strtoul(reader->xrefs[num].offset, NULL, 10);
+	pduint64 off = reader->xrefs[num];
+	if (0 == off) {
+		// invalid PDF: reference to a free object
+		return FALSE;
+	}
 	// parse & verify the start of the object definition, which should be <num> <gen> obj:
 	unsigned long num2, gen2;
 	if (!token_ulong(reader, &off, &num2) ||
@@ -492,15 +832,15 @@ static int xref_lookup(t_pdfrasreader* reader, unsigned num, unsigned gen, pduin
 ///////////////////////////////////////////////////////////////////////
 // object parsing methods
 
-static int object_skip(t_pdfrasreader* reader, pduint32 *poff);
-static int dictionary_lookup(t_pdfrasreader* reader, pduint32 off, const char* key, pduint32 *pvalpos);
+static int object_skip(t_pdfrasreader* reader, pduint64 *poff);
+static int dictionary_lookup(t_pdfrasreader* reader, pduint64 off, t_pdfkey key, pduint64 *pvalpos);
 
 // Parse an indirect reference and return the resolved file offset in *pobjpos.
 // If successful returns TRUE (and advances *poff to point past the reference)
 // If not, returns FALSE, *poff is not changed and *pobjpos is undefined.
-static int parse_indirect_reference(t_pdfrasreader* reader, pduint32* poff, pduint32 *pobjpos)
+static int parse_indirect_reference(t_pdfrasreader* reader, pduint64* poff, pduint64 *pobjpos)
 {
-	pduint32 off = *poff;
+	pduint64 off = *poff;
 	unsigned long num, gen;
 	if (token_ulong(reader, &off, &num) && token_ulong(reader, &off, &gen) && token_match(reader, &off, "R")) {
 		// indirect object!
@@ -518,9 +858,9 @@ static int parse_indirect_reference(t_pdfrasreader* reader, pduint32* poff, pdui
 // parse a direct OR indirect numeric object
 // if successful place it's value in *pdvalue, update *poff and return TRUE.
 // Otherwise set *pdvalue to 0, don't touch *poff and return FALSE.
-static int parse_number_value(t_pdfrasreader* reader, pduint32 *poff, double* pdvalue)
+static int parse_number_value(t_pdfrasreader* reader, pduint64 *poff, double* pdvalue)
 {
-	pduint32 off;
+	pduint64 off;
 	// if indirect reference, skip over it
 	if (parse_indirect_reference(reader, poff, &off)) {
 		// and return the referenced numeric value (if any)
@@ -535,7 +875,7 @@ static int parse_number_value(t_pdfrasreader* reader, pduint32 *poff, double* pd
 // parse a direct OR indirect numeric value and round it to a long.
 // if successful place it's value in *pvalue, update *poff and return TRUE.
 // Otherwise set *pvalue to 0, don't touch *poff and return FALSE.
-static int parse_long_value(t_pdfrasreader* reader, pduint32 *poff, long* pvalue)
+static int parse_long_value(t_pdfrasreader* reader, pduint64 *poff, long* pvalue)
 {
 	double dvalue;
 	if (!parse_number_value(reader, poff, &dvalue)) {
@@ -545,10 +885,24 @@ static int parse_long_value(t_pdfrasreader* reader, pduint32 *poff, long* pvalue
 	return TRUE;
 }
 
+// parse a direct OR indirect non-negative numeric value and round it to a 64-bit integer.
+// if successful place it's value in *pvalue, update *poff and return TRUE.
+// Otherwise set *pvalue to 0, don't touch *poff and return FALSE.
+static int parse_uint64_value(t_pdfrasreader* reader, pduint64 *poff, pduint64* pvalue)
+{
+	double dvalue;
+	*pvalue = 0;
+	if (!parse_number_value(reader, poff, &dvalue) || dvalue < 0) {
+		return FALSE;
+	}
+	*pvalue = (pduint64)(dvalue + 0.5);
+	return TRUE;
+}
+
 // TRUE if successful, FALSE otherwise
-static int parse_dictionary(t_pdfrasreader* reader, pduint32 *poff)
+static int parse_dictionary(t_pdfrasreader* reader, pduint64 *poff)
 {
-	pduint32 off = *poff;
+	pduint64 off = *poff;
 	if (!token_match(reader, &off, "<<")) {
 		// dictionary malformed
 		return FALSE;
@@ -578,9 +932,9 @@ static int parse_dictionary(t_pdfrasreader* reader, pduint32 *poff)
 // Otherwise return FALSE and leave *poff unmoved.
 // If a stream is found, set *pstream to the position of the stream data, and *plen to its length in bytes.
 // Values are only returned through pstream or plen if they are non-NULL.
-static parse_dictionary_or_stream(t_pdfrasreader* reader, pduint32 *poff, pduint32 *pstream, long* plen)
+static int parse_dictionary_or_stream(t_pdfrasreader* reader, pduint64 *poff, pduint64 *pstream, pduint64* plen)
 {
-	pduint32 off = *poff;
+	pduint64 off = *poff;
 	if (!parse_dictionary(reader, &off)) {
 		return FALSE;
 	}
@@ -590,7 +944,7 @@ static parse_dictionary_or_stream(t_pdfrasreader* reader, pduint32 *poff, pduint
 		peekch(reader, off + 3) != 'e' ||
 		peekch(reader, off + 4) != 'a' ||
 		peekch(reader, off + 5) != 'm' ||
-		!isspace(peekch(reader, off + 6))) {
+		!iswhite(peekch(reader, off + 6))) {
 		// Valid dictionary, but not a stream
 		*poff = off;
 		if (pstream) *pstream = 0;
@@ -611,13 +965,13 @@ static parse_dictionary_or_stream(t_pdfrasreader* reader, pduint32 *poff, pduint
 	}
 	// we're positioned at the LF, step over it.
 	off++;
-	pduint32 lenpos;
-	if (!dictionary_lookup(reader, *poff, "/Length", &lenpos)) {
+	pduint64 lenpos;
+	if (!dictionary_lookup(reader, *poff, KEY_Length, &lenpos)) {
 		// invalid stream: no /Length key in stream dictionary
 		return FALSE;
 	}
-	long length;
-	if (!parse_long_value(reader, &lenpos, &length)) {
+	pduint64 length;
+	if (!parse_uint64_value(reader, &lenpos, &length)) {
 		return FALSE;
 	}
 	// we've found position and length of stream data:
@@ -634,7 +988,7 @@ static parse_dictionary_or_stream(t_pdfrasreader* reader, pduint32 *poff, pduint
 	return TRUE;
 }
 
-static int parse_array(t_pdfrasreader* reader, pduint32 *poff)
+static int parse_array(t_pdfrasreader* reader, pduint64 *poff)
 {
 	skip_whitespace(reader, poff);
 	if (peekch(reader, *poff) != '[') {
@@ -654,10 +1008,10 @@ static int parse_array(t_pdfrasreader* reader, pduint32 *poff)
 	return TRUE;
 }
 
-static int parse_media_box(t_pdfrasreader* reader, pduint32 *poff, double mediabox[4])
+static int parse_media_box(t_pdfrasreader* reader, pduint64 *poff, double mediabox[4])
 {
 	skip_whitespace(reader, poff);
-	pduint32 off = *poff;
+	pduint64 off = *poff;
 	if (peekch(reader, off) != '[') {
 		// not a valid array
 		return FALSE;
@@ -689,9 +1043,9 @@ static int parse_media_box(t_pdfrasreader* reader, pduint32 *poff, double mediab
 }
 
 
-static int object_skip(t_pdfrasreader* reader, pduint32 *poff)
+static int object_skip(t_pdfrasreader* reader, pduint64 *poff)
 {
-	pduint32 off = *poff;
+	pduint64 off = *poff;
 	int ch = peekch(reader, off);
 	if (-1 == ch) {
 		// at EOF
@@ -735,102 +1089,188 @@ static int object_skip(t_pdfrasreader* reader, pduint32 *poff)
 	return FALSE;
 }
 
-// Given a dictionary inline at pos, look up the specified key and return the file position of its value element.
-static int dictionary_lookup(t_pdfrasreader* reader, pduint32 off, const char* key, pduint32 *pvalpos)
+// Names of the known keys, without the leading '/'
+static const char* const key_names[KEY_COUNT] = {
+	"BitsPerComponent",
+	"BlackIs1",
+	"ColorSpace",
+	"Count",
+	"DecodeParms",
+	"Filter",
+	"Height",
+	"K",
+	"Kids",
+	"Length",
+	"MediaBox",
+	"Pages",
+	"Resources",
+	"Root",
+	"Rotate",
+	"Subtype",
+	"Type",
+	"Width",
+	"XObject",
+};
+// Perfect hash of the known keys: their first and last characters and their
+// length are enough to tell them apart. key_slots maps each hash value to the
+// key with that hash (or KEY_NONE).
+// If you add a key, check that the hash is still collision-free: the reader
+// asserts it on creation in debug builds. Find new constants if it isn't.
+#define KEY_HASH_SIZE		64
+#define KEY_MAX_LENGTH		16			// length of longest known key
+#define KEY_HASH(name, len)	(((pduint8)(name)[0] * 4 + (pduint8)(name)[(len)-1] * 61 + (len)) & (KEY_HASH_SIZE - 1))
+
+static const pduint8 key_slots[KEY_HASH_SIZE] = {
+	KEY_NONE, KEY_NONE, KEY_DecodeParms, KEY_NONE,
+	KEY_NONE, KEY_NONE, KEY_NONE, KEY_NONE,
+	KEY_Filter, KEY_NONE, KEY_Height, KEY_XObject,
+	KEY_K, KEY_NONE, KEY_NONE, KEY_NONE,
+	KEY_NONE, KEY_NONE, KEY_NONE, KEY_NONE,
+	KEY_MediaBox, KEY_NONE, KEY_NONE, KEY_Kids,
+	KEY_NONE, KEY_NONE, KEY_NONE, KEY_NONE,
+	KEY_NONE, KEY_NONE, KEY_NONE, KEY_Rotate,
+	KEY_NONE, KEY_NONE, KEY_NONE, KEY_NONE,
+	KEY_Subtype, KEY_Type, KEY_NONE, KEY_ColorSpace,
+	KEY_NONE, KEY_Width, KEY_NONE, KEY_NONE,
+	KEY_Pages, KEY_NONE, KEY_NONE, KEY_NONE,
+	KEY_Root, KEY_NONE, KEY_NONE, KEY_NONE,
+	KEY_NONE, KEY_Count, KEY_NONE, KEY_NONE,
+	KEY_Resources, KEY_NONE, KEY_NONE, KEY_NONE,
+	KEY_BitsPerComponent, KEY_BlackIs1, KEY_Length, KEY_NONE,
+};
+
+// Return the known key with the given name (without the leading '/'),
+// or KEY_NONE if it isn't one.
+static t_pdfkey key_lookup(const char* name, size_t len)
 {
-	*pvalpos = 0;
+	if (len == 0 || len > KEY_MAX_LENGTH) {
+		return KEY_NONE;
+	}
+	t_pdfkey key = (t_pdfkey)key_slots[KEY_HASH(name, len)];
+	if (key != KEY_NONE && strlen(key_names[key]) == len && 0 == memcmp(key_names[key], name, len)) {
+		return key;
+	}
+	return KEY_NONE;
+}
+
+#ifndef NDEBUG
+// Check that every known key hashes to its own slot
+static int key_table_valid(void)
+{
+	int k;
+	for (k = 0; k < KEY_COUNT; k++) {
+		size_t len = strlen(key_names[k]);
+		if (len > KEY_MAX_LENGTH || key_slots[KEY_HASH(key_names[k], len)] != k) {
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+#endif
+
+// Parse the dictionary at off in one pass, recording in *index where the value
+// of each known key is. If a key appears more than once, the first one counts.
+// Return TRUE if successful, FALSE if the dictionary is malformed - in which case
+// the keys found before the damage are still recorded.
+static int index_dictionary(t_pdfrasreader* reader, pduint64 off, t_pdfdictindex* index)
+{
+	memset(index, 0, sizeof *index);
 	if (!token_match(reader, &off, "<<")) {
 		// invalid dictionary
 		return FALSE;
 	}
 	while (!token_match(reader, &off, ">>")) {
-		// does the key element match the key we're looking for?
-		if (token_match(reader, &off, key)) {
-			// yes, bingo.
-			// check for indirect reference
-			unsigned long num, gen;
-			pduint32 p = off;
-			if (token_ulong(reader, &p, &num) && token_ulong(reader, &p, &gen) && token_match(reader, &p, "R")) {
-				// indirect object!
-				// and we already parsed it.
-				if (!xref_lookup(reader, num, gen, &off)) {
-					// invalid PDF - referenced object is not in cross-reference table
-					return FALSE;
-				}
-			}
-			*pvalpos = off;
-			return TRUE;
-		} // otherwise skip over and ignore key
-		else if (!token_skip(reader, &off)) {
-			// only fails at EOF
+		if ('/' != peekch(reader, off)) {
+			// invalid PDF: dictionary key is not a Name
+			return FALSE;
+		}
+		// find the extent of the key Name, and see if it's one we know
+		pduint64 name = off + 1;
+		off = name;
+		skip_regular(reader, &off);
+		size_t len = (size_t)(off - name);
+		t_pdfkey key = KEY_NONE;
+		char text[KEY_MAX_LENGTH];
+		if (len <= KEY_MAX_LENGTH && read_bytes(reader, name, len, text) == len) {
+			key = key_lookup(text, len);
+		}
+		if (!skip_whitespace(reader, &off)) {
+			// EOF hit
 			return FALSE;
 		}
+		if (key != KEY_NONE && !index->values[key]) {
+			index->values[key] = off;
+		}
 		// skip over value element
 		if (!object_skip(reader, &off)) {
 			// invalid dictionary (invalid value)
 			return FALSE;
 		}
 	}
-	// key not found in dictionary
-	return FALSE;
+	return TRUE;
 }
 
-// Parse the trailer dictionary.
-// TRUE if successful, FALSE otherwise
-static int read_trailer_dict(t_pdfrasreader* reader, pduint32 *poff)
+// Return the index of the dictionary at off, from the cache if it's there,
+// otherwise building it (and caching it, if the dictionary is valid).
+static const t_pdfdictindex* get_dictionary_index(t_pdfrasreader* reader, pduint64 off)
 {
-	if (!token_match(reader, poff, "trailer")) {
-		// PDF/raster restriction: trailer dictionary does not follow xref table.
-		return FALSE;
+	unsigned i;
+	for (i = 0; i < DICT_CACHE_SIZE; i++) {
+		if (off && reader->dicts[i].off == off) {
+			return &reader->dicts[i];
+		}
 	}
-	return parse_dictionary(reader, poff);
+	t_pdfdictindex* index = &reader->dicts[reader->next_dict];
+	reader->next_dict = (reader->next_dict + 1) % DICT_CACHE_SIZE;
+	if (index_dictionary(reader, off, index)) {
+		index->off = off;
+	}
+	return index;
 }
 
-// check an xref table for anything invalid
-// return TRUE if valid, FALSE otherwise.
-static int validate_xref_table(t_xref_entry* xrefs, unsigned long numxrefs)
-{
-	unsigned long e;
-	// Sweep the xref table, validate entries.
-	for (e = 0; e < numxrefs; e++) {
-		char *offend, *genend;
-		pduint32 offset = strtoul(xrefs[e].offset, &offend, 10);
-		unsigned long gen = strtoul(xrefs[e].gen, &genend, 10);
-		// Note, we don't check for leading 0's on offset or gen.
-		if (offend != xrefs[e].gen ||
-			genend != xrefs[e].status ||
-			(xrefs[e].eol[0] != ' ' && xrefs[e].eol[0] != 0x0D) ||
-			(xrefs[e].eol[1] != 0x0D && xrefs[e].eol[1] != 0x0A) ||
-			xrefs[e].gen[0] != ' ' ||
-			xrefs[e].status[0] != ' ' ||
-			(xrefs[e].status[1] != 'n' && xrefs[e].status[1] != 'f')) {
-			// invalid xref table entry
+// Given a dictionary inline at pos, look up the specified key and return the file position of its value element.
+static int dictionary_lookup(t_pdfrasreader* reader, pduint64 off, t_pdfkey key, pduint64 *pvalpos)
+{
+	STAT_ADD(reader, dict_lookups, 1);
+	*pvalpos = 0;
+	assert(key < KEY_COUNT);
+	off = get_dictionary_index(reader, off)->values[key];
+	if (!off) {
+		// key not found in dictionary
+		return FALSE;
+	}
+	// check for indirect reference
+	unsigned long num, gen;
+	pduint64 p = off;
+	if (token_ulong(reader, &p, &num) && token_ulong(reader, &p, &gen) && token_match(reader, &p, "R")) {
+		// indirect object!
+		// and we already parsed it.
+		if (!xref_lookup(reader, num, gen, &off)) {
+			// invalid PDF - referenced object is not in cross-reference table
 			return FALSE;
 		}
-		if (e == 0) {
-			if (xrefs[e].status[1] != 'f' || gen != 65535) {
-				// object 0 must be free with gen=65535
-				return FALSE;
-			}
-		}
-		else {
-			if (gen != 0 && xrefs[e].status[1] != 'f') {
-				// PDF/raster restriction: in-use object generation must be 0
-				// (free entries can have gen != 0)
-				return FALSE;
-			}
-		}
 	}
+	*pvalpos = off;
 	return TRUE;
 }
 
+// Parse the trailer dictionary.
+// TRUE if successful, FALSE otherwise
+static int read_trailer_dict(t_pdfrasreader* reader, pduint64 *poff)
+{
+	if (!token_match(reader, poff, "trailer")) {
+		// PDF/raster restriction: trailer dictionary does not follow xref table.
+		return FALSE;
+	}
+	return parse_dictionary(reader, poff);
+}
+
 // Parse and load the xref table from given offset within the file.
 // Returns TRUE if successful, FALSE for any error.
-static int read_xref_table(t_pdfrasreader* reader, pduint32* poff)
+static int read_xref_table(t_pdfrasreader* reader, pduint64* poff)
 {
-	pduint32 off = *poff;
+	pduint64 off = *poff;
 	unsigned long firstnum, numxrefs;
-	t_xref_entry* xrefs = NULL;
 	if (!token_match(reader, &off, "xref")) {
 		// invalid xref table
 		return FALSE;
@@ -849,26 +1289,47 @@ static int read_xref_table(t_pdfrasreader* reader, pduint32* poff)
 		// looks invalid, at least per PDF 32000-1:2008
 		return FALSE;
 	}
-	size_t xref_size = 20 * numxrefs;
-	xrefs = (t_xref_entry*)malloc(xref_size);
-	if (!xrefs) {
-		// allocation failed
-		return FALSE;
-	}
-	// Read all the xref entries straight into memory structure
-	// (PDF specifically designed for this)
-	if (reader->fread(reader->source, off, xref_size, (char*)xrefs) != xref_size) {
-		// invalid PDF, the xref table is cut off
-		free(xrefs);
-		return FALSE;
+	if (numxrefs > reader->maxxrefs) {
+		// table kept from the last file is too small (or there isn't one)
+		free(reader->xrefs);
+		reader->xrefs = (pduint64*)malloc(numxrefs * sizeof *reader->xrefs);
+		reader->maxxrefs = reader->xrefs ? numxrefs : 0;
+		if (!reader->xrefs) {
+			// allocation failed
+			return FALSE;
+		}
 	}
-	off += xref_size;
-	if (!validate_xref_table(xrefs, numxrefs)) {
-		free(xrefs);
-		return FALSE;
+	pduint64* xrefs = reader->xrefs;
+	// Decode the entries into binary offsets, as many at a time as the parse window holds
+	// (PDF specifically designed for this: the entries are fixed-size)
+	unsigned long e = 0;
+	while (e < numxrefs) {
+		size_t len;
+		const char* text = scan_window(reader, off, &len);
+		if (text && len < XREF_ENTRY_SIZE) {
+			// entry straddles the end of the window, read on from here
+			text = fill_buffer(reader, off) ? scan_window(reader, off, &len) : NULL;
+		}
+		if (!text || len < XREF_ENTRY_SIZE) {
+			// invalid PDF, the xref table is cut off
+			return FALSE;
+		}
+		unsigned long count = (unsigned long)(len / XREF_ENTRY_SIZE);
+		if (count > numxrefs - e) {
+			count = numxrefs - e;
+		}
+		if (e == 0 && 0 != memcmp(text + 10, " 65535 f", 8)) {
+			// object 0 must be free with gen=65535
+			return FALSE;
+		}
+		if (!pdfras_scan_xref(text, count, xrefs + e)) {
+			// invalid xref table entry
+			return FALSE;
+		}
+		e += count;
+		off += (pduint64)count * XREF_ENTRY_SIZE;
 	}
-	// OK, attach xref table to reader object:
-	reader->xrefs = xrefs;
+	// OK, the xref table is loaded
 	reader->numxrefs = numxrefs;
 	// update caller's file position
 	*poff = off;
@@ -878,16 +1339,17 @@ static int read_xref_table(t_pdfrasreader* reader, pduint32* poff)
 // Find all the pages in the page tree rooted at off, ppn points to next page index value.
 // Store each page's file position (indexed by page#) in the page table,
 // increment *ppn by the number of pages found.
-static int recursive_page_finder(t_pdfrasreader* reader, pduint32 off, pduint32* table, int *ppn)
+static int recursive_page_finder(t_pdfrasreader* reader, pduint64 off, pduint64* table, int *ppn)
 {
-	pduint32 p;
+	pduint64 p;
+	STAT_ADD(reader, page_nodes, 1);
 	assert(reader);
 	assert(table);
 	assert(ppn);
 	assert(*ppn >= 0);
 
 	// look for the Type key
-	if (!dictionary_lookup(reader, off, "/Type", &p)) {
+	if (!dictionary_lookup(reader, off, KEY_Type, &p)) {
 		// invalid PDF: page tree node is not a dictionary or lacks a /Type entry
 		return FALSE;
 	}
@@ -908,8 +1370,8 @@ static int recursive_page_finder(t_pdfrasreader* reader, pduint32 off, pduint32*
 		// invalid PDF: page tree node /Type is not /Pages
 		return FALSE;
 	}
-	pduint32 kids;
-	if (!dictionary_lookup(reader, off, "/Kids", &kids)) {
+	pduint64 kids;
+	if (!dictionary_lookup(reader, off, KEY_Kids, &kids)) {
 		// invalid PDF: page tree node lacks a /Kids entry
 		return FALSE;
 	}
@@ -917,7 +1379,7 @@ static int recursive_page_finder(t_pdfrasreader* reader, pduint32 off, pduint32*
 	if (!token_match(reader, &kids, "[")) {
 		return FALSE;
 	}
-	pduint32 kid;
+	pduint64 kid;
 	while (parse_indirect_reference(reader, &kids, &kid)) {
 		if (!recursive_page_finder(reader, kid, table, ppn)) {
 			// invalid PDF, bad 'kid' entry in page tree
@@ -931,82 +1393,319 @@ static int recursive_page_finder(t_pdfrasreader* reader, pduint32 off, pduint32*
 	return TRUE;
 }
 
-// Build the page table by walking the page tree from root.
-// If successful, return TRUE: page table contains offset of each page object.
-// Otherwise return FALSE;
-static int build_page_table(t_pdfrasreader* reader, pduint32 root)
+// Free a page tree node and all its resolved descendants
+static void free_page_node(t_pdfpagenode* node)
 {
-	assert(reader);
-	assert(NULL==reader->page_table);
-	assert(root > 0);
-	assert(reader->page_count >= 0);
-
-	// allocate a page table
-	pduint32* pages;
-	size_t ptsize = reader->page_count * sizeof *pages;
-	pages = (pduint32*)malloc(ptsize);
-	if (!pages) {
-		// internal failure, mmemory allocation
-		return FALSE;
+	if (node) {
+		int k;
+		for (k = 0; k < node->kid_count; k++) {
+			free_page_node(node->kids[k].node);
+		}
+		free(node->kids);
+		free(node);
+	}
+}
+
+// Return the bytes of memory held by a page tree node and the nodes under it.
+static size_t page_node_size(const t_pdfpagenode* node)
+{
+	size_t size = 0;
+	if (node) {
+		int k;
+		size = sizeof *node + node->kid_count * sizeof *node->kids;
+		for (k = 0; k < node->kid_count; k++) {
+			size += page_node_size(node->kids[k].node);
+		}
+	}
+	return size;
+}
+
+// Parse the /Kids array of a page tree node.
+// Return TRUE if successful, FALSE otherwise.
+static int load_page_node(t_pdfrasreader* reader, t_pdfpagenode* node)
+{
+	pduint64 kids;
+	if (!dictionary_lookup(reader, node->off, KEY_Kids, &kids) || !token_match(reader, &kids, "[")) {
+		// invalid PDF: page tree node lacks a /Kids array
+		return FALSE;
+	}
+	t_pdfpagekid* table = NULL;
+	int n = 0, size = 0;
+	unsigned long num, gen;
+	// Just collect the object numbers: looking each one up would read every kid.
+	while (token_ulong(reader, &kids, &num) && token_ulong(reader, &kids, &gen) && token_match(reader, &kids, "R")) {
+		if (gen != 0) {
+			// not in PDF/raster
+			free(table);
+			return FALSE;
+		}
+		if (n == size) {
+			size = size ? size * 2 : 8;
+			t_pdfpagekid* bigger = (t_pdfpagekid*)realloc(table, size * sizeof *table);
+			if (!bigger) {
+				// internal failure, memory allocation
+				free(table);
+				return FALSE;
+			}
+			table = bigger;
+		}
+		table[n].num = num;
+		table[n].off = 0;
+		table[n].count = -1;
+		table[n].node = NULL;
+		n++;
+	}
+	if (!token_match(reader, &kids, "]") || n == 0) {
+		// invalid PDF, expected ']' at end of 'kids' array
+		free(table);
+		return FALSE;
+	}
+	if (n == node->count) {
+		// As many kids as pages, so every kid holds one page - most likely
+		// it is the page. No need to read them all, find_page checks each one.
+		int k;
+		for (k = 0; k < n; k++) {
+			table[k].count = 1;
+		}
+	}
+	node->kids = table;
+	node->kid_count = n;
+	return TRUE;
+}
+
+// Look up the position of a kid object.
+// Return TRUE if successful, FALSE otherwise.
+static int locate_page_kid(t_pdfrasreader* reader, t_pdfpagekid* kid)
+{
+	return kid->off || xref_lookup(reader, kid->num, 0, &kid->off);
+}
+
+// Find out whether a kid is a page or an intermediate node, and how many pages it holds.
+// Return TRUE if successful, FALSE otherwise.
+static int load_page_kid(t_pdfrasreader* reader, t_pdfpagekid* kid)
+{
+	pduint64 p;
+	STAT_ADD(reader, page_nodes, 1);
+	if (!locate_page_kid(reader, kid)) {
+		// invalid PDF: kid is not in cross-reference table
+		return FALSE;
+	}
+	if (!dictionary_lookup(reader, kid->off, KEY_Type, &p)) {
+		// invalid PDF: page tree node is not a dictionary or lacks a /Type entry
+		return FALSE;
+	}
+	if (token_match(reader, &p, "/Page")) {
+		kid->count = 1;
+		return TRUE;
+	}
+	long count;
+	if (!token_match(reader, &p, "/Pages") ||
+		!dictionary_lookup(reader, kid->off, KEY_Count, &p) ||
+		!parse_long_value(reader, &p, &count) ||
+		count < 0) {
+		// invalid PDF: not a page tree node, or no valid /Count
+		return FALSE;
+	}
+	kid->node = (t_pdfpagenode*)calloc(1, sizeof(t_pdfpagenode));
+	if (!kid->node) {
+		// internal failure, memory allocation
+		return FALSE;
+	}
+	kid->node->off = kid->off;
+	kid->node->count = count;
+	kid->count = count;
+	return TRUE;
+}
+
+// Lazy page lookup: find page n by descending the page tree from the root,
+// choosing at each node the kid whose /Count range holds page n.
+// Record the page position in the page table, and return it.
+// Return 0 if the page can't be found.
+static pduint64 find_page(t_pdfrasreader* reader, long n)
+{
+	t_pdfpagenode* node = reader->page_tree;
+	long first = 0;				// number of first page under node
+	int depth;
+	// (depth limit guards against loops in a damaged page tree)
+	for (depth = 0; node && depth < 256; depth++) {
+		if (!node->kids && !load_page_node(reader, node)) {
+			return 0;
+		}
+		int k;
+		for (k = 0; k < node->kid_count; k++) {
+			if (node->kids[k].count < 0 && !load_page_kid(reader, &node->kids[k])) {
+				return 0;
+			}
+			if (n < first + node->kids[k].count) {
+				break;
+			}
+			first += node->kids[k].count;
+		}
+		if (k == node->kid_count) {
+			// invalid PDF: /Count values in page tree don't add up
+			return 0;
+		}
+		t_pdfpagekid* kid = &node->kids[k];
+		if (!kid->off) {
+			// counted but not looked at yet
+			long count = kid->count;
+			if (!load_page_kid(reader, kid) || kid->count != count) {
+				return 0;
+			}
+		}
+		if (!kid->node) {
+			// it's a page
+			reader->page_table[n] = kid->off;
+			return kid->off;
+		}
+		node = kid->node;
+	}
+	return 0;
+}
+
+// Make the page table hold n entries, all 0.
+// The table kept from the last file is reused if it is big enough.
+// Return TRUE if successful, FALSE if n is negative or memory allocation fails.
+static int reserve_page_table(t_pdfrasreader* reader, long n)
+{
+	if (n < 0) {
+		return FALSE;
+	}
+	if (n > reader->page_table_size) {
+		free(reader->page_table);
+		reader->page_table = (pduint64*)malloc(n * sizeof *reader->page_table);
+		reader->page_table_size = reader->page_table ? n : 0;
+		if (!reader->page_table) {
+			return FALSE;
+		}
+	}
+	memset(reader->page_table, 0, n * sizeof *reader->page_table);
+	return TRUE;
+}
+
+// Lazy mode: set up an empty page table and the root of the page tree
+static int start_page_table(t_pdfrasreader* reader, pduint64 root)
+{
+	assert(reader);
+	assert(NULL == reader->page_tree);
+	assert(reader->page_count >= 0);
+	reader->page_tree = (t_pdfpagenode*)calloc(1, sizeof(t_pdfpagenode));
+	if (!reserve_page_table(reader, reader->page_count + 1) || !reader->page_tree) {
+		// internal failure, memory allocation
+		return FALSE;
+	}
+	reader->page_tree->off = root;
+	reader->page_tree->count = reader->page_count;
+	return TRUE;
+}
+
+// Build the page table by walking the page tree from root.
+// If successful, return TRUE: page table contains offset of each page object.
+// Otherwise return FALSE;
+static int build_page_table(t_pdfrasreader* reader, pduint64 root)
+{
+	assert(reader);
+	assert(root > 0);
+	assert(reader->page_count >= 0);
+
+	// allocate a page table
+	if (!reserve_page_table(reader, reader->page_count)) {
+		// internal failure, mmemory allocation
+		return FALSE;
 	}
-	memset(pages, 0, ptsize);
 
 	int pageno = 0;
-	if (!recursive_page_finder(reader, root, pages, &pageno)) {
+	if (!recursive_page_finder(reader, root, reader->page_table, &pageno)) {
 		// error
-		free(pages);				// free the page table
 		return FALSE;
 	}
 	if (pageno != reader->page_count) {
 		// invalid PDF: /Count in root page node is not correct
-		free(pages);				// free the page table
 		return FALSE;
 	}
-	// keep the filled-in page table
-	reader->page_table = pages;
 	return TRUE;
 }
 
-// Return TRUE if all OK, FALSE if some problem.
-static int parse_trailer(t_pdfrasreader* reader)
+// Find the size of the source by probing it with tiny reads.
+// Returns the size in bytes.
+static pduint64 probe_source_size(t_pdfrasreader* reader)
 {
-	char tail[1024+1];
-	pduint32 off = 0x00000000, step = 0x800000;
-	pduint32 len = 0;
-	while (step > 0) {
-		switch (reader->fread(reader->source, off+step, 2, tail)) {
+	char probe[2];
+	// double hi until it's past EOF.
+	// lo is always 0 or a position known to be inside the source.
+	pduint64 lo = 0, hi = 0x800000;
+	while (source_read(reader, hi, 1, probe) == 1) {
+		lo = hi;
+		if (hi >= ((pduint64)1 << 62)) {
+			// ridiculous, give up
+			return hi;
+		}
+		hi *= 2;
+	}
+	// binary search for EOF between lo and hi
+	while (hi - lo > 1) {
+		pduint64 mid = lo + (hi - lo) / 2;
+		switch (source_read(reader, mid, 2, probe)) {
 		case 1:
-			len = off + step + 1;
-			step = 0;
-			break;
-		case 0:
-			step = (step+1)/2;
-			break;
+			// mid is the last byte
+			return mid + 1;
 		case 2:
-			off += step;
+			lo = mid + 1;
+			break;
+		default:
+			hi = mid;
 			break;
 		} // switch
 	}
+	// if lo is inside the source, it is the last byte
+	return (source_read(reader, lo, 1, probe) == 1) ? hi : lo;
+}
+
+// Return TRUE if all OK, FALSE if some problem.
+static int parse_trailer(t_pdfrasreader* reader)
+{
+	pduint64 off, len;
+	if (reader->skeleton) {
+		// the scan read all of it
+		len = reader->skeleton->filesize;
+	}
+	// ask the source for its size, if it can tell us
+	else if (!reader->fsize || !reader->fsize(reader->source, &len)) {
+		len = probe_source_size(reader);
+	}
 	reader->filesize = len;
-	off = (len < 32) ? 0 : len - 32;
-	step = reader->fread(reader->source, off, 32, tail);
+	// Read the tail of the file straight into the parse buffer, in one read:
+	// it holds startxref and, in smaller files, the trailer and xref table too.
+	size_t tailsize = reader->buffer.minread;
+	off = (len < tailsize) ? 0 : len - tailsize;
+	if (!reserve_store(reader, tailsize)) {
+		return FALSE;
+	}
+	char* tail = reader->buffer.store;
+	reader->buffer.data = tail;
+	reader->buffer.off = off;
+	reader->buffer.len = source_read(reader, off, (size_t)(len - off), tail);
+	reader->buffer.refills++;
+	STAT_ADD(reader, refills, 1);
 	// make sure it's NUL-terminated but remember it could contain embedded NULs.
-	tail[step] = 0;
-	const char* eof = strrstr(tail, "%%EOF");
+	tail[reader->buffer.len] = 0;
+	// look for %%EOF and startxref in the last 1024 bytes
+	size_t last = (reader->buffer.len < 1024) ? 0 : reader->buffer.len - 1024;
+	const char* eof = memrstr(tail + last, reader->buffer.len - last, "%%EOF");
 	if (!eof) {
 		// invalid PDF - %%EOF not found in last 1024 bytes.
 		return FALSE;
 	}
-	const char* startxref = strrstr(tail, "startxref");
+	const char* startxref = memrstr(tail + last, reader->buffer.len - last, "startxref");
 	if (!startxref) {
 		// invalid PDF - startxref not found in last 1024 bytes.
 		return FALSE;
 	}
 	// Calculate the file position of the "startxref" keyword
 	// and make a note of it for a bit later.
-	pduint32 startxref_off = off += (startxref - tail);
-	unsigned long xref_off;
-	if (!token_match(reader, &off, "startxref") || !token_ulong(reader, &off, &xref_off)) {
+	pduint64 startxref_off = off += (startxref - tail);
+	pduint64 xref_off;
+	if (!token_match(reader, &off, "startxref") || !token_uint64(reader, &off, &xref_off)) {
 		// startxref not followed by unsigned int
 		return FALSE;
 	}
@@ -1025,15 +1724,15 @@ static int parse_trailer(t_pdfrasreader* reader)
 		return FALSE;
 	}
 	// find the address of the Catalog
-	pduint32 catpos;
-	if (!dictionary_lookup(reader, off, "/Root", &catpos)) {
+	pduint64 catpos;
+	if (!dictionary_lookup(reader, off, KEY_Root, &catpos)) {
 		// invalid PDF: trailer dictionary must contain /Root entry
 		return FALSE;
 	}
 	// check the Catalog
 	off = catpos;
-	pduint32 p;
-	if (!dictionary_lookup(reader, off, "/Type", &p)) {
+	pduint64 p;
+	if (!dictionary_lookup(reader, off, KEY_Type, &p)) {
 		// invalid PDF: catalog must have /Type /Catalog
 		return FALSE;
 	}
@@ -1042,17 +1741,22 @@ static int parse_trailer(t_pdfrasreader* reader)
 		return FALSE;
 	}
 	// Find the root node of the page tree
-	pduint32 pages;
-	if (!dictionary_lookup(reader, off, "/Pages", &pages)) {
+	pduint64 pages;
+	if (!dictionary_lookup(reader, off, KEY_Pages, &pages)) {
 		// invalid PDF: catalog must have a /Pages entry
 		return FALSE;
 	}
 	// pages points to the root Page Tree Node
 	off = pages;
-	if (!dictionary_lookup(reader, pages, "/Count", &off) || !parse_long_value(reader, &off, &reader->page_count)) {
+	if (!dictionary_lookup(reader, pages, KEY_Count, &off) || !parse_long_value(reader, &off, &reader->page_count) ||
+		reader->page_count < 0) {
 		// invalid PDF: root page node does not have valid /Count value
 		return FALSE;
 	}
+	if (reader->open_mode == PDFRAS_OPEN_LAZY) {
+		// pages are located as they are accessed
+		return start_page_table(reader, pages);
+	}
 	// walk the page tree locating all the pages
 	if (!build_page_table(reader, pages)) {
 		// oops - something went wrong
@@ -1066,13 +1770,13 @@ static int parse_trailer(t_pdfrasreader* reader)
 // -1 in case of error.
 int pdfrasread_page_count(t_pdfrasreader* reader)
 {
-	if (!reader->xrefs) {
+	if (!reader->numxrefs) {
 		parse_trailer(reader);
 	}
 	return reader->page_count;
 }
 
-static pduint32 get_page_pos(t_pdfrasreader* reader, int n)
+static pduint64 get_page_pos(t_pdfrasreader* reader, int n)
 {
 	assert(reader);
 	if (n < 0 || n >= pdfrasread_page_count(reader)) {
@@ -1080,22 +1784,13 @@ static pduint32 get_page_pos(t_pdfrasreader* reader, int n)
 		return 0;
 	}
 	assert(reader->page_table);
+	if (!reader->page_table[n]) {
+		// lazy mode, page not located yet
+		return find_page(reader, n);
+	}
 	return reader->page_table[n];
 }
 
-typedef struct {
-	pduint32			off;				// offset of page object in file
-	unsigned long		BitsPerComponent;
-	double				MediaBox[4];
-	RasterPixelFormat	format;
-	unsigned long		width;
-	unsigned long		height;
-	unsigned long		rotation;
-	double				xdpi, ydpi;
-	int					strip_count;		// number of strips in this page
-	size_t				max_strip_size;		// largest (raw) strip size
-} t_pdfpageinfo;
-
 // round a dpi value to an exact integer, if it's already 'really close'
 static double tweak_dpi(double dpi)
 {
@@ -1110,7 +1805,7 @@ static double tweak_dpi(double dpi)
 	return dpi;
 }
 
-static int decode_strip_format(t_pdfrasreader* reader, pduint32* poff, unsigned long bpc, RasterPixelFormat* pformat)
+static int decode_strip_format(t_pdfrasreader* reader, pduint64* poff, unsigned long bpc, RasterPixelFormat* pformat)
 {
 	if (token_match(reader, poff, "/DeviceGray")) {
 		switch (bpc) {
@@ -1148,44 +1843,141 @@ static int decode_strip_format(t_pdfrasreader* reader, pduint32* poff, unsigned
 	return TRUE;
 }
 
-static int get_page_info(t_pdfrasreader* reader, int p, t_pdfpageinfo* pinfo)
+// Decode the /Filter and /DecodeParms of the strip dictionary at strip
+// into pstrip->compression and pstrip->bBlackIs1.
+// A filter the reader doesn't know, or CCITT parameters other than Group 4,
+// give compression PDFRAS_COMPRESSION_NULL: the strip can still be read raw.
+// Return TRUE if successful, FALSE if the entries are malformed.
+static int decode_strip_compression(t_pdfrasreader* reader, pduint64 strip, t_pdfstripinfo* pstrip)
+{
+	pstrip->compression = PDFRAS_UNCOMPRESSED;
+	pstrip->bBlackIs1 = false;
+	pduint64 val;
+	if (!dictionary_lookup(reader, strip, KEY_Filter, &val)) {
+		// no filter, uncompressed
+		return TRUE;
+	}
+	// /Filter is a name, or an array of names (PDF/raster: at most one)
+	int array = token_match(reader, &val, "[");
+	if (array ? token_match(reader, &val, "]") : token_match(reader, &val, "null")) {
+		// no filter, uncompressed
+		return TRUE;
+	}
+	if (token_match(reader, &val, "/DCTDecode")) {
+		pstrip->compression = PDFRAS_JPEG;
+	}
+	else if (token_match(reader, &val, "/CCITTFaxDecode")) {
+		pstrip->compression = PDFRAS_CCITTG4;
+	}
+	else if (peekch(reader, val) == '/') {
+		// some other filter
+		pstrip->compression = PDFRAS_COMPRESSION_NULL;
+		return TRUE;
+	}
+	else {
+		// invalid PDF: /Filter must be a name or an array of names
+		return FALSE;
+	}
+	if (array && !token_match(reader, &val, "]")) {
+		// a chain of filters, not PDF/raster
+		pstrip->compression = PDFRAS_COMPRESSION_NULL;
+		return TRUE;
+	}
+	if (pstrip->compression != PDFRAS_CCITTG4) {
+		return TRUE;
+	}
+	// CCITT parameters: all default (to K 0, Group 3) unless there's a DecodeParms dictionary,
+	// which may be alone or the first element of an array
+	double k = 0;
+	pduint64 parms;
+	if (dictionary_lookup(reader, strip, KEY_DecodeParms, &parms)) {
+		// step into an array
+		token_match(reader, &parms, "[");
+		if (!token_match(reader, &parms, "null")) {
+			parse_indirect_reference(reader, &parms, &parms);
+			if (dictionary_lookup(reader, parms, KEY_K, &val) && !token_number(reader, &val, &k)) {
+				// invalid PDF: /K must be a number
+				return FALSE;
+			}
+			if (dictionary_lookup(reader, parms, KEY_BlackIs1, &val)) {
+				if (token_match(reader, &val, "true")) {
+					pstrip->bBlackIs1 = true;
+				}
+				else if (!token_match(reader, &val, "false")) {
+					// invalid PDF: /BlackIs1 must be a boolean
+					return FALSE;
+				}
+			}
+		}
+	}
+	if (k >= 0) {
+		// CCITT Group 3: the reader only decodes Group 4
+		pstrip->compression = PDFRAS_COMPRESSION_NULL;
+	}
+	return TRUE;
+}
+
+// Append a strip entry to the strip table of *pinfo.
+// Return TRUE if successful, FALSE if memory allocation fails.
+static int add_strip_info(t_pdfpageinfo* pinfo, const t_pdfstripinfo* strip)
+{
+	int n = pinfo->strip_count;
+	// grow the strip table in powers of 2, starting with 4 entries
+	if (n == pinfo->strip_capacity) {
+		int cap = n ? 2 * n : 4;
+		t_pdfstripinfo* strips = (t_pdfstripinfo*)realloc(pinfo->strips, cap * sizeof *strips);
+		if (!strips) {
+			// internal failure, memory allocation
+			return FALSE;
+		}
+		pinfo->strips = strips;
+		pinfo->strip_capacity = cap;
+	}
+	pinfo->strips[n] = *strip;
+	pinfo->strip_count++;
+	return TRUE;
+}
+
+// Parse page p and all of its strips, filling in *pinfo.
+// Return TRUE if successful, FALSE otherwise.
+// In either case pinfo->strips may have been allocated.
+static int load_page_info(t_pdfrasreader* reader, int p, t_pdfpageinfo* pinfo)
 {
 	assert(reader);
 	assert(pinfo);
-	// clear info to all 0's
+	// clear info to all 0's, but keep the strip table for reuse
+	t_pdfstripinfo* strips = pinfo->strips;
+	int strip_capacity = pinfo->strip_capacity;
 	memset(pinfo, 0, sizeof *pinfo);
-	// If we haven't 'opened' the file, do the initial stuff now
-	if (!reader->xrefs && !parse_trailer(reader)) {
-		return FALSE;
-	}
+	pinfo->strips = strips;
+	pinfo->strip_capacity = strip_capacity;
 	// look up the file position of the nth page object:
-	pduint32 page = get_page_pos(reader, p);
+	pduint64 page = get_page_pos(reader, p);
 	if (!page) {
 		return FALSE;
 	}
-	pinfo->off = page;
-	pduint32 val;
-	if (!dictionary_lookup(reader, page, "/Type", &val) || !token_match(reader, &val, "/Page")) {
+	pduint64 val;
+	if (!dictionary_lookup(reader, page, KEY_Type, &val) || !token_match(reader, &val, "/Page")) {
 		// bad page object, not marked /Type /Page
 		return FALSE;
 	}
 	// rotation is stored in the page object
 	// note: if not present defaults to 0.
-	if (dictionary_lookup(reader, page, "/Rotate", &val) && !token_ulong(reader, &val, &pinfo->rotation)) {
+	if (dictionary_lookup(reader, page, KEY_Rotate, &val) && !token_ulong(reader, &val, &pinfo->rotation)) {
 		return FALSE;
 	}
 	// similarly for mediabox
-	if (!dictionary_lookup(reader, page, "/MediaBox", &val) || !parse_media_box(reader, &val, pinfo->MediaBox)) {
+	if (!dictionary_lookup(reader, page, KEY_MediaBox, &val) || !parse_media_box(reader, &val, pinfo->MediaBox)) {
 		return FALSE;
 	}
-	pduint32 resdict;
-	if (!dictionary_lookup(reader, page, "/Resources", &resdict)) {
+	pduint64 resdict;
+	if (!dictionary_lookup(reader, page, KEY_Resources, &resdict)) {
 		// bad page object, no /Resources entry
 		return FALSE;
 	}
 	// In the Resources dictionary find the XObject dictionary
-	pduint32 xobjects;
-	if (!dictionary_lookup(reader, resdict, "/XObject", &xobjects)) {
+	pduint64 xobjects;
+	if (!dictionary_lookup(reader, resdict, KEY_XObject, &xobjects)) {
 		// bad resource dictionary, no /XObject entry
 		return FALSE;
 	}
@@ -1212,21 +2004,21 @@ static int get_page_info(t_pdfrasreader* reader, int p, t_pdfpageinfo* pinfo)
 			// PDF/raster: strips must be named /strip0, /strip1, /strip2, etc.
 			return FALSE;
 		}
-		pduint32 strip;
+		pduint64 strip;
 		if (!parse_indirect_reference(reader, &xobjects, &strip)) {
 			// invalid PDF: strip entry in XObject dict doesn't point to strip stream
 			return FALSE;
 		}
-		if (!dictionary_lookup(reader, strip, "/Subtype", &val) || !token_match(reader, &val, "/Image")) {
+		if (!dictionary_lookup(reader, strip, KEY_Subtype, &val) || !token_match(reader, &val, "/Image")) {
 			// strip isn't an image?
 			return FALSE;
 		}
-		if (!dictionary_lookup(reader, strip, "/BitsPerComponent", &val) || !token_ulong(reader, &val, &pinfo->BitsPerComponent)) {
+		if (!dictionary_lookup(reader, strip, KEY_BitsPerComponent, &val) || !token_ulong(reader, &val, &pinfo->BitsPerComponent)) {
 			// strip doesn't have BitsPerComponent?
 			return FALSE;
 		}
 		unsigned long strip_height;
-		if (!dictionary_lookup(reader, strip, "/Height", &val) || !token_ulong(reader, &val, &strip_height)) {
+		if (!dictionary_lookup(reader, strip, KEY_Height, &val) || !token_ulong(reader, &val, &strip_height)) {
 			// strip doesn't have Length?
 			return FALSE;
 		}
@@ -1234,7 +2026,7 @@ static int get_page_info(t_pdfrasreader* reader, int p, t_pdfpageinfo* pinfo)
 		pinfo->height += strip_height;
 		// get/check strip width
 		unsigned long width;
-		if (!dictionary_lookup(reader, strip, "/Width", &val) || !token_ulong(reader, &val, &width)) {
+		if (!dictionary_lookup(reader, strip, KEY_Width, &val) || !token_ulong(reader, &val, &width)) {
 			// strip doesn't have Width?
 			return FALSE;
 		}
@@ -1245,7 +2037,7 @@ static int get_page_info(t_pdfrasreader* reader, int p, t_pdfpageinfo* pinfo)
 			// all strips on a page must have the same width
 			assert(pinfo->width == width);
 		}
-		if (!dictionary_lookup(reader, strip, "/ColorSpace", &val)) {
+		if (!dictionary_lookup(reader, strip, KEY_ColorSpace, &val)) {
 			// PDF/raster: image object, each strip must have a named ColorSpace
 			return FALSE;
 		}
@@ -1261,223 +2053,1871 @@ static int get_page_info(t_pdfrasreader* reader, int p, t_pdfpageinfo* pinfo)
 			// all strips on a page must have the same pixel format
 			assert(pinfo->format == strip_format);
 		}
+		t_pdfstripinfo info;
+		if (!decode_strip_compression(reader, strip, &info)) {
+			// invalid PDF: bad /Filter or /DecodeParms
+			return FALSE;
+		}
+		// find the position & length of the strip data
+		pduint64 data_pos;
+		pduint64 strip_size;
+		if (!parse_dictionary_or_stream(reader, &strip, &data_pos, &strip_size) || data_pos == 0) {
+			// invalid PDF: strip image must be a stream with a /Length
+			return FALSE;
+		}
+		if ((size_t)strip_size != strip_size) {
+			// strip is too big to address in memory on this platform
+			return FALSE;
+		}
 		// max_strip_size is (surprise) the maximum of the strip sizes (in bytes)
-		long strip_size;
-		if (!dictionary_lookup(reader, strip, "/Length", &val) || !parse_long_value(reader, &val, &strip_size)) {
-			// invalid PDF: strip image must have /Length
+		pinfo->max_strip_size = szmax(pinfo->max_strip_size, (size_t)strip_size);
+		// found a valid strip, record & count it
+		info.pos = data_pos;
+		info.len = (size_t)strip_size;
+		info.rows = strip_height;
+		info.top = pinfo->height - strip_height;
+		if (!add_strip_info(pinfo, &info)) {
 			return FALSE;
 		}
-		pinfo->max_strip_size = ulmax(pinfo->max_strip_size, (unsigned long)strip_size);
-		// found a valid strip, count it
-		pinfo->strip_count++;
 	} // for each strip
 	// we have MediaBox and pixel dimensions, we can calculate DPI
 	pinfo->xdpi = tweak_dpi(pinfo->width * 72.0 / (pinfo->MediaBox[2] - pinfo->MediaBox[0]));
 	pinfo->ydpi = tweak_dpi(pinfo->height * 72.0 / (pinfo->MediaBox[3] - pinfo->MediaBox[1]));
+	pinfo->off = page;
 	return TRUE;
 }
 
+// Return the index entry for page p, loading it on first access.
+// Return NULL if p is not a valid page, or page p can't be parsed.
+static const t_pdfpageinfo* get_page_info(t_pdfrasreader* reader, int p)
+{
+	assert(reader);
+	// If we haven't 'opened' the file, do the initial stuff now
+	if (!reader->numxrefs && !parse_trailer(reader)) {
+		return NULL;
+	}
+	if (p < 0 || p >= reader->page_count) {
+		// invalid page number
+		return NULL;
+	}
+	if (reader->page_count > reader->page_info_size) {
+		// first page access, or more pages than the last file: grow the (empty) page index
+		t_pdfpageinfo* info = (t_pdfpageinfo*)realloc(reader->page_info, reader->page_count * sizeof *info);
+		if (!info) {
+			// internal failure, memory allocation
+			return NULL;
+		}
+		memset(info + reader->page_info_size, 0, (reader->page_count - reader->page_info_size) * sizeof *info);
+		reader->page_info = info;
+		reader->page_info_size = reader->page_count;
+	}
+	t_pdfpageinfo* pinfo = &reader->page_info[p];
+	if (!pinfo->off) {
+		// not loaded yet, parse the page and its strips
+		if (!load_page_info(reader, p, pinfo)) {
+			pinfo->off = 0;
+			pinfo->strip_count = 0;
+			return NULL;
+		}
+	}
+	return pinfo;
+}
+
+// Return the index entry for strip s of page p,
+// or NULL if there is no such strip.
+static const t_pdfstripinfo* get_strip_info(t_pdfrasreader* reader, int p, int s)
+{
+	const t_pdfpageinfo* pinfo = get_page_info(reader, p);
+	if (!pinfo || s < 0 || s >= pinfo->strip_count) {
+		// invalid page or strip number
+		return NULL;
+	}
+	return &pinfo->strips[s];
+}
+
 // Return the pixel format of the raster image of page n (indexed from 0)
 RasterPixelFormat pdfrasread_page_format(t_pdfrasreader* reader, int n)
 {
-	t_pdfpageinfo info;
-	if (!get_page_info(reader, n, &info)) {
+	const t_pdfpageinfo* pinfo = get_page_info(reader, n);
+	if (!pinfo) {
 		return PDFRAS_FORMAT_NULL;
 	}
-	return info.format;
+	return pinfo->format;
 }
 
 // Return the pixel width of the raster image of page n
 int pdfrasread_page_width(t_pdfrasreader* reader, int n)
 {
-	t_pdfpageinfo info;
-	if (!get_page_info(reader, n, &info)) {
+	const t_pdfpageinfo* pinfo = get_page_info(reader, n);
+	if (!pinfo) {
 		return 0;
 	}
-	return info.width;
+	return pinfo->width;
 }
 
 // Return the pixel height of the raster image of page n
 int pdfrasread_page_height(t_pdfrasreader* reader, int n)
 {
-	t_pdfpageinfo info;
-	if (!get_page_info(reader, n, &info)) {
+	const t_pdfpageinfo* pinfo = get_page_info(reader, n);
+	if (!pinfo) {
 		return 0;
 	}
-	return info.height;
+	return pinfo->height;
 }
 
 // Return the clockwise rotation in degrees to be applied to page n
 int pdfrasread_page_rotation(t_pdfrasreader* reader, int n)
 {
-	t_pdfpageinfo info;
-	if (!get_page_info(reader, n, &info)) {
+	const t_pdfpageinfo* pinfo = get_page_info(reader, n);
+	if (!pinfo) {
 		return 0;
 	}
-	return info.rotation;
+	return pinfo->rotation;
 }
 
 // Get the resolution in dpi of the raster image of page n
 double pdfrasread_page_horizontal_dpi(t_pdfrasreader* reader, int n)
 {
-	t_pdfpageinfo info;
-	if (!get_page_info(reader, n, &info)) {
+	const t_pdfpageinfo* pinfo = get_page_info(reader, n);
+	if (!pinfo) {
 		return 0.0;
 	}
-	return info.xdpi;
+	return pinfo->xdpi;
 }
 
 double pdfrasread_page_vertical_dpi(t_pdfrasreader* reader, int n)
 {
-	t_pdfpageinfo info;
-	if (!get_page_info(reader, n, &info)) {
+	const t_pdfpageinfo* pinfo = get_page_info(reader, n);
+	if (!pinfo) {
 		return 0.0;
 	}
-	return info.ydpi;
+	return pinfo->ydpi;
 }
 
 // Strip reading functions
 // Return the number of strips in page p
 int pdfrasread_strip_count(t_pdfrasreader* reader, int p)
 {
-	t_pdfpageinfo info;
-	if (!get_page_info(reader, p, &info)) {
+	const t_pdfpageinfo* pinfo = get_page_info(reader, p);
+	if (!pinfo) {
 		return 0;
 	}
-	return info.strip_count;
+	return pinfo->strip_count;
 }
 
 // Return the maximum raw (compressed) strip size on page p
 size_t pdfrasread_max_strip_size(t_pdfrasreader* reader, int p)
 {
-	t_pdfpageinfo info;
-	if (!get_page_info(reader, p, &info)) {
+	const t_pdfpageinfo* pinfo = get_page_info(reader, p);
+	if (!pinfo) {
 		return 0;
 	}
-	return info.max_strip_size;
+	return pinfo->max_strip_size;
 }
 
-static find_strip(t_pdfrasreader* reader, int p, int s, pduint32* pstrip)
+// Return the height in rows of strip s on page p
+int pdfrasread_strip_height(t_pdfrasreader* reader, int p, int s)
 {
-	char stripname[32];
-
-	sprintf(stripname, "/strip%d", s);
-
-	// look up the file position of the nth page object:
-	pduint32 page = get_page_pos(reader, p);
-	if (!page) {
-		return FALSE;
-	}
-	pduint32 resdict;
-	if (!dictionary_lookup(reader, page, "/Resources", &resdict)) {
-		// bad page object, no /Resources entry
-		return FALSE;
-	}
-	// In the Resources dictionary find the XObject dictionary
-	pduint32 xobjects;
-	if (!dictionary_lookup(reader, resdict, "/XObject", &xobjects)) {
-		// bad resource dictionary, no /XObject entry
-		return FALSE;
+	const t_pdfstripinfo* strip = get_strip_info(reader, p, s);
+	if (!strip) {
+		return 0;
 	}
-	if (!dictionary_lookup(reader, xobjects, stripname, pstrip)) {
-		// strip not found in XObject dictionary
-		return FALSE;
+	return strip->rows;
+}
+
+// Return the raw (compressed) size of strip s on page p
+size_t pdfrasread_strip_raw_size(t_pdfrasreader* reader, int p, int s)
+{
+	const t_pdfstripinfo* strip = get_strip_info(reader, p, s);
+	if (!strip) {
+		return 0;
 	}
-	return TRUE;
+	return strip->len;
 }
 
 // Read the raw (compressed) data of strip s on page p into buffer
 // Returns the actual number of bytes read.
 size_t pdfrasread_read_raw_strip(t_pdfrasreader* reader, int p, int s, void* buffer, size_t bufsize)
 {
-	// find the strip
-	pduint32 strip;
-	if (!find_strip(reader, p, s, &strip)) {
-		// invalid strip request
-		return 0;
-	}
-	// Parse the strip stream and find the position & length of its data
-	pduint32 pos;
-	long length;
-	if (!parse_dictionary_or_stream(reader, &strip, &pos, &length) || pos == 0 || length == 0) {
-		// strip stream not found or invalid
+	// find the strip in the page index
+	const t_pdfstripinfo* strip = get_strip_info(reader, p, s);
+	if (!strip || strip->len == 0) {
+		// invalid strip request, or empty strip
 		return 0;
 	}
-	if ((unsigned)length > bufsize) {
+	size_t length = strip->len;
+	if (length > bufsize) {
 		// invalid strip request, strip does not fit in buffer
 		return 0;
 	}
-	if (reader->fread(reader->source, pos, length, buffer) != length) {
+	if (source_read(reader, strip->pos, length, buffer) != length) {
 		// read error, unable to read all of strip data
 		return 0;
 	}
 	return length;
 }
 
-// Utility functions, do not require a reader object
-//
-int pdfras_recognize_signature(const void* sig)
+// Return a pointer to the raw (compressed) data of strip s on page p,
+// directly in the source, and set *plen to its length in bytes.
+// Returns NULL if the source does not support direct access, or the strip is invalid.
+const void* pdfrasread_get_raw_strip_view(t_pdfrasreader* reader, int p, int s, size_t* plen)
 {
-	if (!sig) {
-		return FALSE;
-	}
-	const char* p = (const char*)sig;
-	if (0 != strncmp(p, "%PDF-1.", 7)) {
-		return FALSE;
-	}
-	p += 7;
-	if (!isdigit(*p)) return FALSE;
-	while (isdigit(*p)) p++;
-	if (*p == 0x0D) {
-		p++;
-		if (*p == 0x0A) p++;
-	}
-	else if (*p == 0x0A) {
-		p++;
-	}
-	else {
-		return FALSE;
-	}
-	if (0 != strncmp(p, "%⚆er-", 8)) {
-		return FALSE;
+	*plen = 0;
+	if (!reader->fview) {
+		// source has no direct access
+		return NULL;
 	}
-	p += 8;
-	if (!isdigit(*p)) return FALSE;
-	while (isdigit(*p)) p++;
-	if (*p != '.') return FALSE;
-	p++;
-	if (!isdigit(*p)) return FALSE;
-	while (isdigit(*p)) p++;
-	if (*p == 0x0D) {
-		p++;
-		if (*p == 0x0A) p++;
+	const t_pdfstripinfo* strip = get_strip_info(reader, p, s);
+	if (!strip || strip->len == 0) {
+		// invalid strip request, or empty strip
+		return NULL;
 	}
-	else if (*p == 0x0A) {
-		p++;
+	const void* data = reader->fview(reader->source, strip->pos, strip->len);
+	if (data) {
+		*plen = strip->len;
 	}
-	else {
-		return FALSE;
+	return data;
+}
+
+// Return the compression of strip s on page p
+RasterCompression pdfrasread_strip_compression(t_pdfrasreader* reader, int p, int s)
+{
+	const t_pdfstripinfo* strip = get_strip_info(reader, p, s);
+	if (!strip) {
+		return PDFRAS_COMPRESSION_NULL;
 	}
-	return TRUE;
+	return strip->compression;
 }
 
 ///////////////////////////////////////////////////////////////////////
-// Top-Level Public Functions
+// Decoded strips
 
-// Create a PDF/raster reader
-t_pdfrasreader* pdfrasread_create(int apiLevel, pdfras_freader readfn, pdfras_fcloser closefn)
+// Return the number of bits per pixel of a pixel format
+static unsigned bits_per_pixel(RasterPixelFormat format)
 {
-	if (apiLevel < 1) {
-		// error, invalid parameter value
-		return NULL;
+	switch (format) {
+	case PDFRAS_BITONAL:
+		return 1;
+	case PDFRAS_GRAY8:
+		return 8;
+	case PDFRAS_GRAY16:
+		return 16;
+	case PDFRAS_RGB24:
+		return 24;
+	case PDFRAS_RGB48:
+		return 48;
+	default:
+		return 0;
 	}
-	if (apiLevel > PDFRAS_API_LEVEL) {
-		// error, caller expects a future version of this API
-		return NULL;
+}
+
+// Return the size in bytes of a decoded row of a page
+static size_t page_row_size(const t_pdfpageinfo* pinfo)
+{
+	return ((size_t)pinfo->width * bits_per_pixel(pinfo->format) + 7) / 8;
+}
+
+// Return the size in bytes of the decoded pixels of a strip,
+// or 0 if that's not addressable on this platform.
+static size_t strip_pixel_size(const t_pdfpageinfo* pinfo, const t_pdfstripinfo* strip)
+{
+	size_t row_size = page_row_size(pinfo);
+	if (row_size == 0 || strip->rows > (size_t)-1 / row_size) {
+		return 0;
+	}
+	return row_size * strip->rows;
+}
+
+// Invert size bytes of decoded CCITT pixels with /BlackIs1 true:
+// our bitonal pixels are 0=black
+static void invert_pixels(void* buffer, size_t size)
+{
+	pduint8* pixels = (pduint8*)buffer;
+	size_t i;
+	for (i = 0; i < size; i++) {
+		pixels[i] = (pduint8)~pixels[i];
+	}
+}
+
+// Decode the raw data[0..len) of a strip into buffer.
+// Return the number of bytes of pixels written, 0 if the strip can't be decoded
+// or doesn't fit in buffer.
+static size_t decode_strip(const t_pdfpageinfo* pinfo, const t_pdfstripinfo* strip, const void* data, size_t len, void* buffer, size_t bufsize)
+{
+	size_t size = strip_pixel_size(pinfo, strip);
+	if (size == 0 || size > bufsize) {
+		// invalid strip request, strip does not fit in buffer
+		return 0;
+	}
+	switch (strip->compression) {
+	case PDFRAS_UNCOMPRESSED:
+		if (len < size) {
+			// invalid PDF: uncompressed strip is shorter than its rows
+			return 0;
+		}
+		memcpy(buffer, data, size);
+		break;
+	case PDFRAS_CCITTG4:
+		if (pinfo->format != PDFRAS_BITONAL ||
+			!pdfras_ccitt_g4_decode(data, len, pinfo->width, strip->rows, buffer, size / strip->rows)) {
+			// invalid PDF: CCITT image must be bitonal, and its data valid
+			return 0;
+		}
+		if (strip->bBlackIs1) {
+			invert_pixels(buffer, size);
+		}
+		break;
+	default:
+		// JPEG, or unknown compression: not decoded by the reader
+		return 0;
+	}
+	return size;
+}
+
+// Return the size in bytes of strip s on page p, once decoded
+size_t pdfrasread_strip_pixel_size(t_pdfrasreader* reader, int p, int s)
+{
+	const t_pdfpageinfo* pinfo = get_page_info(reader, p);
+	if (!pinfo || s < 0 || s >= pinfo->strip_count) {
+		// invalid page or strip number
+		return 0;
+	}
+	return strip_pixel_size(pinfo, &pinfo->strips[s]);
+}
+
+// Read strip s on page p and decode its pixels into buffer
+// Returns the number of bytes of pixels written.
+size_t pdfrasread_read_strip_pixels(t_pdfrasreader* reader, int p, int s, void* buffer, size_t bufsize)
+{
+	const t_pdfpageinfo* pinfo = get_page_info(reader, p);
+	if (!pinfo || s < 0 || s >= pinfo->strip_count) {
+		// invalid page or strip number
+		return 0;
+	}
+	const t_pdfstripinfo* strip = &pinfo->strips[s];
+	if (strip->compression == PDFRAS_UNCOMPRESSED) {
+		// the strip data is the pixels, read it straight into buffer
+		size_t size = strip_pixel_size(pinfo, strip);
+		if (size == 0 || size > bufsize || size > strip->len ||
+			source_read(reader, strip->pos, size, buffer) != size) {
+			// strip doesn't fit in buffer, is too short, or can't be read
+			return 0;
+		}
+		return size;
+	}
+	// decode from a view of the source if there's one, else from a copy of the strip
+	const void* data = reader->fview ? reader->fview(reader->source, strip->pos, strip->len) : NULL;
+	void* copy = NULL;
+	if (!data) {
+		copy = malloc(strip->len ? strip->len : 1);
+		if (!copy) {
+			// internal failure, memory allocation
+			return 0;
+		}
+		if (source_read(reader, strip->pos, strip->len, copy) != strip->len) {
+			// read error, unable to read all of strip data
+			free(copy);
+			return 0;
+		}
+		data = copy;
+	}
+	size_t size = decode_strip(pinfo, strip, data, strip->len, buffer, bufsize);
+	free(copy);
+	return size;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Row iterators
+
+// Most bytes of CCITT data a row iterator reads at a time
+#define ROW_CHUNK_SIZE		(64*1024)
+
+// Return the size in bytes of a decoded row of page p
+size_t pdfrasread_page_row_size(t_pdfrasreader* reader, int p)
+{
+	const t_pdfpageinfo* pinfo = get_page_info(reader, p);
+	if (!pinfo) {
+		return 0;
+	}
+	return page_row_size(pinfo);
+}
+
+// Feed the CCITT decoder of a row iterator the next chunk of the current strip:
+// a view of the rest of it if the source allows, else the next ROW_CHUNK_SIZE bytes.
+static const void* row_iter_fill(void* cookie, size_t* plen)
+{
+	t_pdfrasrowiter* it = (t_pdfrasrowiter*)cookie;
+	t_pdfrasreader* reader = it->reader;
+	size_t len = it->left;
+	const void* data = NULL;
+	*plen = 0;
+	if (len == 0) {
+		// end of strip data
+		return NULL;
+	}
+	if (reader->fview) {
+		data = reader->fview(reader->source, it->next_pos, len);
+	}
+	if (!data) {
+		if (len > ROW_CHUNK_SIZE) {
+			len = ROW_CHUNK_SIZE;
+		}
+		if (!it->chunk && !(it->chunk = (char*)malloc(ROW_CHUNK_SIZE))) {
+			// internal failure, memory allocation: no more data, decoding will fail
+			return NULL;
+		}
+		if (source_read(reader, it->next_pos, len, it->chunk) != len) {
+			// read error: no more data, decoding will fail
+			return NULL;
+		}
+		data = it->chunk;
+	}
+	it->next_pos += len;
+	it->left -= len;
+	*plen = len;
+	return data;
+}
+
+t_pdfrasrowiter* pdfrasread_page_row_begin(t_pdfrasreader* reader, int p)
+{
+	const t_pdfpageinfo* pinfo = get_page_info(reader, p);
+	if (!pinfo) {
+		// invalid page
+		return NULL;
+	}
+	// check up front that every strip can be decoded
+	int s;
+	for (s = 0; s < pinfo->strip_count; s++) {
+		const t_pdfstripinfo* strip = &pinfo->strips[s];
+		size_t size = strip_pixel_size(pinfo, strip);
+		if (size == 0 ||
+			(strip->compression == PDFRAS_UNCOMPRESSED && strip->len < size) ||
+			(strip->compression == PDFRAS_CCITTG4 && pinfo->format != PDFRAS_BITONAL) ||
+			(strip->compression != PDFRAS_UNCOMPRESSED && strip->compression != PDFRAS_CCITTG4)) {
+			// strip is too big, too short for its rows, or not decoded by the reader
+			return NULL;
+		}
+	}
+	t_pdfrasrowiter* it = (t_pdfrasrowiter*)calloc(1, sizeof *it);
+	if (!it) {
+		// internal failure, memory allocation
+		return NULL;
+	}
+	it->reader = reader;
+	it->pinfo = pinfo;
+	it->row_size = page_row_size(pinfo);
+	return it;
+}
+
+int pdfrasread_page_next_rows(t_pdfrasrowiter* it, int n, void* buffer, size_t bufsize)
+{
+	if (bufsize < it->row_size) {
+		// buffer can't hold a row
+		return -1;
+	}
+	if (n <= 0) {
+		return 0;
+	}
+	if ((size_t)n > bufsize / it->row_size) {
+		n = (int)(bufsize / it->row_size);
+	}
+	const t_pdfpageinfo* pinfo = it->pinfo;
+	char* dst = (char*)buffer;
+	int done = 0;
+	while (done < n && it->strip < pinfo->strip_count) {
+		const t_pdfstripinfo* strip = &pinfo->strips[it->strip];
+		if (it->row == strip->rows) {
+			// end of this strip, on to the next
+			pdfras_ccitt_g4_destroy(it->ccitt);
+			it->ccitt = NULL;
+			it->strip++;
+			it->row = 0;
+			continue;
+		}
+		unsigned long k = strip->rows - it->row;
+		if (k > (unsigned long)(n - done)) {
+			k = n - done;
+		}
+		size_t size = k * it->row_size;
+		if (strip->compression == PDFRAS_UNCOMPRESSED) {
+			// the strip data is the pixels, read the rows straight into buffer
+			pduint64 off = strip->pos + (pduint64)it->row * it->row_size;
+			if (source_read(it->reader, off, size, dst) != size) {
+				// read error, unable to read the rows
+				return -1;
+			}
+		}
+		else {
+			if (!it->ccitt) {
+				// start decoding the strip
+				it->next_pos = strip->pos;
+				it->left = strip->len;
+				it->ccitt = pdfras_ccitt_g4_create(pinfo->width, row_iter_fill, it);
+				if (!it->ccitt) {
+					// internal failure, memory allocation
+					return -1;
+				}
+			}
+			if (!pdfras_ccitt_g4_rows(it->ccitt, k, dst, it->row_size)) {
+				// invalid PDF: bad CCITT data
+				return -1;
+			}
+			if (strip->bBlackIs1) {
+				invert_pixels(dst, size);
+			}
+		}
+		it->row += k;
+		done += (int)k;
+		dst += size;
+	}
+	return done;
+}
+
+void pdfrasread_page_row_end(t_pdfrasrowiter* it)
+{
+	if (it) {
+		pdfras_ccitt_g4_destroy(it->ccitt);
+		free(it->chunk);
+		free(it);
+	}
+}
+
+///////////////////////////////////////////////////////////////////////
+// Region reads
+
+// Copy w pixels of bpp bits each, starting at pixel x of the row at src, to dst.
+// Rows of bitonal pixels that don't start on a byte boundary are shifted into place.
+static void crop_row(pduint8* dst, const pduint8* src, unsigned long x, unsigned long w, unsigned bpp)
+{
+	size_t bit = (size_t)x * bpp;
+	size_t bits = (size_t)w * bpp;
+	size_t bytes = (bits + 7) / 8;
+	unsigned shift = bit % 8;
+	src += bit / 8;
+	if (shift == 0) {
+		memcpy(dst, src, bytes);
+		return;
+	}
+	// last source byte with pixels of the region
+	size_t last = (shift + bits - 1) / 8;
+	size_t i;
+	for (i = 0; i < bytes; i++) {
+		pduint8 b = (pduint8)(src[i] << shift);
+		if (i < last) {
+			b |= src[i + 1] >> (8 - shift);
+		}
+		dst[i] = b;
+	}
+}
+
+// Make *pbuf at least size bytes.
+// Return TRUE if successful, FALSE if memory allocation fails.
+static int reserve_scratch(char** pbuf, size_t* pbufsize, size_t size)
+{
+	if (size > *pbufsize) {
+		char* bigger = (char*)realloc(*pbuf, size);
+		if (!bigger) {
+			// internal failure, memory allocation
+			return FALSE;
+		}
+		*pbuf = bigger;
+		*pbufsize = size;
+	}
+	return TRUE;
+}
+
+// All of a strip's CCITT data, already in memory
+typedef struct t_stripdata {
+	const void*			data;
+	size_t				len;				// 0 once handed to the decoder
+} t_stripdata;
+
+static const void* strip_data_fill(void* cookie, size_t* plen)
+{
+	t_stripdata* sd = (t_stripdata*)cookie;
+	*plen = sd->len;
+	sd->len = 0;
+	return sd->data;
+}
+
+// Return the size in bytes of a row of a page converted to out, 0 if out is not an output format
+static size_t converted_row_size(const t_pdfpageinfo* pinfo, RasterOutputFormat out)
+{
+	switch (out) {
+	case PDFRAS_OUT_NATIVE:
+		return page_row_size(pinfo);
+	case PDFRAS_OUT_GRAY8:
+		return pinfo->width;
+	case PDFRAS_OUT_RGB24:
+		return (size_t)pinfo->width * 3;
+	case PDFRAS_OUT_BGRA32:
+		return (size_t)pinfo->width * 4;
+	default:
+		return 0;
+	}
+}
+
+// Put w pixels of a row of the page, starting at pixel x of src, at dst: as they are,
+// or converted to out. Conversion starts on a byte boundary of src.
+static void put_row(pduint8* dst, const pduint8* src, const t_pdfpageinfo* pinfo,
+	unsigned long x, unsigned long w, RasterOutputFormat out)
+{
+	unsigned bpp = bits_per_pixel(pinfo->format);
+	if (out == PDFRAS_OUT_NATIVE) {
+		crop_row(dst, src, x, w, bpp);
+	}
+	else {
+		assert((size_t)x * bpp % 8 == 0);
+		pdfras_pixels_convert(dst, out, src + (size_t)x * bpp / 8, pinfo->format, w);
+	}
+}
+
+// Read rows r0 .. r1-1 of a strip, cropped to columns x .. x+w-1 and converted to out,
+// into dst (rows stride bytes apart).
+// *pscratch is a buffer for strip data, grown as needed.
+// Return TRUE if successful, FALSE if the strip can't be read or decoded.
+static int read_strip_region(t_pdfrasreader* reader, const t_pdfpageinfo* pinfo, const t_pdfstripinfo* strip,
+	unsigned long r0, unsigned long r1, unsigned long x, unsigned long w, RasterOutputFormat out,
+	pduint8* dst, size_t stride, char** pscratch, size_t* pscratch_size)
+{
+	unsigned bpp = bits_per_pixel(pinfo->format);
+	size_t row_size = page_row_size(pinfo);
+	size_t strip_size = strip_pixel_size(pinfo, strip);
+	bool whole_rows = (x == 0 && w == pinfo->width && out == PDFRAS_OUT_NATIVE);
+	unsigned long r;
+	if (strip_size == 0) {
+		// strip too big to address
+		return FALSE;
+	}
+	if (strip->compression == PDFRAS_UNCOMPRESSED) {
+		if (strip->len < strip_size) {
+			// invalid PDF: uncompressed strip is shorter than its rows
+			return FALSE;
+		}
+		// just the rows wanted, in one piece
+		pduint64 pos = strip->pos + (pduint64)r0 * row_size;
+		size_t size = (r1 - r0) * row_size;
+		const pduint8* rows = reader->fview ? (const pduint8*)reader->fview(reader->source, pos, size) : NULL;
+		if (!rows) {
+			if (whole_rows && stride == row_size) {
+				// laid out as in the source: read them straight into place
+				return source_read(reader, pos, size, dst) == size;
+			}
+			if (!reserve_scratch(pscratch, pscratch_size, size) ||
+				source_read(reader, pos, size, *pscratch) != size) {
+				// memory allocation or read error
+				return FALSE;
+			}
+			rows = (const pduint8*)*pscratch;
+		}
+		for (r = r0; r < r1; r++, rows += row_size, dst += stride) {
+			put_row(dst, rows, pinfo, x, w, out);
+		}
+		return TRUE;
+	}
+	if (strip->compression != PDFRAS_CCITTG4 || pinfo->format != PDFRAS_BITONAL) {
+		// JPEG, or unknown compression: not decoded by the reader
+		return FALSE;
+	}
+	// CCITT: each row is coded relative to the one above, so decode from the top of
+	// the strip, down to the last row wanted.
+	t_stripdata sd;
+	sd.data = reader->fview ? reader->fview(reader->source, strip->pos, strip->len) : NULL;
+	sd.len = strip->len;
+	if (!sd.data) {
+		if (!reserve_scratch(pscratch, pscratch_size, strip->len) ||
+			source_read(reader, strip->pos, strip->len, *pscratch) != strip->len) {
+			// memory allocation or read error
+			return FALSE;
+		}
+		sd.data = *pscratch;
+	}
+	pduint8* row = (pduint8*)malloc(row_size);
+	t_pdfrasccitt* dec = pdfras_ccitt_g4_create(pinfo->width, strip_data_fill, &sd);
+	int ok = (row && dec);
+	for (r = 0; ok && r < r1; r++) {
+		if (r >= r0 && whole_rows) {
+			// decode straight into place
+			ok = pdfras_ccitt_g4_rows(dec, 1, dst, stride);
+			if (ok && strip->bBlackIs1) {
+				invert_pixels(dst, row_size);
+			}
+		}
+		else {
+			ok = pdfras_ccitt_g4_rows(dec, 1, row, row_size);
+			if (ok && r >= r0) {
+				if (out == PDFRAS_OUT_NATIVE) {
+					crop_row(dst, row, x, w, bpp);
+					if (strip->bBlackIs1) {
+						invert_pixels(dst, (w + 7) / 8);
+					}
+				}
+				else {
+					if (strip->bBlackIs1) {
+						invert_pixels(row, row_size);
+					}
+					put_row(dst, row, pinfo, x, w, out);
+				}
+			}
+		}
+		if (ok && r >= r0) {
+			dst += stride;
+		}
+	}
+	pdfras_ccitt_g4_destroy(dec);
+	free(row);
+	return ok;
+}
+
+// Read the rectangle of page p with top-left pixel (x, y), w pixels wide & h rows high
+int pdfrasread_read_region(t_pdfrasreader* reader, int p, int x, int y, int w, int h, void* buffer, size_t stride)
+{
+	const t_pdfpageinfo* pinfo = get_page_info(reader, p);
+	if (!pinfo || x < 0 || y < 0 || w <= 0 || h <= 0 ||
+		(unsigned long)x + w > pinfo->width || (unsigned long)y + h > pinfo->height) {
+		// invalid page, or rectangle not inside it
+		return FALSE;
+	}
+	if (stride < ((size_t)w * bits_per_pixel(pinfo->format) + 7) / 8) {
+		// rows of the region overlap
+		return FALSE;
+	}
+	// find the first strip in the region: the last one that starts at or above y
+	int lo = 0, hi = pinfo->strip_count - 1;
+	while (lo < hi) {
+		int mid = (lo + hi + 1) / 2;
+		if (pinfo->strips[mid].top <= (unsigned long)y) {
+			lo = mid;
+		}
+		else {
+			hi = mid - 1;
+		}
+	}
+	// read the strips that intersect the region, and only those
+	unsigned long end = (unsigned long)y + h;
+	char* scratch = NULL;
+	size_t scratch_size = 0;
+	int ok = TRUE;
+	int s;
+	for (s = lo; ok && s < pinfo->strip_count && pinfo->strips[s].top < end; s++) {
+		const t_pdfstripinfo* strip = &pinfo->strips[s];
+		// rows r0 .. r1-1 of the strip are in the region
+		unsigned long r0 = (unsigned long)y > strip->top ? y - strip->top : 0;
+		unsigned long r1 = end - strip->top < strip->rows ? end - strip->top : strip->rows;
+		if (r0 >= r1) {
+			continue;
+		}
+		pduint8* dst = (pduint8*)buffer + (strip->top + r0 - y) * stride;
+		if (reader->strip_cache) {
+			// crop the whole strip, decoded once and cached
+			size_t strip_stride;
+			unsigned long rows, r;
+			const pduint8* pixels = (const pduint8*)pdfrasread_pin_strip(reader, p, s, PDFRAS_OUT_NATIVE, 1, &strip_stride, &rows);
+			ok = (pixels && rows >= r1);
+			for (r = r0; ok && r < r1; r++, dst += stride) {
+				crop_row(dst, pixels + r * strip_stride, x, w, bits_per_pixel(pinfo->format));
+			}
+			if (pixels) {
+				pdfrasread_unpin_strip(reader, pixels);
+			}
+		}
+		else {
+			ok = read_strip_region(reader, pinfo, strip, r0, r1, x, w, PDFRAS_OUT_NATIVE, dst, stride, &scratch, &scratch_size);
+		}
+	}
+	free(scratch);
+	return ok;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Converted strips
+
+size_t pdfrasread_converted_row_size(t_pdfrasreader* reader, int p, RasterOutputFormat out)
+{
+	const t_pdfpageinfo* pinfo = get_page_info(reader, p);
+	if (!pinfo) {
+		return 0;
+	}
+	return converted_row_size(pinfo, out);
+}
+
+// Read strip s of page p, converting its rows to out on their way into buffer
+int pdfrasread_read_strip_converted(t_pdfrasreader* reader, int p, int s, RasterOutputFormat out, void* buffer, size_t stride)
+{
+	const t_pdfpageinfo* pinfo = get_page_info(reader, p);
+	if (!pinfo || s < 0 || s >= pinfo->strip_count) {
+		// invalid page or strip number
+		return FALSE;
+	}
+	size_t row_size = converted_row_size(pinfo, out);
+	if (row_size == 0 || stride < row_size) {
+		// unknown output format, or rows overlap
+		return FALSE;
+	}
+	const t_pdfstripinfo* strip = &pinfo->strips[s];
+	char* scratch = NULL;
+	size_t scratch_size = 0;
+	int ok = read_strip_region(reader, pinfo, strip, 0, strip->rows, 0, pinfo->width, out, (pduint8*)buffer, stride, &scratch, &scratch_size);
+	free(scratch);
+	return ok;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Reduced-resolution reads
+
+// Most bytes of page rows a reduced read decodes at a time
+#define REDUCE_BAND_SIZE	(256*1024)
+
+// Return the pixel format of a page reduced by box filtering
+static RasterPixelFormat reduced_format(RasterPixelFormat format)
+{
+	// bitonal boxes average to shades of gray
+	return format == PDFRAS_BITONAL ? PDFRAS_GRAY8 : format;
+}
+
+// Return the number of sums for a row of boxes factor pixels wide:
+// one per sample, or per box of a bitonal row
+static size_t reduced_sum_count(const t_pdfpageinfo* pinfo, unsigned factor)
+{
+	unsigned channels = (pinfo->format == PDFRAS_RGB24 || pinfo->format == PDFRAS_RGB48) ? 3 : 1;
+	return (pinfo->format == PDFRAS_BITONAL) ? (pinfo->width + factor - 1) / factor : (size_t)pinfo->width * channels;
+}
+
+// Add a row of the page to the sums of a row of boxes
+static void sum_row(const t_pdfpageinfo* pinfo, pduint32* sums, size_t nsums, const pduint8* row, unsigned factor)
+{
+	switch (pinfo->format) {
+	case PDFRAS_BITONAL:
+		pdfras_pixels_sum1(sums, row, pinfo->width, factor);
+		break;
+	case PDFRAS_GRAY16:
+	case PDFRAS_RGB48:
+		pdfras_pixels_sum16(sums, row, nsums);
+		break;
+	default:
+		pdfras_pixels_sum8(sums, row, nsums);
+		break;
+	}
+}
+
+// Average the sums of a row of boxes, box rows high, into a reduced row at dst
+static void box_row(const t_pdfpageinfo* pinfo, pduint8* dst, const pduint32* sums, unsigned factor, unsigned box)
+{
+	unsigned channels = (pinfo->format == PDFRAS_RGB24 || pinfo->format == PDFRAS_RGB48) ? 3 : 1;
+	switch (pinfo->format) {
+	case PDFRAS_BITONAL:
+		pdfras_pixels_box1(dst, sums, pinfo->width, factor, box);
+		break;
+	case PDFRAS_GRAY16:
+	case PDFRAS_RGB48:
+		pdfras_pixels_box16(dst, sums, pinfo->width, channels, factor, box);
+		break;
+	default:
+		pdfras_pixels_box8(dst, sums, pinfo->width, channels, factor, box);
+		break;
+	}
+}
+
+RasterPixelFormat pdfrasread_reduced_format(t_pdfrasreader* reader, int p)
+{
+	const t_pdfpageinfo* pinfo = get_page_info(reader, p);
+	if (!pinfo) {
+		return PDFRAS_FORMAT_NULL;
+	}
+	return reduced_format(pinfo->format);
+}
+
+size_t pdfrasread_reduced_row_size(t_pdfrasreader* reader, int p, int factor)
+{
+	const t_pdfpageinfo* pinfo = get_page_info(reader, p);
+	if (!pinfo || factor < 1 || factor > PDFRAS_REDUCE_MAX) {
+		return 0;
+	}
+	size_t width = (pinfo->width + factor - 1) / factor;
+	return (width * bits_per_pixel(reduced_format(pinfo->format)) + 7) / 8;
+}
+
+int pdfrasread_read_page_reduced(t_pdfrasreader* reader, int p, int factor, void* buffer, size_t stride)
+{
+	size_t reduced_size = pdfrasread_reduced_row_size(reader, p, factor);
+	if (reduced_size == 0 || stride < reduced_size) {
+		// invalid page or factor, or rows of the reduced page overlap
+		return FALSE;
+	}
+	const t_pdfpageinfo* pinfo = get_page_info(reader, p);
+	size_t nsums = reduced_sum_count(pinfo, factor);
+	size_t row_size = page_row_size(pinfo);
+	// rows are decoded a band at a time, of up to factor rows
+	unsigned long band = REDUCE_BAND_SIZE / row_size;
+	if (band > (unsigned long)factor) {
+		band = factor;
+	}
+	if (band == 0) {
+		band = 1;
+	}
+	t_pdfrasrowiter* it = pdfrasread_page_row_begin(reader, p);
+	if (!it) {
+		// a strip can't be decoded, or internal failure
+		return FALSE;
+	}
+	pduint32* sums = (pduint32*)malloc(nsums * sizeof *sums);
+	pduint8* rows = (pduint8*)malloc(band * row_size);
+	int ok = (sums && rows);
+	pduint8* dst = (pduint8*)buffer;
+	unsigned long y;
+	for (y = 0; ok && y < pinfo->height; y += factor, dst += stride) {
+		// add up the rows of this row of boxes, column by column
+		unsigned box = (pinfo->height - y < (unsigned long)factor) ? (unsigned)(pinfo->height - y) : (unsigned)factor;
+		unsigned done = 0;
+		memset(sums, 0, nsums * sizeof *sums);
+		while (done < box) {
+			unsigned long want = (box - done < band) ? box - done : band;
+			int n = pdfrasread_page_next_rows(it, (int)want, rows, band * row_size);
+			if (n <= 0) {
+				// strip can't be read or decoded, or the strips run out before the page does
+				ok = FALSE;
+				break;
+			}
+			int i;
+			for (i = 0; i < n; i++) {
+				sum_row(pinfo, sums, nsums, rows + i * row_size, factor);
+			}
+			done += n;
+		}
+		if (ok) {
+			// and average the boxes
+			box_row(pinfo, dst, sums, factor, box);
+		}
+	}
+	free(rows);
+	free(sums);
+	pdfrasread_page_row_end(it);
+	return ok;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Rotated reads
+
+// Rows of the page a rotated read decodes at a time (a multiple of 8, for bitonal transposes)
+#define ROTATE_BAND_ROWS	64
+
+// Return the clockwise rotation of a page as 0, 90, 180 or 270 degrees, -1 if it is not a multiple of 90
+static int page_quarter_turns(const t_pdfpageinfo* pinfo)
+{
+	unsigned long degrees = pinfo->rotation % 360;
+	return (degrees % 90 == 0) ? (int)degrees : -1;
+}
+
+size_t pdfrasread_rotated_row_size(t_pdfrasreader* reader, int p)
+{
+	const t_pdfpageinfo* pinfo = get_page_info(reader, p);
+	if (!pinfo) {
+		return 0;
+	}
+	int degrees = page_quarter_turns(pinfo);
+	if (degrees < 0) {
+		// invalid PDF: /Rotate must be a multiple of 90
+		return 0;
+	}
+	size_t width = (degrees == 90 || degrees == 270) ? pinfo->height : pinfo->width;
+	return (width * bits_per_pixel(pinfo->format) + 7) / 8;
+}
+
+int pdfrasread_read_page_rotated(t_pdfrasreader* reader, int p, void* buffer, size_t stride)
+{
+	size_t rotated_size = pdfrasread_rotated_row_size(reader, p);
+	if (rotated_size == 0 || stride < rotated_size) {
+		// invalid page or rotation, or rows of the rotated page overlap
+		return FALSE;
+	}
+	const t_pdfpageinfo* pinfo = get_page_info(reader, p);
+	int degrees = page_quarter_turns(pinfo);
+	unsigned bpp = bits_per_pixel(pinfo->format);
+	unsigned long rotated_height = (degrees == 90 || degrees == 270) ? pinfo->width : pinfo->height;
+	size_t row_size = page_row_size(pinfo);
+	t_pdfrasrowiter* it = pdfrasread_page_row_begin(reader, p);
+	if (!it) {
+		// a strip can't be decoded, or internal failure
+		return FALSE;
+	}
+	pduint8* band = (pduint8*)malloc(ROTATE_BAND_ROWS * row_size);
+	int ok = (band != NULL);
+	if (ok && bpp == 1 && (degrees == 90 || degrees == 270) && pinfo->height % 8) {
+		// transposed bits never reach the padding at the end of the rotated rows: set it to 1
+		unsigned long r;
+		for (r = 0; r < rotated_height; r++) {
+			((pduint8*)buffer)[r * stride + rotated_size - 1] = 0xFF;
+		}
+	}
+	unsigned long y = 0;
+	while (ok && y < pinfo->height) {
+		int n = pdfrasread_page_next_rows(it, ROTATE_BAND_ROWS, band, ROTATE_BAND_ROWS * row_size);
+		if (n <= 0) {
+			// strip can't be read or decoded, or the strips run out before the page does
+			ok = FALSE;
+			break;
+		}
+		pdfras_pixels_rotate_band((pduint8*)buffer, stride, band, row_size,
+			pinfo->width, pinfo->height, y, (unsigned)n, bpp, degrees);
+		y += n;
+	}
+	free(band);
+	pdfrasread_page_row_end(it);
+	return ok;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Decoded strip cache
+
+// Number of hash buckets a strip cache starts with
+#define STRIP_CACHE_BUCKETS		64
+
+static unsigned cached_strip_hash(int p, int s, RasterOutputFormat out, int factor)
+{
+	unsigned h = (unsigned)p * 2654435761u;
+	h ^= (unsigned)s * 40503u + (unsigned)out * 257u + (unsigned)factor;
+	return h ^ (h >> 15);
+}
+
+// Return the cached strip (p, s, out, factor), NULL if it's not in the cache
+static t_pdfcachedstrip* cache_find(t_pdfstripcache* cache, int p, int s, RasterOutputFormat out, int factor)
+{
+	t_pdfcachedstrip* e = cache->buckets[cached_strip_hash(p, s, out, factor) & (cache->nbuckets - 1)];
+	while (e && (e->page != p || e->strip != s || e->out != out || e->factor != factor)) {
+		e = e->next;
+	}
+	return e;
+}
+
+// Take a cached strip off the list in order of use
+static void cache_unlink(t_pdfstripcache* cache, t_pdfcachedstrip* e)
+{
+	if (e->newer) {
+		e->newer->older = e->older;
+	}
+	else {
+		cache->newest = e->older;
+	}
+	if (e->older) {
+		e->older->newer = e->newer;
+	}
+	else {
+		cache->oldest = e->newer;
+	}
+	e->newer = e->older = NULL;
+}
+
+// Put a cached strip at the most recently used end of the list
+static void cache_link_newest(t_pdfstripcache* cache, t_pdfcachedstrip* e)
+{
+	e->older = cache->newest;
+	e->newer = NULL;
+	if (cache->newest) {
+		cache->newest->newer = e;
+	}
+	else {
+		cache->oldest = e;
+	}
+	cache->newest = e;
+}
+
+// Drop a cached strip (not pinned) from the cache
+static void cache_remove(t_pdfstripcache* cache, t_pdfcachedstrip* e)
+{
+	assert(e->pins == 0);
+	t_pdfcachedstrip** pp = &cache->buckets[cached_strip_hash(e->page, e->strip, e->out, e->factor) & (cache->nbuckets - 1)];
+	while (*pp != e) {
+		pp = &(*pp)->next;
+	}
+	*pp = e->next;
+	cache_unlink(cache, e);
+	cache->bytes -= e->size;
+	cache->count--;
+	free(e);
+}
+
+// Drop least recently used strips that aren't pinned until the cache is within budget
+static void cache_trim(t_pdfstripcache* cache)
+{
+	t_pdfcachedstrip* e = cache->oldest;
+	while (e && cache->bytes > cache->budget) {
+		t_pdfcachedstrip* newer = e->newer;
+		if (e->pins == 0) {
+			cache_remove(cache, e);
+			cache->evictions++;
+		}
+		e = newer;
+	}
+}
+
+// Drop all strips from the cache (none may be pinned)
+static void cache_clear(t_pdfstripcache* cache)
+{
+	while (cache->oldest) {
+		cache_remove(cache, cache->oldest);
+	}
+	cache->pinned = 0;
+}
+
+// Double the number of hash buckets, when there are more strips than buckets.
+// If memory allocation fails the cache carries on with longer chains.
+static void cache_grow(t_pdfstripcache* cache)
+{
+	unsigned n = cache->nbuckets * 2;
+	t_pdfcachedstrip** buckets = (t_pdfcachedstrip**)calloc(n, sizeof *buckets);
+	if (!buckets) {
+		return;
+	}
+	unsigned i;
+	for (i = 0; i < cache->nbuckets; i++) {
+		t_pdfcachedstrip* e = cache->buckets[i];
+		while (e) {
+			t_pdfcachedstrip* next = e->next;
+			unsigned b = cached_strip_hash(e->page, e->strip, e->out, e->factor) & (n - 1);
+			e->next = buckets[b];
+			buckets[b] = e;
+			e = next;
+		}
+	}
+	free(cache->buckets);
+	cache->buckets = buckets;
+	cache->nbuckets = n;
+}
+
+// Return the size in bytes of a row of a strip reduced by factor and converted to out,
+// 0 if out is not an output format
+static size_t cached_row_size(const t_pdfpageinfo* pinfo, RasterOutputFormat out, int factor)
+{
+	if (factor == 1) {
+		return converted_row_size(pinfo, out);
+	}
+	size_t width = (pinfo->width + factor - 1) / factor;
+	switch (out) {
+	case PDFRAS_OUT_NATIVE:
+		return (width * bits_per_pixel(reduced_format(pinfo->format)) + 7) / 8;
+	case PDFRAS_OUT_GRAY8:
+		return width;
+	case PDFRAS_OUT_RGB24:
+		return width * 3;
+	case PDFRAS_OUT_BGRA32:
+		return width * 4;
+	default:
+		return 0;
+	}
+}
+
+// Decode strip s of page p, reduced by factor (> 1) and converted to out, into dst
+// (rows stride bytes apart). Return TRUE if successful, FALSE otherwise.
+static int read_strip_reduced(t_pdfrasreader* reader, const t_pdfpageinfo* pinfo, const t_pdfstripinfo* strip,
+	RasterOutputFormat out, int factor, pduint8* dst, size_t stride)
+{
+	size_t row_size = page_row_size(pinfo);
+	size_t strip_size = strip_pixel_size(pinfo, strip);
+	size_t nsums = reduced_sum_count(pinfo, factor);
+	RasterPixelFormat format = reduced_format(pinfo->format);
+	unsigned long width = (pinfo->width + factor - 1) / factor;
+	char* scratch = NULL;
+	size_t scratch_size = 0;
+	pduint8* pixels = (pduint8*)malloc(strip_size ? strip_size : 1);
+	pduint32* sums = (pduint32*)malloc(nsums * sizeof *sums);
+	// reduced row, before conversion
+	pduint8* reduced = (pduint8*)malloc((width * bits_per_pixel(format) + 7) / 8);
+	int ok = (strip_size && pixels && sums && reduced &&
+		read_strip_region(reader, pinfo, strip, 0, strip->rows, 0, pinfo->width, PDFRAS_OUT_NATIVE, pixels, row_size, &scratch, &scratch_size));
+	unsigned long y;
+	for (y = 0; ok && y < strip->rows; y += factor, dst += stride) {
+		unsigned box = (strip->rows - y < (unsigned long)factor) ? (unsigned)(strip->rows - y) : (unsigned)factor;
+		unsigned i;
+		memset(sums, 0, nsums * sizeof *sums);
+		for (i = 0; i < box; i++) {
+			sum_row(pinfo, sums, nsums, pixels + (y + i) * row_size, factor);
+		}
+		if (out == PDFRAS_OUT_NATIVE) {
+			box_row(pinfo, dst, sums, factor, box);
+		}
+		else {
+			box_row(pinfo, reduced, sums, factor, box);
+			pdfras_pixels_convert(dst, out, reduced, format, width);
+		}
+	}
+	free(reduced);
+	free(sums);
+	free(pixels);
+	free(scratch);
+	return ok;
+}
+
+int pdfrasread_set_strip_cache(t_pdfrasreader* reader, size_t budget)
+{
+	t_pdfstripcache* cache = reader->strip_cache;
+	if (budget == 0) {
+		if (cache) {
+			if (cache->pinned) {
+				// strips are still pinned
+				return FALSE;
+			}
+			cache_clear(cache);
+			free(cache->buckets);
+			free(cache);
+			reader->strip_cache = NULL;
+		}
+		return TRUE;
+	}
+	if (!cache) {
+		cache = (t_pdfstripcache*)calloc(1, sizeof(t_pdfstripcache));
+		if (!cache) {
+			// internal failure, memory allocation
+			return FALSE;
+		}
+		cache->nbuckets = STRIP_CACHE_BUCKETS;
+		cache->buckets = (t_pdfcachedstrip**)calloc(cache->nbuckets, sizeof *cache->buckets);
+		if (!cache->buckets) {
+			// internal failure, memory allocation
+			free(cache);
+			return FALSE;
+		}
+		reader->strip_cache = cache;
+	}
+	cache->budget = budget;
+	cache_trim(cache);
+	return TRUE;
+}
+
+const void* pdfrasread_pin_strip(t_pdfrasreader* reader, int p, int s, RasterOutputFormat out, int factor,
+	size_t* pstride, unsigned long* prows)
+{
+	t_pdfstripcache* cache = reader->strip_cache;
+	*pstride = 0;
+	*prows = 0;
+	if (!cache || factor < 1 || factor > PDFRAS_REDUCE_MAX) {
+		// no cache, or invalid factor
+		return NULL;
+	}
+	t_pdfcachedstrip* e = cache_find(cache, p, s, out, factor);
+	if (e) {
+		cache->hits++;
+		cache_unlink(cache, e);
+	}
+	else {
+		const t_pdfpageinfo* pinfo = get_page_info(reader, p);
+		if (!pinfo || s < 0 || s >= pinfo->strip_count) {
+			// invalid page or strip number
+			return NULL;
+		}
+		const t_pdfstripinfo* strip = &pinfo->strips[s];
+		size_t stride = cached_row_size(pinfo, out, factor);
+		unsigned long rows = (strip->rows + factor - 1) / factor;
+		if (stride == 0 || (rows && stride > ((size_t)-1 - sizeof *e) / rows)) {
+			// unknown output format, or strip too big to address
+			return NULL;
+		}
+		e = (t_pdfcachedstrip*)malloc(sizeof *e + stride * rows);
+		if (!e) {
+			// internal failure, memory allocation
+			return NULL;
+		}
+		pduint8* pixels = (pduint8*)(e + 1);
+		int ok;
+		if (factor == 1) {
+			char* scratch = NULL;
+			size_t scratch_size = 0;
+			ok = read_strip_region(reader, pinfo, strip, 0, strip->rows, 0, pinfo->width, out, pixels, stride, &scratch, &scratch_size);
+			free(scratch);
+		}
+		else {
+			ok = read_strip_reduced(reader, pinfo, strip, out, factor, pixels, stride);
+		}
+		if (!ok) {
+			// strip can't be read or decoded
+			free(e);
+			return NULL;
+		}
+		cache->misses++;
+		e->page = p;
+		e->strip = s;
+		e->out = out;
+		e->factor = factor;
+		e->stride = stride;
+		e->rows = rows;
+		e->size = stride * rows;
+		e->pins = 0;
+		unsigned b = cached_strip_hash(p, s, out, factor) & (cache->nbuckets - 1);
+		e->next = cache->buckets[b];
+		cache->buckets[b] = e;
+		cache->bytes += e->size;
+		cache->count++;
+		if (cache->count > cache->nbuckets) {
+			cache_grow(cache);
+		}
+	}
+	if (e->pins++ == 0) {
+		cache->pinned++;
+	}
+	cache_link_newest(cache, e);
+	// make room for it, if it's new
+	cache_trim(cache);
+	*pstride = e->stride;
+	*prows = e->rows;
+	return e + 1;
+}
+
+void pdfrasread_unpin_strip(t_pdfrasreader* reader, const void* pixels)
+{
+	t_pdfstripcache* cache = reader->strip_cache;
+	t_pdfcachedstrip* e = (t_pdfcachedstrip*)pixels - 1;
+	assert(cache && e->pins > 0);
+	if (--e->pins == 0) {
+		cache->pinned--;
+		// it may have been keeping the cache over budget
+		cache_trim(cache);
+	}
+}
+
+void pdfrasread_strip_cache_stats(t_pdfrasreader* reader, t_pdfrascachestats* stats)
+{
+	t_pdfstripcache* cache = reader->strip_cache;
+	memset(stats, 0, sizeof *stats);
+	if (cache) {
+		stats->hits = cache->hits;
+		stats->misses = cache->misses;
+		stats->evictions = cache->evictions;
+		stats->strips = cache->count;
+		stats->pinned = cache->pinned;
+		stats->bytes = cache->bytes;
+		stats->budget = cache->budget;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////
+// Batched strip reads
+
+// Strips separated by at most this many bytes are read together
+#define COALESCE_GAP		4096
+// Longest run of strips read into a temporary buffer, when there's no vectored read
+#define COALESCE_MAX		(4*1024*1024)
+// Most buffers in one vectored read
+#define COALESCE_IOV		64
+
+// One strip of a batched read
+typedef struct t_stripread {
+	pduint64			pos;				// file position of strip data
+	t_pdfrasstripbuf*	dst;				// where it goes
+	size_t				len;				// length of strip data
+} t_stripread;
+
+static int compare_stripreads(const void* a, const void* b)
+{
+	pduint64 pa = ((const t_stripread*)a)->pos, pb = ((const t_stripread*)b)->pos;
+	return (pa > pb) - (pa < pb);
+}
+
+// Read a run of strips, sorted by position and not overlapping, that together
+// span the source bytes [run[0].pos, end).
+// *pbounce is a temporary buffer, (re)allocated as needed.
+// Return TRUE if successful, FALSE otherwise.
+static int read_strip_run(t_pdfrasreader* reader, const t_stripread* run, int n, pduint64 end, char** pbounce, size_t* pbouncesize)
+{
+	int i;
+	size_t span = (size_t)(end - run[0].pos);
+	if (n == 1) {
+		return source_read(reader, run[0].pos, run[0].len, run[0].dst->buffer) == run[0].len;
+	}
+	if (reader->freadv) {
+		// read straight into the strip buffers, and the gaps between them into scratch
+		char gap[COALESCE_GAP];
+		t_pdfrasiovec iov[2 * COALESCE_IOV];
+		int iovcnt = 0;
+		for (i = 0; i < n; i++) {
+			if (i > 0 && run[i].pos > run[i - 1].pos + run[i - 1].len) {
+				iov[iovcnt].base = gap;
+				iov[iovcnt].len = (size_t)(run[i].pos - (run[i - 1].pos + run[i - 1].len));
+				iovcnt++;
+			}
+			iov[iovcnt].base = run[i].dst->buffer;
+			iov[iovcnt].len = run[i].len;
+			iovcnt++;
+		}
+		pduint64 t0 = STAT_CLOCK();
+		size_t got = reader->freadv(reader->source, run[0].pos, iov, iovcnt);
+		STAT_ADD(reader, source_reads, 1);
+		STAT_ADD(reader, bytes_read, got);
+		STAT_ADD(reader, source_ns, STAT_CLOCK() - t0);
+		return got == span;
+	}
+	// read the whole run into the bounce buffer and copy the strips out
+	if (span > *pbouncesize) {
+		char* bigger = (char*)realloc(*pbounce, span);
+		if (!bigger) {
+			// internal failure, memory allocation
+			return FALSE;
+		}
+		*pbounce = bigger;
+		*pbouncesize = span;
+	}
+	if (source_read(reader, run[0].pos, span, *pbounce) != span) {
+		return FALSE;
+	}
+	for (i = 0; i < n; i++) {
+		memcpy(run[i].dst->buffer, *pbounce + (size_t)(run[i].pos - run[0].pos), run[i].len);
+	}
+	return TRUE;
+}
+
+int pdfrasread_read_page_strips(t_pdfrasreader* reader, int first, int pages, t_pdfrasstripbuf* strips, int count)
+{
+	int p, s, n = 0;
+	if (first < 0 || pages < 1 || first + pages > pdfrasread_page_count(reader) || count < 0) {
+		// invalid page range
+		return FALSE;
+	}
+	t_stripread* reads = (t_stripread*)malloc((count ? count : 1) * sizeof *reads);
+	if (!reads) {
+		// internal failure, memory allocation
+		return FALSE;
+	}
+	// collect the strips from the page index
+	int ok = TRUE, sorted = TRUE, i = 0;
+	for (p = first; ok && p < first + pages; p++) {
+		const t_pdfpageinfo* pinfo = get_page_info(reader, p);
+		if (!pinfo || i + pinfo->strip_count > count) {
+			// invalid page, or not enough strip buffers
+			ok = FALSE;
+			break;
+		}
+		for (s = 0; s < pinfo->strip_count; s++, i++) {
+			const t_pdfstripinfo* strip = &pinfo->strips[s];
+			strips[i].len = 0;
+			if (strip->len > strips[i].bufsize) {
+				// strip does not fit in buffer
+				ok = FALSE;
+				break;
+			}
+			if (strip->len == 0) {
+				// empty strip, nothing to read
+				continue;
+			}
+			reads[n].pos = strip->pos;
+			reads[n].len = strip->len;
+			reads[n].dst = &strips[i];
+			if (n > 0 && reads[n].pos < reads[n - 1].pos) {
+				sorted = FALSE;
+			}
+			n++;
+		}
+	}
+	if (ok && i != count) {
+		// more strip buffers than strips
+		ok = FALSE;
+	}
+	if (ok && reader->fview) {
+		// source is directly accessible, just copy
+		for (i = 0; ok && i < n; i++) {
+			const void* data = reader->fview(reader->source, reads[i].pos, reads[i].len);
+			if (!data) {
+				ok = FALSE;
+				break;
+			}
+			memcpy(reads[i].dst->buffer, data, reads[i].len);
+		}
+		n = 0;
+	}
+	if (ok && !sorted) {
+		qsort(reads, n, sizeof *reads, compare_stripreads);
+	}
+	// read runs of nearby strips
+	char* bounce = NULL;
+	size_t bouncesize = 0;
+	for (i = 0; ok && i < n; ) {
+		pduint64 end = reads[i].pos + reads[i].len;
+		int j = i + 1;
+		while (j < n &&
+			reads[j].pos >= end &&
+			reads[j].pos - end <= COALESCE_GAP &&
+			j - i < COALESCE_IOV &&
+			(reader->freadv || reads[j].pos + reads[j].len - reads[i].pos <= COALESCE_MAX)) {
+			end = reads[j].pos + reads[j].len;
+			j++;
+		}
+		ok = read_strip_run(reader, &reads[i], j - i, end, &bounce, &bouncesize);
+		i = j;
+	}
+	free(bounce);
+	if (ok) {
+		// record the strip lengths
+		for (p = first, i = 0; p < first + pages; p++) {
+			const t_pdfpageinfo* pinfo = get_page_info(reader, p);
+			for (s = 0; s < pinfo->strip_count; s++, i++) {
+				strips[i].len = pinfo->strips[s].len;
+			}
+		}
+	}
+	free(reads);
+	return ok;
+}
+
+// Utility functions, do not require a reader object
+//
+int pdfras_recognize_signature(const void* sig)
+{
+	if (!sig) {
+		return FALSE;
+	}
+	const char* p = (const char*)sig;
+	if (0 != strncmp(p, "%PDF-1.", 7)) {
+		return FALSE;
+	}
+	p += 7;
+	if (!isdigit(*p)) return FALSE;
+	while (isdigit(*p)) p++;
+	if (*p == 0x0D) {
+		p++;
+		if (*p == 0x0A) p++;
+	}
+	else if (*p == 0x0A) {
+		p++;
+	}
+	else {
+		return FALSE;
+	}
+	if (0 != strncmp(p, "%⚆er-", 8)) {
+		return FALSE;
+	}
+	p += 8;
+	if (!isdigit(*p)) return FALSE;
+	while (isdigit(*p)) p++;
+	if (*p != '.') return FALSE;
+	p++;
+	if (!isdigit(*p)) return FALSE;
+	while (isdigit(*p)) p++;
+	if (*p == 0x0D) {
+		p++;
+		if (*p == 0x0A) p++;
+	}
+	else if (*p == 0x0A) {
+		p++;
+	}
+	else {
+		return FALSE;
+	}
+	return TRUE;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Sequential scan (PDFRAS_OPEN_SCAN)
+//
+// One pass over the file, front to back, in the parse window's largest reads.
+// Everything but stream data is kept - object headers, dictionaries, the xref
+// table and trailer - and where each "num 0 obj" header is noted. Then the trailer,
+// xref table, page tree and every page are parsed from what was kept, as if from
+// the file, and the xref table is checked against the objects found.
+
+// Bytes kept from before the search position when the next chunk is read:
+// room for the longest object header in front of an "obj"
+#define SCAN_BACK			48
+// Keywords are only taken up this close to the end of a chunk (short of EOF),
+// so what follows them is in the chunk too
+#define SCAN_MARGIN			16
+
+static void free_skeleton(t_pdfskeleton* sk)
+{
+	if (sk) {
+		free(sk->bytes);
+		free(sk->segs);
+		free(sk->objpos);
+		free(sk);
+	}
+}
+
+// Keep len bytes of the file at off, which don't come before those kept already.
+// Return TRUE if successful, FALSE if memory allocation fails.
+static int skeleton_keep(t_pdfskeleton* sk, pduint64 off, const char* bytes, size_t len)
+{
+	if (len == 0) {
+		return TRUE;
+	}
+	if (sk->size + len > sk->capacity) {
+		size_t cap = sk->capacity ? sk->capacity : 4096;
+		while (cap < sk->size + len) {
+			cap *= 2;
+		}
+		char* grown = (char*)realloc(sk->bytes, cap);
+		if (!grown) {
+			return FALSE;
+		}
+		sk->bytes = grown;
+		sk->capacity = cap;
+	}
+	t_pdfsegment* seg = sk->nsegs ? &sk->segs[sk->nsegs - 1] : NULL;
+	if (!seg || seg->off + seg->len != off) {
+		// not contiguous with the last segment, start another
+		if (sk->nsegs == sk->maxsegs) {
+			unsigned long cap = sk->maxsegs ? 2 * sk->maxsegs : 64;
+			t_pdfsegment* segs = (t_pdfsegment*)realloc(sk->segs, cap * sizeof *segs);
+			if (!segs) {
+				return FALSE;
+			}
+			sk->segs = segs;
+			sk->maxsegs = cap;
+		}
+		seg = &sk->segs[sk->nsegs++];
+		seg->off = off;
+		seg->len = 0;
+		seg->at = sk->size;
+	}
+	memcpy(sk->bytes + sk->size, bytes, len);
+	sk->size += len;
+	seg->len += len;
+	return TRUE;
+}
+
+// Note that object num starts at off.
+// Return TRUE if successful, FALSE if memory allocation fails.
+static int skeleton_object(t_pdfskeleton* sk, unsigned long num, pduint64 off)
+{
+	if (num >= sk->maxobjs) {
+		unsigned long cap = sk->maxobjs ? sk->maxobjs : 256;
+		while (cap <= num) {
+			cap *= 2;
+		}
+		pduint64* objpos = (pduint64*)realloc(sk->objpos, cap * sizeof *objpos);
+		if (!objpos) {
+			return FALSE;
+		}
+		memset(objpos + sk->maxobjs, 0, (cap - sk->maxobjs) * sizeof *objpos);
+		sk->objpos = objpos;
+		sk->maxobjs = cap;
+	}
+	sk->objpos[num] = off;
+	if (num >= sk->numobjs) {
+		sk->numobjs = num + 1;
+	}
+	return TRUE;
+}
+
+// If the "obj" at p[i] ends an object header "num 0 obj", set *pnum to num and *pstart to
+// the index of its first digit, and return TRUE. Otherwise return FALSE.
+// The header is looked for in the SCAN_BACK bytes before i; at_start is TRUE if p[0] is
+// the first byte of the file.
+static int object_header(const char* p, size_t i, size_t n, int at_start, unsigned long* pnum, size_t* pstart)
+{
+	if (i + 3 < n && !iswhite(p[i + 3]) && !isdelim(p[i + 3])) {
+		// a longer word
+		return FALSE;
+	}
+	size_t lo = (i > SCAN_BACK) ? i - SCAN_BACK : 0;
+	size_t k = i;
+	// whitespace, then generation number 0
+	if (k == lo || !iswhite(p[k - 1])) {
+		return FALSE;
+	}
+	while (k > lo && iswhite(p[k - 1])) {
+		k--;
+	}
+	if (k == lo || p[k - 1] != '0') {
+		return FALSE;
+	}
+	k--;
+	// whitespace, then the object number
+	if (k == lo || !iswhite(p[k - 1])) {
+		return FALSE;
+	}
+	while (k > lo && iswhite(p[k - 1])) {
+		k--;
+	}
+	size_t end = k;
+	while (k > lo && isdigit((unsigned char)p[k - 1])) {
+		k--;
+	}
+	if (k == end || end - k > 7) {
+		// no object number, or more than an xref table can hold
+		return FALSE;
+	}
+	// which starts a token - some writers put it right after endobj
+	if (k == 0 ? !at_start : (k == lo || !(iswhite(p[k - 1]) || isdelim(p[k - 1]) ||
+		(k >= lo + 6 && 0 == memcmp(p + k - 6, "endobj", 6))))) {
+		return FALSE;
+	}
+	unsigned long num = 0;
+	for (*pstart = k; k < end; k++) {
+		num = num * 10 + (p[k] - '0');
+	}
+	*pnum = num;
+	return TRUE;
+}
+
+// If the "stream" at p[i] is the keyword that starts stream data, return the index
+// of the first byte of the data. Otherwise return 0.
+static size_t stream_data_start(const char* p, size_t i)
+{
+	if (i == 0 || !(iswhite(p[i - 1]) || p[i - 1] == '>')) {
+		// part of a longer word, such as endstream
+		return 0;
+	}
+	// must be followed by exactly CRLF or LF
+	if (p[i + 6] == 0x0A) {
+		return i + 7;
+	}
+	if (p[i + 6] == 0x0D && p[i + 7] == 0x0A) {
+		return i + 8;
+	}
+	return 0;
+}
+
+// Read the whole file, front to back, into a new skeleton.
+// The parse window's store holds each chunk read.
+// Return the skeleton, or NULL if memory allocation fails or the file ends in stream data.
+static t_pdfskeleton* scan_file(t_pdfrasreader* reader)
+{
+	size_t chunk = reader->buffer.maxread;
+	assert(chunk > 2 * (SCAN_BACK + SCAN_MARGIN));
+	if (!reserve_store(reader, chunk)) {
+		return NULL;
+	}
+	t_pdfskeleton* sk = (t_pdfskeleton*)calloc(1, sizeof *sk);
+	if (!sk) {
+		return NULL;
+	}
+	char* buf = reader->buffer.store;
+	// the window doesn't hold any of the file while its store is used for scanning
+	reader->buffer.len = 0;
+	pduint64 base = 0;				// file position of buf[0]
+	size_t len = 0;					// bytes in buf
+	size_t i = 0;					// where to search next, in buf
+	pduint64 kept = 0;				// outside stream data, bytes up to here have been kept
+	bool in_stream = false;			// searching stream data for its end
+	pduint64 data_pos = 0;			// if so, where the data starts
+	int ok = TRUE, eof = FALSE;
+	while (ok && !eof) {
+		// read on, keeping a few bytes before the search position
+		size_t from = (i > SCAN_BACK) ? i - SCAN_BACK : 0;
+		memmove(buf, buf + from, len - from);
+		base += from;
+		len -= from;
+		i -= from;
+		len += source_read(reader, base + len, chunk - len, buf + len);
+		buf[len] = 0;
+		eof = (len < chunk);
+		size_t lim = eof ? len : len - SCAN_MARGIN;
+		size_t obj = 0, str = 0;	// next "obj" and "stream" at or after i (0 = look again)
+		while (ok && i < lim) {
+			if (in_stream) {
+				size_t q = i + pdfras_scan_find(buf + i, len - i, "endstream", 9);
+				if (q >= lim) {
+					i = lim;
+					break;
+				}
+				// the data ends with an EOL before endstream: keep from there on
+				kept = base + q - 2;
+				if (kept < data_pos) {
+					kept = data_pos;
+				}
+				in_stream = false;
+				i = q;
+				obj = str = 0;
+				continue;
+			}
+			if (obj < i || obj == 0) {
+				obj = i + pdfras_scan_find(buf + i, len - i, "obj", 3);
+			}
+			if (str < i || str == 0) {
+				str = i + pdfras_scan_find(buf + i, len - i, "stream", 6);
+			}
+			if (obj < str) {
+				if (obj >= lim) {
+					i = lim;
+					break;
+				}
+				unsigned long num;
+				size_t start;
+				if (object_header(buf, obj, len, base == 0, &num, &start)) {
+					ok = skeleton_object(sk, num, base + start);
+				}
+				i = obj + 3;
+			}
+			else {
+				if (str >= lim) {
+					i = lim;
+					break;
+				}
+				size_t data = stream_data_start(buf, str);
+				if (data) {
+					// keep everything up to the data, then look for its end
+					ok = skeleton_keep(sk, kept, buf + (size_t)(kept - base), data - (size_t)(kept - base));
+					data_pos = base + data;
+					in_stream = true;
+					i = data;
+				}
+				else {
+					i = str + 6;
+				}
+			}
+		}
+		if (ok && !in_stream) {
+			// keep what has been searched
+			ok = skeleton_keep(sk, kept, buf + (size_t)(kept - base), lim - (size_t)(kept - base));
+			kept = base + lim;
+		}
+	}
+	if (!ok || in_stream) {
+		// out of memory, or invalid PDF: stream data runs to EOF
+		free_skeleton(sk);
+		return NULL;
+	}
+	sk->filesize = base + len;
+	return sk;
+}
+
+// Check the xref table against the objects found by a scan: each object in use must be
+// where the xref table says it is, and each object found must be in use.
+static int check_xref(t_pdfrasreader* reader, const t_pdfskeleton* sk)
+{
+	unsigned long num;
+	for (num = 0; num < reader->numxrefs || num < sk->numobjs; num++) {
+		pduint64 xref = (num < reader->numxrefs) ? reader->xrefs[num] : 0;
+		pduint64 found = (num < sk->numobjs) ? sk->objpos[num] : 0;
+		if (xref != found) {
+			// invalid PDF: the xref table doesn't match the objects in the file
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+// Open the reader's source by scanning it (see above), and index every page.
+// Return TRUE if successful, FALSE otherwise.
+static int scan_open(t_pdfrasreader* reader)
+{
+	t_pdfskeleton* sk = scan_file(reader);
+	if (!sk) {
+		return FALSE;
+	}
+	reader->skeleton = sk;
+	int p, ok = parse_trailer(reader) && check_xref(reader, sk);
+	for (p = 0; ok && p < reader->page_count; p++) {
+		// a page that isn't a valid raster page fails when it's asked about, as in other modes
+		(void)get_page_info(reader, p);
+	}
+	reader->skeleton = NULL;
+	free_skeleton(sk);
+	// forget what the window read from the skeleton
+	reader->buffer.data = NULL;
+	reader->buffer.off = 0;
+	reader->buffer.len = 0;
+	return ok;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Top-Level Public Functions
+
+// Create a PDF/raster reader, common code
+static t_pdfrasreader* create_reader(int apiLevel, pdfras_freader64 readfn, pdfras_freader readfn32, pdfras_fcloser closefn)
+{
+	if (apiLevel < 1) {
+		// error, invalid parameter value
+		return NULL;
 	}
-	// some internal consistency checks
-	if (20 != sizeof(t_xref_entry)) {
-		// compilation/build error: xref entry is not exactly 20 bytes.
+	if (apiLevel > PDFRAS_API_LEVEL) {
+		// error, caller expects a future version of this API
 		return NULL;
 	}
 	t_pdfrasreader* reader = (t_pdfrasreader*)malloc(sizeof(t_pdfrasreader));
@@ -1485,35 +3925,224 @@ t_pdfrasreader* pdfrasread_create(int apiLevel, pdfras_freader readfn, pdfras_fc
 		memset(reader, 0, sizeof *reader);
 		reader->apiLevel = apiLevel;
 		reader->fread = readfn;
+		reader->fread32 = readfn32;
 		reader->fclose = closefn;
+		reader->buffer.minread = PDFRAS_WINDOW_MIN;
+		reader->buffer.maxread = PDFRAS_WINDOW_MAX;
 		reader->page_count = -1;		// Unknown
 	}
+	assert(key_table_valid());
 	return reader;
 }
 
+// Create a PDF/raster reader with a 32-bit (API level 1) reader function
+t_pdfrasreader* pdfrasread_create(int apiLevel, pdfras_freader readfn, pdfras_fcloser closefn)
+{
+	return create_reader(apiLevel, NULL, readfn, closefn);
+}
+
+// Create a PDF/raster reader with a 64-bit (API level 2) reader function
+t_pdfrasreader* pdfrasread_create64(int apiLevel, pdfras_freader64 readfn, pdfras_fcloser closefn)
+{
+	return create_reader(apiLevel, readfn, NULL, closefn);
+}
+
 void pdfrasread_destroy(t_pdfrasreader* reader)
 {
 	if (reader) {
+		pdfrasread_close(reader);
+		pdfrasread_set_strip_cache(reader, 0);
+		if (reader->page_info) {
+			long n;
+			for (n = 0; n < reader->page_info_size; n++) {
+				free(reader->page_info[n].strips);
+			}
+			free(reader->page_info);
+		}
 		if (reader->page_table) {
 			free(reader->page_table);
 		}
+		free_page_node(reader->page_tree);
 		if (reader->xrefs) {
 			free(reader->xrefs);
 		}
+		if (!reader->buffer.callers) {
+			free(reader->buffer.store);
+		}
 		free(reader);
 	}
 }
 
+void pdfrasread_set_viewer(t_pdfrasreader* reader, pdfras_fviewer viewfn)
+{
+	reader->fview = viewfn;
+}
+
+void pdfrasread_set_sizer(t_pdfrasreader* reader, pdfras_fsizer sizefn)
+{
+	reader->fsize = sizefn;
+}
+
+void pdfrasread_set_vreader(t_pdfrasreader* reader, pdfras_freaderv readvfn)
+{
+	reader->freadv = readvfn;
+}
+
+int pdfrasread_set_open_mode(t_pdfrasreader* reader, RasterOpenMode mode)
+{
+	if (!reader || reader->bOpen) {
+		return FALSE;
+	}
+	if (mode != PDFRAS_OPEN_EAGER && mode != PDFRAS_OPEN_LAZY && mode != PDFRAS_OPEN_SCAN) {
+		// invalid parameter value
+		return FALSE;
+	}
+	reader->open_mode = mode;
+	return TRUE;
+}
+
+int pdfrasread_set_window(t_pdfrasreader* reader, size_t minsize, size_t maxsize)
+{
+	if (!reader || reader->bOpen) {
+		return FALSE;
+	}
+	if (minsize < 1024 || maxsize < minsize) {
+		// invalid parameter values
+		return FALSE;
+	}
+	if (reader->buffer.callers && maxsize + 1 > reader->buffer.size) {
+		// caller's buffer is too small
+		return FALSE;
+	}
+	reader->buffer.minread = minsize;
+	reader->buffer.maxread = maxsize;
+	return TRUE;
+}
+
+int pdfrasread_set_window_buffer(t_pdfrasreader* reader, void* buffer, size_t bufsize)
+{
+	if (!reader || reader->bOpen) {
+		return FALSE;
+	}
+	if (buffer && bufsize < 1024 + 1) {
+		// too small to be useful
+		return FALSE;
+	}
+	if (!reader->buffer.callers) {
+		free(reader->buffer.store);
+	}
+	reader->buffer.store = (char*)buffer;
+	reader->buffer.size = buffer ? bufsize : 0;
+	reader->buffer.callers = (buffer != NULL);
+	reader->buffer.data = NULL;
+	reader->buffer.len = 0;
+	if (buffer) {
+		// fit the window into the caller's buffer
+		reader->buffer.maxread = bufsize - 1;
+		if (reader->buffer.minread > reader->buffer.maxread) {
+			reader->buffer.minread = reader->buffer.maxread;
+		}
+	}
+	return TRUE;
+}
+
+unsigned long pdfrasread_window_refills(t_pdfrasreader* reader)
+{
+	return reader ? reader->buffer.refills : 0;
+}
+
+size_t pdfrasread_memory_size(t_pdfrasreader* reader)
+{
+	if (!reader) {
+		return 0;
+	}
+	size_t size = sizeof *reader;
+	if (!reader->buffer.callers) {
+		size += reader->buffer.size;
+	}
+	size += reader->maxxrefs * sizeof *reader->xrefs;
+	size += reader->page_table_size * sizeof *reader->page_table;
+	size += page_node_size(reader->page_tree);
+	if (reader->page_info) {
+		long n;
+		size += reader->page_info_size * sizeof *reader->page_info;
+		for (n = 0; n < reader->page_info_size; n++) {
+			size += reader->page_info[n].strip_capacity * sizeof *reader->page_info[n].strips;
+		}
+	}
+	if (reader->strip_cache) {
+		t_pdfstripcache* cache = reader->strip_cache;
+		size += sizeof *cache + cache->nbuckets * sizeof *cache->buckets +
+			cache->count * sizeof(t_pdfcachedstrip) + cache->bytes;
+	}
+	return size;
+}
+
+int pdfrasread_get_stats(t_pdfrasreader* reader, t_pdfrasstats* stats)
+{
+	memset(stats, 0, sizeof *stats);
+#ifndef PDFRAS_NO_STATS
+	if (reader) {
+		*stats = reader->stats;
+		return TRUE;
+	}
+#endif
+	return FALSE;
+}
+
+void pdfrasread_reset_stats(t_pdfrasreader* reader)
+{
+#ifndef PDFRAS_NO_STATS
+	if (reader) {
+		memset(&reader->stats, 0, sizeof reader->stats);
+	}
+#else
+	(void)reader;
+#endif
+}
+
+// Forget what the parse window holds, which may be a view of the source,
+// and the dictionaries indexed.
+static void forget_window(t_pdfrasreader* reader)
+{
+	reader->buffer.data = NULL;
+	reader->buffer.off = 0;
+	reader->buffer.len = 0;
+	memset(reader->dicts, 0, sizeof reader->dicts);
+	reader->next_dict = 0;
+}
+
+// Forget the file the reader last had open, or failed to open, but keep the memory
+// of its index, for the next file: the xref table, the page table and each page's strip table.
+static void forget_file(t_pdfrasreader* reader)
+{
+	long n;
+	forget_window(reader);
+	reader->filesize = 0;
+	reader->numxrefs = 0;
+	reader->page_count = -1;
+	free_page_node(reader->page_tree);
+	reader->page_tree = NULL;
+	for (n = 0; n < reader->page_info_size; n++) {
+		reader->page_info[n].off = 0;
+		reader->page_info[n].strip_count = 0;
+	}
+}
+
 int pdfrasread_open(t_pdfrasreader* reader, void* source)
 {
 	if (reader->bOpen) {
 		return FALSE;
 	}
+	forget_file(reader);
 	reader->source = source;
-	if (parse_trailer(reader)) {
+	reader->buffer.refills = 0;
+	if (reader->open_mode == PDFRAS_OPEN_SCAN ? scan_open(reader) : parse_trailer(reader)) {
 		reader->bOpen = true;
 	}
 	else {
+		// nothing parsed from a file that failed to open may be used for the next one
+		forget_file(reader);
 		reader->source = NULL;
 	}
 	return reader->bOpen;
@@ -1533,6 +4162,15 @@ int pdfrasread_is_open(t_pdfrasreader* reader)
 	return reader && reader->bOpen;
 }
 
+int pdfrasread_reopen(t_pdfrasreader* reader, void* source)
+{
+	if (!reader) {
+		return FALSE;
+	}
+	pdfrasread_close(reader);
+	return pdfrasread_open(reader, source);
+}
+
 int pdfrasread_close(t_pdfrasreader* reader)
 {
 	if (reader && reader->bOpen) {
@@ -1540,7 +4178,107 @@ int pdfrasread_close(t_pdfrasreader* reader)
 			reader->fclose(reader->source);
 		}
 		reader->bOpen = false;
+		reader->bShared = false;
+		forget_window(reader);
+		// and the strips decoded
+		if (reader->strip_cache) {
+			assert(reader->strip_cache->pinned == 0);
+			cache_clear(reader->strip_cache);
+		}
 		return TRUE;
 	}
 	return FALSE;
 }
+
+int pdfrasread_share(t_pdfrasreader* reader)
+{
+	if (!reader || !reader->bOpen) {
+		return FALSE;
+	}
+	int p, pages = pdfrasread_page_count(reader);
+	for (p = 0; p < pages; p++) {
+		if (!get_page_info(reader, p)) {
+			// invalid page
+			return FALSE;
+		}
+	}
+	// Every query can now be answered from the index, without touching the parse window.
+	reader->bShared = true;
+	return TRUE;
+}
+
+int pdfrasread_is_shared(t_pdfrasreader* reader)
+{
+	return reader && reader->bOpen && reader->bShared;
+}
+
+t_pdfrascursor* pdfrasread_cursor_create(t_pdfrasreader* reader)
+{
+	if (!pdfrasread_is_shared(reader)) {
+		return NULL;
+	}
+	t_pdfrascursor* cursor = (t_pdfrascursor*)calloc(1, sizeof(t_pdfrascursor));
+	if (cursor) {
+		cursor->reader = reader;
+	}
+	return cursor;
+}
+
+void pdfrasread_cursor_destroy(t_pdfrascursor* cursor)
+{
+	if (cursor) {
+		free(cursor->strip);
+		free(cursor);
+	}
+}
+
+t_pdfrasreader* pdfrasread_cursor_reader(t_pdfrascursor* cursor)
+{
+	return cursor ? cursor->reader : NULL;
+}
+
+const void* pdfrasread_cursor_read_strip(t_pdfrascursor* cursor, int p, int s, size_t* plen)
+{
+	*plen = 0;
+	t_pdfrasreader* reader = cursor->reader;
+	assert(reader->bShared);
+	const t_pdfstripinfo* strip = get_strip_info(reader, p, s);
+	if (!strip || strip->len == 0) {
+		// invalid strip request, or empty strip
+		return NULL;
+	}
+	if (reader->fview) {
+		const void* data = reader->fview(reader->source, strip->pos, strip->len);
+		if (data) {
+			*plen = strip->len;
+			return data;
+		}
+	}
+	if (strip->len > cursor->strip_size) {
+		char* bigger = (char*)realloc(cursor->strip, strip->len);
+		if (!bigger) {
+			// internal failure, memory allocation
+			return NULL;
+		}
+		cursor->strip = bigger;
+		cursor->strip_size = strip->len;
+	}
+	if (source_read(reader, strip->pos, strip->len, cursor->strip) != strip->len) {
+		// read error, unable to read all of strip data
+		return NULL;
+	}
+	*plen = strip->len;
+	return cursor->strip;
+}
+
+size_t pdfrasread_cursor_read_strip_pixels(t_pdfrascursor* cursor, int p, int s, void* buffer, size_t bufsize)
+{
+	size_t len;
+	const void* data = pdfrasread_cursor_read_strip(cursor, p, s, &len);
+	if (!data) {
+		return 0;
+	}
+	// the page is indexed, since the strip was found
+	const t_pdfpageinfo* pinfo = get_page_info(cursor->reader, p);
+	return decode_strip(pinfo, &pinfo->strips[s], data, len, buffer, bufsize);
+}
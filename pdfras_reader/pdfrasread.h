@@ -13,7 +13,9 @@ extern "C" {
 #define FALSE 0
 #endif
 
-#define PDFRAS_API_LEVEL	1
+#define PDFRAS_API_LEVEL	2
+// 2	64-bit file offsets (pdfras_freader64, pdfrasread_create64)
+// 1	1st version
 
 #define PDFRASREAD_VERSION "0.1"
 // 0.1	spike	2015.02.11	1st version
@@ -28,6 +30,14 @@ typedef enum {
 	PDFRAS_RGB48,				// 48-bit per pixel, sRGB (under discussion)
 } RasterPixelFormat;
 
+// Output Formats - what decoded pixels can be converted to as they are read
+typedef enum {
+	PDFRAS_OUT_NATIVE,			// the page's own pixel format, unconverted
+	PDFRAS_OUT_GRAY8,			// 8-bit per pixel, 0=black
+	PDFRAS_OUT_RGB24,			// 24-bit per pixel, R G B
+	PDFRAS_OUT_BGRA32,			// 32-bit per pixel, B G R A with A=255 (Windows DIB order)
+} RasterOutputFormat;
+
 // Compression Modes
 typedef enum {
 	PDFRAS_COMPRESSION_NULL,	// null value
@@ -36,12 +46,40 @@ typedef enum {
 	PDFRAS_CCITTG4,				// CCITT Group 4 (CCITTFaxDecode)
 } RasterCompression;
 
+// Open Modes - how much of the file is parsed when it is opened
+typedef enum {
+	PDFRAS_OPEN_EAGER,			// walk the whole page tree at open (default)
+	PDFRAS_OPEN_LAZY,			// locate each page in the page tree on first access
+	PDFRAS_OPEN_SCAN,			// read the whole file once, front to back, and index every page
+} RasterOpenMode;
+
 // function template: read length bytes at offset from source into buffer
 typedef size_t (*pdfras_freader)(void *source, pduint32 offset, size_t length, char *buffer);
+// function template: same, but with a 64-bit offset (API level 2)
+typedef size_t (*pdfras_freader64)(void *source, pduint64 offset, size_t length, char *buffer);
 // function template: close the source
 typedef void (*pdfras_fcloser)(void *source);
+// function template: return a pointer to length bytes at offset in source,
+// or NULL if that range is not directly accessible.
+// The pointer must stay valid until the source is closed.
+typedef const void* (*pdfras_fviewer)(void *source, pduint64 offset, size_t length);
+// function template: store the size in bytes of source in *psize and return TRUE,
+// or return FALSE if the size can't be determined.
+typedef int (*pdfras_fsizer)(void *source, pduint64 *psize);
+
+// One buffer of a vectored read
+typedef struct t_pdfrasiovec {
+	void*		base;			// start of buffer
+	size_t		len;			// size of buffer, in bytes
+} t_pdfrasiovec;
+// function template: read consecutive bytes starting at offset in source,
+// filling each of the iovcnt buffers in turn (like preadv).
+// Return the total number of bytes read.
+typedef size_t (*pdfras_freaderv)(void *source, pduint64 offset, const t_pdfrasiovec* iov, int iovcnt);
 
 typedef struct t_pdfrasreader t_pdfrasreader;
+typedef struct t_pdfrascursor t_pdfrascursor;
+typedef struct t_pdfrasrowiter t_pdfrasrowiter;
 
 // Return TRUE if the string at sig starts with the signature of a PDF/raster file.
 // FALSE otherwise.
@@ -49,8 +87,103 @@ int pdfras_recognize_signature(const void* sig);
 
 // Create a PDF/raster reader in the closed state.
 // Return NULL if a reader can't be constructed - typically that can only be a malloc failure.
+// A reader created with a pdfras_freader can only access the first 4GB of its source.
 t_pdfrasreader* pdfrasread_create(int apiLevel, pdfras_freader readfn, pdfras_fcloser closefn);
 
+// Create a PDF/raster reader in the closed state, using a reader function with 64-bit offsets.
+// Otherwise the same as pdfrasread_create.
+t_pdfrasreader* pdfrasread_create64(int apiLevel, pdfras_freader64 readfn, pdfras_fcloser closefn);
+
+// Give the reader direct access to the bytes of its source, for sources
+// that are already in memory (or mapped into memory).
+// Enables pdfrasread_get_raw_strip_view.
+void pdfrasread_set_viewer(t_pdfrasreader* reader, pdfras_fviewer viewfn);
+
+// Tell the reader how to get the size of its source.
+// Without this, open finds the size by probing the source with many tiny reads,
+// which can be expensive on remote sources.
+void pdfrasread_set_sizer(t_pdfrasreader* reader, pdfras_fsizer sizefn);
+
+// Give the reader a vectored read function for its source.
+// pdfrasread_read_page_strips then reads runs of nearby strips with one call,
+// straight into the caller's buffers. Without it, it reads each run into a
+// temporary buffer and copies the strips out.
+void pdfrasread_set_vreader(t_pdfrasreader* reader, pdfras_freaderv readvfn);
+
+// Default size limits of the parse window (see pdfrasread_set_window)
+#define PDFRAS_WINDOW_MIN		4096
+#define PDFRAS_WINDOW_MAX		(256*1024)
+
+// Set the size limits of the reader's parse window, the buffer that
+// PDF syntax is read into. After a seek, the reader reads minsize bytes.
+// While reading sequentially, each read is twice the last, up to maxsize.
+// minsize must be at least 1024, and maxsize at least minsize.
+// Can only be called when the reader is not open.
+// Return TRUE if successful, FALSE if the reader is open or the sizes are invalid.
+int pdfrasread_set_window(t_pdfrasreader* reader, size_t minsize, size_t maxsize);
+
+// Make the reader use the caller's memory for its parse window, instead of allocating it.
+// The buffer must be at least 1025 bytes, and stay valid until the reader is
+// destroyed, or is given a different buffer. Reads are limited to bufsize-1 bytes.
+// Pass buffer=NULL to go back to memory allocated by the reader.
+// Can only be called when the reader is not open.
+// Return TRUE if successful, FALSE if the reader is open or the buffer is too small.
+int pdfrasread_set_window_buffer(t_pdfrasreader* reader, void* buffer, size_t bufsize);
+
+// Return the number of reads into the parse window since the reader was opened.
+// Useful for tuning the window size (see pdfrasread_set_window)
+unsigned long pdfrasread_window_refills(t_pdfrasreader* reader);
+
+// Instrumentation
+// A reader counts its reads of the source, and the parsing work it does, so the time
+// an open or a page lookup takes can be put down to I/O or to parsing, and a change
+// in either measured. Counting costs an add or two per token and a clock reading per
+// read; build the reader with PDFRAS_NO_STATS defined to leave it out altogether.
+// A shared reader (see pdfrasread_share) stops counting: its cursors read from
+// several threads at once.
+
+// Counters of a reader
+typedef struct t_pdfrasstats {
+	unsigned long	source_reads;	// calls of the source's reader function (or vectored reader)
+	pduint64		bytes_read;		// bytes those calls returned
+	pduint64		source_ns;		// nanoseconds spent in those calls
+	unsigned long	refills;		// reads into the parse window
+	unsigned long	tokens;			// tokens scanned
+	unsigned long	dict_lookups;	// dictionary key lookups
+	unsigned long	xref_lookups;	// indirect objects located through the cross-reference table
+	unsigned long	page_nodes;		// page tree nodes visited
+} t_pdfrasstats;
+
+// Get the counters of reader, counted since it was created or its counters were reset.
+// Return TRUE if successful, FALSE (with all counters 0) if reader is NULL or
+// the reader was built with PDFRAS_NO_STATS.
+int pdfrasread_get_stats(t_pdfrasreader* reader, t_pdfrasstats* stats);
+
+// Set the counters of reader to 0.
+void pdfrasread_reset_stats(t_pdfrasreader* reader);
+
+// Return the bytes of memory reader holds: its parse window, index and strip cache.
+// The window isn't counted if it is the caller's (see pdfrasread_set_window_buffer).
+size_t pdfrasread_memory_size(t_pdfrasreader* reader);
+
+// Set how much of the file the reader parses when it is opened.
+// In PDFRAS_OPEN_EAGER mode every page object is located at open, so a damaged
+// page tree is detected immediately.
+// In PDFRAS_OPEN_LAZY mode open only reads the page count. Each page is found on
+// first access, by descending the page tree guided by the /Count of each node, and
+// the nodes visited are kept for later lookups. Opening a huge file to show one
+// page then reads only the page tree nodes on the way to that page.
+// In PDFRAS_OPEN_SCAN mode open reads the file once, from start to end, in reads of the
+// parse window's largest size (see pdfrasread_set_window), and never seeks back:
+// for tape, cold storage and other sources where sequential reads are cheap and random
+// ones are not. Object headers and stream data are located as the file goes by, and
+// everything but stream data is kept in memory until the page and strip index of every
+// page is built from it. Open fails if the xref table doesn't match the objects found.
+// Reading strips after that reads the file at the strips' positions.
+// Can only be called when the reader is not open.
+// Return TRUE if successful, FALSE if the reader is open or the mode is invalid.
+int pdfrasread_set_open_mode(t_pdfrasreader* reader, RasterOpenMode mode);
+
 // Destroy the reader and release all associated resources.
 // If open, closes it (and calls the closefn (and ignores any error)).
 void pdfrasread_destroy(t_pdfrasreader* reader);
@@ -60,8 +193,15 @@ void pdfrasread_destroy(t_pdfrasreader* reader);
 // Otherwise returns FALSE.
 // Fails if the reader is already open.
 // Fails if the source does not pass initial parsing/tests for PDF/raster.
+// A closed reader can be opened again, on another source: the memory of its index
+// (xref table, page table, strip tables) is reused, and only grows when a file needs more.
 int pdfrasread_open(t_pdfrasreader* reader, void* source);
 
+// Close the reader if it is open, then open it on source, as pdfrasread_open does.
+// For batch jobs: one reader can read any number of files, one after another,
+// without allocating its index again for each one.
+int pdfrasread_reopen(t_pdfrasreader* reader, void* source);
+
 // Return TRUE if reader has a PDF/raster stream open,
 // return FALSE otherwise.
 int pdfrasread_is_open(t_pdfrasreader* reader);
@@ -80,6 +220,9 @@ int pdfrasread_close(t_pdfrasreader* reader);
 // -1 in case of error.
 int pdfrasread_page_count(t_pdfrasreader* reader);
 
+// Page and strip information is parsed on the first query about a page,
+// and kept in memory: subsequent queries about that page are cheap.
+
 // Return the pixel format of the raster image of page n (indexed from 0)
 RasterPixelFormat pdfrasread_page_format(t_pdfrasreader* reader, int n);
 
@@ -104,10 +247,240 @@ int pdfrasread_strip_count(t_pdfrasreader* reader, int p);
 // Return the maximum raw (compressed) strip size on page p
 size_t pdfrasread_max_strip_size(t_pdfrasreader* reader, int p);
 
+// Return the height in rows of strip s on page p
+int pdfrasread_strip_height(t_pdfrasreader* reader, int p, int s);
+
+// Return the raw (compressed) size of strip s on page p
+size_t pdfrasread_strip_raw_size(t_pdfrasreader* reader, int p, int s);
+
 // Read the raw (compressed) data of strip s on page p into buffer
 // Returns the actual number of bytes read.
 size_t pdfrasread_read_raw_strip(t_pdfrasreader* reader, int p, int s, void* buffer, size_t bufsize);
 
+// Return a pointer to the raw (compressed) data of strip s on page p, without copying it,
+// and set *plen to its length in bytes.
+// The pointer is valid until the reader is closed.
+// Returns NULL (and sets *plen to 0) if the reader has no viewer function (see pdfrasread_set_viewer)
+// or the strip does not exist.
+const void* pdfrasread_get_raw_strip_view(t_pdfrasreader* reader, int p, int s, size_t* plen);
+
+// Return the compression of strip s on page p.
+// PDFRAS_COMPRESSION_NULL if there's no such strip, or it's compressed in a way
+// PDF/raster doesn't allow (it can still be read raw).
+RasterCompression pdfrasread_strip_compression(t_pdfrasreader* reader, int p, int s);
+
+// Decoded strips
+//
+// Decoded pixels are rows of the page's pixel format (see RasterPixelFormat), packed,
+// each row padded to a whole byte: strip height x ceil(width x bits per pixel / 8) bytes.
+// The reader decodes uncompressed and CCITT Group 4 strips itself. It does not
+// decode JPEG: read those raw, and use a JPEG decoder.
+
+// Return the size in bytes of strip s on page p once decoded, 0 if there's no such strip.
+size_t pdfrasread_strip_pixel_size(t_pdfrasreader* reader, int p, int s);
+
+// Read strip s on page p and decode its pixels into buffer.
+// Returns the number of bytes of pixels written (see pdfrasread_strip_pixel_size),
+// 0 if the strip does not exist, is JPEG, can't be read or decoded, or does not fit in buffer.
+size_t pdfrasread_read_strip_pixels(t_pdfrasreader* reader, int p, int s, void* buffer, size_t bufsize);
+
+// Return the size in bytes of a row of page p converted to out (see RasterOutputFormat),
+// 0 if p is not a valid page or out is not an output format.
+size_t pdfrasread_converted_row_size(t_pdfrasreader* reader, int p, RasterOutputFormat out);
+
+// Read strip s on page p, decode it and convert its pixels to out as they are copied
+// into buffer, in rows stride bytes apart (stride >= pdfrasread_converted_row_size).
+// Bytes between the end of a row and the next are left alone.
+// Return TRUE if successful, FALSE if the strip does not exist, out is not an output format,
+// stride is too small, or the strip can't be read or decoded.
+int pdfrasread_read_strip_converted(t_pdfrasreader* reader, int p, int s, RasterOutputFormat out, void* buffer, size_t stride);
+
+// Row-by-row reading
+//
+// For pages too big to decode whole: a row iterator hands out the decoded rows
+// of a page in order, as many at a time as the caller wants, reading and decoding
+// the strips as it goes. Its memory use doesn't depend on the size of the page:
+// uncompressed rows are read straight into the caller's buffer, and CCITT strips
+// are read 64KB at a time and decoded only as far as the rows asked for.
+// An iterator must be ended before its reader is closed. On a shared reader
+// (see pdfrasread_share) each thread can have its own iterators.
+
+// Return the size in bytes of one decoded row of page p, 0 if p is not a valid page.
+size_t pdfrasread_page_row_size(t_pdfrasreader* reader, int p);
+
+// Start reading the rows of page p.
+// Return NULL if p is not a valid page, any of its strips can't be decoded
+// (see pdfrasread_read_strip_pixels), or memory allocation fails.
+t_pdfrasrowiter* pdfrasread_page_row_begin(t_pdfrasreader* reader, int p);
+
+// Decode the next rows of the page into buffer: up to n rows, as many as fit.
+// Returns the number of rows written, 0 at the end of the page,
+// -1 if buffer can't hold a row or a strip can't be read or decoded.
+int pdfrasread_page_next_rows(t_pdfrasrowiter* it, int n, void* buffer, size_t bufsize);
+
+// Release a row iterator.
+void pdfrasread_page_row_end(t_pdfrasrowiter* it);
+
+// Read the decoded pixels of a rectangle of page p: w pixels wide and h rows high,
+// with its top-left pixel at column x of row y. The pixels are written to buffer in
+// rows stride bytes apart, each row starting on a byte boundary.
+// Only the strips that intersect the rectangle are read, and each strip only as far
+// as needed: just the rows in the rectangle if it's uncompressed, down to the last of
+// them if it's CCITT.
+// Return TRUE if successful, FALSE if the rectangle is not inside the page, stride
+// is less than a row of the rectangle, or a strip can't be read or decoded.
+int pdfrasread_read_region(t_pdfrasreader* reader, int p, int x, int y, int w, int h, void* buffer, size_t stride);
+
+// Reduced-resolution reading
+//
+// For previews and thumbnails: a page read at 1/factor of its resolution each way,
+// every pixel the average of a factor x factor box of page pixels. The reduced page is
+// ceil(width / factor) x ceil(height / factor) pixels, the boxes at its right and bottom
+// edges averaging only the page pixels they cover. Bitonal pages reduce to 8-bit gray,
+// pages in other formats to the same format.
+// The page is decoded row by row as for a row iterator, and filtered as it is decoded,
+// so memory use is a band of up to factor rows of the page. JPEG pages can't be reduced.
+
+// Largest reduction factor
+#define PDFRAS_REDUCE_MAX		256
+
+// Return the pixel format of page p once reduced: PDFRAS_GRAY8 if it is bitonal,
+// its own format otherwise. PDFRAS_FORMAT_NULL if p is not a valid page.
+RasterPixelFormat pdfrasread_reduced_format(t_pdfrasreader* reader, int p);
+
+// Return the size in bytes of a row of page p reduced by factor,
+// 0 if p is not a valid page or factor is not 1 .. PDFRAS_REDUCE_MAX.
+size_t pdfrasread_reduced_row_size(t_pdfrasreader* reader, int p, int factor);
+
+// Read page p reduced by factor into buffer, in rows stride bytes apart.
+// Return TRUE if successful, FALSE if p is not a valid page, factor is out of range,
+// stride is less than a reduced row, or a strip can't be read or decoded.
+int pdfrasread_read_page_reduced(t_pdfrasreader* reader, int p, int factor, void* buffer, size_t stride);
+
+// Rotated reading
+//
+// A page read in viewing orientation, turned clockwise by its /Rotate
+// (see pdfrasread_page_rotation). Turned 90 or 270 degrees, a page width x height pixels
+// becomes height pixels wide and width rows high. The pixels keep the page's format.
+// The page is decoded a band of rows at a time, and each band is rotated into place:
+// a quarter turn transposes the band down its columns, 8 x 8 bit blocks at a time
+// if the page is bitonal. JPEG pages can't be read rotated.
+
+// Return the size in bytes of a row of page p in viewing orientation,
+// 0 if p is not a valid page or its /Rotate is not a multiple of 90.
+size_t pdfrasread_rotated_row_size(t_pdfrasreader* reader, int p);
+
+// Read page p in viewing orientation into buffer, in rows stride bytes apart.
+// Return TRUE if successful, FALSE if p is not a valid page, its /Rotate is not a multiple
+// of 90, stride is less than a rotated row, or a strip can't be read or decoded.
+int pdfrasread_read_page_rotated(t_pdfrasreader* reader, int p, void* buffer, size_t stride);
+
+// Decoded strip cache
+//
+// Viewers come back to the same strips again and again: scrolling back, panning,
+// redrawing. A reader can keep the strips it has decoded, up to a budget of bytes,
+// dropping the least recently used strips when it goes over. A strip is cached as it
+// was asked for, converted to an output format and reduced by a factor, and each
+// combination is cached on its own.
+// Callers borrow cached pixels by pinning them instead of copying them: a pinned strip
+// stays in the cache, and its pixels valid, until it is unpinned. While strips are pinned
+// the cache can go over its budget, and it drops strips again as they are unpinned.
+// When a reader has a cache, pdfrasread_read_region reads strips through it.
+// The cache is emptied when the reader is closed, so strips must be unpinned before.
+// It belongs to the reader, not to cursors: only one thread at a time may use it.
+
+// Counters of a strip cache
+typedef struct t_pdfrascachestats {
+	unsigned long	hits;			// strips found in the cache
+	unsigned long	misses;			// strips decoded into the cache
+	unsigned long	evictions;		// strips dropped to keep within the budget
+	unsigned long	strips;			// strips in the cache now
+	unsigned long	pinned;			// how many of those are pinned
+	size_t			bytes;			// bytes of pixels in the cache now
+	size_t			budget;			// most bytes of pixels kept, while none are pinned
+} t_pdfrascachestats;
+
+// Give reader a decoded strip cache of up to budget bytes of pixels, or change the
+// budget of its cache, dropping strips to keep within it. A budget of 0 removes the cache.
+// Return TRUE if successful, FALSE if memory allocation fails, or the cache would
+// be removed while strips are pinned.
+int pdfrasread_set_strip_cache(t_pdfrasreader* reader, size_t budget);
+
+// Pin strip s of page p, converted to out and reduced by factor (1 = full size), in the
+// cache: found there, or else read, decoded and added. Returns a pointer to its pixels,
+// in rows *pstride bytes apart, and sets *prows to the number of rows.
+// A strip is reduced on its own, as pdfrasread_read_page_reduced reduces a page, and
+// a reduced bitonal strip is 8-bit gray before it is converted.
+// Return NULL if reader has no cache, p or s is not valid, out is not an output format,
+// factor is not 1 .. PDFRAS_REDUCE_MAX, the strip can't be read or decoded, or memory
+// allocation fails.
+const void* pdfrasread_pin_strip(t_pdfrasreader* reader, int p, int s, RasterOutputFormat out, int factor,
+	size_t* pstride, unsigned long* prows);
+
+// Unpin the pixels of a strip pinned by pdfrasread_pin_strip. Each pin needs an unpin.
+void pdfrasread_unpin_strip(t_pdfrasreader* reader, const void* pixels);
+
+// Get the counters of reader's strip cache, all 0 if it has none.
+void pdfrasread_strip_cache_stats(t_pdfrasreader* reader, t_pdfrascachestats* stats);
+
+// Where to put one strip, in a batched strip read
+typedef struct t_pdfrasstripbuf {
+	void*		buffer;			// buffer for the raw (compressed) strip data
+	size_t		bufsize;		// size of buffer, in bytes
+	size_t		len;			// set to the length of the strip data read, 0 if not read
+} t_pdfrasstripbuf;
+
+// Read the raw (compressed) data of all the strips of pages first .. first+pages-1
+// in one go. strips[] has one entry for each of those strips, in order: all the
+// strips of page first, then all the strips of the next page, and so on.
+// Strips that are close together in the source are read together, so a page
+// typically takes one read instead of one per strip.
+// Safe to call on a shared reader (see pdfrasread_share).
+// Return TRUE if all the strips were read, FALSE if the pages don't exist,
+// count is not the total number of strips, a buffer is too small or a read fails.
+int pdfrasread_read_page_strips(t_pdfrasreader* reader, int first, int pages, t_pdfrasstripbuf* strips, int count);
+
+// Sharing a reader between threads
+//
+// A reader parses on demand, through a single parse window, so by default only one
+// thread at a time may use it. To read one document from many threads:
+// open a reader, call pdfrasread_share, then give each thread its own cursor.
+// The source's reader function must be positional (like pread: it can't rely on
+// a current file position) and safe to call from several threads at once.
+// The FILE, memory and mapped sources of pdfrasread_files.h all are.
+
+// Index every page and strip of an open reader, and make it read-only:
+// from then on page and strip queries only look at the index, and strip reads
+// go straight to the source, so any number of threads can make them at once.
+// Return TRUE if successful, FALSE if the reader isn't open or a page is invalid.
+int pdfrasread_share(t_pdfrasreader* reader);
+
+// Return TRUE if reader is open and shared (see pdfrasread_share), FALSE otherwise.
+int pdfrasread_is_shared(t_pdfrasreader* reader);
+
+// Create a cursor on a shared reader, for use by one thread.
+// Cursors are cheap: they hold no copy of the index, just the thread's strip buffer.
+// All cursors must be destroyed before the reader is closed.
+// Return NULL if reader is not shared, or memory allocation fails.
+t_pdfrascursor* pdfrasread_cursor_create(t_pdfrasreader* reader);
+
+// Destroy a cursor.
+void pdfrasread_cursor_destroy(t_pdfrascursor* cursor);
+
+// Return the shared reader of a cursor.
+t_pdfrasreader* pdfrasread_cursor_reader(t_pdfrascursor* cursor);
+
+// Return a pointer to the raw (compressed) data of strip s on page p and set *plen
+// to its length in bytes. Where the source allows it is a view of the source,
+// otherwise the strip is read into the cursor's buffer.
+// The pointer is valid until the next call with this cursor, or the cursor is destroyed.
+// Returns NULL (and sets *plen to 0) if the strip does not exist or can't be read.
+const void* pdfrasread_cursor_read_strip(t_pdfrascursor* cursor, int p, int s, size_t* plen);
+
+// Same as pdfrasread_read_strip_pixels, through a cursor.
+// Uses the cursor's strip buffer.
+size_t pdfrasread_cursor_read_strip_pixels(t_pdfrascursor* cursor, int p, int s, void* buffer, size_t bufsize);
+
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,367 @@
+// nanosleep, in pdfrasread_threads.h, is POSIX, not C99
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+#include "pdfrasread_async.h"
+#include "pdfrasread_threads.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+///////////////////////////////////////////////////////////////////////
+// Data Structures & Types
+
+// A prefetched page: all its strips, in one block of memory
+typedef struct t_prefetch {
+	int					page;				// page number, -1 if slot is empty
+	RasterRequestStatus	status;				// PENDING while being read
+	int					count;				// number of strips
+	t_pdfrasstripbuf*	strips;				// the strips, pointing into data
+	char*				data;				// strip data
+	unsigned long		used;				// when last hinted or read, for LRU replacement
+	int					readers;			// callers copying strips out of it
+} t_prefetch;
+
+// A queued job: a strip request, or a page to prefetch
+typedef struct t_asyncjob {
+	t_pdfrasstripreq*	req;				// strip read, or NULL
+	t_prefetch*			page;				// page prefetch, or NULL
+} t_asyncjob;
+
+struct t_pdfrasasync {
+	t_pdfrasreader*		reader;				// the (shared) reader
+	t_mutex				lock;				// protects everything below
+	t_cond				work;				// signalled when a job is queued (or on stop)
+	t_cond				done;				// broadcast when a job completes
+	bool				stop;				// TRUE when the threads should exit
+	t_asyncjob*			jobs;				// queue of jobs, a ring buffer
+	int					jobs_size;			// size of ring buffer
+	int					jobs_head;			// index of first job in queue
+	int					jobs_count;			// number of jobs in queue
+	int					nthreads;			// number of I/O threads running
+	t_thread*			threads;			// the I/O threads
+	t_prefetch			pages[PDFRAS_PREFETCH_PAGES];	// prefetched pages
+	unsigned long		tick;				// LRU clock
+};
+
+///////////////////////////////////////////////////////////////////////
+// Job queue (call with lock held)
+
+static int push_job(t_pdfrasasync* async, t_pdfrasstripreq* req, t_prefetch* page)
+{
+	if (async->jobs_count == async->jobs_size) {
+		int size = async->jobs_size ? async->jobs_size * 2 : 16;
+		t_asyncjob* jobs = (t_asyncjob*)malloc(size * sizeof *jobs);
+		if (!jobs) {
+			return FALSE;
+		}
+		int i;
+		for (i = 0; i < async->jobs_count; i++) {
+			jobs[i] = async->jobs[(async->jobs_head + i) % async->jobs_size];
+		}
+		free(async->jobs);
+		async->jobs = jobs;
+		async->jobs_size = size;
+		async->jobs_head = 0;
+	}
+	t_asyncjob* job = &async->jobs[(async->jobs_head + async->jobs_count) % async->jobs_size];
+	job->req = req;
+	job->page = page;
+	async->jobs_count++;
+	cond_signal(&async->work);
+	return TRUE;
+}
+
+static t_asyncjob pop_job(t_pdfrasasync* async)
+{
+	assert(async->jobs_count > 0);
+	t_asyncjob job = async->jobs[async->jobs_head];
+	async->jobs_head = (async->jobs_head + 1) % async->jobs_size;
+	async->jobs_count--;
+	return job;
+}
+
+///////////////////////////////////////////////////////////////////////
+// I/O threads
+
+static void run_strip_job(t_pdfrasasync* async, t_pdfrasstripreq* req)
+{
+	size_t len = pdfrasread_read_raw_strip(async->reader, req->page, req->strip, req->buffer, req->bufsize);
+	// nobody looks at len until the request completes
+	req->len = len;
+	// the callback comes first: once complete, req may be freed or resubmitted at any time
+	if (req->callback) {
+		req->callback(req->cookie, req);
+	}
+	mutex_lock(&async->lock);
+	req->status = len ? PDFRAS_REQ_DONE : PDFRAS_REQ_FAILED;
+	cond_broadcast(&async->done);
+	mutex_unlock(&async->lock);
+}
+
+static void run_page_job(t_pdfrasasync* async, t_prefetch* slot)
+{
+	t_pdfrasreader* reader = async->reader;
+	// slot is PENDING, so nobody else touches it until we're done
+	int p = slot->page;
+	int s, count = pdfrasread_strip_count(reader, p);
+	t_pdfrasstripbuf* strips = NULL;
+	char* data = NULL;
+	int ok = (count > 0);
+	if (ok) {
+		size_t total = 0;
+		for (s = 0; s < count; s++) {
+			total += pdfrasread_strip_raw_size(reader, p, s);
+		}
+		strips = (t_pdfrasstripbuf*)calloc(count, sizeof *strips);
+		data = (char*)malloc(total ? total : 1);
+		ok = (strips && data);
+	}
+	if (ok) {
+		size_t off = 0;
+		for (s = 0; s < count; s++) {
+			strips[s].buffer = data + off;
+			strips[s].bufsize = pdfrasread_strip_raw_size(reader, p, s);
+			off += strips[s].bufsize;
+		}
+		ok = pdfrasread_read_page_strips(reader, p, 1, strips, count);
+	}
+	mutex_lock(&async->lock);
+	if (ok) {
+		slot->strips = strips;
+		slot->data = data;
+		slot->count = count;
+		slot->status = PDFRAS_REQ_DONE;
+	}
+	else {
+		free(strips);
+		free(data);
+		slot->status = PDFRAS_REQ_FAILED;
+	}
+	cond_broadcast(&async->done);
+	mutex_unlock(&async->lock);
+}
+
+static void worker(t_pdfrasasync* async)
+{
+	mutex_lock(&async->lock);
+	for (;;) {
+		while (!async->stop && async->jobs_count == 0) {
+			cond_wait(&async->work, &async->lock);
+		}
+		if (async->stop) {
+			break;
+		}
+		t_asyncjob job = pop_job(async);
+		mutex_unlock(&async->lock);
+		if (job.req) {
+			run_strip_job(async, job.req);
+		}
+		else {
+			run_page_job(async, job.page);
+		}
+		mutex_lock(&async->lock);
+	}
+	mutex_unlock(&async->lock);
+}
+
+// thread body: run jobs until stopped
+static void worker_main(void* arg)
+{
+	worker((t_pdfrasasync*)arg);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Public functions
+
+t_pdfrasasync* pdfrasread_async_create(t_pdfrasreader* reader, int threads)
+{
+	if (!pdfrasread_is_shared(reader) && !pdfrasread_share(reader)) {
+		return NULL;
+	}
+	if (threads <= 0) {
+		threads = 2;
+	}
+	t_pdfrasasync* async = (t_pdfrasasync*)calloc(1, sizeof(t_pdfrasasync));
+	if (!async) {
+		return NULL;
+	}
+	async->threads = (t_thread*)calloc(threads, sizeof(t_thread));
+	if (!async->threads) {
+		free(async);
+		return NULL;
+	}
+	async->reader = reader;
+	int i;
+	for (i = 0; i < PDFRAS_PREFETCH_PAGES; i++) {
+		async->pages[i].page = -1;
+	}
+	mutex_init(&async->lock);
+	cond_init(&async->work);
+	cond_init(&async->done);
+	for (i = 0; i < threads; i++) {
+		if (!thread_start(&async->threads[i], worker_main, async)) {
+			break;
+		}
+		async->nthreads++;
+	}
+	if (async->nthreads < threads) {
+		// couldn't start all the threads
+		pdfrasread_async_destroy(async);
+		return NULL;
+	}
+	return async;
+}
+
+void pdfrasread_async_destroy(t_pdfrasasync* async)
+{
+	if (!async) {
+		return;
+	}
+	mutex_lock(&async->lock);
+	async->stop = true;
+	cond_broadcast(&async->work);
+	mutex_unlock(&async->lock);
+	int i;
+	for (i = 0; i < async->nthreads; i++) {
+		thread_join(async->threads[i]);
+	}
+	// cancel whatever is still queued
+	while (async->jobs_count) {
+		t_asyncjob job = pop_job(async);
+		if (job.req) {
+			job.req->len = 0;
+			if (job.req->callback) {
+				job.req->callback(job.req->cookie, job.req);
+			}
+			job.req->status = PDFRAS_REQ_FAILED;
+		}
+	}
+	for (i = 0; i < PDFRAS_PREFETCH_PAGES; i++) {
+		free(async->pages[i].strips);
+		free(async->pages[i].data);
+	}
+	cond_destroy(&async->done);
+	cond_destroy(&async->work);
+	mutex_destroy(&async->lock);
+	free(async->jobs);
+	free(async->threads);
+	free(async);
+}
+
+int pdfrasread_async_submit(t_pdfrasasync* async, t_pdfrasstripreq* req)
+{
+	int ok = FALSE;
+	mutex_lock(&async->lock);
+	if (req->status != PDFRAS_REQ_PENDING) {
+		req->status = PDFRAS_REQ_PENDING;
+		req->len = 0;
+		ok = push_job(async, req, NULL);
+		if (!ok) {
+			// internal failure, memory allocation
+			req->status = PDFRAS_REQ_FAILED;
+		}
+	}
+	mutex_unlock(&async->lock);
+	return ok;
+}
+
+int pdfrasread_async_poll(t_pdfrasasync* async, t_pdfrasstripreq* req)
+{
+	mutex_lock(&async->lock);
+	RasterRequestStatus status = req->status;
+	mutex_unlock(&async->lock);
+	return status == PDFRAS_REQ_DONE || status == PDFRAS_REQ_FAILED;
+}
+
+int pdfrasread_async_complete(t_pdfrasasync* async, t_pdfrasstripreq* req)
+{
+	mutex_lock(&async->lock);
+	while (req->status == PDFRAS_REQ_PENDING) {
+		cond_wait(&async->done, &async->lock);
+	}
+	RasterRequestStatus status = req->status;
+	mutex_unlock(&async->lock);
+	return status == PDFRAS_REQ_DONE;
+}
+
+// Return the prefetch slot holding page p, or NULL (call with lock held)
+static t_prefetch* find_prefetch(t_pdfrasasync* async, int p)
+{
+	int i;
+	for (i = 0; i < PDFRAS_PREFETCH_PAGES; i++) {
+		if (async->pages[i].page == p) {
+			return &async->pages[i];
+		}
+	}
+	return NULL;
+}
+
+int pdfrasread_will_need(t_pdfrasasync* async, int p)
+{
+	if (p < 0 || p >= pdfrasread_page_count(async->reader)) {
+		// invalid page number
+		return FALSE;
+	}
+	mutex_lock(&async->lock);
+	t_prefetch* slot = find_prefetch(async, p);
+	if (!slot || slot->status == PDFRAS_REQ_FAILED) {
+		if (!slot) {
+			// pick the least recently used slot that's not busy
+			int i;
+			for (i = 0; i < PDFRAS_PREFETCH_PAGES; i++) {
+				t_prefetch* t = &async->pages[i];
+				if (t->status != PDFRAS_REQ_PENDING && t->readers == 0 && (!slot || t->used < slot->used)) {
+					slot = t;
+				}
+			}
+		}
+		// (a failed prefetch is tried again)
+		if (slot) {
+			free(slot->strips);
+			free(slot->data);
+			memset(slot, 0, sizeof *slot);
+			slot->page = p;
+			slot->status = PDFRAS_REQ_PENDING;
+			if (!push_job(async, NULL, slot)) {
+				// internal failure, memory allocation
+				slot->page = -1;
+				slot->status = PDFRAS_REQ_IDLE;
+				slot = NULL;
+			}
+		}
+	}
+	if (slot) {
+		slot->used = ++async->tick;
+	}
+	mutex_unlock(&async->lock);
+	return slot != NULL;
+}
+
+size_t pdfrasread_async_read_strip(t_pdfrasasync* async, int p, int s, void* buffer, size_t bufsize)
+{
+	t_prefetch* slot;
+	mutex_lock(&async->lock);
+	// if the page is being prefetched, wait for it
+	while ((slot = find_prefetch(async, p)) && slot->status == PDFRAS_REQ_PENDING) {
+		cond_wait(&async->done, &async->lock);
+	}
+	if (!slot || slot->status != PDFRAS_REQ_DONE) {
+		// not prefetched, read it ourselves
+		mutex_unlock(&async->lock);
+		return pdfrasread_read_raw_strip(async->reader, p, s, buffer, bufsize);
+	}
+	// keep the page in memory while we copy the strip out
+	slot->readers++;
+	slot->used = ++async->tick;
+	mutex_unlock(&async->lock);
+	size_t len = 0;
+	if (s >= 0 && s < slot->count && slot->strips[s].len <= bufsize) {
+		len = slot->strips[s].len;
+		memcpy(buffer, slot->strips[s].buffer, len);
+	}
+	mutex_lock(&async->lock);
+	slot->readers--;
+	mutex_unlock(&async->lock);
+	return len;
+}
@@ -0,0 +1,92 @@
+#ifndef H_pdfrasread_async
+#define H_pdfrasread_async
+#pragma once
+
+// Asynchronous strip reading for the PDF/raster reader.
+// Strip reads are queued and served by a small pool of I/O threads, so the
+// caller can work on one page while the next is being read.
+// The threads read through the reader's source, so several reads are in flight at
+// once if the source reads at explicit positions, as file sources do (see
+// pdfrasread_files.h). There is no io_uring backend: it would be Linux-only and need liburing.
+
+#include "pdfrasread.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct t_pdfrasasync t_pdfrasasync;
+
+// Status of an asynchronous strip read
+typedef enum {
+	PDFRAS_REQ_IDLE,			// not submitted (yet)
+	PDFRAS_REQ_PENDING,			// queued, or being read
+	PDFRAS_REQ_DONE,			// read successfully
+	PDFRAS_REQ_FAILED,			// invalid strip, buffer too small, read error or cancelled
+} RasterRequestStatus;
+
+struct t_pdfrasstripreq;
+
+// function template: called (on an I/O thread) when an asynchronous strip read finishes,
+// just before it completes: req->len is the length read (0 if it failed), and req->status
+// is still PDFRAS_REQ_PENDING. Once the callback returns, req is not touched again.
+typedef void (*pdfras_stripdone)(void* cookie, struct t_pdfrasstripreq* req);
+
+// An asynchronous strip read.
+// Owned by the caller, it must stay valid (and unchanged) until the read completes.
+typedef struct t_pdfrasstripreq {
+	int					page;		// page number
+	int					strip;		// strip number on page
+	void*				buffer;		// buffer for the raw (compressed) strip data
+	size_t				bufsize;	// size of buffer, in bytes
+	pdfras_stripdone	callback;	// optional, called when read finishes (or NULL)
+	void*				cookie;		// passed to callback
+	// filled in by the reader:
+	RasterRequestStatus	status;		// use pdfrasread_async_poll to check it
+	size_t				len;		// length of strip data read
+} t_pdfrasstripreq;
+
+// Create an asynchronous reading engine with the given number of I/O threads
+// (threads <= 0 means the default, 2), for an open reader.
+// The reader is shared (see pdfrasread_share) if it isn't already, so its source
+// must be safe to read from several threads at once.
+// Destroy the engine before closing the reader.
+// Return NULL if the reader can't be shared, or threads can't be started.
+t_pdfrasasync* pdfrasread_async_create(t_pdfrasreader* reader, int threads);
+
+// Stop the I/O threads and release the engine.
+// Requests still queued are cancelled: they complete with status PDFRAS_REQ_FAILED
+// (and their callbacks are called, on this thread).
+void pdfrasread_async_destroy(t_pdfrasasync* async);
+
+// Queue the read of strip req->strip of page req->page into req->buffer.
+// Return TRUE if queued, FALSE if the request is already pending.
+int pdfrasread_async_submit(t_pdfrasasync* async, t_pdfrasstripreq* req);
+
+// Return TRUE if the request has completed (see req->status), FALSE if it is still pending.
+int pdfrasread_async_poll(t_pdfrasasync* async, t_pdfrasstripreq* req);
+
+// Wait for a request to complete.
+// Return TRUE if the strip was read (req->len is its length), FALSE otherwise.
+int pdfrasread_async_complete(t_pdfrasasync* async, t_pdfrasstripreq* req);
+
+// Number of pages the engine keeps prefetched
+#define PDFRAS_PREFETCH_PAGES	4
+
+// Hint that page p will be needed soon: read all its strips into memory in the
+// background, so pdfrasread_async_read_strip can then serve them without blocking.
+// The engine keeps the last PDFRAS_PREFETCH_PAGES pages hinted.
+// Return TRUE if the page is prefetched or being prefetched,
+// FALSE if p is not a page, or all prefetch slots are busy.
+int pdfrasread_will_need(t_pdfrasasync* async, int p);
+
+// Read the raw (compressed) data of strip s on page p into buffer, from memory if
+// the page has been prefetched (waiting for it if the prefetch is under way),
+// from the source otherwise.
+// Returns the actual number of bytes read.
+size_t pdfrasread_async_read_strip(t_pdfrasasync* async, int p, int s, void* buffer, size_t bufsize);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
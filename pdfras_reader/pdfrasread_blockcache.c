@@ -0,0 +1,432 @@
+// nanosleep, in pdfrasread_threads.h, is POSIX, not C99
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+#include "pdfrasread_blockcache.h"
+#include "pdfrasread_threads.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+///////////////////////////////////////////////////////////////////////
+// Data Structures & Types
+
+// A cached block. Allocated in one block with its data, which follows it.
+typedef struct t_cacheblock {
+	pduint64			index;				// block number: the block starts at index * block size
+	size_t				len;				// bytes of source in it, less than a block only at the end
+	struct t_cacheblock*	newer;			// next more recently used block (NULL = newest)
+	struct t_cacheblock*	older;			// next less recently used block (NULL = oldest)
+	struct t_cacheblock*	next;			// next block in the same hash bucket
+} t_cacheblock;
+
+struct t_pdfrasblockcache {
+	pdfras_freader64	fread;				// the source's reader function
+	pdfras_fcloser		fclose;				// its closer (NULL if none)
+	pdfras_fsizer		fsize;				// its sizer (NULL if none)
+	void*				source;				// and the source
+	t_mutex				lock;				// protects everything below
+	size_t				block_size;			// bytes per block, a power of 2
+	unsigned long		max_blocks;			// most blocks kept
+	unsigned long		count;				// blocks kept
+	t_cacheblock*		newest;				// most recently used block
+	t_cacheblock*		oldest;				// least recently used block
+	t_cacheblock**		buckets;			// hash table of blocks
+	unsigned long		nbuckets;			// size of hash table, a power of 2
+	pduint64			next_block;			// block after the last one read, to spot sequential reads
+	unsigned			ahead;				// blocks to read ahead of the next read
+	bool				size_known;			// TRUE if the size of the source is known
+	pduint64			size;				// and if so, what it is
+	pduint64			past_end;			// if not, an offset known to be past the end (0 = none)
+	char*				fetch;				// buffer for reads of the source
+	size_t				fetch_size;			// size of fetch buffer, in bytes
+	t_pdfrasblockstats	stats;
+};
+
+struct t_pdfraslatencysource {
+	pdfras_freader64	fread;				// the source's reader function
+	pdfras_fcloser		fclose;				// its closer (NULL if none)
+	pdfras_fsizer		fsize;				// its sizer (NULL if none)
+	void*				source;				// and the source
+	unsigned			latency_ms;			// sleep before each read
+	t_mutex				lock;				// protects requests
+	unsigned long		requests;			// number of reads
+};
+
+///////////////////////////////////////////////////////////////////////
+// Blocks
+
+static unsigned long block_hash(t_pdfrasblockcache* cache, pduint64 index)
+{
+	return (unsigned long)(index ^ (index >> 20)) & (cache->nbuckets - 1);
+}
+
+// Return the cached block index, NULL if it's not in the cache
+static t_cacheblock* find_block(t_pdfrasblockcache* cache, pduint64 index)
+{
+	t_cacheblock* b = cache->buckets[block_hash(cache, index)];
+	while (b && b->index != index) {
+		b = b->next;
+	}
+	return b;
+}
+
+// Take a block off the list in order of use
+static void unlink_block(t_pdfrasblockcache* cache, t_cacheblock* b)
+{
+	if (b->newer) {
+		b->newer->older = b->older;
+	}
+	else {
+		cache->newest = b->older;
+	}
+	if (b->older) {
+		b->older->newer = b->newer;
+	}
+	else {
+		cache->oldest = b->newer;
+	}
+	b->newer = b->older = NULL;
+}
+
+// Put a block at the most recently used end of the list
+static void link_newest(t_pdfrasblockcache* cache, t_cacheblock* b)
+{
+	b->older = cache->newest;
+	b->newer = NULL;
+	if (cache->newest) {
+		cache->newest->newer = b;
+	}
+	else {
+		cache->oldest = b;
+	}
+	cache->newest = b;
+}
+
+// Drop the least recently used block
+static void evict_oldest(t_pdfrasblockcache* cache)
+{
+	t_cacheblock* b = cache->oldest;
+	t_cacheblock** pp = &cache->buckets[block_hash(cache, b->index)];
+	while (*pp != b) {
+		pp = &(*pp)->next;
+	}
+	*pp = b->next;
+	unlink_block(cache, b);
+	cache->count--;
+	cache->stats.evictions++;
+	free(b);
+}
+
+// Add a copy of len bytes of data to the cache as block index.
+// If memory allocation fails the block just isn't cached.
+static void add_block(t_pdfrasblockcache* cache, pduint64 index, const char* data, size_t len)
+{
+	while (cache->count >= cache->max_blocks) {
+		evict_oldest(cache);
+	}
+	t_cacheblock* b = (t_cacheblock*)malloc(sizeof *b + cache->block_size);
+	if (!b) {
+		return;
+	}
+	b->index = index;
+	b->len = len;
+	memcpy(b + 1, data, len);
+	unsigned long h = block_hash(cache, index);
+	b->next = cache->buckets[h];
+	cache->buckets[h] = b;
+	link_newest(cache, b);
+	cache->count++;
+}
+
+// Return length, cut short at what's known of the end of the source
+static size_t clamp_to_end(t_pdfrasblockcache* cache, pduint64 off, size_t length)
+{
+	pduint64 end = cache->size_known ? cache->size : cache->past_end;
+	if (cache->size_known || cache->past_end) {
+		if (off >= end) {
+			return 0;
+		}
+		if (end - off < length) {
+			return (size_t)(end - off);
+		}
+	}
+	return length;
+}
+
+// Read blocks first .. end-1 from the source into the fetch buffer, with one read,
+// and add them to the cache. Return the number of bytes read.
+static size_t fetch_blocks(t_pdfrasblockcache* cache, pduint64 first, pduint64 end)
+{
+	pduint64 off = first * cache->block_size;
+	// don't ask for what isn't there
+	size_t length = clamp_to_end(cache, off, (size_t)(end - first) * cache->block_size);
+	if (length > cache->fetch_size) {
+		char* bigger = (char*)realloc(cache->fetch, length);
+		if (!bigger) {
+			// internal failure, memory allocation
+			return 0;
+		}
+		cache->fetch = bigger;
+		cache->fetch_size = length;
+	}
+	size_t got = length ? cache->fread(cache->source, off, length, cache->fetch) : 0;
+	cache->stats.requests += (length != 0);
+	cache->stats.bytes_fetched += got;
+	if (got < length && !cache->size_known) {
+		if (got > 0) {
+			// read up to the end of the source
+			cache->size_known = true;
+			cache->size = off + got;
+		}
+		else {
+			// started past the end
+			cache->past_end = off;
+		}
+	}
+	size_t pos;
+	pduint64 index = first;
+	for (pos = 0; pos < got; pos += cache->block_size, index++) {
+		size_t len = (got - pos < cache->block_size) ? got - pos : cache->block_size;
+		add_block(cache, index, cache->fetch + pos, len);
+	}
+	return got;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Block cache
+
+t_pdfrasblockcache* pdfrasread_blockcache_create(pdfras_freader64 readfn, pdfras_fcloser closefn, pdfras_fsizer sizefn,
+	void* source, size_t block_size, size_t budget)
+{
+	size_t size = 4096;
+	if (block_size == 0) {
+		block_size = PDFRAS_BLOCK_SIZE;
+	}
+	while (size < block_size) {
+		size *= 2;
+	}
+	t_pdfrasblockcache* cache = (t_pdfrasblockcache*)calloc(1, sizeof(t_pdfrasblockcache));
+	if (!cache) {
+		return NULL;
+	}
+	cache->fread = readfn;
+	cache->fclose = closefn;
+	cache->fsize = sizefn;
+	cache->source = source;
+	cache->block_size = size;
+	cache->max_blocks = (unsigned long)(budget / size);
+	if (cache->max_blocks < PDFRAS_BLOCK_READAHEAD + 1) {
+		cache->max_blocks = PDFRAS_BLOCK_READAHEAD + 1;
+	}
+	cache->nbuckets = 16;
+	while (cache->nbuckets < cache->max_blocks) {
+		cache->nbuckets *= 2;
+	}
+	cache->buckets = (t_cacheblock**)calloc(cache->nbuckets, sizeof *cache->buckets);
+	if (!cache->buckets) {
+		free(cache);
+		return NULL;
+	}
+	mutex_init(&cache->lock);
+	return cache;
+}
+
+size_t pdfrasread_blockcache_read(void* source, pduint64 offset, size_t length, char* buffer)
+{
+	t_pdfrasblockcache* cache = (t_pdfrasblockcache*)source;
+	mutex_lock(&cache->lock);
+	cache->stats.reads++;
+	length = clamp_to_end(cache, offset, length);
+	size_t done = 0;
+	if (length != 0) {
+		pduint64 first = offset / cache->block_size;
+		pduint64 last = (offset + length - 1) / cache->block_size;
+		// a read that carries on where the last one left off reads further ahead each time
+		if (first == cache->next_block || first + 1 == cache->next_block) {
+			cache->ahead = (cache->ahead == 0) ? 1 : (cache->ahead * 2 > PDFRAS_BLOCK_READAHEAD) ? PDFRAS_BLOCK_READAHEAD : cache->ahead * 2;
+		}
+		else {
+			cache->ahead = 0;
+		}
+		// hold on to the blocks of the read that are cached, so reading the others doesn't push them out
+		pduint64 index;
+		for (index = first; index <= last && index < first + cache->max_blocks; index++) {
+			t_cacheblock* b = find_block(cache, index);
+			if (b) {
+				unlink_block(cache, b);
+				link_newest(cache, b);
+			}
+		}
+		index = first;
+		while (done < length) {
+			pduint64 start = index * cache->block_size;
+			const char* data;
+			size_t len;
+			t_cacheblock* b = find_block(cache, index);
+			if (b) {
+				cache->stats.hits++;
+				unlink_block(cache, b);
+				link_newest(cache, b);
+				data = (const char*)(b + 1);
+				len = b->len;
+				index++;
+			}
+			else {
+				// read this block and all the missing ones after it in the read, in one go,
+				// and as many beyond the read as the readahead says
+				pduint64 end = index + 1;
+				while (end <= last && !find_block(cache, end)) {
+					end++;
+				}
+				cache->stats.misses += (unsigned long)(end - index);
+				if (end > last) {
+					pduint64 ahead = last + 1 + cache->ahead;
+					while (end < ahead && !find_block(cache, end) && clamp_to_end(cache, end * cache->block_size, 1)) {
+						end++;
+						cache->stats.readaheads++;
+					}
+				}
+				len = fetch_blocks(cache, index, end);
+				data = cache->fetch;
+				index = end;
+			}
+			// copy what the read wants of [start, start+len)
+			pduint64 pos = offset + done;
+			if (pos < start || pos >= start + len) {
+				// the source ends before the read does
+				break;
+			}
+			size_t n = (size_t)(start + len - pos);
+			if (n > length - done) {
+				n = length - done;
+			}
+			memcpy(buffer + done, data + (size_t)(pos - start), n);
+			done += n;
+		}
+		cache->next_block = last + 1;
+	}
+	cache->stats.bytes_served += done;
+	mutex_unlock(&cache->lock);
+	return done;
+}
+
+int pdfrasread_blockcache_size(void* source, pduint64* psize)
+{
+	t_pdfrasblockcache* cache = (t_pdfrasblockcache*)source;
+	mutex_lock(&cache->lock);
+	if (!cache->size_known && cache->fsize && cache->fsize(cache->source, &cache->size)) {
+		cache->size_known = true;
+	}
+	int known = cache->size_known;
+	*psize = cache->size;
+	mutex_unlock(&cache->lock);
+	return known;
+}
+
+void pdfrasread_blockcache_close(void* source)
+{
+	t_pdfrasblockcache* cache = (t_pdfrasblockcache*)source;
+	if (!cache) {
+		return;
+	}
+	if (cache->fclose) {
+		cache->fclose(cache->source);
+	}
+	while (cache->oldest) {
+		evict_oldest(cache);
+	}
+	mutex_destroy(&cache->lock);
+	free(cache->fetch);
+	free(cache->buckets);
+	free(cache);
+}
+
+t_pdfrasreader* pdfrasread_open_blockcache(int apiLevel, t_pdfrasblockcache* cache)
+{
+	t_pdfrasreader* reader = pdfrasread_create64(apiLevel, &pdfrasread_blockcache_read, &pdfrasread_blockcache_close);
+	if (reader) {
+		pdfrasread_set_sizer(reader, &pdfrasread_blockcache_size);
+		if (!pdfrasread_open(reader, cache)) {
+			pdfrasread_destroy(reader);
+			reader = NULL;
+		}
+	}
+	if (!reader) {
+		pdfrasread_blockcache_close(cache);
+	}
+	return reader;
+}
+
+void pdfrasread_blockcache_stats(t_pdfrasblockcache* cache, t_pdfrasblockstats* stats)
+{
+	mutex_lock(&cache->lock);
+	*stats = cache->stats;
+	mutex_unlock(&cache->lock);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Simulated-latency source
+
+t_pdfraslatencysource* pdfrasread_latency_source_create(pdfras_freader64 readfn, pdfras_fcloser closefn, pdfras_fsizer sizefn,
+	void* source, unsigned latency_ms)
+{
+	t_pdfraslatencysource* slow = (t_pdfraslatencysource*)calloc(1, sizeof(t_pdfraslatencysource));
+	if (slow) {
+		slow->fread = readfn;
+		slow->fclose = closefn;
+		slow->fsize = sizefn;
+		slow->source = source;
+		slow->latency_ms = latency_ms;
+		mutex_init(&slow->lock);
+	}
+	return slow;
+}
+
+// Count a request, and wait for it to get there and back
+static void latency_request(t_pdfraslatencysource* slow)
+{
+	mutex_lock(&slow->lock);
+	slow->requests++;
+	mutex_unlock(&slow->lock);
+	if (slow->latency_ms) {
+		thread_sleep(slow->latency_ms);
+	}
+}
+
+size_t pdfrasread_latency_source_read(void* source, pduint64 offset, size_t length, char* buffer)
+{
+	t_pdfraslatencysource* slow = (t_pdfraslatencysource*)source;
+	latency_request(slow);
+	return slow->fread(slow->source, offset, length, buffer);
+}
+
+int pdfrasread_latency_source_size(void* source, pduint64* psize)
+{
+	t_pdfraslatencysource* slow = (t_pdfraslatencysource*)source;
+	if (!slow->fsize) {
+		return FALSE;
+	}
+	latency_request(slow);
+	return slow->fsize(slow->source, psize);
+}
+
+void pdfrasread_latency_source_close(void* source)
+{
+	t_pdfraslatencysource* slow = (t_pdfraslatencysource*)source;
+	if (slow) {
+		if (slow->fclose) {
+			slow->fclose(slow->source);
+		}
+		mutex_destroy(&slow->lock);
+		free(slow);
+	}
+}
+
+unsigned long pdfrasread_latency_source_requests(t_pdfraslatencysource* source)
+{
+	mutex_lock(&source->lock);
+	unsigned long requests = source->requests;
+	mutex_unlock(&source->lock);
+	return requests;
+}
@@ -0,0 +1,88 @@
+#ifndef H_pdfrasread_blockcache
+#define H_pdfrasread_blockcache
+#pragma once
+
+// Block cache for high-latency sources.
+// When every read from a source is a round trip - a range read from object storage,
+// say - the reader's many small reads (parse window refills, size probes, xref
+// tables, strips) each cost a round trip. A block cache sits between the reader and
+// such a source: it reads the source in aligned blocks of a fixed size, and keeps the
+// most recently used blocks up to a budget of bytes. Runs of missing blocks are read
+// with one request, and while a source is being read sequentially the cache reads
+// further and further ahead.
+// The cache is a source itself, for pdfrasread_create64, and is safe to read from
+// several threads at once (see pdfrasread_share); reads of the underlying source are
+// made one at a time.
+
+#include "pdfrasread.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct t_pdfrasblockcache t_pdfrasblockcache;
+
+// Default block size, and most blocks read ahead of sequential reads
+#define PDFRAS_BLOCK_SIZE			(64*1024)
+#define PDFRAS_BLOCK_READAHEAD		8
+
+// Counters of a block cache
+typedef struct t_pdfrasblockstats {
+	unsigned long	reads;			// reads from the cache
+	pduint64		bytes_served;	// bytes those reads returned
+	unsigned long	hits;			// blocks found in the cache
+	unsigned long	misses;			// blocks read from the source for a read of the cache
+	unsigned long	readaheads;		// blocks read from the source ahead of a read
+	unsigned long	requests;		// reads of the source
+	pduint64		bytes_fetched;	// bytes those reads returned
+	unsigned long	evictions;		// blocks dropped to keep within the budget
+} t_pdfrasblockstats;
+
+// Create a block cache in front of a source: source is read with readfn, and closed with
+// closefn (if not NULL) when the cache is closed. sizefn (can be NULL) tells the source's size.
+// block_size is rounded up to a power of 2, 0 means PDFRAS_BLOCK_SIZE. budget is the most
+// bytes of blocks kept, at least PDFRAS_BLOCK_READAHEAD + 1 blocks.
+// Return NULL if memory allocation fails.
+t_pdfrasblockcache* pdfrasread_blockcache_create(pdfras_freader64 readfn, pdfras_fcloser closefn, pdfras_fsizer sizefn,
+	void* source, size_t block_size, size_t budget);
+
+// The cache as a source: reader, sizer and closer functions, with the cache as source.
+// The sizer knows the size if the underlying source has a sizer, or the cache has read up to its end.
+// Reads that start past the end are remembered too, so probing for the size costs few reads.
+size_t pdfrasread_blockcache_read(void* cache, pduint64 offset, size_t length, char* buffer);
+int pdfrasread_blockcache_size(void* cache, pduint64* psize);
+void pdfrasread_blockcache_close(void* cache);
+
+// Create a PDF/raster reader on a block cache, and open it.
+// If that fails, the cache is closed (see pdfrasread_blockcache_close) and NULL returned.
+t_pdfrasreader* pdfrasread_open_blockcache(int apiLevel, t_pdfrasblockcache* cache);
+
+// Get the counters of a block cache.
+void pdfrasread_blockcache_stats(t_pdfrasblockcache* cache, t_pdfrasblockstats* stats);
+
+// Simulated-latency source, for testing
+//
+// A source that reads from another source, but sleeps latency_ms milliseconds before
+// each read, as if it were fetching a range of a remote object. It counts the reads,
+// and asking for its size counts as a read.
+
+typedef struct t_pdfraslatencysource t_pdfraslatencysource;
+
+// Create a source that reads from source with readfn, sizes it with sizefn (if not NULL),
+// and closes it with closefn (if not NULL).
+// Return NULL if memory allocation fails.
+t_pdfraslatencysource* pdfrasread_latency_source_create(pdfras_freader64 readfn, pdfras_fcloser closefn, pdfras_fsizer sizefn,
+	void* source, unsigned latency_ms);
+
+// The simulated-latency source as a source: reader, sizer and closer functions.
+size_t pdfrasread_latency_source_read(void* source, pduint64 offset, size_t length, char* buffer);
+int pdfrasread_latency_source_size(void* source, pduint64* psize);
+void pdfrasread_latency_source_close(void* source);
+
+// Return the number of reads made from a simulated-latency source.
+unsigned long pdfrasread_latency_source_requests(t_pdfraslatencysource* source);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
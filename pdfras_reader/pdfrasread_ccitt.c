@@ -0,0 +1,519 @@
+#include "pdfrasread_ccitt.h"
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+///////////////////////////////////////////////////////////////////////
+// Code tables
+//
+// Codes are decoded by table lookup on the next few bits of the data:
+// every possible bit pattern maps directly to the code it starts with.
+// Run-length codes are up to 13 bits long, so to keep the tables small the
+// long ones are looked up in two steps: a lookup on the first bits either
+// finds the code, or finds a common prefix (run -1) whose length says how
+// many bits to skip before a lookup in the long-code table.
+//	white:	9 bits, then 4 bits after the prefix 00000001
+//	black:	6 bits, then 9 bits after the prefix 0000
+// Entries with length 0 are invalid codes (or the start of an EOL/EOFB).
+// Generated from the tables of ITU-T T.4, 4.1.2, checked to be prefix-free.
+
+// Two-dimensional coding modes, ITU-T T.4 4.2.1.3.2 & T.6 2.2.3
+typedef enum {
+	MODE_ERROR,						// invalid code, or start of EOFB
+	MODE_PASS,						// pass mode
+	MODE_HORIZ,						// horizontal mode: two runs follow
+	MODE_VL3,						// vertical modes: a1 = b1 - 3 .. b1 + 3
+	MODE_VL2,
+	MODE_VL1,
+	MODE_V0,
+	MODE_VR1,
+	MODE_VR2,
+	MODE_VR3,
+	MODE_EXT,						// extension (uncompressed mode): not supported
+} t_mode;
+
+typedef struct t_modecode {
+	pduint8				mode;		// t_mode
+	pduint8				len;		// code length, in bits
+} t_modecode;
+
+typedef struct t_runcode {
+	pdint16				run;		// run length (>= 64 for makeup codes), -1 for a long-code prefix
+	pduint8				len;		// code length in bits, 0 if invalid
+} t_runcode;
+
+#define MODE_BITS			7		// longest mode code
+#define WHITE_BITS			9		// first white lookup
+#define WHITE_LONG_BITS		4		// second white lookup
+#define BLACK_BITS			6		// first black lookup
+#define BLACK_LONG_BITS		9		// second black lookup
+
+static const t_modecode mode_codes[128] = {
+	{ MODE_ERROR, 0 }, { MODE_EXT, 7 }, { MODE_VL3, 7 }, { MODE_VR3, 7 }, { MODE_VL2, 6 }, { MODE_VL2, 6 }, { MODE_VR2, 6 }, { MODE_VR2, 6 },
+	{ MODE_PASS, 4 }, { MODE_PASS, 4 }, { MODE_PASS, 4 }, { MODE_PASS, 4 }, { MODE_PASS, 4 }, { MODE_PASS, 4 }, { MODE_PASS, 4 }, { MODE_PASS, 4 },
+	{ MODE_HORIZ, 3 }, { MODE_HORIZ, 3 }, { MODE_HORIZ, 3 }, { MODE_HORIZ, 3 }, { MODE_HORIZ, 3 }, { MODE_HORIZ, 3 }, { MODE_HORIZ, 3 }, { MODE_HORIZ, 3 },
+	{ MODE_HORIZ, 3 }, { MODE_HORIZ, 3 }, { MODE_HORIZ, 3 }, { MODE_HORIZ, 3 }, { MODE_HORIZ, 3 }, { MODE_HORIZ, 3 }, { MODE_HORIZ, 3 }, { MODE_HORIZ, 3 },
+	{ MODE_VL1, 3 }, { MODE_VL1, 3 }, { MODE_VL1, 3 }, { MODE_VL1, 3 }, { MODE_VL1, 3 }, { MODE_VL1, 3 }, { MODE_VL1, 3 }, { MODE_VL1, 3 },
+	{ MODE_VL1, 3 }, { MODE_VL1, 3 }, { MODE_VL1, 3 }, { MODE_VL1, 3 }, { MODE_VL1, 3 }, { MODE_VL1, 3 }, { MODE_VL1, 3 }, { MODE_VL1, 3 },
+	{ MODE_VR1, 3 }, { MODE_VR1, 3 }, { MODE_VR1, 3 }, { MODE_VR1, 3 }, { MODE_VR1, 3 }, { MODE_VR1, 3 }, { MODE_VR1, 3 }, { MODE_VR1, 3 },
+	{ MODE_VR1, 3 }, { MODE_VR1, 3 }, { MODE_VR1, 3 }, { MODE_VR1, 3 }, { MODE_VR1, 3 }, { MODE_VR1, 3 }, { MODE_VR1, 3 }, { MODE_VR1, 3 },
+	{ MODE_V0, 1 }, { MODE_V0, 1 }, { MODE_V0, 1 }, { MODE_V0, 1 }, { MODE_V0, 1 }, { MODE_V0, 1 }, { MODE_V0, 1 }, { MODE_V0, 1 },
+	{ MODE_V0, 1 }, { MODE_V0, 1 }, { MODE_V0, 1 }, { MODE_V0, 1 }, { MODE_V0, 1 }, { MODE_V0, 1 }, { MODE_V0, 1 }, { MODE_V0, 1 },
+	{ MODE_V0, 1 }, { MODE_V0, 1 }, { MODE_V0, 1 }, { MODE_V0, 1 }, { MODE_V0, 1 }, { MODE_V0, 1 }, { MODE_V0, 1 }, { MODE_V0, 1 },
+	{ MODE_V0, 1 }, { MODE_V0, 1 }, { MODE_V0, 1 }, { MODE_V0, 1 }, { MODE_V0, 1 }, { MODE_V0, 1 }, { MODE_V0, 1 }, { MODE_V0, 1 },
+	{ MODE_V0, 1 }, { MODE_V0, 1 }, { MODE_V0, 1 }, { MODE_V0, 1 }, { MODE_V0, 1 }, { MODE_V0, 1 }, { MODE_V0, 1 }, { MODE_V0, 1 },
+	{ MODE_V0, 1 }, { MODE_V0, 1 }, { MODE_V0, 1 }, { MODE_V0, 1 }, { MODE_V0, 1 }, { MODE_V0, 1 }, { MODE_V0, 1 }, { MODE_V0, 1 },
+	{ MODE_V0, 1 }, { MODE_V0, 1 }, { MODE_V0, 1 }, { MODE_V0, 1 }, { MODE_V0, 1 }, { MODE_V0, 1 }, { MODE_V0, 1 }, { MODE_V0, 1 },
+	{ MODE_V0, 1 }, { MODE_V0, 1 }, { MODE_V0, 1 }, { MODE_V0, 1 }, { MODE_V0, 1 }, { MODE_V0, 1 }, { MODE_V0, 1 }, { MODE_V0, 1 },
+};
+static const t_runcode white_codes[512] = {
+	{ 0, 0 }, { 0, 0 }, { -1, 8 }, { -1, 8 }, { 29, 8 }, { 29, 8 }, { 30, 8 }, { 30, 8 },
+	{ 45, 8 }, { 45, 8 }, { 46, 8 }, { 46, 8 }, { 22, 7 }, { 22, 7 }, { 22, 7 }, { 22, 7 },
+	{ 23, 7 }, { 23, 7 }, { 23, 7 }, { 23, 7 }, { 47, 8 }, { 47, 8 }, { 48, 8 }, { 48, 8 },
+	{ 13, 6 }, { 13, 6 }, { 13, 6 }, { 13, 6 }, { 13, 6 }, { 13, 6 }, { 13, 6 }, { 13, 6 },
+	{ 20, 7 }, { 20, 7 }, { 20, 7 }, { 20, 7 }, { 33, 8 }, { 33, 8 }, { 34, 8 }, { 34, 8 },
+	{ 35, 8 }, { 35, 8 }, { 36, 8 }, { 36, 8 }, { 37, 8 }, { 37, 8 }, { 38, 8 }, { 38, 8 },
+	{ 19, 7 }, { 19, 7 }, { 19, 7 }, { 19, 7 }, { 31, 8 }, { 31, 8 }, { 32, 8 }, { 32, 8 },
+	{ 1, 6 }, { 1, 6 }, { 1, 6 }, { 1, 6 }, { 1, 6 }, { 1, 6 }, { 1, 6 }, { 1, 6 },
+	{ 12, 6 }, { 12, 6 }, { 12, 6 }, { 12, 6 }, { 12, 6 }, { 12, 6 }, { 12, 6 }, { 12, 6 },
+	{ 53, 8 }, { 53, 8 }, { 54, 8 }, { 54, 8 }, { 26, 7 }, { 26, 7 }, { 26, 7 }, { 26, 7 },
+	{ 39, 8 }, { 39, 8 }, { 40, 8 }, { 40, 8 }, { 41, 8 }, { 41, 8 }, { 42, 8 }, { 42, 8 },
+	{ 43, 8 }, { 43, 8 }, { 44, 8 }, { 44, 8 }, { 21, 7 }, { 21, 7 }, { 21, 7 }, { 21, 7 },
+	{ 28, 7 }, { 28, 7 }, { 28, 7 }, { 28, 7 }, { 61, 8 }, { 61, 8 }, { 62, 8 }, { 62, 8 },
+	{ 63, 8 }, { 63, 8 }, { 0, 8 }, { 0, 8 }, { 320, 8 }, { 320, 8 }, { 384, 8 }, { 384, 8 },
+	{ 10, 5 }, { 10, 5 }, { 10, 5 }, { 10, 5 }, { 10, 5 }, { 10, 5 }, { 10, 5 }, { 10, 5 },
+	{ 10, 5 }, { 10, 5 }, { 10, 5 }, { 10, 5 }, { 10, 5 }, { 10, 5 }, { 10, 5 }, { 10, 5 },
+	{ 11, 5 }, { 11, 5 }, { 11, 5 }, { 11, 5 }, { 11, 5 }, { 11, 5 }, { 11, 5 }, { 11, 5 },
+	{ 11, 5 }, { 11, 5 }, { 11, 5 }, { 11, 5 }, { 11, 5 }, { 11, 5 }, { 11, 5 }, { 11, 5 },
+	{ 27, 7 }, { 27, 7 }, { 27, 7 }, { 27, 7 }, { 59, 8 }, { 59, 8 }, { 60, 8 }, { 60, 8 },
+	{ 1472, 9 }, { 1536, 9 }, { 1600, 9 }, { 1728, 9 }, { 18, 7 }, { 18, 7 }, { 18, 7 }, { 18, 7 },
+	{ 24, 7 }, { 24, 7 }, { 24, 7 }, { 24, 7 }, { 49, 8 }, { 49, 8 }, { 50, 8 }, { 50, 8 },
+	{ 51, 8 }, { 51, 8 }, { 52, 8 }, { 52, 8 }, { 25, 7 }, { 25, 7 }, { 25, 7 }, { 25, 7 },
+	{ 55, 8 }, { 55, 8 }, { 56, 8 }, { 56, 8 }, { 57, 8 }, { 57, 8 }, { 58, 8 }, { 58, 8 },
+	{ 192, 6 }, { 192, 6 }, { 192, 6 }, { 192, 6 }, { 192, 6 }, { 192, 6 }, { 192, 6 }, { 192, 6 },
+	{ 1664, 6 }, { 1664, 6 }, { 1664, 6 }, { 1664, 6 }, { 1664, 6 }, { 1664, 6 }, { 1664, 6 }, { 1664, 6 },
+	{ 448, 8 }, { 448, 8 }, { 512, 8 }, { 512, 8 }, { 704, 9 }, { 768, 9 }, { 640, 8 }, { 640, 8 },
+	{ 576, 8 }, { 576, 8 }, { 832, 9 }, { 896, 9 }, { 960, 9 }, { 1024, 9 }, { 1088, 9 }, { 1152, 9 },
+	{ 1216, 9 }, { 1280, 9 }, { 1344, 9 }, { 1408, 9 }, { 256, 7 }, { 256, 7 }, { 256, 7 }, { 256, 7 },
+	{ 2, 4 }, { 2, 4 }, { 2, 4 }, { 2, 4 }, { 2, 4 }, { 2, 4 }, { 2, 4 }, { 2, 4 },
+	{ 2, 4 }, { 2, 4 }, { 2, 4 }, { 2, 4 }, { 2, 4 }, { 2, 4 }, { 2, 4 }, { 2, 4 },
+	{ 2, 4 }, { 2, 4 }, { 2, 4 }, { 2, 4 }, { 2, 4 }, { 2, 4 }, { 2, 4 }, { 2, 4 },
+	{ 2, 4 }, { 2, 4 }, { 2, 4 }, { 2, 4 }, { 2, 4 }, { 2, 4 }, { 2, 4 }, { 2, 4 },
+	{ 3, 4 }, { 3, 4 }, { 3, 4 }, { 3, 4 }, { 3, 4 }, { 3, 4 }, { 3, 4 }, { 3, 4 },
+	{ 3, 4 }, { 3, 4 }, { 3, 4 }, { 3, 4 }, { 3, 4 }, { 3, 4 }, { 3, 4 }, { 3, 4 },
+	{ 3, 4 }, { 3, 4 }, { 3, 4 }, { 3, 4 }, { 3, 4 }, { 3, 4 }, { 3, 4 }, { 3, 4 },
+	{ 3, 4 }, { 3, 4 }, { 3, 4 }, { 3, 4 }, { 3, 4 }, { 3, 4 }, { 3, 4 }, { 3, 4 },
+	{ 128, 5 }, { 128, 5 }, { 128, 5 }, { 128, 5 }, { 128, 5 }, { 128, 5 }, { 128, 5 }, { 128, 5 },
+	{ 128, 5 }, { 128, 5 }, { 128, 5 }, { 128, 5 }, { 128, 5 }, { 128, 5 }, { 128, 5 }, { 128, 5 },
+	{ 8, 5 }, { 8, 5 }, { 8, 5 }, { 8, 5 }, { 8, 5 }, { 8, 5 }, { 8, 5 }, { 8, 5 },
+	{ 8, 5 }, { 8, 5 }, { 8, 5 }, { 8, 5 }, { 8, 5 }, { 8, 5 }, { 8, 5 }, { 8, 5 },
+	{ 9, 5 }, { 9, 5 }, { 9, 5 }, { 9, 5 }, { 9, 5 }, { 9, 5 }, { 9, 5 }, { 9, 5 },
+	{ 9, 5 }, { 9, 5 }, { 9, 5 }, { 9, 5 }, { 9, 5 }, { 9, 5 }, { 9, 5 }, { 9, 5 },
+	{ 16, 6 }, { 16, 6 }, { 16, 6 }, { 16, 6 }, { 16, 6 }, { 16, 6 }, { 16, 6 }, { 16, 6 },
+	{ 17, 6 }, { 17, 6 }, { 17, 6 }, { 17, 6 }, { 17, 6 }, { 17, 6 }, { 17, 6 }, { 17, 6 },
+	{ 4, 4 }, { 4, 4 }, { 4, 4 }, { 4, 4 }, { 4, 4 }, { 4, 4 }, { 4, 4 }, { 4, 4 },
+	{ 4, 4 }, { 4, 4 }, { 4, 4 }, { 4, 4 }, { 4, 4 }, { 4, 4 }, { 4, 4 }, { 4, 4 },
+	{ 4, 4 }, { 4, 4 }, { 4, 4 }, { 4, 4 }, { 4, 4 }, { 4, 4 }, { 4, 4 }, { 4, 4 },
+	{ 4, 4 }, { 4, 4 }, { 4, 4 }, { 4, 4 }, { 4, 4 }, { 4, 4 }, { 4, 4 }, { 4, 4 },
+	{ 5, 4 }, { 5, 4 }, { 5, 4 }, { 5, 4 }, { 5, 4 }, { 5, 4 }, { 5, 4 }, { 5, 4 },
+	{ 5, 4 }, { 5, 4 }, { 5, 4 }, { 5, 4 }, { 5, 4 }, { 5, 4 }, { 5, 4 }, { 5, 4 },
+	{ 5, 4 }, { 5, 4 }, { 5, 4 }, { 5, 4 }, { 5, 4 }, { 5, 4 }, { 5, 4 }, { 5, 4 },
+	{ 5, 4 }, { 5, 4 }, { 5, 4 }, { 5, 4 }, { 5, 4 }, { 5, 4 }, { 5, 4 }, { 5, 4 },
+	{ 14, 6 }, { 14, 6 }, { 14, 6 }, { 14, 6 }, { 14, 6 }, { 14, 6 }, { 14, 6 }, { 14, 6 },
+	{ 15, 6 }, { 15, 6 }, { 15, 6 }, { 15, 6 }, { 15, 6 }, { 15, 6 }, { 15, 6 }, { 15, 6 },
+	{ 64, 5 }, { 64, 5 }, { 64, 5 }, { 64, 5 }, { 64, 5 }, { 64, 5 }, { 64, 5 }, { 64, 5 },
+	{ 64, 5 }, { 64, 5 }, { 64, 5 }, { 64, 5 }, { 64, 5 }, { 64, 5 }, { 64, 5 }, { 64, 5 },
+	{ 6, 4 }, { 6, 4 }, { 6, 4 }, { 6, 4 }, { 6, 4 }, { 6, 4 }, { 6, 4 }, { 6, 4 },
+	{ 6, 4 }, { 6, 4 }, { 6, 4 }, { 6, 4 }, { 6, 4 }, { 6, 4 }, { 6, 4 }, { 6, 4 },
+	{ 6, 4 }, { 6, 4 }, { 6, 4 }, { 6, 4 }, { 6, 4 }, { 6, 4 }, { 6, 4 }, { 6, 4 },
+	{ 6, 4 }, { 6, 4 }, { 6, 4 }, { 6, 4 }, { 6, 4 }, { 6, 4 }, { 6, 4 }, { 6, 4 },
+	{ 7, 4 }, { 7, 4 }, { 7, 4 }, { 7, 4 }, { 7, 4 }, { 7, 4 }, { 7, 4 }, { 7, 4 },
+	{ 7, 4 }, { 7, 4 }, { 7, 4 }, { 7, 4 }, { 7, 4 }, { 7, 4 }, { 7, 4 }, { 7, 4 },
+	{ 7, 4 }, { 7, 4 }, { 7, 4 }, { 7, 4 }, { 7, 4 }, { 7, 4 }, { 7, 4 }, { 7, 4 },
+	{ 7, 4 }, { 7, 4 }, { 7, 4 }, { 7, 4 }, { 7, 4 }, { 7, 4 }, { 7, 4 }, { 7, 4 },
+};
+static const t_runcode white_long_codes[16] = {
+	{ 1792, 3 }, { 1792, 3 }, { 1984, 4 }, { 2048, 4 }, { 2112, 4 }, { 2176, 4 }, { 2240, 4 }, { 2304, 4 },
+	{ 1856, 3 }, { 1856, 3 }, { 1920, 3 }, { 1920, 3 }, { 2368, 4 }, { 2432, 4 }, { 2496, 4 }, { 2560, 4 },
+};
+static const t_runcode black_codes[64] = {
+	{ -1, 4 }, { -1, 4 }, { -1, 4 }, { -1, 4 }, { 9, 6 }, { 8, 6 }, { 7, 5 }, { 7, 5 },
+	{ 6, 4 }, { 6, 4 }, { 6, 4 }, { 6, 4 }, { 5, 4 }, { 5, 4 }, { 5, 4 }, { 5, 4 },
+	{ 1, 3 }, { 1, 3 }, { 1, 3 }, { 1, 3 }, { 1, 3 }, { 1, 3 }, { 1, 3 }, { 1, 3 },
+	{ 4, 3 }, { 4, 3 }, { 4, 3 }, { 4, 3 }, { 4, 3 }, { 4, 3 }, { 4, 3 }, { 4, 3 },
+	{ 3, 2 }, { 3, 2 }, { 3, 2 }, { 3, 2 }, { 3, 2 }, { 3, 2 }, { 3, 2 }, { 3, 2 },
+	{ 3, 2 }, { 3, 2 }, { 3, 2 }, { 3, 2 }, { 3, 2 }, { 3, 2 }, { 3, 2 }, { 3, 2 },
+	{ 2, 2 }, { 2, 2 }, { 2, 2 }, { 2, 2 }, { 2, 2 }, { 2, 2 }, { 2, 2 }, { 2, 2 },
+	{ 2, 2 }, { 2, 2 }, { 2, 2 }, { 2, 2 }, { 2, 2 }, { 2, 2 }, { 2, 2 }, { 2, 2 },
+};
+static const t_runcode black_long_codes[512] = {
+	{ 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 },
+	{ 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 },
+	{ 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 },
+	{ 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 },
+	{ 1792, 7 }, { 1792, 7 }, { 1792, 7 }, { 1792, 7 }, { 1984, 8 }, { 1984, 8 }, { 2048, 8 }, { 2048, 8 },
+	{ 2112, 8 }, { 2112, 8 }, { 2176, 8 }, { 2176, 8 }, { 2240, 8 }, { 2240, 8 }, { 2304, 8 }, { 2304, 8 },
+	{ 1856, 7 }, { 1856, 7 }, { 1856, 7 }, { 1856, 7 }, { 1920, 7 }, { 1920, 7 }, { 1920, 7 }, { 1920, 7 },
+	{ 2368, 8 }, { 2368, 8 }, { 2432, 8 }, { 2432, 8 }, { 2496, 8 }, { 2496, 8 }, { 2560, 8 }, { 2560, 8 },
+	{ 18, 6 }, { 18, 6 }, { 18, 6 }, { 18, 6 }, { 18, 6 }, { 18, 6 }, { 18, 6 }, { 18, 6 },
+	{ 52, 8 }, { 52, 8 }, { 640, 9 }, { 704, 9 }, { 768, 9 }, { 832, 9 }, { 55, 8 }, { 55, 8 },
+	{ 56, 8 }, { 56, 8 }, { 1280, 9 }, { 1344, 9 }, { 1408, 9 }, { 1472, 9 }, { 59, 8 }, { 59, 8 },
+	{ 60, 8 }, { 60, 8 }, { 1536, 9 }, { 1600, 9 }, { 24, 7 }, { 24, 7 }, { 24, 7 }, { 24, 7 },
+	{ 25, 7 }, { 25, 7 }, { 25, 7 }, { 25, 7 }, { 1664, 9 }, { 1728, 9 }, { 320, 8 }, { 320, 8 },
+	{ 384, 8 }, { 384, 8 }, { 448, 8 }, { 448, 8 }, { 512, 9 }, { 576, 9 }, { 53, 8 }, { 53, 8 },
+	{ 54, 8 }, { 54, 8 }, { 896, 9 }, { 960, 9 }, { 1024, 9 }, { 1088, 9 }, { 1152, 9 }, { 1216, 9 },
+	{ 64, 6 }, { 64, 6 }, { 64, 6 }, { 64, 6 }, { 64, 6 }, { 64, 6 }, { 64, 6 }, { 64, 6 },
+	{ 13, 4 }, { 13, 4 }, { 13, 4 }, { 13, 4 }, { 13, 4 }, { 13, 4 }, { 13, 4 }, { 13, 4 },
+	{ 13, 4 }, { 13, 4 }, { 13, 4 }, { 13, 4 }, { 13, 4 }, { 13, 4 }, { 13, 4 }, { 13, 4 },
+	{ 13, 4 }, { 13, 4 }, { 13, 4 }, { 13, 4 }, { 13, 4 }, { 13, 4 }, { 13, 4 }, { 13, 4 },
+	{ 13, 4 }, { 13, 4 }, { 13, 4 }, { 13, 4 }, { 13, 4 }, { 13, 4 }, { 13, 4 }, { 13, 4 },
+	{ 23, 7 }, { 23, 7 }, { 23, 7 }, { 23, 7 }, { 50, 8 }, { 50, 8 }, { 51, 8 }, { 51, 8 },
+	{ 44, 8 }, { 44, 8 }, { 45, 8 }, { 45, 8 }, { 46, 8 }, { 46, 8 }, { 47, 8 }, { 47, 8 },
+	{ 57, 8 }, { 57, 8 }, { 58, 8 }, { 58, 8 }, { 61, 8 }, { 61, 8 }, { 256, 8 }, { 256, 8 },
+	{ 16, 6 }, { 16, 6 }, { 16, 6 }, { 16, 6 }, { 16, 6 }, { 16, 6 }, { 16, 6 }, { 16, 6 },
+	{ 17, 6 }, { 17, 6 }, { 17, 6 }, { 17, 6 }, { 17, 6 }, { 17, 6 }, { 17, 6 }, { 17, 6 },
+	{ 48, 8 }, { 48, 8 }, { 49, 8 }, { 49, 8 }, { 62, 8 }, { 62, 8 }, { 63, 8 }, { 63, 8 },
+	{ 30, 8 }, { 30, 8 }, { 31, 8 }, { 31, 8 }, { 32, 8 }, { 32, 8 }, { 33, 8 }, { 33, 8 },
+	{ 40, 8 }, { 40, 8 }, { 41, 8 }, { 41, 8 }, { 22, 7 }, { 22, 7 }, { 22, 7 }, { 22, 7 },
+	{ 14, 4 }, { 14, 4 }, { 14, 4 }, { 14, 4 }, { 14, 4 }, { 14, 4 }, { 14, 4 }, { 14, 4 },
+	{ 14, 4 }, { 14, 4 }, { 14, 4 }, { 14, 4 }, { 14, 4 }, { 14, 4 }, { 14, 4 }, { 14, 4 },
+	{ 14, 4 }, { 14, 4 }, { 14, 4 }, { 14, 4 }, { 14, 4 }, { 14, 4 }, { 14, 4 }, { 14, 4 },
+	{ 14, 4 }, { 14, 4 }, { 14, 4 }, { 14, 4 }, { 14, 4 }, { 14, 4 }, { 14, 4 }, { 14, 4 },
+	{ 10, 3 }, { 10, 3 }, { 10, 3 }, { 10, 3 }, { 10, 3 }, { 10, 3 }, { 10, 3 }, { 10, 3 },
+	{ 10, 3 }, { 10, 3 }, { 10, 3 }, { 10, 3 }, { 10, 3 }, { 10, 3 }, { 10, 3 }, { 10, 3 },
+	{ 10, 3 }, { 10, 3 }, { 10, 3 }, { 10, 3 }, { 10, 3 }, { 10, 3 }, { 10, 3 }, { 10, 3 },
+	{ 10, 3 }, { 10, 3 }, { 10, 3 }, { 10, 3 }, { 10, 3 }, { 10, 3 }, { 10, 3 }, { 10, 3 },
+	{ 10, 3 }, { 10, 3 }, { 10, 3 }, { 10, 3 }, { 10, 3 }, { 10, 3 }, { 10, 3 }, { 10, 3 },
+	{ 10, 3 }, { 10, 3 }, { 10, 3 }, { 10, 3 }, { 10, 3 }, { 10, 3 }, { 10, 3 }, { 10, 3 },
+	{ 10, 3 }, { 10, 3 }, { 10, 3 }, { 10, 3 }, { 10, 3 }, { 10, 3 }, { 10, 3 }, { 10, 3 },
+	{ 10, 3 }, { 10, 3 }, { 10, 3 }, { 10, 3 }, { 10, 3 }, { 10, 3 }, { 10, 3 }, { 10, 3 },
+	{ 11, 3 }, { 11, 3 }, { 11, 3 }, { 11, 3 }, { 11, 3 }, { 11, 3 }, { 11, 3 }, { 11, 3 },
+	{ 11, 3 }, { 11, 3 }, { 11, 3 }, { 11, 3 }, { 11, 3 }, { 11, 3 }, { 11, 3 }, { 11, 3 },
+	{ 11, 3 }, { 11, 3 }, { 11, 3 }, { 11, 3 }, { 11, 3 }, { 11, 3 }, { 11, 3 }, { 11, 3 },
+	{ 11, 3 }, { 11, 3 }, { 11, 3 }, { 11, 3 }, { 11, 3 }, { 11, 3 }, { 11, 3 }, { 11, 3 },
+	{ 11, 3 }, { 11, 3 }, { 11, 3 }, { 11, 3 }, { 11, 3 }, { 11, 3 }, { 11, 3 }, { 11, 3 },
+	{ 11, 3 }, { 11, 3 }, { 11, 3 }, { 11, 3 }, { 11, 3 }, { 11, 3 }, { 11, 3 }, { 11, 3 },
+	{ 11, 3 }, { 11, 3 }, { 11, 3 }, { 11, 3 }, { 11, 3 }, { 11, 3 }, { 11, 3 }, { 11, 3 },
+	{ 11, 3 }, { 11, 3 }, { 11, 3 }, { 11, 3 }, { 11, 3 }, { 11, 3 }, { 11, 3 }, { 11, 3 },
+	{ 15, 5 }, { 15, 5 }, { 15, 5 }, { 15, 5 }, { 15, 5 }, { 15, 5 }, { 15, 5 }, { 15, 5 },
+	{ 15, 5 }, { 15, 5 }, { 15, 5 }, { 15, 5 }, { 15, 5 }, { 15, 5 }, { 15, 5 }, { 15, 5 },
+	{ 128, 8 }, { 128, 8 }, { 192, 8 }, { 192, 8 }, { 26, 8 }, { 26, 8 }, { 27, 8 }, { 27, 8 },
+	{ 28, 8 }, { 28, 8 }, { 29, 8 }, { 29, 8 }, { 19, 7 }, { 19, 7 }, { 19, 7 }, { 19, 7 },
+	{ 20, 7 }, { 20, 7 }, { 20, 7 }, { 20, 7 }, { 34, 8 }, { 34, 8 }, { 35, 8 }, { 35, 8 },
+	{ 36, 8 }, { 36, 8 }, { 37, 8 }, { 37, 8 }, { 38, 8 }, { 38, 8 }, { 39, 8 }, { 39, 8 },
+	{ 21, 7 }, { 21, 7 }, { 21, 7 }, { 21, 7 }, { 42, 8 }, { 42, 8 }, { 43, 8 }, { 43, 8 },
+	{ 0, 6 }, { 0, 6 }, { 0, 6 }, { 0, 6 }, { 0, 6 }, { 0, 6 }, { 0, 6 }, { 0, 6 },
+	{ 12, 3 }, { 12, 3 }, { 12, 3 }, { 12, 3 }, { 12, 3 }, { 12, 3 }, { 12, 3 }, { 12, 3 },
+	{ 12, 3 }, { 12, 3 }, { 12, 3 }, { 12, 3 }, { 12, 3 }, { 12, 3 }, { 12, 3 }, { 12, 3 },
+	{ 12, 3 }, { 12, 3 }, { 12, 3 }, { 12, 3 }, { 12, 3 }, { 12, 3 }, { 12, 3 }, { 12, 3 },
+	{ 12, 3 }, { 12, 3 }, { 12, 3 }, { 12, 3 }, { 12, 3 }, { 12, 3 }, { 12, 3 }, { 12, 3 },
+	{ 12, 3 }, { 12, 3 }, { 12, 3 }, { 12, 3 }, { 12, 3 }, { 12, 3 }, { 12, 3 }, { 12, 3 },
+	{ 12, 3 }, { 12, 3 }, { 12, 3 }, { 12, 3 }, { 12, 3 }, { 12, 3 }, { 12, 3 }, { 12, 3 },
+	{ 12, 3 }, { 12, 3 }, { 12, 3 }, { 12, 3 }, { 12, 3 }, { 12, 3 }, { 12, 3 }, { 12, 3 },
+	{ 12, 3 }, { 12, 3 }, { 12, 3 }, { 12, 3 }, { 12, 3 }, { 12, 3 }, { 12, 3 }, { 12, 3 },
+};
+
+///////////////////////////////////////////////////////////////////////
+// Bit reader
+
+typedef struct t_bitreader {
+	const pduint8*		next;		// next byte of data to load
+	const pduint8*		end;		// end of the current chunk of data
+	pdfras_ccitt_fill	fill;		// function to get the next chunk (NULL = no more data)
+	void*				cookie;		// passed to fill
+	pduint64			bits;		// loaded bits, next one in the top bit
+	int					count;		// number of bits loaded
+	size_t				pad;		// number of 0 bytes loaded past the end of data
+} t_bitreader;
+
+// Load whole bytes until at least 57 bits are available.
+// Past the end of the data, load 0's: no valid code is all 0's, so decoding stops.
+static void load_bits(t_bitreader* br)
+{
+	while (br->count <= 56) {
+		pduint64 byte = 0;
+		if (br->next == br->end && br->fill) {
+			// current chunk used up, get the next one
+			size_t len = 0;
+			const pduint8* chunk = (const pduint8*)br->fill(br->cookie, &len);
+			if (chunk && len) {
+				br->next = chunk;
+				br->end = chunk + len;
+			}
+			else {
+				// end of data
+				br->fill = NULL;
+			}
+		}
+		if (br->next < br->end) {
+			byte = *br->next++;
+		}
+		else {
+			br->pad++;
+		}
+		br->bits |= byte << (56 - br->count);
+		br->count += 8;
+	}
+}
+
+#define PEEK_BITS(br, n)	((unsigned)((br)->bits >> (64 - (n))))
+#define SKIP_BITS(br, n)	((br)->bits <<= (n), (br)->count -= (n))
+
+// Read a run length of the given color: makeup codes, then a terminating code.
+// Return the run length, or -1 if a code is invalid or the run is longer than limit.
+static long read_run(t_bitreader* br, int black, long limit)
+{
+	long run = 0;
+	for (;;) {
+		t_runcode code;
+		if (br->count < 16) {
+			load_bits(br);
+		}
+		if (black) {
+			code = black_codes[PEEK_BITS(br, BLACK_BITS)];
+			if (code.run < 0) {
+				SKIP_BITS(br, code.len);
+				code = black_long_codes[PEEK_BITS(br, BLACK_LONG_BITS)];
+			}
+		}
+		else {
+			code = white_codes[PEEK_BITS(br, WHITE_BITS)];
+			if (code.run < 0) {
+				SKIP_BITS(br, code.len);
+				code = white_long_codes[PEEK_BITS(br, WHITE_LONG_BITS)];
+			}
+		}
+		if (code.len == 0) {
+			// invalid code
+			return -1;
+		}
+		SKIP_BITS(br, code.len);
+		run += code.run;
+		if (run > limit) {
+			// run goes past the end of the row
+			return -1;
+		}
+		if (code.run < 64) {
+			// terminating code
+			return run;
+		}
+	}
+}
+
+///////////////////////////////////////////////////////////////////////
+// Rows
+//
+// A row is described by its changing elements: the positions of the pixels
+// whose color differs from the pixel before. Even entries are changes to black,
+// odd entries changes to white (a row starts white). The changes of the row
+// being decoded (the coding line) are coded relative to those of the row
+// above it (the reference line).
+
+// Append change a to the n changes of a coding line and return the new count.
+// A change at the same position as the last one cancels it: there's no run between them.
+static int add_change(long* changes, int n, long a)
+{
+	if (n > 0 && changes[n - 1] == a) {
+		return n - 1;
+	}
+	changes[n] = a;
+	return n + 1;
+}
+
+// Set pixels [a, b) of row to black (0).
+// Partial bytes at either end are masked, whole bytes are cleared by memset.
+static void fill_black(pduint8* row, long a, long b)
+{
+	if (a >= b) {
+		return;
+	}
+	pduint8* first = row + (a >> 3);
+	pduint8* last = row + ((b - 1) >> 3);
+	pduint8 head = (pduint8)(0xFF >> (a & 7));				// pixels a.. of first byte
+	pduint8 tail = (pduint8)(0xFF << (7 - ((b - 1) & 7)));	// pixels ..b-1 of last byte
+	if (first == last) {
+		*first &= (pduint8)~(head & tail);
+	}
+	else {
+		*first &= (pduint8)~head;
+		memset(first + 1, 0, last - first - 1);
+		*last &= (pduint8)~tail;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////
+// Decoder
+
+// State of a decoder between rows
+struct t_pdfrasccitt {
+	long				width;		// pixels per row
+	long*				lines;		// storage for ref and cur
+	long*				ref;		// changes of the reference line (the last row decoded)
+	long*				cur;		// changes of the coding line
+	t_bitreader			br;			// the coded data
+	bool				bFailed;	// the data is invalid: no more rows
+};
+
+// Create a decoder for rows of width pixels, with no data yet.
+static t_pdfrasccitt* new_decoder(unsigned long width)
+{
+	if (width == 0 || width > INT_MAX - 4 || width > (size_t)-1 / (2 * sizeof(long)) - 4) {
+		return NULL;
+	}
+	t_pdfrasccitt* dec = (t_pdfrasccitt*)calloc(1, sizeof *dec);
+	if (!dec) {
+		// internal failure, memory allocation
+		return NULL;
+	}
+	// changes of the reference and coding lines, each followed by 3 sentinels at width.
+	// Changes are in increasing order, so a line has at most width+1 of them.
+	dec->lines = (long*)malloc(2 * (width + 4) * sizeof(long));
+	if (!dec->lines) {
+		// internal failure, memory allocation
+		free(dec);
+		return NULL;
+	}
+	dec->ref = dec->lines;
+	dec->cur = dec->lines + width + 4;
+	dec->width = (long)width;
+	// the line above the first one is all white: no changes
+	dec->ref[0] = dec->ref[1] = dec->ref[2] = dec->width;
+	return dec;
+}
+
+t_pdfrasccitt* pdfras_ccitt_g4_create(unsigned long width, pdfras_ccitt_fill fill, void* cookie)
+{
+	t_pdfrasccitt* dec = new_decoder(width);
+	if (dec) {
+		dec->br.fill = fill;
+		dec->br.cookie = cookie;
+	}
+	return dec;
+}
+
+void pdfras_ccitt_g4_destroy(t_pdfrasccitt* dec)
+{
+	if (dec) {
+		free(dec->lines);
+		free(dec);
+	}
+}
+
+int pdfras_ccitt_g4_rows(t_pdfrasccitt* dec, unsigned long rows, void* pixels, size_t stride)
+{
+	long w = dec->width;
+	size_t row_bytes = (size_t)(w + 7) / 8;
+	if (stride < row_bytes) {
+		return 0;
+	}
+	long* ref = dec->ref;
+	long* cur = dec->cur;
+	t_bitreader br = dec->br;
+	pduint8* row = (pduint8*)pixels;
+	int ok = !dec->bFailed;
+	unsigned long y;
+	for (y = 0; y < rows && ok; y++, row += stride) {
+		long a0 = -1;				// position of the imaginary white pixel before the row
+		int color = 0;				// color of the run starting at a0: 0 = white, 1 = black
+		int n = 0;					// number of changes on the coding line
+		int b = 0;					// index of b1 on the reference line
+		while (a0 < w) {
+			// b1 is the first change on the reference line to the right of a0
+			// to the opposite of color, b2 the change after it.
+			while (b > 0 && ref[b - 1] > a0) {
+				b--;
+			}
+			while (ref[b] <= a0) {
+				b++;
+			}
+			if ((b & 1) != color) {
+				b++;
+			}
+			if (br.count < 16) {
+				load_bits(&br);
+			}
+			t_modecode mode = mode_codes[PEEK_BITS(&br, MODE_BITS)];
+			SKIP_BITS(&br, mode.len);
+			switch (mode.mode) {
+			case MODE_PASS:
+				// the run continues past b2
+				a0 = ref[b + 1];
+				break;
+			case MODE_HORIZ:
+				{
+					// two runs, a0..a1 and a1..a2, coded by length
+					long start = a0 < 0 ? 0 : a0;
+					long r1 = read_run(&br, color, w - start);
+					long r2 = r1 < 0 ? -1 : read_run(&br, !color, w - start - r1);
+					if (r2 < 0) {
+						// invalid PDF: bad run length code
+						ok = 0;
+						break;
+					}
+					n = add_change(cur, n, start + r1);
+					n = add_change(cur, n, start + r1 + r2);
+					a0 = start + r1 + r2;
+				}
+				break;
+			case MODE_ERROR:
+			case MODE_EXT:
+				// invalid PDF: bad code, or end of data before the last row
+				ok = 0;
+				break;
+			default:
+				{
+					// vertical mode: a1 is within 3 pixels of b1
+					long a1 = ref[b] + (mode.mode - MODE_V0);
+					if (a1 < a0 || a1 < 0 || a1 > w) {
+						// invalid PDF: change outside the row, or behind a0
+						ok = 0;
+						break;
+					}
+					n = add_change(cur, n, a1);
+					a0 = a1;
+					color = !color;
+				}
+				break;
+			}
+			if (!ok) {
+				break;
+			}
+		}
+		if (br.pad * 8 > (size_t)br.count) {
+			// invalid PDF: row runs past the end of the data
+			ok = 0;
+		}
+		if (ok) {
+			// paint the row white, then the black runs
+			memset(row, 0xFF, row_bytes);
+			int i;
+			for (i = 0; i < n; i += 2) {
+				fill_black(row, cur[i], i + 1 < n ? cur[i + 1] : w);
+			}
+			// this coding line is the next reference line
+			cur[n] = cur[n + 1] = cur[n + 2] = w;
+			long* t = ref;
+			ref = cur;
+			cur = t;
+		}
+	}
+	dec->ref = ref;
+	dec->cur = cur;
+	dec->br = br;
+	dec->bFailed = !ok;
+	return ok;
+}
+
+int pdfras_ccitt_g4_decode(const void* data, size_t len, unsigned long width, unsigned long rows, void* pixels, size_t stride)
+{
+	t_pdfrasccitt* dec = new_decoder(width);
+	if (!dec) {
+		return 0;
+	}
+	// all the data is here
+	dec->br.next = (const pduint8*)data;
+	dec->br.end = dec->br.next + len;
+	int ok = pdfras_ccitt_g4_rows(dec, rows, pixels, stride);
+	pdfras_ccitt_g4_destroy(dec);
+	return ok;
+}
@@ -0,0 +1,45 @@
+#ifndef H_pdfrasread_ccitt
+#define H_pdfrasread_ccitt
+#pragma once
+
+// CCITT Group 4 (ITU-T T.6) decoding, as used by PDF/raster bitonal strips:
+// CCITTFaxDecode with K < 0, no EOLs and no byte alignment of rows, which are
+// the parameters the PDF/raster writer emits.
+
+#include "pdfras_platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct t_pdfrasccitt t_pdfrasccitt;
+
+// function template: return a pointer to the next chunk of coded data, and set *plen
+// to its length. Return NULL (or set *plen to 0) at the end of the data.
+// The chunk must stay valid until the next call.
+typedef const void* (*pdfras_ccitt_fill)(void* cookie, size_t* plen);
+
+// Decode rows rows of width pixels of Group 4 data[0..len) into pixels,
+// as packed 1-bit-per-pixel rows stride bytes apart (stride >= (width+7)/8).
+// Pixels are written with 0=black (BlackIs1 false); any padding bits at the end
+// of a row are set to 1. Data after the last row (typically an EOFB) is ignored.
+// Return TRUE if all the rows were decoded, FALSE if the data is invalid or runs out,
+// or memory allocation fails.
+int pdfras_ccitt_g4_decode(const void* data, size_t len, unsigned long width, unsigned long rows, void* pixels, size_t stride);
+
+// Incremental decoding, for when the data or the pixels don't fit in memory at once.
+// Create a decoder for rows of width pixels, that gets its data chunk by chunk
+// from fill(cookie, ...). Return NULL if width is 0 or memory allocation fails.
+t_pdfrasccitt* pdfras_ccitt_g4_create(unsigned long width, pdfras_ccitt_fill fill, void* cookie);
+
+// Decode the next rows rows into pixels, as pdfras_ccitt_g4_decode does.
+// Return TRUE if successful. Once it has returned FALSE, it always does.
+int pdfras_ccitt_g4_rows(t_pdfrasccitt* dec, unsigned long rows, void* pixels, size_t stride);
+
+// Release a decoder.
+void pdfras_ccitt_g4_destroy(t_pdfrasccitt* dec);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,31 @@
+// clock_gettime is POSIX, not C99
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+#include "pdfrasread_clock.h"
+
+#ifdef WIN32
+#include <windows.h>
+
+pduint64 pdfras_clock_ns(void)
+{
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER now;
+	if (freq.QuadPart == 0) {
+		QueryPerformanceFrequency(&freq);
+	}
+	QueryPerformanceCounter(&now);
+	// whole seconds, then the rest, so the multiply doesn't overflow
+	return (pduint64)(now.QuadPart / freq.QuadPart) * 1000000000u +
+		(pduint64)(now.QuadPart % freq.QuadPart) * 1000000000u / (pduint64)freq.QuadPart;
+}
+#else
+#include <time.h>
+
+pduint64 pdfras_clock_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (pduint64)ts.tv_sec * 1000000000u + (pduint64)ts.tv_nsec;
+}
+#endif
@@ -0,0 +1,21 @@
+#ifndef H_pdfrasread_clock
+#define H_pdfrasread_clock
+#pragma once
+
+// A monotonic wall clock, for the reader's instrumentation (not part of the API).
+// In its own file because the reader proper is built without language extensions,
+// and the system headers that tell the time need them.
+
+#include "pdfras_platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Return the time in nanoseconds since some fixed moment.
+pduint64 pdfras_clock_ns(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -1,7 +1,26 @@
+// pread, fileno and mmap are POSIX, preadv is BSD: not C99
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE
+#endif
 #include "pdfrasread_files.h"
+#include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
-#include "..\pdfras_writer\PdfPlatform.h"
+
+#ifdef WIN32
+#include <windows.h>
+#include <io.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#else
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 // Return TRUE if the file starts with the signature of a PDF/raster file.
 // FALSE otherwise.
@@ -29,13 +48,110 @@ int pdfrasread_recognize_filename(const char* fn)
 	return bResult;
 }
 
-static size_t file_reader(void *source, pduint32 offset, size_t length, char *buffer)
+// Read from the file at an explicit position (pread, or ReadFile with an OVERLAPPED
+// offset), never seeking, so several threads can read the same file at once.
+// On Windows the read still moves the handle's file pointer: only the explicit
+// offset makes it safe, so don't mix these reads with the FILE's own.
+static size_t file_reader(void *source, pduint64 offset, size_t length, char *buffer)
 {
 	FILE* f = (FILE*)source;
-	if (0 != fseek(f, offset, SEEK_SET)) {
+	size_t total = 0;
+#ifdef WIN32
+	HANDLE h = (HANDLE)_get_osfhandle(_fileno(f));
+	if (h == INVALID_HANDLE_VALUE) {
 		return 0;
 	}
-	return fread(buffer, sizeof(pduint8), length, f);
+	while (total < length) {
+		OVERLAPPED ov;
+		DWORD n, chunk = (length - total > 0x40000000) ? 0x40000000 : (DWORD)(length - total);
+		memset(&ov, 0, sizeof ov);
+		ov.Offset = (DWORD)(offset + total);
+		ov.OffsetHigh = (DWORD)((offset + total) >> 32);
+		if (!ReadFile(h, buffer + total, chunk, &n, &ov) || n == 0) {
+			break;
+		}
+		total += n;
+	}
+#else
+	int fd = fileno(f);
+	while (total < length) {
+		ssize_t n = pread(fd, buffer + total, length - total, (off_t)(offset + total));
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			break;
+		}
+		total += (size_t)n;
+	}
+#endif
+	return total;
+}
+
+// Read consecutive bytes from the file into several buffers, without moving the FILE's position.
+static size_t file_readerv(void *source, pduint64 offset, const t_pdfrasiovec* iov, int iovcnt)
+{
+	size_t total = 0;
+#ifdef WIN32
+	// Scatter reads need unbuffered handles, so read the buffers one by one:
+	// still one sequential pass over the file.
+	int i;
+	for (i = 0; i < iovcnt; i++) {
+		size_t n = file_reader(source, offset + total, iov[i].len, (char*)iov[i].base);
+		total += n;
+		if (n < iov[i].len) {
+			break;
+		}
+	}
+#else
+	int fd = fileno((FILE*)source);
+	int i = 0;					// first buffer not yet full
+	size_t done = 0;			// bytes already in buffer i
+	while (i < iovcnt) {
+		struct iovec v[64];
+		int k;
+		for (k = 0; k < 64 && i + k < iovcnt; k++) {
+			size_t skip = k ? 0 : done;
+			v[k].iov_base = (char*)iov[i + k].base + skip;
+			v[k].iov_len = iov[i + k].len - skip;
+		}
+		ssize_t n = preadv(fd, v, k, (off_t)(offset + total));
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			break;
+		}
+		total += (size_t)n;
+		// step over the buffers filled
+		size_t m = (size_t)n;
+		while (i < iovcnt && m >= iov[i].len - done) {
+			m -= iov[i].len - done;
+			done = 0;
+			i++;
+		}
+		done += m;
+	}
+#endif
+	return total;
+}
+
+static int file_sizer(void *source, pduint64 *psize)
+{
+	FILE* f = (FILE*)source;
+#ifdef WIN32
+	struct _stat64 st;
+	if (0 != _fstat64(_fileno(f), &st)) {
+		return FALSE;
+	}
+#else
+	struct stat st;
+	if (0 != fstat(fileno(f), &st)) {
+		return FALSE;
+	}
+#endif
+	*psize = (pduint64)st.st_size;
+	return TRUE;
 }
 
 static void file_closer(void* source)
@@ -52,8 +168,9 @@ int pdfrasread_page_count_file(FILE* f)
 {
 	int nPages = -1;
 	// construct a PDF/raster reader based on the file
-	t_pdfrasreader* reader = pdfrasread_create(PDFRAS_API_LEVEL, &file_reader, NULL);
+	t_pdfrasreader* reader = pdfrasread_create64(PDFRAS_API_LEVEL, &file_reader, NULL);
 	if (reader) {
+		pdfrasread_set_sizer(reader, &file_sizer);
 		if (pdfrasread_open(reader, f)) {
 			// count its pages
 			nPages = pdfrasread_page_count(reader);
@@ -77,8 +194,10 @@ int pdfrasread_page_count_filename(const char* fn)
 
 t_pdfrasreader* pdfrasread_open_file(int apiLevel, FILE* f)
 {
-	t_pdfrasreader* reader = pdfrasread_create(apiLevel, &file_reader, &file_closer);
+	t_pdfrasreader* reader = pdfrasread_create64(apiLevel, &file_reader, &file_closer);
 	if (reader) {
+		pdfrasread_set_sizer(reader, &file_sizer);
+		pdfrasread_set_vreader(reader, &file_readerv);
 		if (!pdfrasread_open(reader, f)) {
 			pdfrasread_destroy(reader);
 			reader = NULL;
@@ -101,3 +220,153 @@ t_pdfrasreader* pdfrasread_open_filename(int apiLevel, const char* fn)
 	}
 	return reader;
 }
+
+
+///////////////////////////////////////////////////////////////////////
+// In-memory and memory-mapped sources
+
+// A source that is a block of memory.
+// For a mapped file, the block is the file mapping.
+typedef struct t_memsource {
+	const pduint8*		data;				// first byte of source
+	pduint64			size;				// size of source, in bytes
+	bool				mapped;				// TRUE if data is a file mapping we own
+} t_memsource;
+
+static size_t mem_reader(void *source, pduint64 offset, size_t length, char *buffer)
+{
+	t_memsource* mem = (t_memsource*)source;
+	if (offset >= mem->size) {
+		return 0;
+	}
+	if (length > mem->size - offset) {
+		length = (size_t)(mem->size - offset);
+	}
+	memcpy(buffer, mem->data + offset, length);
+	return length;
+}
+
+static const void* mem_viewer(void *source, pduint64 offset, size_t length)
+{
+	t_memsource* mem = (t_memsource*)source;
+	if (offset > mem->size || length > mem->size - offset) {
+		// not all inside the source
+		return NULL;
+	}
+	return mem->data + offset;
+}
+
+static int mem_sizer(void *source, pduint64 *psize)
+{
+	*psize = ((t_memsource*)source)->size;
+	return TRUE;
+}
+
+static void mem_closer(void* source)
+{
+	t_memsource* mem = (t_memsource*)source;
+	if (mem) {
+		if (mem->mapped) {
+#ifdef WIN32
+			UnmapViewOfFile(mem->data);
+#else
+			munmap((void*)mem->data, (size_t)mem->size);
+#endif
+		}
+		free(mem);
+	}
+}
+
+// Create a reader and open it on a memory source.
+// If that fails, the memory source is closed.
+static t_pdfrasreader* open_memsource(int apiLevel, t_memsource* mem)
+{
+	t_pdfrasreader* reader = pdfrasread_create64(apiLevel, &mem_reader, &mem_closer);
+	if (reader) {
+		pdfrasread_set_viewer(reader, &mem_viewer);
+		pdfrasread_set_sizer(reader, &mem_sizer);
+		if (!pdfrasread_open(reader, mem)) {
+			pdfrasread_destroy(reader);
+			reader = NULL;
+		}
+	}
+	if (!reader) {
+		mem_closer(mem);
+	}
+	return reader;
+}
+
+t_pdfrasreader* pdfrasread_open_memory(int apiLevel, const void* data, size_t len)
+{
+	if (!data) {
+		return NULL;
+	}
+	t_memsource* mem = (t_memsource*)malloc(sizeof *mem);
+	if (!mem) {
+		return NULL;
+	}
+	mem->data = (const pduint8*)data;
+	mem->size = len;
+	mem->mapped = false;
+	return open_memsource(apiLevel, mem);
+}
+
+// Map the named file read-only into memory.
+// If successful, fill in *mem and return TRUE. Otherwise return FALSE.
+static int map_file(const char* fn, t_memsource* mem)
+{
+#ifdef WIN32
+	HANDLE hfile = CreateFileA(fn, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hfile == INVALID_HANDLE_VALUE) {
+		return FALSE;
+	}
+	LARGE_INTEGER size;
+	const void* view = NULL;
+	if (GetFileSizeEx(hfile, &size) && size.QuadPart > 0 && (SIZE_T)size.QuadPart == size.QuadPart) {
+		HANDLE hmap = CreateFileMappingA(hfile, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (hmap) {
+			view = MapViewOfFile(hmap, FILE_MAP_READ, 0, 0, 0);
+			// the view keeps the mapping alive
+			CloseHandle(hmap);
+		}
+	}
+	CloseHandle(hfile);
+	if (!view) {
+		return FALSE;
+	}
+	mem->data = (const pduint8*)view;
+	mem->size = size.QuadPart;
+#else
+	int fd = open(fn, O_RDONLY);
+	if (fd < 0) {
+		return FALSE;
+	}
+	struct stat st;
+	void* view = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && st.st_size > 0 && (pduint64)st.st_size <= (size_t)-1) {
+		view = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	}
+	// the mapping keeps the file alive
+	close(fd);
+	if (view == MAP_FAILED) {
+		return FALSE;
+	}
+	mem->data = (const pduint8*)view;
+	mem->size = (pduint64)st.st_size;
+#endif
+	mem->mapped = true;
+	return TRUE;
+}
+
+t_pdfrasreader* pdfrasread_open_mapped_filename(int apiLevel, const char* fn)
+{
+	t_memsource* mem = (t_memsource*)malloc(sizeof *mem);
+	if (!mem) {
+		return NULL;
+	}
+	if (!map_file(fn, mem)) {
+		free(mem);
+		return NULL;
+	}
+	return open_memsource(apiLevel, mem);
+}
@@ -26,6 +26,16 @@ t_pdfrasreader* pdfrasread_open_file(int apiLevel, FILE* f);
 // create a PDF/raster reader and use it to open a named file
 t_pdfrasreader* pdfrasread_open_filename(int apiLevel, const char* fn);
 
+// create a PDF/raster reader and use it to access len bytes of PDF/raster data in memory.
+// The data is not copied: it must remain valid and unchanged until the reader is closed.
+// Raw strips of this reader can be accessed with pdfrasread_get_raw_strip_view.
+t_pdfrasreader* pdfrasread_open_memory(int apiLevel, const void* data, size_t len);
+
+// create a PDF/raster reader and use it to open a named file through a read-only memory mapping.
+// The mapping is released when the reader is closed.
+// Raw strips of this reader can be accessed with pdfrasread_get_raw_strip_view.
+t_pdfrasreader* pdfrasread_open_mapped_filename(int apiLevel, const char* fn);
+
 #ifdef __cplusplus
 }
 #endif
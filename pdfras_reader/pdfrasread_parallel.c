@@ -0,0 +1,441 @@
+// sysconf, and nanosleep in pdfrasread_threads.h, are POSIX, not C99
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+#include "pdfrasread_parallel.h"
+#include "pdfrasread_threads.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#ifndef WIN32
+#include <unistd.h>
+#endif
+
+///////////////////////////////////////////////////////////////////////
+// Data Structures & Types
+
+// A page being decoded
+typedef struct t_pageslot {
+	int					page;				// page number
+	char*				pixels;				// where its strips are decoded to
+	size_t				size;				// size of the decoded page, in bytes
+	size_t				capacity;			// size of pixels, if the slot allocated it
+	int					remaining;			// number of strips not decoded yet
+	bool				failed;				// TRUE if a strip couldn't be decoded
+} t_pageslot;
+
+// One strip to decode
+typedef struct t_decodetask {
+	t_pdfrasreader*		reader;				// the (shared) reader
+	t_pageslot*			slot;				// the page it's on
+	int					strip;				// strip number on page
+	char*				dst;				// where its pixels go
+	size_t				size;				// size of its pixels
+} t_decodetask;
+
+// A thread's queue of tasks: a deque, as a ring buffer.
+// The owner takes tasks from the back, thieves from the front.
+typedef struct t_taskqueue {
+	t_mutex				lock;				// protects the rest
+	t_decodetask*		tasks;				// ring buffer
+	int					size;				// size of ring buffer
+	int					head;				// index of first (front) task
+	int					count;				// number of tasks in queue
+} t_taskqueue;
+
+// What each thread is started with
+typedef struct t_poolthread {
+	t_pdfraspool*		pool;
+	int					index;				// of its own queue
+} t_poolthread;
+
+struct t_pdfraspool {
+	t_mutex				lock;				// protects everything below, and all page slots
+	t_cond				work;				// signalled when tasks are queued (or on stop)
+	t_cond				done;				// broadcast when a strip is decoded
+	bool				stop;				// TRUE when the threads should exit
+	int					queued;				// number of tasks in all the queues
+	unsigned			next;				// queue the next task goes to
+	int					nthreads;			// number of threads (and queues)
+	int					started;			// number of threads started
+	t_thread*			threads;			// the threads
+	t_poolthread*		starts;				// and what they were started with
+	t_taskqueue*		queues;				// one per thread
+};
+
+///////////////////////////////////////////////////////////////////////
+// Task queues
+
+// Add a task at the back of a queue. Return TRUE if successful, FALSE if memory allocation fails.
+static int queue_push(t_taskqueue* q, const t_decodetask* task)
+{
+	int ok = TRUE;
+	mutex_lock(&q->lock);
+	if (q->count == q->size) {
+		int size = q->size ? q->size * 2 : 16;
+		t_decodetask* tasks = (t_decodetask*)malloc(size * sizeof *tasks);
+		if (!tasks) {
+			ok = FALSE;
+		}
+		else {
+			int i;
+			for (i = 0; i < q->count; i++) {
+				tasks[i] = q->tasks[(q->head + i) % q->size];
+			}
+			free(q->tasks);
+			q->tasks = tasks;
+			q->size = size;
+			q->head = 0;
+		}
+	}
+	if (ok) {
+		q->tasks[(q->head + q->count) % q->size] = *task;
+		q->count++;
+	}
+	mutex_unlock(&q->lock);
+	return ok;
+}
+
+// Take a task from the back (the owner) or the front (a thief) of a queue.
+// Return TRUE if there was one.
+static int queue_take(t_taskqueue* q, bool back, t_decodetask* task)
+{
+	int ok = FALSE;
+	mutex_lock(&q->lock);
+	if (q->count) {
+		if (back) {
+			*task = q->tasks[(q->head + q->count - 1) % q->size];
+		}
+		else {
+			*task = q->tasks[q->head];
+			q->head = (q->head + 1) % q->size;
+		}
+		q->count--;
+		ok = TRUE;
+	}
+	mutex_unlock(&q->lock);
+	return ok;
+}
+
+// Find a task: from the back of queue self, or else stolen from the front of another.
+// self is -1 for a thread outside the pool, which can only steal.
+// Return TRUE if one was found.
+static int find_task(t_pdfraspool* pool, int self, t_decodetask* task)
+{
+	int i, n = pool->nthreads;
+	if (self >= 0 && queue_take(&pool->queues[self], true, task)) {
+		return TRUE;
+	}
+	for (i = 1; i <= n; i++) {
+		int victim = (self + i + n) % n;
+		if (victim != self && queue_take(&pool->queues[victim], false, task)) {
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Decoding
+
+// Decode the strip of a task that has been taken from a queue
+static void run_task(t_pdfraspool* pool, const t_decodetask* task)
+{
+	size_t size = pdfrasread_read_strip_pixels(task->reader, task->slot->page, task->strip, task->dst, task->size);
+	mutex_lock(&pool->lock);
+	if (size != task->size) {
+		task->slot->failed = true;
+	}
+	task->slot->remaining--;
+	cond_broadcast(&pool->done);
+	mutex_unlock(&pool->lock);
+}
+
+// Find a task and run it. Return TRUE if there was one.
+static int help(t_pdfraspool* pool, int self)
+{
+	t_decodetask task;
+	if (!find_task(pool, self, &task)) {
+		return FALSE;
+	}
+	mutex_lock(&pool->lock);
+	pool->queued--;
+	mutex_unlock(&pool->lock);
+	run_task(pool, &task);
+	return TRUE;
+}
+
+static void worker(void* arg)
+{
+	t_poolthread* start = (t_poolthread*)arg;
+	t_pdfraspool* pool = start->pool;
+	for (;;) {
+		if (help(pool, start->index)) {
+			continue;
+		}
+		// nothing to do: sleep until there is
+		mutex_lock(&pool->lock);
+		while (!pool->stop && pool->queued == 0) {
+			cond_wait(&pool->work, &pool->lock);
+		}
+		bool stop = pool->stop;
+		mutex_unlock(&pool->lock);
+		if (stop) {
+			break;
+		}
+	}
+}
+
+// Size up page p of reader into slot, to be decoded to pixels (or to a new buffer if pixels is NULL),
+// and queue its strips. Return TRUE if successful, FALSE if p is not a valid page,
+// the page doesn't fit in bufsize bytes, or memory allocation fails.
+static int start_page(t_pdfraspool* pool, t_pdfrasreader* reader, int p, t_pageslot* slot, void* pixels, size_t bufsize)
+{
+	int s, count = pdfrasread_strip_count(reader, p);
+	size_t size = pdfrasread_page_row_size(reader, p) * pdfrasread_page_height(reader, p);
+	if (count <= 0 || size == 0) {
+		// invalid page
+		return FALSE;
+	}
+	if (pixels) {
+		if (size > bufsize) {
+			// page doesn't fit
+			return FALSE;
+		}
+	}
+	else {
+		// (re)use the slot's own buffer
+		if (size > slot->capacity) {
+			char* bigger = (char*)realloc(slot->pixels, size);
+			if (!bigger) {
+				// internal failure, memory allocation
+				return FALSE;
+			}
+			slot->pixels = bigger;
+			slot->capacity = size;
+		}
+		pixels = slot->pixels;
+	}
+	// lay the strips out one after another, and queue them round the threads.
+	// They are counted as queued first, so queued never drops below 0, and the queues
+	// they go to are claimed under the same lock, as several callers can start pages at once.
+	t_decodetask task;
+	size_t off = 0;
+	unsigned next;
+	task.reader = reader;
+	task.slot = slot;
+	slot->page = p;
+	slot->size = size;
+	slot->remaining = count;
+	slot->failed = false;
+	mutex_lock(&pool->lock);
+	pool->queued += count;
+	next = pool->next;
+	pool->next += count;
+	mutex_unlock(&pool->lock);
+	for (s = 0; s < count; s++) {
+		task.strip = s;
+		task.dst = (char*)pixels + off;
+		task.size = pdfrasread_strip_pixel_size(reader, p, s);
+		off += task.size;
+		if (task.size == 0 || off > size) {
+			// strip too big, or strips taller than the page
+			task.size = 0;
+		}
+		if (task.size == 0 || !queue_push(&pool->queues[(next + s) % pool->nthreads], &task)) {
+			// not queued: this strip, and the ones after it, count as failed
+			mutex_lock(&pool->lock);
+			slot->failed = true;
+			slot->remaining -= count - s;
+			pool->queued -= count - s;
+			cond_broadcast(&pool->work);
+			mutex_unlock(&pool->lock);
+			return TRUE;
+		}
+	}
+	mutex_lock(&pool->lock);
+	if (off != size) {
+		// strips shorter than the page
+		slot->failed = true;
+	}
+	cond_broadcast(&pool->work);
+	mutex_unlock(&pool->lock);
+	return TRUE;
+}
+
+// Wait for the strips of a started page to be decoded, decoding strips (of any page) meanwhile.
+// Return TRUE if they all were.
+static int finish_page(t_pdfraspool* pool, t_pageslot* slot)
+{
+	for (;;) {
+		mutex_lock(&pool->lock);
+		int remaining = slot->remaining, queued = pool->queued;
+		if (remaining && !queued) {
+			// the last strips are being decoded: wait for them
+			while (slot->remaining && !pool->queued) {
+				cond_wait(&pool->done, &pool->lock);
+			}
+			remaining = slot->remaining;
+		}
+		mutex_unlock(&pool->lock);
+		if (!remaining) {
+			break;
+		}
+		help(pool, -1);
+	}
+	return !slot->failed;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Public functions
+
+// Return the number of CPUs, 1 if that's not known
+static int cpu_count(void)
+{
+#ifdef WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return (int)info.dwNumberOfProcessors;
+#else
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? (int)n : 1;
+#endif
+}
+
+t_pdfraspool* pdfrasread_pool_create(int threads)
+{
+	if (threads <= 0) {
+		threads = cpu_count();
+	}
+	t_pdfraspool* pool = (t_pdfraspool*)calloc(1, sizeof(t_pdfraspool));
+	if (!pool) {
+		return NULL;
+	}
+	pool->threads = (t_thread*)calloc(threads, sizeof(t_thread));
+	pool->starts = (t_poolthread*)calloc(threads, sizeof(t_poolthread));
+	pool->queues = (t_taskqueue*)calloc(threads, sizeof(t_taskqueue));
+	if (!pool->threads || !pool->starts || !pool->queues) {
+		free(pool->threads);
+		free(pool->starts);
+		free(pool->queues);
+		free(pool);
+		return NULL;
+	}
+	mutex_init(&pool->lock);
+	cond_init(&pool->work);
+	cond_init(&pool->done);
+	int i;
+	pool->nthreads = threads;
+	for (i = 0; i < threads; i++) {
+		mutex_init(&pool->queues[i].lock);
+	}
+	for (i = 0; i < threads; i++) {
+		pool->starts[i].pool = pool;
+		pool->starts[i].index = i;
+		if (!thread_start(&pool->threads[i], worker, &pool->starts[i])) {
+			break;
+		}
+		pool->started++;
+	}
+	if (pool->started < threads) {
+		// couldn't start all the threads
+		pdfrasread_pool_destroy(pool);
+		return NULL;
+	}
+	return pool;
+}
+
+void pdfrasread_pool_destroy(t_pdfraspool* pool)
+{
+	if (!pool) {
+		return;
+	}
+	mutex_lock(&pool->lock);
+	assert(pool->queued == 0);
+	pool->stop = true;
+	cond_broadcast(&pool->work);
+	mutex_unlock(&pool->lock);
+	int i;
+	for (i = 0; i < pool->started; i++) {
+		thread_join(pool->threads[i]);
+	}
+	for (i = 0; i < pool->nthreads; i++) {
+		mutex_destroy(&pool->queues[i].lock);
+		free(pool->queues[i].tasks);
+	}
+	cond_destroy(&pool->done);
+	cond_destroy(&pool->work);
+	mutex_destroy(&pool->lock);
+	free(pool->threads);
+	free(pool->starts);
+	free(pool->queues);
+	free(pool);
+}
+
+int pdfrasread_pool_threads(t_pdfraspool* pool)
+{
+	return pool->nthreads;
+}
+
+int pdfrasread_pool_decode_page(t_pdfraspool* pool, t_pdfrasreader* reader, int p, void* buffer, size_t bufsize)
+{
+	if (!pdfrasread_is_shared(reader) && !pdfrasread_share(reader)) {
+		return FALSE;
+	}
+	t_pageslot slot;
+	memset(&slot, 0, sizeof slot);
+	if (!buffer || !start_page(pool, reader, p, &slot, buffer, bufsize)) {
+		return FALSE;
+	}
+	return finish_page(pool, &slot);
+}
+
+int pdfrasread_pool_decode_pages(t_pdfraspool* pool, t_pdfrasreader* reader, int first, int pages, pdfras_pagedone done, void* cookie)
+{
+	if (!pdfrasread_is_shared(reader) && !pdfrasread_share(reader)) {
+		return FALSE;
+	}
+	if (first < 0 || pages < 0 || first + pages > pdfrasread_page_count(reader)) {
+		// no such pages
+		return FALSE;
+	}
+	// keep enough pages on the go for every thread to have a page of strips
+	int window = 2 * pool->nthreads;
+	if (window > pages) {
+		window = pages;
+	}
+	t_pageslot* slots = (t_pageslot*)calloc(window ? window : 1, sizeof *slots);
+	if (!slots) {
+		return FALSE;
+	}
+	// ok: every page handed out so far was decoded.
+	// startable: no page has failed to start; the pages started before one that does are still handed out.
+	int started = 0, finished = 0, ok = TRUE, startable = TRUE;
+	while (startable && started < window) {
+		startable = start_page(pool, reader, first + started, &slots[started], NULL, 0);
+		started += startable;
+	}
+	// hand out the pages in order, starting another one as each is done with
+	while (finished < started) {
+		t_pageslot* slot = &slots[finished % window];
+		int decoded = finish_page(pool, slot);
+		if (ok && decoded) {
+			done(cookie, slot->page, slot->pixels, slot->size);
+		}
+		ok = ok && decoded;
+		finished++;
+		if (ok && startable && started < pages) {
+			startable = start_page(pool, reader, first + started, slot, NULL, 0);
+			started += startable;
+		}
+	}
+	// a page that failed to start fails the call, after the pages before it
+	ok = ok && started == pages;
+	int i;
+	for (i = 0; i < window; i++) {
+		free(slots[i].pixels);
+	}
+	free(slots);
+	return ok;
+}
@@ -0,0 +1,53 @@
+#ifndef H_pdfrasread_parallel
+#define H_pdfrasread_parallel
+#pragma once
+
+// Parallel decoding for the PDF/raster reader.
+// The strips of a page are independent images, and so are pages, so a pool of
+// decode threads can decode many at once. Each thread works through its own queue
+// of strips, and when that runs dry steals from the other threads' queues, so the
+// work stays spread over all of them however unevenly the strips decode.
+// The thread that asks for pages decodes strips too, while it waits for them.
+
+#include "pdfrasread.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct t_pdfraspool t_pdfraspool;
+
+// Create a pool of decode threads: threads of them, or one per CPU if threads <= 0.
+// A pool can serve any number of readers, and callers, at once.
+// Return NULL if the threads can't be started.
+t_pdfraspool* pdfrasread_pool_create(int threads);
+
+// Stop the threads and release the pool. No decoding may be under way.
+void pdfrasread_pool_destroy(t_pdfraspool* pool);
+
+// Return the number of threads in the pool.
+int pdfrasread_pool_threads(t_pdfraspool* pool);
+
+// Decoded pages are laid out as their strips are (see pdfrasread_read_strip_pixels),
+// one after another: height rows of pdfrasread_page_row_size bytes.
+// The reader is shared (see pdfrasread_share) if it isn't already, so its source
+// must be safe to read from several threads at once.
+
+// Decode page p into buffer, its strips spread over the pool.
+// Return TRUE if successful, FALSE if the reader can't be shared, p is not a valid page,
+// the page doesn't fit in buffer, or a strip can't be read or decoded.
+int pdfrasread_pool_decode_page(t_pdfraspool* pool, t_pdfrasreader* reader, int p, void* buffer, size_t bufsize);
+
+// function template: called with a decoded page. pixels are only valid during the call.
+typedef void (*pdfras_pagedone)(void* cookie, int p, const void* pixels, size_t size);
+
+// Decode pages first .. first+pages-1, several at a time over the pool, and call
+// done(cookie, ...) with each one in page order, on the calling thread.
+// Return TRUE if all the pages were decoded, FALSE if the reader can't be shared,
+// the pages don't exist, or a page can't be decoded (done is called for the pages before it).
+int pdfrasread_pool_decode_pages(t_pdfraspool* pool, t_pdfrasreader* reader, int first, int pages, pdfras_pagedone done, void* cookie);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,528 @@
+#include "pdfrasread_pixels.h"
+#include <string.h>
+#include <assert.h>
+#include <stddef.h>
+
+// SSE2 code is compiled for the same targets as the scanning kernels (see pdfrasread_scan.c).
+// Define PDFRAS_NO_SIMD to build only the portable scalar code.
+#if !defined(PDFRAS_NO_SIMD) && (defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define PIXELS_SSE2
+#include <emmintrin.h>
+#endif
+
+// each byte value with its bits in reverse order
+#define R2(n)	n, n + 2 * 64, n + 1 * 64, n + 3 * 64
+#define R4(n)	R2(n), R2(n + 2 * 16), R2(n + 1 * 16), R2(n + 3 * 16)
+#define R6(n)	R4(n), R4(n + 2 * 4), R4(n + 1 * 4), R4(n + 3 * 4)
+static const pduint8 bit_reverse[256] = { R6(0), R6(2), R6(1), R6(3) };
+
+// number of 1 bits in each byte value
+#define B2(n)	n, n + 1, n + 1, n + 2
+#define B4(n)	B2(n), B2(n + 1), B2(n + 1), B2(n + 2)
+#define B6(n)	B4(n), B4(n + 1), B4(n + 1), B4(n + 2)
+static const pduint8 bit_count[256] = { B6(0), B6(1), B6(1), B6(2) };
+
+///////////////////////////////////////////////////////////////////////
+// Column sums
+
+// Add 4 32-bit values to sums[0..4)
+#ifdef PIXELS_SSE2
+static void add4(pduint32* sums, __m128i v)
+{
+	__m128i s = _mm_loadu_si128((const __m128i*)sums);
+	_mm_storeu_si128((__m128i*)sums, _mm_add_epi32(s, v));
+}
+#endif
+
+void pdfras_pixels_sum8(pduint32* sums, const pduint8* row, size_t n)
+{
+	size_t i = 0;
+#ifdef PIXELS_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + 16 <= n; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(row + i));
+		// widen 16 bytes to 2 x 8 words, then 4 x 4 dwords
+		__m128i lo = _mm_unpacklo_epi8(v, zero);
+		__m128i hi = _mm_unpackhi_epi8(v, zero);
+		add4(sums + i, _mm_unpacklo_epi16(lo, zero));
+		add4(sums + i + 4, _mm_unpackhi_epi16(lo, zero));
+		add4(sums + i + 8, _mm_unpacklo_epi16(hi, zero));
+		add4(sums + i + 12, _mm_unpackhi_epi16(hi, zero));
+	}
+#endif
+	for (; i < n; i++) {
+		sums[i] += row[i];
+	}
+}
+
+void pdfras_pixels_sum16(pduint32* sums, const pduint8* row, size_t n)
+{
+	size_t i = 0;
+#ifdef PIXELS_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + 8 <= n; i += 8) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(row + 2 * i));
+		// swap the bytes of each word to native order, then widen to dwords
+		v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+		add4(sums + i, _mm_unpacklo_epi16(v, zero));
+		add4(sums + i + 4, _mm_unpackhi_epi16(v, zero));
+	}
+#endif
+	for (; i < n; i++) {
+		sums[i] += ((pduint32)row[2 * i] << 8) | row[2 * i + 1];
+	}
+}
+
+// Return the number of 1 bits in pixels x0 .. x1-1 of a bitonal row
+static unsigned count_ones(const pduint8* row, unsigned long x0, unsigned long x1)
+{
+	const pduint8* p = row + x0 / 8;
+	unsigned head = x0 % 8;
+	unsigned long len = x1 - x0;
+	unsigned n = 0;
+	if (head) {
+		// pixels in the first byte, which may also be the last
+		unsigned mask = 0xFFu >> head;
+		if (head + len < 8) {
+			mask &= 0xFFu << (8 - head - len);
+			return bit_count[*p & mask];
+		}
+		n = bit_count[*p++ & mask];
+		len -= 8 - head;
+	}
+	for (; len >= 8; len -= 8) {
+		n += bit_count[*p++];
+	}
+	if (len) {
+		n += bit_count[*p & (0xFFu << (8 - len)) & 0xFFu];
+	}
+	return n;
+}
+
+void pdfras_pixels_sum1(pduint32* sums, const pduint8* row, unsigned long width, unsigned factor)
+{
+	unsigned long x0;
+	if (factor == 8) {
+		// one byte per box
+		unsigned long i, bytes = width / 8;
+		for (i = 0; i < bytes; i++) {
+			sums[i] += bit_count[row[i]];
+		}
+		if (width % 8) {
+			sums[i] += count_ones(row, i * 8, width);
+		}
+		return;
+	}
+	for (x0 = 0; x0 < width; x0 += factor) {
+		unsigned long x1 = (width - x0 < factor) ? width : x0 + factor;
+		*sums++ += count_ones(row, x0, x1);
+	}
+}
+
+///////////////////////////////////////////////////////////////////////
+// Box averages
+
+void pdfras_pixels_box8(pduint8* dst, const pduint32* sums, unsigned long width, unsigned channels, unsigned factor, unsigned rows)
+{
+	unsigned long x0;
+	for (x0 = 0; x0 < width; x0 += factor) {
+		unsigned cols = (width - x0 < factor) ? (unsigned)(width - x0) : factor;
+		pduint32 n = cols * rows;
+		unsigned c, k;
+		for (c = 0; c < channels; c++) {
+			const pduint32* s = sums + x0 * channels + c;
+			pduint32 total = 0;
+			for (k = 0; k < cols; k++, s += channels) {
+				total += *s;
+			}
+			*dst++ = (pduint8)((total + n / 2) / n);
+		}
+	}
+}
+
+void pdfras_pixels_box16(pduint8* dst, const pduint32* sums, unsigned long width, unsigned channels, unsigned factor, unsigned rows)
+{
+	unsigned long x0;
+	for (x0 = 0; x0 < width; x0 += factor) {
+		unsigned cols = (width - x0 < factor) ? (unsigned)(width - x0) : factor;
+		pduint32 n = cols * rows;
+		unsigned c, k;
+		for (c = 0; c < channels; c++) {
+			const pduint32* s = sums + x0 * channels + c;
+			// 256 x 256 16-bit samples can just overflow 32 bits once rounded
+			pduint64 total = 0;
+			for (k = 0; k < cols; k++, s += channels) {
+				total += *s;
+			}
+			pduint32 v = (pduint32)((total + n / 2) / n);
+			*dst++ = (pduint8)(v >> 8);
+			*dst++ = (pduint8)v;
+		}
+	}
+}
+
+void pdfras_pixels_box1(pduint8* dst, const pduint32* sums, unsigned long width, unsigned factor, unsigned rows)
+{
+	unsigned long x0;
+	for (x0 = 0; x0 < width; x0 += factor) {
+		unsigned cols = (width - x0 < factor) ? (unsigned)(width - x0) : factor;
+		pduint32 n = cols * rows;
+		*dst++ = (pduint8)((*sums++ * 255 + n / 2) / n);
+	}
+}
+
+///////////////////////////////////////////////////////////////////////
+// Format conversion
+
+// Most pixels converted at a time, through 8-bit samples
+#define CONVERT_CHUNK	256
+
+// Expand n bitonal pixels at src to 8-bit gray, 0 or 255
+static void expand1(pduint8* dst, const pduint8* src, size_t n)
+{
+	size_t i = 0;
+#ifdef PIXELS_SSE2
+	// the bit of each byte of a pair of pixel bytes, first pixel first
+	const __m128i bits = _mm_set_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+	for (; i + 16 <= n; i += 16, src += 2) {
+		__m128i v = _mm_unpacklo_epi64(_mm_set1_epi8((char)src[0]), _mm_set1_epi8((char)src[1]));
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_cmpeq_epi8(_mm_and_si128(v, bits), bits));
+	}
+#endif
+	for (; i + 8 <= n; i += 8, src++) {
+		unsigned b;
+		for (b = 0; b < 8; b++) {
+			dst[i + b] = (*src & (0x80 >> b)) ? 255 : 0;
+		}
+	}
+	for (; i < n; i++) {
+		dst[i] = (*src & (0x80 >> (i % 8))) ? 255 : 0;
+	}
+}
+
+// Round n 16-bit big-endian samples at src to 8 bits, v * 255 / 65535
+static void narrow16(pduint8* dst, const pduint8* src, size_t n)
+{
+	size_t i = 0;
+#ifdef PIXELS_SSE2
+	// With v = 256h + l = 257h + (l - h), v / 257 rounds to h, h+1 or h-1
+	// as l - h is in -128 .. 128, above it, or below it.
+	const __m128i lowbyte = _mm_set1_epi16(0xFF);
+	const __m128i up = _mm_set1_epi16(128), down = _mm_set1_epi16(-128);
+	__m128i r[2];
+	for (; i + 16 <= n; i += 16) {
+		int k;
+		for (k = 0; k < 2; k++) {
+			__m128i v = _mm_loadu_si128((const __m128i*)(src + 2 * i + 16 * k));
+			// loaded little-endian: the high byte of each sample is in the low byte of its word
+			__m128i h = _mm_and_si128(v, lowbyte);
+			__m128i d = _mm_sub_epi16(_mm_srli_epi16(v, 8), h);
+			h = _mm_sub_epi16(h, _mm_cmpgt_epi16(d, up));
+			r[k] = _mm_add_epi16(h, _mm_cmpgt_epi16(down, d));
+		}
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(r[0], r[1]));
+	}
+#endif
+	for (; i < n; i++) {
+		pduint32 v = ((pduint32)src[2 * i] << 8) | src[2 * i + 1];
+		dst[i] = (pduint8)((v * 255 + 32895) >> 16);
+	}
+}
+
+// Convert n pixels of 8-bit gray to R G B
+static void gray_to_rgb(pduint8* dst, const pduint8* src, size_t n)
+{
+	size_t i;
+	for (i = 0; i < n; i++, dst += 3) {
+		dst[0] = dst[1] = dst[2] = src[i];
+	}
+}
+
+// Convert n pixels of 8-bit gray to B G R A
+static void gray_to_bgra(pduint8* dst, const pduint8* src, size_t n)
+{
+	size_t i = 0;
+#ifdef PIXELS_SSE2
+	const __m128i alpha = _mm_set1_epi8(-1);
+	for (; i + 16 <= n; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+		// gg gg ... and ga ga ..., interleaved to ggga ggga ...
+		__m128i gg = _mm_unpacklo_epi8(v, v), ga = _mm_unpacklo_epi8(v, alpha);
+		_mm_storeu_si128((__m128i*)(dst + 4 * i), _mm_unpacklo_epi16(gg, ga));
+		_mm_storeu_si128((__m128i*)(dst + 4 * i + 16), _mm_unpackhi_epi16(gg, ga));
+		gg = _mm_unpackhi_epi8(v, v);
+		ga = _mm_unpackhi_epi8(v, alpha);
+		_mm_storeu_si128((__m128i*)(dst + 4 * i + 32), _mm_unpacklo_epi16(gg, ga));
+		_mm_storeu_si128((__m128i*)(dst + 4 * i + 48), _mm_unpackhi_epi16(gg, ga));
+	}
+#endif
+	for (; i < n; i++) {
+		dst[4 * i] = dst[4 * i + 1] = dst[4 * i + 2] = src[i];
+		dst[4 * i + 3] = 255;
+	}
+}
+
+// Convert n pixels of R G B to 8-bit gray (luma)
+static void rgb_to_gray(pduint8* dst, const pduint8* src, size_t n)
+{
+	size_t i;
+	for (i = 0; i < n; i++, src += 3) {
+		dst[i] = (pduint8)((77 * src[0] + 150 * src[1] + 29 * src[2] + 128) >> 8);
+	}
+}
+
+// Convert n pixels of R G B to B G R A
+static void rgb_to_bgra(pduint8* dst, const pduint8* src, size_t n)
+{
+	size_t i;
+	for (i = 0; i < n; i++, src += 3, dst += 4) {
+		dst[0] = src[2];
+		dst[1] = src[1];
+		dst[2] = src[0];
+		dst[3] = 255;
+	}
+}
+
+void pdfras_pixels_convert(pduint8* dst, RasterOutputFormat out, const pduint8* src, RasterPixelFormat in, unsigned long width)
+{
+	static const unsigned out_bytes[] = { 0, 1, 3, 4 };
+	pduint8 tmp[CONVERT_CHUNK * 3];
+	unsigned long x;
+	if (out == PDFRAS_OUT_NATIVE) {
+		size_t bits = (in == PDFRAS_BITONAL) ? 1 : (in == PDFRAS_GRAY8) ? 8 : (in == PDFRAS_GRAY16) ? 16 : (in == PDFRAS_RGB24) ? 24 : 48;
+		memcpy(dst, src, ((size_t)width * bits + 7) / 8);
+		return;
+	}
+	for (x = 0; x < width; x += CONVERT_CHUNK) {
+		size_t n = (width - x < CONVERT_CHUNK) ? width - x : CONVERT_CHUNK;
+		const pduint8* s;
+		int rgb = (in == PDFRAS_RGB24 || in == PDFRAS_RGB48);
+		// 8-bit samples of this chunk: the source's own, or converted into tmp
+		switch (in) {
+		case PDFRAS_BITONAL:
+			expand1(tmp, src + x / 8, n);
+			s = tmp;
+			break;
+		case PDFRAS_GRAY16:
+			narrow16(tmp, src + 2 * x, n);
+			s = tmp;
+			break;
+		case PDFRAS_RGB24:
+			s = src + 3 * x;
+			break;
+		case PDFRAS_RGB48:
+			narrow16(tmp, src + 6 * x, 3 * n);
+			s = tmp;
+			break;
+		default:
+			s = src + x;
+			break;
+		}
+		pduint8* d = dst + x * out_bytes[out];
+		switch (out) {
+		case PDFRAS_OUT_GRAY8:
+			if (rgb) {
+				rgb_to_gray(d, s, n);
+			}
+			else {
+				memcpy(d, s, n);
+			}
+			break;
+		case PDFRAS_OUT_RGB24:
+			if (rgb) {
+				memcpy(d, s, 3 * n);
+			}
+			else {
+				gray_to_rgb(d, s, n);
+			}
+			break;
+		default:
+			if (rgb) {
+				rgb_to_bgra(d, s, n);
+			}
+			else {
+				gray_to_bgra(d, s, n);
+			}
+			break;
+		}
+	}
+}
+
+///////////////////////////////////////////////////////////////////////
+// Rotation
+
+// Transpose an 8 x 8 matrix of bits, packed in x one row per byte, first row in the
+// high byte, first column in the high bit of each byte: return its columns, packed
+// the same way (Hacker's Delight, 7-3).
+static pduint64 transpose8(pduint64 x)
+{
+	pduint64 t;
+	t = (x ^ (x >> 7)) & 0x00AA00AA00AA00AAULL;
+	x ^= t ^ (t << 7);
+	t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCULL;
+	x ^= t ^ (t << 14);
+	t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ULL;
+	x ^= t ^ (t << 28);
+	return x;
+}
+
+// Write the high n bits of v (1 .. 64) into a bitonal row, starting at pixel x
+static void put_run(pduint8* row, unsigned long x, pduint64 v, unsigned n)
+{
+	unsigned shift = x % 8;
+	pduint64 mask = (n == 64) ? ~(pduint64)0 : ~(~(pduint64)0 >> n);
+	// the run shifted into place: 8 bytes, and the top of a 9th
+	pduint64 head = (v & mask) >> shift, mhead = mask >> shift;
+	unsigned tail = shift ? (unsigned)((v & mask) << (64 - shift) >> 56) : 0;
+	unsigned mtail = shift ? (unsigned)(mask << (64 - shift) >> 56) : 0;
+	int i;
+	row += x / 8;
+	for (i = 0; i < 8; i++) {
+		unsigned m = (unsigned)(mhead >> (56 - 8 * i)) & 0xFFu;
+		unsigned b = (unsigned)(head >> (56 - 8 * i)) & 0xFFu;
+		if (m == 0xFFu) {
+			row[i] = (pduint8)b;
+		}
+		else if (m) {
+			row[i] = (pduint8)((row[i] & ~m) | b);
+		}
+		else {
+			// the run ended in the previous byte
+			return;
+		}
+	}
+	if (mtail) {
+		row[8] = (pduint8)((row[8] & ~mtail) | tail);
+	}
+}
+
+// Bitonal quarter turns: each column of 8 pixels down the band (up to 64 rows)
+// is transposed 8 x 8 bits at a time, as 64-bit words, into runs of bits that
+// are then written into the rotated rows whole.
+static void rotate_band1(pduint8* dst, size_t dst_stride, const pduint8* src, size_t src_stride,
+	unsigned long width, unsigned long height, unsigned long y, unsigned rows, int degrees)
+{
+	size_t bytes = (width + 7) / 8;
+	size_t b;
+	assert(rows <= 64);
+	// turning clockwise, the band's last row goes leftmost: stack the rows bottom up
+	unsigned long col = (degrees == 90) ? height - y - rows : y;
+	ptrdiff_t step = (degrees == 90) ? -(ptrdiff_t)src_stride : (ptrdiff_t)src_stride;
+	for (b = 0; b < bytes; b++) {
+		// runs[k]: the band's bits down column 8b+k, in rotated order from the high bit
+		pduint64 runs[8] = { 0 };
+		unsigned r0, k;
+		for (r0 = 0; r0 < rows; r0 += 8) {
+			unsigned n = (rows - r0 < 8) ? rows - r0 : 8;
+			const pduint8* s = src + ((degrees == 90) ? rows - 1 - r0 : r0) * src_stride + b;
+			pduint64 block;
+			if (n == 8) {
+				block = ((pduint64)s[0] << 56) | ((pduint64)s[step] << 48) |
+					((pduint64)s[2 * step] << 40) | ((pduint64)s[3 * step] << 32) |
+					((pduint64)s[4 * step] << 24) | ((pduint64)s[5 * step] << 16) |
+					((pduint64)s[6 * step] << 8) | (pduint64)s[7 * step];
+			}
+			else {
+				for (block = 0, k = 0; k < n; k++) {
+					block |= (pduint64)s[k * step] << (56 - 8 * k);
+				}
+			}
+			block = transpose8(block);
+			for (k = 0; k < 8; k++) {
+				runs[k] |= ((block >> (56 - 8 * k)) & 0xFF) << (56 - r0);
+			}
+		}
+		unsigned cols = (width - 8 * b < 8) ? (unsigned)(width - 8 * b) : 8;
+		for (k = 0; k < cols; k++) {
+			unsigned long x = 8 * b + k;
+			unsigned long out = (degrees == 90) ? x : width - 1 - x;
+			put_run(dst + out * dst_stride, col, runs[k], rows);
+		}
+	}
+}
+
+// Bitonal half turn: each row reversed, bits and all, and shifted back to the row start
+static void reverse_row1(pduint8* dst, const pduint8* src, unsigned long width)
+{
+	size_t bytes = (width + 7) / 8;
+	unsigned pad = (unsigned)(bytes * 8 - width);
+	size_t i;
+	for (i = 0; i < bytes; i++) {
+		// byte i of the fully reversed row, and the next one
+		unsigned hi = bit_reverse[src[bytes - 1 - i]];
+		unsigned lo = (i + 1 < bytes) ? bit_reverse[src[bytes - 2 - i]] : 0;
+		dst[i] = (pduint8)((hi << pad) | (lo >> (8 - pad)));
+	}
+	if (pad) {
+		// padding bits are 1, as decoded rows have them
+		dst[bytes - 1] |= (pduint8)(0xFFu >> (8 - pad));
+	}
+}
+
+// Copy a pixel of n bytes
+static void copy_pixel(pduint8* dst, const pduint8* src, unsigned n)
+{
+	if (n == 1) {
+		*dst = *src;
+	}
+	else {
+		unsigned i;
+		for (i = 0; i < n; i++) {
+			dst[i] = src[i];
+		}
+	}
+}
+
+void pdfras_pixels_rotate_band(pduint8* dst, size_t dst_stride, const pduint8* src, size_t src_stride,
+	unsigned long width, unsigned long height, unsigned long y, unsigned rows, unsigned bpp, int degrees)
+{
+	unsigned n = bpp / 8;
+	unsigned long x;
+	unsigned r;
+	if (degrees == 0) {
+		for (r = 0; r < rows; r++) {
+			memcpy(dst + (y + r) * dst_stride, src + r * src_stride, ((size_t)width * bpp + 7) / 8);
+		}
+	}
+	else if (degrees == 180) {
+		for (r = 0; r < rows; r++) {
+			const pduint8* s = src + r * src_stride;
+			pduint8* d = dst + (height - 1 - (y + r)) * dst_stride;
+			if (bpp == 1) {
+				reverse_row1(d, s, width);
+			}
+			else {
+				for (x = 0; x < width; x++) {
+					copy_pixel(d + (width - 1 - x) * n, s + x * n, n);
+				}
+			}
+		}
+	}
+	else if (bpp == 1) {
+		// 64 rows at a time
+		for (r = 0; r < rows; r += 64) {
+			unsigned n = (rows - r < 64) ? rows - r : 64;
+			rotate_band1(dst, dst_stride, src + r * src_stride, src_stride, width, height, y + r, n, degrees);
+		}
+	}
+	else {
+		// a quarter turn: pixel x of band row r lands in rotated row x (or width-1-x),
+		// column height-1-(y+r) (or y+r). The band is the cache block: down each column
+		// of it the reads stay in a few lines, and each rotated row gets a run of rows pixels.
+		for (x = 0; x < width; x++) {
+			const pduint8* s = src + x * n;
+			if (degrees == 90) {
+				pduint8* d = dst + x * dst_stride + (height - 1 - y) * n;
+				for (r = 0; r < rows; r++, s += src_stride, d -= n) {
+					copy_pixel(d, s, n);
+				}
+			}
+			else {
+				pduint8* d = dst + (width - 1 - x) * dst_stride + y * n;
+				for (r = 0; r < rows; r++, s += src_stride, d += n) {
+					copy_pixel(d, s, n);
+				}
+			}
+		}
+	}
+}
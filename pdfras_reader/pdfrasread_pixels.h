@@ -0,0 +1,58 @@
+#ifndef H_pdfrasread_pixels
+#define H_pdfrasread_pixels
+#pragma once
+
+// Pixel kernels for the PDF/raster reader: loops over rows of decoded pixels,
+// 16 bytes at a time where the CPU allows, one sample at a time otherwise.
+
+#include "pdfrasread.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Box filtering (area averaging), for reduced-resolution reads.
+// The rows of a box are added up column by column into 32-bit sums, then each
+// factor columns of sums are averaged into one output pixel. Sums don't overflow
+// for factors up to 256.
+
+// Add the n 8-bit samples at row to sums[0..n)
+void pdfras_pixels_sum8(pduint32* sums, const pduint8* row, size_t n);
+
+// Add the n 16-bit samples at row, big-endian as in PDF, to sums[0..n)
+void pdfras_pixels_sum16(pduint32* sums, const pduint8* row, size_t n);
+
+// Count the 1 (white) bits of a bitonal row of width pixels, factor pixels at a time,
+// adding the count of pixels x*factor .. x*factor+factor-1 to sums[x].
+void pdfras_pixels_sum1(pduint32* sums, const pduint8* row, unsigned long width, unsigned factor);
+
+// Average sums of rows rows of width pixels of channels samples each, boxes of factor
+// columns at a time (fewer at the right edge), into rows of ceil(width / factor) pixels:
+// 8-bit samples, 16-bit samples (big-endian), or 8-bit gray from bitonal pixel counts.
+void pdfras_pixels_box8(pduint8* dst, const pduint32* sums, unsigned long width, unsigned channels, unsigned factor, unsigned rows);
+void pdfras_pixels_box16(pduint8* dst, const pduint32* sums, unsigned long width, unsigned channels, unsigned factor, unsigned rows);
+void pdfras_pixels_box1(pduint8* dst, const pduint32* sums, unsigned long width, unsigned factor, unsigned rows);
+
+// Format conversion
+
+// Convert a row of width pixels at src, in the page format in, to the output
+// format out at dst. Conversions go through 8-bit samples:
+// bitonal pixels become 0 or 255, 16-bit samples are rounded to 8 bits,
+// gray is copied into R, G and B, and RGB is reduced to gray as luma (ITU-R BT.601).
+// PDFRAS_OUT_NATIVE copies the row as it is.
+void pdfras_pixels_convert(pduint8* dst, RasterOutputFormat out, const pduint8* src, RasterPixelFormat in, unsigned long width);
+
+// Rotation
+
+// Rotate a band of rows rows of width pixels, bpp bits each (1, 8, 16, 24 or 48),
+// at src in rows src_stride bytes apart, clockwise by degrees (0, 90, 180 or 270)
+// into a page at dst, in rows dst_stride bytes apart. The band is rows y .. y+rows-1
+// of a page height rows high. Bitonal quarter turns go 64 rows at a time, and are
+// fastest for bands that start on a multiple of 64 rows.
+void pdfras_pixels_rotate_band(pduint8* dst, size_t dst_stride, const pduint8* src, size_t src_stride,
+	unsigned long width, unsigned long height, unsigned long y, unsigned rows, unsigned bpp, int degrees);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,412 @@
+// fileno, and nanosleep in pdfrasread_threads.h, are POSIX, not C99
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+#include "pdfrasread_readerpool.h"
+#include "pdfrasread_files.h"
+#include "pdfrasread_threads.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef WIN32
+#include <io.h>
+#endif
+
+///////////////////////////////////////////////////////////////////////
+// Data Structures & Types
+
+// A file open in the pool. Allocated in one block with its path, which follows it.
+typedef struct t_pooledreader {
+	t_pdfrasreader*		reader;				// shared reader of the file
+	pduint64			size;				// size of the file when it was opened
+	pduint64			mtime;				// and its modification time
+	size_t				memory;				// memory held by the reader
+	unsigned long		loans;				// times lent out and not yet returned
+	bool				stale;				// file has changed: close the reader when it's returned
+	struct t_pooledreader*	newer;			// next more recently returned idle reader (NULL = newest)
+	struct t_pooledreader*	older;			// next less recently returned idle reader (NULL = oldest)
+	struct t_pooledreader*	next_path;		// next in the same bucket of the path hash table
+	struct t_pooledreader*	next_reader;	// next in the same bucket of the reader hash table
+	char				path[1];			// name of the file
+} t_pooledreader;
+
+struct t_pdfrasreaderpool {
+	int					apiLevel;			// API level of the readers
+	unsigned			max_open;			// most files kept open, while not lent out
+	size_t				budget;				// most memory held, while not lent out
+	t_mutex				lock;				// protects everything below
+	t_pooledreader*		newest;				// most recently returned idle reader
+	t_pooledreader*		oldest;				// least recently returned idle reader
+	t_pooledreader**	by_path;			// hash table of readers that aren't stale, by path
+	t_pooledreader**	by_reader;			// hash table of all readers, by reader
+	unsigned long		nbuckets;			// size of each hash table, a power of 2
+	t_pdfrasreaderpoolstats	stats;
+};
+
+///////////////////////////////////////////////////////////////////////
+// Files
+
+// Get the size and modification time of the named file.
+// Return TRUE if successful, FALSE if the file can't be found.
+static int stat_filename(const char* fn, pduint64* psize, pduint64* pmtime)
+{
+#ifdef WIN32
+	struct _stat64 st;
+	if (0 != _stat64(fn, &st)) {
+		return FALSE;
+	}
+#else
+	struct stat st;
+	if (0 != stat(fn, &st)) {
+		return FALSE;
+	}
+#endif
+	*psize = (pduint64)st.st_size;
+	*pmtime = (pduint64)st.st_mtime;
+	return TRUE;
+}
+
+// Get the size and modification time of an open file.
+static int stat_file(FILE* f, pduint64* psize, pduint64* pmtime)
+{
+#ifdef WIN32
+	struct _stat64 st;
+	if (0 != _fstat64(_fileno(f), &st)) {
+		return FALSE;
+	}
+#else
+	struct stat st;
+	if (0 != fstat(fileno(f), &st)) {
+		return FALSE;
+	}
+#endif
+	*psize = (pduint64)st.st_size;
+	*pmtime = (pduint64)st.st_mtime;
+	return TRUE;
+}
+
+// Open the named file, index it and share its reader, and note the size and
+// modification time of the file opened (which may have changed since it was looked up).
+// Return the new entry, not yet in the pool, or NULL if any of that fails.
+static t_pooledreader* open_pooled(int apiLevel, const char* fn)
+{
+	size_t len = strlen(fn);
+	t_pooledreader* entry = (t_pooledreader*)malloc(sizeof *entry + len);
+	if (!entry) {
+		return NULL;
+	}
+	memset(entry, 0, sizeof *entry);
+	memcpy(entry->path, fn, len + 1);
+	FILE* f = fopen(fn, "rb");
+	if (f) {
+		if (stat_file(f, &entry->size, &entry->mtime)) {
+			entry->reader = pdfrasread_open_file(apiLevel, f);
+		}
+		if (!entry->reader) {
+			// open failed, we have to close the file ourselves
+			fclose(f);
+		}
+		else if (!pdfrasread_share(entry->reader)) {
+			// internal failure, the reader can't be shared
+			pdfrasread_destroy(entry->reader);
+			entry->reader = NULL;
+		}
+	}
+	if (!entry->reader) {
+		free(entry);
+		return NULL;
+	}
+	entry->memory = pdfrasread_memory_size(entry->reader);
+	return entry;
+}
+
+///////////////////////////////////////////////////////////////////////
+// Pool
+
+static unsigned long path_hash(t_pdfrasreaderpool* pool, const char* path)
+{
+	// FNV-1a
+	pduint32 h = 2166136261u;
+	while (*path) {
+		h = (h ^ (pduint8)*path++) * 16777619u;
+	}
+	return h & (pool->nbuckets - 1);
+}
+
+static unsigned long reader_hash(t_pdfrasreaderpool* pool, const t_pdfrasreader* reader)
+{
+	size_t h = (size_t)reader / sizeof(void*);
+	return (unsigned long)(h ^ (h >> 16)) & (pool->nbuckets - 1);
+}
+
+// Return the entry for the named file, NULL if the file isn't open in the pool
+static t_pooledreader* find_path(t_pdfrasreaderpool* pool, const char* path)
+{
+	t_pooledreader* e = pool->by_path[path_hash(pool, path)];
+	while (e && strcmp(e->path, path) != 0) {
+		e = e->next_path;
+	}
+	return e;
+}
+
+// Return the entry for reader, NULL if reader isn't one of the pool's
+static t_pooledreader* find_reader(t_pdfrasreaderpool* pool, const t_pdfrasreader* reader)
+{
+	t_pooledreader* e = pool->by_reader[reader_hash(pool, reader)];
+	while (e && e->reader != reader) {
+		e = e->next_reader;
+	}
+	return e;
+}
+
+// Take an entry out of the path hash table: another can be opened for its path
+static void unlink_path(t_pdfrasreaderpool* pool, t_pooledreader* e)
+{
+	t_pooledreader** pp = &pool->by_path[path_hash(pool, e->path)];
+	while (*pp != e) {
+		pp = &(*pp)->next_path;
+	}
+	*pp = e->next_path;
+}
+
+// Take an idle entry off the list in order of return
+static void unlink_idle(t_pdfrasreaderpool* pool, t_pooledreader* e)
+{
+	if (e->newer) {
+		e->newer->older = e->older;
+	}
+	else {
+		pool->newest = e->older;
+	}
+	if (e->older) {
+		e->older->newer = e->newer;
+	}
+	else {
+		pool->oldest = e->newer;
+	}
+	e->newer = e->older = NULL;
+}
+
+// Put an entry that is no longer lent out at the most recently returned end of the list
+static void link_newest(t_pdfrasreaderpool* pool, t_pooledreader* e)
+{
+	e->older = pool->newest;
+	e->newer = NULL;
+	if (pool->newest) {
+		pool->newest->newer = e;
+	}
+	else {
+		pool->oldest = e;
+	}
+	pool->newest = e;
+}
+
+// Add a new entry to the pool, lent out once
+static void add_entry(t_pdfrasreaderpool* pool, t_pooledreader* e)
+{
+	unsigned long h = path_hash(pool, e->path);
+	e->next_path = pool->by_path[h];
+	pool->by_path[h] = e;
+	h = reader_hash(pool, e->reader);
+	e->next_reader = pool->by_reader[h];
+	pool->by_reader[h] = e;
+	e->loans = 1;
+	pool->stats.open++;
+	pool->stats.lent++;
+	pool->stats.bytes += e->memory;
+}
+
+// Take an entry out of the pool altogether, and add it to the list at *pclosing
+// (linked through next_path) to be closed once the pool is unlocked.
+static void remove_entry(t_pdfrasreaderpool* pool, t_pooledreader* e, t_pooledreader** pclosing)
+{
+	assert(e->loans == 0);
+	if (!e->stale) {
+		unlink_path(pool, e);
+		unlink_idle(pool, e);
+	}
+	t_pooledreader** pp = &pool->by_reader[reader_hash(pool, e->reader)];
+	while (*pp != e) {
+		pp = &(*pp)->next_reader;
+	}
+	*pp = e->next_reader;
+	pool->stats.open--;
+	pool->stats.bytes -= e->memory;
+	e->next_path = *pclosing;
+	*pclosing = e;
+}
+
+// The file of an entry has changed: stop lending its reader, and close it as soon
+// as it isn't lent out
+static void retire_entry(t_pdfrasreaderpool* pool, t_pooledreader* e, t_pooledreader** pclosing)
+{
+	if (e->loans == 0) {
+		remove_entry(pool, e, pclosing);
+	}
+	else {
+		unlink_path(pool, e);
+		e->stale = true;
+	}
+}
+
+// Close idle readers, least recently returned first, until the pool is within its limits
+static void evict_to_limits(t_pdfrasreaderpool* pool, t_pooledreader** pclosing)
+{
+	while (pool->oldest && (pool->stats.open > pool->max_open || pool->stats.bytes > pool->budget)) {
+		remove_entry(pool, pool->oldest, pclosing);
+		pool->stats.evictions++;
+	}
+}
+
+// Close the readers of a list of entries made by remove_entry, and free the entries
+static void close_entries(t_pooledreader* closing)
+{
+	while (closing) {
+		t_pooledreader* e = closing;
+		closing = e->next_path;
+		pdfrasread_destroy(e->reader);
+		free(e);
+	}
+}
+
+///////////////////////////////////////////////////////////////////////
+// Top-Level Public Functions
+
+t_pdfrasreaderpool* pdfrasread_readerpool_create(int apiLevel, unsigned max_open, size_t budget)
+{
+	if (apiLevel < 1 || apiLevel > PDFRAS_API_LEVEL || max_open == 0) {
+		// error, invalid parameter value
+		return NULL;
+	}
+	t_pdfrasreaderpool* pool = (t_pdfrasreaderpool*)calloc(1, sizeof *pool);
+	if (!pool) {
+		return NULL;
+	}
+	pool->apiLevel = apiLevel;
+	pool->max_open = max_open;
+	pool->budget = budget;
+	// a bucket per file kept open, give or take
+	pool->nbuckets = 16;
+	while (pool->nbuckets < max_open && pool->nbuckets < 0x100000) {
+		pool->nbuckets *= 2;
+	}
+	pool->by_path = (t_pooledreader**)calloc(pool->nbuckets, sizeof *pool->by_path);
+	pool->by_reader = (t_pooledreader**)calloc(pool->nbuckets, sizeof *pool->by_reader);
+	if (!pool->by_path || !pool->by_reader) {
+		free(pool->by_path);
+		free(pool->by_reader);
+		free(pool);
+		return NULL;
+	}
+	mutex_init(&pool->lock);
+	return pool;
+}
+
+void pdfrasread_readerpool_destroy(t_pdfrasreaderpool* pool)
+{
+	if (pool) {
+		assert(pool->stats.lent == 0);
+		t_pooledreader* closing = NULL;
+		while (pool->oldest) {
+			remove_entry(pool, pool->oldest, &closing);
+		}
+		close_entries(closing);
+		mutex_destroy(&pool->lock);
+		free(pool->by_path);
+		free(pool->by_reader);
+		free(pool);
+	}
+}
+
+t_pdfrasreader* pdfrasread_readerpool_acquire(t_pdfrasreaderpool* pool, const char* fn)
+{
+	pduint64 size, mtime;
+	if (!pool || !fn || !stat_filename(fn, &size, &mtime)) {
+		return NULL;
+	}
+	t_pooledreader* closing = NULL;
+	t_pdfrasreader* reader = NULL;
+	mutex_lock(&pool->lock);
+	t_pooledreader* e = find_path(pool, fn);
+	if (e && (e->size != size || e->mtime != mtime)) {
+		retire_entry(pool, e, &closing);
+		pool->stats.reopens++;
+		e = NULL;
+	}
+	if (e) {
+		if (e->loans++ == 0) {
+			unlink_idle(pool, e);
+			pool->stats.lent++;
+		}
+		pool->stats.hits++;
+		reader = e->reader;
+	}
+	mutex_unlock(&pool->lock);
+	close_entries(closing);
+	if (reader) {
+		return reader;
+	}
+	// Open the file with the pool unlocked: other files can be lent out meanwhile
+	t_pooledreader* opened = open_pooled(pool->apiLevel, fn);
+	if (!opened) {
+		return NULL;
+	}
+	mutex_lock(&pool->lock);
+	pool->stats.misses++;
+	e = find_path(pool, fn);
+	if (e && e->size == opened->size && e->mtime == opened->mtime) {
+		// another thread opened it first: use theirs
+		if (e->loans++ == 0) {
+			unlink_idle(pool, e);
+			pool->stats.lent++;
+		}
+		reader = e->reader;
+		opened->next_path = closing;
+		closing = opened;
+	}
+	else {
+		if (e) {
+			// another thread opened a different version of the file: it's this one now
+			retire_entry(pool, e, &closing);
+		}
+		add_entry(pool, opened);
+		reader = opened->reader;
+		evict_to_limits(pool, &closing);
+	}
+	mutex_unlock(&pool->lock);
+	close_entries(closing);
+	return reader;
+}
+
+void pdfrasread_readerpool_release(t_pdfrasreaderpool* pool, t_pdfrasreader* reader)
+{
+	if (!pool || !reader) {
+		return;
+	}
+	t_pooledreader* closing = NULL;
+	mutex_lock(&pool->lock);
+	t_pooledreader* e = find_reader(pool, reader);
+	assert(e && e->loans > 0);
+	if (e && e->loans > 0 && --e->loans == 0) {
+		pool->stats.lent--;
+		if (e->stale) {
+			remove_entry(pool, e, &closing);
+		}
+		else {
+			link_newest(pool, e);
+			evict_to_limits(pool, &closing);
+		}
+	}
+	mutex_unlock(&pool->lock);
+	close_entries(closing);
+}
+
+void pdfrasread_readerpool_stats(t_pdfrasreaderpool* pool, t_pdfrasreaderpoolstats* stats)
+{
+	mutex_lock(&pool->lock);
+	*stats = pool->stats;
+	mutex_unlock(&pool->lock);
+}
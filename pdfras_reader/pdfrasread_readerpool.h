@@ -0,0 +1,60 @@
+#ifndef H_pdfrasread_readerpool
+#define H_pdfrasread_readerpool
+#pragma once
+
+// Reader pool, for servers that open the same files over and over.
+// Opening a file parses its trailer, loads its xref table and builds its page table,
+// so opening a hot document for every request repeats the same work every time.
+// A reader pool keeps files open, as fully indexed shared readers (see pdfrasread_share),
+// and lends them out: asking for a file that is already open costs a stat of the
+// file and a hash lookup. A reader is reopened if its file's size or modification time
+// changes. Readers that aren't lent out are closed, least recently used first, to keep
+// the number of open files and the memory they hold within the pool's limits.
+// One pool can serve a whole process: it is safe to use from several threads at once.
+
+#include "pdfrasread.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct t_pdfrasreaderpool t_pdfrasreaderpool;
+
+// Counters of a reader pool
+typedef struct t_pdfrasreaderpoolstats {
+	unsigned long	hits;			// files found open in the pool
+	unsigned long	misses;			// files opened
+	unsigned long	reopens;		// of those, files changed since they were opened
+	unsigned long	evictions;		// readers closed to keep within the limits
+	unsigned long	open;			// readers open now
+	unsigned long	lent;			// how many of those are lent out
+	size_t			bytes;			// memory held by the open readers (see pdfrasread_memory_size)
+} t_pdfrasreaderpoolstats;
+
+// Create a reader pool, that creates its readers at API level apiLevel, and keeps up to
+// max_open files open, holding up to budget bytes of memory, while they aren't lent out.
+// Return NULL if an argument is invalid, or memory allocation fails.
+t_pdfrasreaderpool* pdfrasread_readerpool_create(int apiLevel, unsigned max_open, size_t budget);
+
+// Close all the readers of a pool, and release it. All its readers must have been returned.
+void pdfrasread_readerpool_destroy(t_pdfrasreaderpool* pool);
+
+// Borrow a shared reader of the named file from the pool: one that is open already, or
+// else the file is opened and indexed. The reader can be used from any number of threads,
+// like any shared reader, until it is returned with pdfrasread_readerpool_release.
+// A file is only taken to be unchanged if its size and modification time are: a rewrite
+// that keeps both shows its old contents until its reader is closed.
+// Return NULL if the file can't be opened, is not a valid PDF/raster file, or memory
+// allocation fails.
+t_pdfrasreader* pdfrasread_readerpool_acquire(t_pdfrasreaderpool* pool, const char* fn);
+
+// Return a reader borrowed from the pool. Each acquire needs a release.
+void pdfrasread_readerpool_release(t_pdfrasreaderpool* pool, t_pdfrasreader* reader);
+
+// Get the counters of a reader pool.
+void pdfrasread_readerpool_stats(t_pdfrasreaderpool* pool, t_pdfrasreaderpoolstats* stats);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
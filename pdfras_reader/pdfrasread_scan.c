@@ -0,0 +1,500 @@
+#include "pdfrasread_scan.h"
+#include <string.h>
+#include <assert.h>
+
+// SIMD implementations are compiled for x86/x64 targets that have SSE2,
+// which is every x64 target and any x86 target built with /arch:SSE2 (the default since VS2012).
+// Define PDFRAS_NO_SIMD to build only the portable scalar code.
+#if !defined(PDFRAS_NO_SIMD) && (defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define SCAN_SSE2
+#include <emmintrin.h>
+#if (defined(_MSC_VER) && _MSC_VER >= 1700) || defined(__GNUC__)
+// AVX2 code is compiled in, but only used if the CPU supports it.
+#define SCAN_AVX2
+#include <immintrin.h>
+#endif
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#if defined(__GNUC__)
+#define AVX2_FUNCTION __attribute__((target("avx2")))
+#else
+#define AVX2_FUNCTION
+#endif
+
+const pduint8 pdfras_charclass[256] = {
+	1, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 0, 1, 1, 0, 0,	// 00-0F
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,	// 10-1F
+	1, 0, 0, 0, 0, 2, 0, 0, 2, 2, 0, 0, 0, 0, 0, 2,	// 20-2F
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 0, 2, 0,	// 30-3F
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,	// 40-4F
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 0, 2, 0, 0,	// 50-5F
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,	// 60-6F
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 0, 2, 0, 0,	// 70-7F
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,	// 80-8F
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,	// 90-9F
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,	// A0-AF
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,	// B0-BF
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,	// C0-CF
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,	// D0-DF
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,	// E0-EF
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,	// F0-FF
+};
+
+///////////////////////////////////////////////////////////////////////
+// Scalar (portable) implementations
+
+static size_t scalar_space(const char* p, size_t n)
+{
+	size_t i = 0;
+	while (i < n && (pdfras_charclass[(pduint8)p[i]] & PDFRAS_CC_SPACE)) {
+		i++;
+	}
+	return i;
+}
+
+static size_t scalar_regular(const char* p, size_t n)
+{
+	size_t i = 0;
+	while (i < n && 0 == pdfras_charclass[(pduint8)p[i]]) {
+		i++;
+	}
+	return i;
+}
+
+static size_t scalar_string(const char* p, size_t n)
+{
+	size_t i = 0;
+	while (i < n && p[i] != '(' && p[i] != ')' && p[i] != '\\') {
+		i++;
+	}
+	return i;
+}
+
+static size_t scalar_find(const char* p, size_t n, const char* key, size_t len)
+{
+	size_t i = 0;
+	while (i + len <= n) {
+		const char* q = (const char*)memchr(p + i, key[0], n - len + 1 - i);
+		if (!q) {
+			break;
+		}
+		i = q - p;
+		if (0 == memcmp(p + i + 1, key + 1, len - 1)) {
+			return i;
+		}
+		i++;
+	}
+	return n;
+}
+
+#ifdef SCAN_SSE2
+// index of lowest 1 bit in m, which must be non-zero
+static unsigned lowest_bit(unsigned m)
+{
+	assert(m != 0);
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, m);
+	return index;
+#else
+	return __builtin_ctz(m);
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////
+// SSE2 implementations - 16 bytes at a time
+
+// 0xFF in each byte of v that is whitespace, 0 elsewhere
+static __m128i sse2_space_mask(__m128i v)
+{
+	__m128i m = _mm_cmpeq_epi8(v, _mm_setzero_si128());
+	m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')));
+	m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8(0x09)));
+	m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8(0x0A)));
+	m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8(0x0C)));
+	return _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8(0x0D)));
+}
+
+// 0xFF in each byte of v that is a delimiter, 0 elsewhere
+static __m128i sse2_delim_mask(__m128i v)
+{
+	__m128i m = _mm_cmpeq_epi8(v, _mm_set1_epi8('('));
+	m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8(')')));
+	m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('<')));
+	m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('>')));
+	m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('[')));
+	m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8(']')));
+	m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('{')));
+	m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('}')));
+	m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('/')));
+	return _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('%')));
+}
+
+static size_t sse2_space(const char* p, size_t n)
+{
+	size_t i;
+	for (i = 0; i + 16 <= n; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(p + i));
+		// 1 bits mark the non-whitespace bytes
+		unsigned m = ~_mm_movemask_epi8(sse2_space_mask(v)) & 0xFFFF;
+		if (m) {
+			return i + lowest_bit(m);
+		}
+	}
+	return i + scalar_space(p + i, n - i);
+}
+
+static size_t sse2_regular(const char* p, size_t n)
+{
+	size_t i;
+	for (i = 0; i + 16 <= n; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(p + i));
+		// 1 bits mark the whitespace & delimiter bytes
+		unsigned m = _mm_movemask_epi8(_mm_or_si128(sse2_space_mask(v), sse2_delim_mask(v)));
+		if (m) {
+			return i + lowest_bit(m);
+		}
+	}
+	return i + scalar_regular(p + i, n - i);
+}
+
+static size_t sse2_string(const char* p, size_t n)
+{
+	size_t i;
+	for (i = 0; i + 16 <= n; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(p + i));
+		__m128i m = _mm_cmpeq_epi8(v, _mm_set1_epi8('('));
+		m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8(')')));
+		m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\\')));
+		unsigned bits = _mm_movemask_epi8(m);
+		if (bits) {
+			return i + lowest_bit(bits);
+		}
+	}
+	return i + scalar_string(p + i, n - i);
+}
+
+// Candidates are the positions where both the first and the last byte of key match,
+// 16 at a time; only those are compared in full.
+static size_t sse2_find(const char* p, size_t n, const char* key, size_t len)
+{
+	const __m128i first = _mm_set1_epi8(key[0]);
+	const __m128i last = _mm_set1_epi8(key[len - 1]);
+	size_t i;
+	for (i = 0; i + len - 1 + 16 <= n; i += 16) {
+		__m128i f = _mm_cmpeq_epi8(first, _mm_loadu_si128((const __m128i*)(p + i)));
+		__m128i l = _mm_cmpeq_epi8(last, _mm_loadu_si128((const __m128i*)(p + i + len - 1)));
+		unsigned m = (unsigned)_mm_movemask_epi8(_mm_and_si128(f, l));
+		while (m) {
+			unsigned b = lowest_bit(m);
+			if (0 == memcmp(p + i + b + 1, key + 1, len - 2)) {
+				return i + b;
+			}
+			m &= m - 1;
+		}
+	}
+	return i + scalar_find(p + i, n - i, key, len);
+}
+#endif
+
+#ifdef SCAN_AVX2
+///////////////////////////////////////////////////////////////////////
+// AVX2 implementations - 32 bytes at a time
+//
+// Bytes are classified with two 16-entry nibble lookups (one indexed by
+// the low nibble, one by the high nibble) ANDed together. Each bit
+// stands for a group of characters sharing a high nibble:
+//		0x01	00 09 0A 0C 0D		whitespace
+//		0x02	20					whitespace
+//		0x04	25 28 29 2F			delimiters
+//		0x08	3C 3E				delimiters
+//		0x10	5B 5D 7B 7D			delimiters
+#define AVX2_SPACE_BITS		0x03
+
+// class bits of each byte of v, 0 for regular characters
+AVX2_FUNCTION static __m256i avx2_classify(__m256i v)
+{
+	const __m256i lo_lut = _mm256_setr_epi8(
+		0x03, 0, 0, 0, 0, 0x04, 0, 0, 0x04, 0x05, 0x01, 0x10, 0x09, 0x11, 0x08, 0x04,
+		0x03, 0, 0, 0, 0, 0x04, 0, 0, 0x04, 0x05, 0x01, 0x10, 0x09, 0x11, 0x08, 0x04);
+	const __m256i hi_lut = _mm256_setr_epi8(
+		0x01, 0, 0x06, 0x08, 0, 0x10, 0, 0x10, 0, 0, 0, 0, 0, 0, 0, 0,
+		0x01, 0, 0x06, 0x08, 0, 0x10, 0, 0x10, 0, 0, 0, 0, 0, 0, 0, 0);
+	const __m256i nibble = _mm256_set1_epi8(0x0F);
+	__m256i lo = _mm256_and_si256(v, nibble);
+	__m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble);
+	return _mm256_and_si256(_mm256_shuffle_epi8(lo_lut, lo), _mm256_shuffle_epi8(hi_lut, hi));
+}
+
+AVX2_FUNCTION static size_t avx2_space(const char* p, size_t n)
+{
+	size_t i;
+	for (i = 0; i + 32 <= n; i += 32) {
+		__m256i cls = avx2_classify(_mm256_loadu_si256((const __m256i*)(p + i)));
+		__m256i notspace = _mm256_cmpeq_epi8(_mm256_and_si256(cls, _mm256_set1_epi8(AVX2_SPACE_BITS)), _mm256_setzero_si256());
+		unsigned m = (unsigned)_mm256_movemask_epi8(notspace);
+		if (m) {
+			return i + lowest_bit(m);
+		}
+	}
+	return i + sse2_space(p + i, n - i);
+}
+
+AVX2_FUNCTION static size_t avx2_regular(const char* p, size_t n)
+{
+	size_t i;
+	for (i = 0; i + 32 <= n; i += 32) {
+		__m256i cls = avx2_classify(_mm256_loadu_si256((const __m256i*)(p + i)));
+		unsigned m = ~(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(cls, _mm256_setzero_si256()));
+		if (m) {
+			return i + lowest_bit(m);
+		}
+	}
+	return i + sse2_regular(p + i, n - i);
+}
+
+AVX2_FUNCTION static size_t avx2_string(const char* p, size_t n)
+{
+	size_t i;
+	for (i = 0; i + 32 <= n; i += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i*)(p + i));
+		__m256i m = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('('));
+		m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(')')));
+		m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\')));
+		unsigned bits = (unsigned)_mm256_movemask_epi8(m);
+		if (bits) {
+			return i + lowest_bit(bits);
+		}
+	}
+	return i + sse2_string(p + i, n - i);
+}
+
+AVX2_FUNCTION static size_t avx2_find(const char* p, size_t n, const char* key, size_t len)
+{
+	const __m256i first = _mm256_set1_epi8(key[0]);
+	const __m256i last = _mm256_set1_epi8(key[len - 1]);
+	size_t i;
+	for (i = 0; i + len - 1 + 32 <= n; i += 32) {
+		__m256i f = _mm256_cmpeq_epi8(first, _mm256_loadu_si256((const __m256i*)(p + i)));
+		__m256i l = _mm256_cmpeq_epi8(last, _mm256_loadu_si256((const __m256i*)(p + i + len - 1)));
+		unsigned m = (unsigned)_mm256_movemask_epi8(_mm256_and_si256(f, l));
+		while (m) {
+			unsigned b = lowest_bit(m);
+			if (0 == memcmp(p + i + b + 1, key + 1, len - 2)) {
+				return i + b;
+			}
+			m &= m - 1;
+		}
+	}
+	return i + sse2_find(p + i, n - i, key, len);
+}
+
+// TRUE if the CPU and OS support AVX2
+static int cpu_has_avx2(void)
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) {
+		return 0;
+	}
+	__cpuid(info, 1);
+	// need OSXSAVE and AVX
+	if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0) {
+		return 0;
+	}
+	// and the OS must save the YMM registers
+	if ((_xgetbv(0) & 6) != 6) {
+		return 0;
+	}
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+///////////////////////////////////////////////////////////////////////
+// Dispatch
+
+typedef size_t(*t_scanfn)(const char* p, size_t n);
+typedef size_t(*t_findfn)(const char* p, size_t n, const char* key, size_t len);
+
+// Selected implementations (all NULL until the first selection)
+// Selection always picks the same functions, so racing first calls are harmless.
+static struct {
+	t_scanfn	space;
+	t_scanfn	regular;
+	t_scanfn	string;
+	t_findfn	find;
+} scan;
+
+RasterScanLevel pdfras_scan_select(RasterScanLevel level)
+{
+	if (level == PDFRAS_SCAN_AUTO) {
+		level = PDFRAS_SCAN_AVX2;
+	}
+#ifdef SCAN_AVX2
+	if (level == PDFRAS_SCAN_AVX2 && cpu_has_avx2()) {
+		scan.space = avx2_space;
+		scan.regular = avx2_regular;
+		scan.string = avx2_string;
+		scan.find = avx2_find;
+		return PDFRAS_SCAN_AVX2;
+	}
+#endif
+#ifdef SCAN_SSE2
+	if (level >= PDFRAS_SCAN_SSE2) {
+		scan.space = sse2_space;
+		scan.regular = sse2_regular;
+		scan.string = sse2_string;
+		scan.find = sse2_find;
+		return PDFRAS_SCAN_SSE2;
+	}
+#endif
+	scan.space = scalar_space;
+	scan.regular = scalar_regular;
+	scan.string = scalar_string;
+	scan.find = scalar_find;
+	return PDFRAS_SCAN_SCALAR;
+}
+
+// Most runs in PDF syntax are short - a space or two, a short Name or number -
+// so each scan looks at the first few bytes one at a time, and only
+// hands long runs to the selected (vector) implementation.
+#define SHORT_RUN	8
+
+size_t pdfras_scan_space(const char* p, size_t n)
+{
+	size_t i, m = (n < SHORT_RUN) ? n : SHORT_RUN;
+	for (i = 0; i < m; i++) {
+		if (!(pdfras_charclass[(pduint8)p[i]] & PDFRAS_CC_SPACE)) {
+			return i;
+		}
+	}
+	if (i == n) {
+		return n;
+	}
+	if (!scan.space) {
+		pdfras_scan_select(PDFRAS_SCAN_AUTO);
+	}
+	return i + scan.space(p + i, n - i);
+}
+
+size_t pdfras_scan_regular(const char* p, size_t n)
+{
+	size_t i, m = (n < SHORT_RUN) ? n : SHORT_RUN;
+	for (i = 0; i < m; i++) {
+		if (pdfras_charclass[(pduint8)p[i]]) {
+			return i;
+		}
+	}
+	if (i == n) {
+		return n;
+	}
+	if (!scan.regular) {
+		pdfras_scan_select(PDFRAS_SCAN_AUTO);
+	}
+	return i + scan.regular(p + i, n - i);
+}
+
+size_t pdfras_scan_string(const char* p, size_t n)
+{
+	size_t i, m = (n < SHORT_RUN) ? n : SHORT_RUN;
+	for (i = 0; i < m; i++) {
+		if (p[i] == '(' || p[i] == ')' || p[i] == '\\') {
+			return i;
+		}
+	}
+	if (i == n) {
+		return n;
+	}
+	if (!scan.string) {
+		pdfras_scan_select(PDFRAS_SCAN_AUTO);
+	}
+	return i + scan.string(p + i, n - i);
+}
+
+size_t pdfras_scan_find(const char* p, size_t n, const char* key, size_t len)
+{
+	assert(len >= 2);
+	if (!scan.find) {
+		pdfras_scan_select(PDFRAS_SCAN_AUTO);
+	}
+	return scan.find(p, n, key, len);
+}
+
+///////////////////////////////////////////////////////////////////////
+// Cross-reference table decoding
+//
+// SWAR (SIMD within a register): each xref entry is handled as a few
+// 64-bit words, validating and converting 8 digits per word.
+
+// Load 8 bytes as a little-endian 64-bit word, first byte in the low bits
+static pduint64 load8(const char* p)
+{
+	const pduint8* b = (const pduint8*)p;
+	return (pduint64)b[0] | ((pduint64)b[1] << 8) | ((pduint64)b[2] << 16) | ((pduint64)b[3] << 24) |
+		((pduint64)b[4] << 32) | ((pduint64)b[5] << 40) | ((pduint64)b[6] << 48) | ((pduint64)b[7] << 56);
+}
+
+// TRUE if all 8 bytes of the word x are ASCII digits
+static int all_digits(pduint64 x)
+{
+	// every byte must be 0x30-0x3F, and still 0x30-0x3F after adding 6
+	return (x & 0xF0F0F0F0F0F0F0F0ULL) == 0x3030303030303030ULL &&
+		((x + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) == 0x3030303030303030ULL;
+}
+
+// Convert the 8 ASCII digits in x (as loaded by load8) to their value
+static pduint64 digits8(pduint64 x)
+{
+	x -= 0x3030303030303030ULL;
+	// combine adjacent digits into 2-digit, then 4-digit, then 8-digit values
+	x = (x * 10 + (x >> 8)) & 0x00FF00FF00FF00FFULL;
+	x = (x * 100 + (x >> 16)) & 0x0000FFFF0000FFFFULL;
+	x = (x * 10000 + (x >> 32)) & 0xFFFFFFFFULL;
+	return x;
+}
+
+int pdfras_scan_xref(const char* text, unsigned long count, pduint64* offsets)
+{
+	// the middle of an in-use entry, which must have generation 0
+	const pduint64 inuse = load8(" 00000 n");
+	unsigned long i;
+	for (i = 0; i < count; i++, text += 20) {
+		// end of line is SP CR, SP LF, CR LF (or CR CR)
+		if ((text[18] != ' ' && text[18] != 0x0D) ||
+			(text[19] != 0x0D && text[19] != 0x0A)) {
+			return 0;
+		}
+		// 10-digit offset, as two overlapping 8-digit words
+		pduint64 head = load8(text), tail = load8(text + 2);
+		if (!all_digits(head) || !all_digits(tail)) {
+			return 0;
+		}
+		if (load8(text + 10) == inuse) {
+			offsets[i] = (pduint64)((text[0] - '0') * 10 + (text[1] - '0')) * 100000000 + digits8(tail);
+		}
+		else {
+			// should be free, with any 5-digit generation number
+			int k;
+			if (text[10] != ' ' || text[16] != ' ' || text[17] != 'f') {
+				return 0;
+			}
+			for (k = 11; k < 16; k++) {
+				if (text[k] < '0' || text[k] > '9') {
+					return 0;
+				}
+			}
+			offsets[i] = 0;
+		}
+	}
+	return 1;
+}
@@ -0,0 +1,63 @@
+#ifndef H_pdfrasread_scan
+#define H_pdfrasread_scan
+#pragma once
+
+// Bulk byte-scanning primitives used by the PDF/raster reader's tokenizer.
+// Each one looks at a block of bytes already in memory and returns how many
+// leading bytes belong to some character class, 16 or 32 bytes at a time
+// where the CPU allows, one at a time otherwise.
+
+#include "pdfras_platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Character classes, per ISO 32000-1, 7.2.2 Character Set
+#define PDFRAS_CC_SPACE		1		// NUL, TAB, LF, FF, CR, SPACE
+#define PDFRAS_CC_DELIM		2		// ( ) < > [ ] { } / %
+
+// class bits of every byte value
+extern const pduint8 pdfras_charclass[256];
+
+// Scanning implementations
+typedef enum {
+	PDFRAS_SCAN_AUTO,				// best available on this CPU
+	PDFRAS_SCAN_SCALAR,				// byte-at-a-time, portable
+	PDFRAS_SCAN_SSE2,				// 16 bytes at a time
+	PDFRAS_SCAN_AVX2				// 32 bytes at a time
+} RasterScanLevel;
+
+// Select the scanning implementation to use.
+// Return the implementation actually selected, which may be lower than the one
+// requested if the CPU (or compiler) doesn't support it.
+// Intended for testing and benchmarking: by default the best one is used.
+RasterScanLevel pdfras_scan_select(RasterScanLevel level);
+
+// Return the number of whitespace bytes at the start of p[0..n)
+size_t pdfras_scan_space(const char* p, size_t n);
+
+// Return the number of 'regular' bytes (neither whitespace nor delimiter)
+// at the start of p[0..n)
+size_t pdfras_scan_regular(const char* p, size_t n);
+
+// Return the number of bytes at the start of p[0..n) that are ordinary
+// literal string content i.e. not '(', ')' or '\'
+size_t pdfras_scan_string(const char* p, size_t n);
+
+// Return the offset of the first occurrence of key[0..len) in p[0..n),
+// or n if there is none. len must be at least 2.
+// For finding keywords in long runs of bytes, such as the end of stream data.
+size_t pdfras_scan_find(const char* p, size_t n, const char* key, size_t len);
+
+// Decode count consecutive cross-reference table entries, the fixed 20-byte
+// "nnnnnnnnnn ggggg n<eol>" lines of a PDF xref table, into offsets[].
+// In-use entries get their byte offset, free entries get 0.
+// Return TRUE if all entries are valid, FALSE otherwise.
+// (PDF/raster restriction: in-use entries must have generation 0)
+int pdfras_scan_xref(const char* text, unsigned long count, pduint64* offsets);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,137 @@
+#ifndef H_pdfrasread_threads
+#define H_pdfrasread_threads
+#pragma once
+
+// Threads & synchronization, for the reader's own threads (not part of the API):
+// thin wrappers over Win32 or pthreads, so the code that uses them reads the same on both.
+// They are __inline (VS2013 C has no inline), so a file that uses only some doesn't warn about the rest.
+
+#include <stdlib.h>
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <time.h>
+#endif
+
+#ifdef WIN32
+typedef CRITICAL_SECTION	t_mutex;
+typedef CONDITION_VARIABLE	t_cond;
+typedef HANDLE				t_thread;
+
+static __inline void mutex_init(t_mutex* m)		{ InitializeCriticalSection(m); }
+static __inline void mutex_destroy(t_mutex* m)	{ DeleteCriticalSection(m); }
+static __inline void mutex_lock(t_mutex* m)		{ EnterCriticalSection(m); }
+static __inline void mutex_unlock(t_mutex* m)	{ LeaveCriticalSection(m); }
+static __inline void cond_init(t_cond* c)		{ InitializeConditionVariable(c); }
+static __inline void cond_destroy(t_cond* c)		{ (void)c; }
+static __inline void cond_wait(t_cond* c, t_mutex* m) { SleepConditionVariableCS(c, m, INFINITE); }
+static __inline void cond_signal(t_cond* c)		{ WakeConditionVariable(c); }
+static __inline void cond_broadcast(t_cond* c)	{ WakeAllConditionVariable(c); }
+#else
+typedef pthread_mutex_t		t_mutex;
+typedef pthread_cond_t		t_cond;
+typedef pthread_t			t_thread;
+
+static __inline void mutex_init(t_mutex* m)		{ pthread_mutex_init(m, NULL); }
+static __inline void mutex_destroy(t_mutex* m)	{ pthread_mutex_destroy(m); }
+static __inline void mutex_lock(t_mutex* m)		{ pthread_mutex_lock(m); }
+static __inline void mutex_unlock(t_mutex* m)	{ pthread_mutex_unlock(m); }
+static __inline void cond_init(t_cond* c)		{ pthread_cond_init(c, NULL); }
+static __inline void cond_destroy(t_cond* c)		{ pthread_cond_destroy(c); }
+static __inline void cond_wait(t_cond* c, t_mutex* m) { pthread_cond_wait(c, m); }
+static __inline void cond_signal(t_cond* c)		{ pthread_cond_signal(c); }
+static __inline void cond_broadcast(t_cond* c)	{ pthread_cond_broadcast(c); }
+#endif
+
+// function template: the body of a thread
+typedef void (*t_threadfn)(void* arg);
+
+// What a thread is started with (thread_start allocates it, the thread frees it)
+typedef struct t_threadstart {
+	t_threadfn			fn;
+	void*				arg;
+} t_threadstart;
+
+#ifdef WIN32
+static __inline DWORD WINAPI thread_main(LPVOID p)
+{
+	t_threadstart start = *(t_threadstart*)p;
+	free(p);
+	start.fn(start.arg);
+	return 0;
+}
+
+// Start a thread running fn(arg). Return TRUE if it started.
+static __inline int thread_start(t_thread* pt, t_threadfn fn, void* arg)
+{
+	t_threadstart* start = (t_threadstart*)malloc(sizeof *start);
+	if (!start) {
+		return 0;
+	}
+	start->fn = fn;
+	start->arg = arg;
+	*pt = CreateThread(NULL, 0, thread_main, start, 0, NULL);
+	if (*pt == NULL) {
+		free(start);
+		return 0;
+	}
+	return 1;
+}
+
+// Wait for a thread to finish.
+static __inline void thread_join(t_thread t)
+{
+	WaitForSingleObject(t, INFINITE);
+	CloseHandle(t);
+}
+
+// Sleep for ms milliseconds.
+static __inline void thread_sleep(unsigned ms)
+{
+	Sleep(ms);
+}
+#else
+static __inline void* thread_main(void* p)
+{
+	t_threadstart start = *(t_threadstart*)p;
+	free(p);
+	start.fn(start.arg);
+	return NULL;
+}
+
+// Start a thread running fn(arg). Return TRUE if it started.
+static __inline int thread_start(t_thread* pt, t_threadfn fn, void* arg)
+{
+	t_threadstart* start = (t_threadstart*)malloc(sizeof *start);
+	if (!start) {
+		return 0;
+	}
+	start->fn = fn;
+	start->arg = arg;
+	if (0 != pthread_create(pt, NULL, thread_main, start)) {
+		free(start);
+		return 0;
+	}
+	return 1;
+}
+
+// Wait for a thread to finish.
+static __inline void thread_join(t_thread t)
+{
+	pthread_join(t, NULL);
+}
+
+// Sleep for ms milliseconds.
+static __inline void thread_sleep(unsigned ms)
+{
+	struct timespec ts;
+	ts.tv_sec = ms / 1000;
+	ts.tv_nsec = (long)(ms % 1000) * 1000000L;
+	while (nanosleep(&ts, &ts) != 0) {
+		// interrupted: sleep for the rest
+	}
+}
+#endif
+
+#endif
@@ -0,0 +1,538 @@
+// reader_bench.c : time the pdf/raster reader's parsing primitives
+//
+// usage: reader_bench [file.pdf [page.g4]]
+//
+// Times the byte-scanning kernels used by the tokenizer with each
+// implementation this CPU supports (scalar, SSE2, AVX2), and xref table
+// decoding, then times opening a PDF/raster file from memory and indexing
+// all its pages (with a new reader each time, and reopening one reader),
+// reading thumbnails of its pages, scrolling down a page
+// with and without a decoded strip cache, converting rows of
+// pixels between formats, and decoding and rotating a CCITT Group 4 page -
+// by default the demo encoder's 2521 x 3279 scan.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "..\pdfras_reader\pdfrasread_files.h"
+#include "..\pdfras_reader\pdfrasread_scan.h"
+#include "..\pdfras_reader\pdfrasread_ccitt.h"
+#include "..\pdfras_reader\pdfrasread_pixels.h"
+
+static const char* level_name[] = { "auto", "scalar", "SSE2", "AVX2" };
+
+static double seconds_since(clock_t t0)
+{
+	return (double)(clock() - t0) / CLOCKS_PER_SEC;
+}
+
+// Fill buf with text that looks like the inside of large dictionaries:
+// Names, numbers, indirect references and runs of whitespace.
+static void make_dictionary_text(char* buf, size_t size)
+{
+	size_t len = 0;
+	unsigned n = 0;
+	while (len + 64 < size) {
+		switch (n % 4) {
+		case 0:
+			len += sprintf(buf + len, "/Key%u %u 0 R\r\n", n, n * 7);
+			break;
+		case 1:
+			len += sprintf(buf + len, "/Name%u /SomeLongerValue%u          ", n, n);
+			break;
+		case 2:
+			len += sprintf(buf + len, "/Box [ %u %u %u.5 %u ]\n", n, n + 1, n + 2, n + 3);
+			break;
+		default:
+			len += sprintf(buf + len, "/Sub << /A %u /B (text %u) >>\r\n                \r\n", n, n);
+			break;
+		}
+		n++;
+	}
+	memset(buf + len, ' ', size - len);
+}
+
+// Split text into tokens the way the reader's token_skip does,
+// and return the number of tokens.
+static unsigned long count_tokens(const char* p, size_t n)
+{
+	unsigned long tokens = 0;
+	size_t i = pdfras_scan_space(p, n);
+	while (i < n) {
+		int ch0 = (unsigned char)p[i++];
+		if ('/' == ch0 || !(pdfras_charclass[ch0] & PDFRAS_CC_DELIM)) {
+			// Name or regular token, runs to the next whitespace or delimiter
+			i += pdfras_scan_regular(p + i, n - i);
+		}
+		// delimiters are tokens by themselves
+		i += pdfras_scan_space(p + i, n - i);
+		tokens++;
+	}
+	return tokens;
+}
+
+static void bench_kernels(void)
+{
+	const size_t size = 1024 * 1024;
+	const int passes = 200;
+	char* text = (char*)malloc(size);
+	if (!text) {
+		return;
+	}
+	make_dictionary_text(text, size);
+	printf("-- tokenizing %d x %u KB of dictionary text --\n", passes, (unsigned)(size / 1024));
+	unsigned long expected = 0;
+	int level;
+	for (level = PDFRAS_SCAN_SCALAR; level <= PDFRAS_SCAN_AVX2; level++) {
+		if (pdfras_scan_select((RasterScanLevel)level) != level) {
+			printf("%-8s not supported\n", level_name[level]);
+			continue;
+		}
+		unsigned long tokens = 0;
+		clock_t t0 = clock();
+		int i;
+		for (i = 0; i < passes; i++) {
+			tokens = count_tokens(text, size);
+		}
+		double secs = seconds_since(t0);
+		if (!expected) {
+			expected = tokens;
+		}
+		printf("%-8s %8.1f MB/s  (%lu tokens%s)\n", level_name[level],
+			secs > 0 ? (double)size * passes / secs / 1e6 : 0.0,
+			tokens, tokens == expected ? "" : " - MISMATCH");
+	}
+	pdfras_scan_select(PDFRAS_SCAN_AUTO);
+	free(text);
+}
+
+// Decode an xref table with strtoull, field by field, as the reader used to.
+// Return TRUE if all entries are valid.
+static int decode_xref_strtoull(const char* text, unsigned long count, pduint64* offsets)
+{
+	unsigned long e;
+	for (e = 0; e < count; e++, text += 20) {
+		char *offend, *genend;
+		pduint64 offset = strtoull(text, &offend, 10);
+		unsigned long gen = strtoul(text + 10, &genend, 10);
+		if (offend != text + 10 || genend != text + 16 || (text[17] != 'n' && text[17] != 'f')) {
+			return 0;
+		}
+		offsets[e] = (text[17] == 'n' && gen == 0) ? offset : 0;
+	}
+	return 1;
+}
+
+static void bench_xref(void)
+{
+	const unsigned long count = 500000;
+	const int passes = 20;
+	char* text = (char*)malloc(count * 20 + 1);
+	pduint64* offsets = (pduint64*)malloc(count * sizeof *offsets);
+	if (!text || !offsets) {
+		free(text);
+		free(offsets);
+		return;
+	}
+	unsigned long e;
+	for (e = 0; e < count; e++) {
+		sprintf(text + e * 20, "%010lu 00000 n\r\n", e * 1000 + 15);
+	}
+	printf("-- decoding a %lu-entry xref table %d times --\n", count, passes);
+	clock_t t0 = clock();
+	int i, ok = 1;
+	for (i = 0; i < passes; i++) {
+		ok &= decode_xref_strtoull(text, count, offsets);
+	}
+	printf("%-8s %8.1f ns per entry\n", "strtoull", seconds_since(t0) * 1e9 / count / passes);
+	t0 = clock();
+	for (i = 0; i < passes; i++) {
+		ok &= pdfras_scan_xref(text, count, offsets);
+	}
+	printf("%-8s %8.1f ns per entry\n", "SWAR", seconds_since(t0) * 1e9 / count / passes);
+	if (!ok || offsets[count - 1] != (count - 1) * 1000 + 15) {
+		printf("decoding FAILED\n");
+	}
+	free(text);
+	free(offsets);
+}
+
+// Read all of file fn into memory, return NULL if that fails.
+static char* read_file(const char* fn, size_t* psize)
+{
+	FILE* f = fopen(fn, "rb");
+	if (!f) {
+		printf("cannot open %s\n", fn);
+		return NULL;
+	}
+	fseek(f, 0, SEEK_END);
+	size_t size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	char* data = (char*)malloc(size ? size : 1);
+	if (!data || size != fread(data, 1, size, f)) {
+		printf("cannot read %s\n", fn);
+		fclose(f);
+		free(data);
+		return NULL;
+	}
+	fclose(f);
+	*psize = size;
+	return data;
+}
+
+static void bench_open(const char* fn)
+{
+	size_t size;
+	char* data = read_file(fn, &size);
+	if (!data) {
+		return;
+	}
+	const int passes = 2000;
+	printf("-- open & index all pages of %s, %d times --\n", fn, passes);
+	int level;
+	for (level = PDFRAS_SCAN_SCALAR; level <= PDFRAS_SCAN_AVX2; level++) {
+		if (pdfras_scan_select((RasterScanLevel)level) != level) {
+			continue;
+		}
+		clock_t t0 = clock();
+		int i, pages = 0;
+		for (i = 0; i < passes; i++) {
+			t_pdfrasreader* reader = pdfrasread_open_memory(PDFRAS_API_LEVEL, data, size);
+			if (!reader) {
+				printf("%s is not a valid PDF/raster file\n", fn);
+				free(data);
+				return;
+			}
+			pages = pdfrasread_page_count(reader);
+			int p;
+			for (p = 0; p < pages; p++) {
+				pdfrasread_page_width(reader, p);
+			}
+			pdfrasread_destroy(reader);
+		}
+		double secs = seconds_since(t0);
+		printf("%-8s %8.1f us per open (%d pages)\n", level_name[level], secs * 1e6 / passes, pages);
+	}
+	pdfras_scan_select(PDFRAS_SCAN_AUTO);
+	free(data);
+}
+
+// A file in memory, as a source for bench_reopen and bench_scan_open
+typedef struct t_membuf {
+	const char*		data;
+	size_t			size;
+	unsigned long	reads;			// reads of it
+	unsigned long	seeks;			// of those, reads that didn't start where the last one ended
+	pduint64		next;			// where the last read ended
+} t_membuf;
+
+static size_t membuf_reader(void* source, pduint64 offset, size_t length, char* buffer)
+{
+	t_membuf* mem = (t_membuf*)source;
+	mem->reads++;
+	if (offset != mem->next) {
+		mem->seeks++;
+	}
+	mem->next = offset + length;
+	if (offset >= mem->size) {
+		return 0;
+	}
+	if (length > mem->size - offset) {
+		length = (size_t)(mem->size - offset);
+	}
+	memcpy(buffer, mem->data + offset, length);
+	return length;
+}
+
+static int membuf_sizer(void* source, pduint64* psize)
+{
+	*psize = ((t_membuf*)source)->size;
+	return TRUE;
+}
+
+// Open a file and index all its pages, repeatedly: with a new reader each time,
+// and with one reader, reopened each time.
+static void bench_reopen(const char* fn)
+{
+	t_membuf mem = { 0 };
+	mem.data = read_file(fn, &mem.size);
+	if (!mem.data) {
+		return;
+	}
+	const int passes = 2000;
+	printf("-- open & index all pages of %s, %d times, with new or reused readers --\n", fn, passes);
+	int reuse;
+	for (reuse = 0; reuse <= 1; reuse++) {
+		t_pdfrasreader* reader = NULL;
+		clock_t t0 = clock();
+		int i, ok = 1;
+		for (i = 0; ok && i < passes; i++) {
+			if (!reader) {
+				reader = pdfrasread_create64(PDFRAS_API_LEVEL, &membuf_reader, NULL);
+				pdfrasread_set_sizer(reader, &membuf_sizer);
+			}
+			ok = pdfrasread_reopen(reader, &mem);
+			int p, pages = pdfrasread_page_count(reader);
+			for (p = 0; p < pages; p++) {
+				pdfrasread_page_width(reader, p);
+			}
+			if (!reuse) {
+				pdfrasread_destroy(reader);
+				reader = NULL;
+			}
+		}
+		double secs = seconds_since(t0);
+		pdfrasread_destroy(reader);
+		if (!ok) {
+			printf("%s is not a valid PDF/raster file\n", fn);
+			break;
+		}
+		printf("%-8s %8.1f us per file\n", reuse ? "reused" : "new", secs * 1e6 / passes);
+	}
+	free((void*)mem.data);
+}
+
+// Open a file and index all its pages, eagerly and by sequential scan: reads of the
+// source, how many of them seek, and time taken.
+static void bench_scan_open(const char* fn)
+{
+	t_membuf mem = { 0 };
+	mem.data = read_file(fn, &mem.size);
+	if (!mem.data) {
+		return;
+	}
+	const int passes = 500;
+	printf("-- open & index all pages of %s, %d times, eagerly or by sequential scan --\n", fn, passes);
+	int scan;
+	for (scan = 0; scan <= 1; scan++) {
+		t_pdfrasreader* reader = pdfrasread_create64(PDFRAS_API_LEVEL, &membuf_reader, NULL);
+		pdfrasread_set_sizer(reader, &membuf_sizer);
+		pdfrasread_set_open_mode(reader, scan ? PDFRAS_OPEN_SCAN : PDFRAS_OPEN_EAGER);
+		unsigned long reads = 0, seeks = 0;
+		clock_t t0 = clock();
+		int i, ok = 1;
+		for (i = 0; ok && i < passes; i++) {
+			mem.reads = mem.seeks = 0;
+			mem.next = 0;
+			ok = pdfrasread_reopen(reader, &mem);
+			int p, pages = pdfrasread_page_count(reader);
+			for (p = 0; p < pages; p++) {
+				pdfrasread_page_width(reader, p);
+			}
+			reads = mem.reads;
+			seeks = mem.seeks;
+		}
+		double secs = seconds_since(t0);
+		pdfrasread_destroy(reader);
+		if (!ok) {
+			printf("%s is not a valid PDF/raster file\n", fn);
+			break;
+		}
+		printf("%-8s %8.1f us per file, %lu reads, %lu seeks\n", scan ? "scan" : "eager", secs * 1e6 / passes, reads, seeks);
+	}
+	free((void*)mem.data);
+}
+
+// Read every page of a file that the reader can decode, reduced by 1/8, repeatedly.
+static void bench_reduced(const char* fn)
+{
+	size_t size;
+	char* data = read_file(fn, &size);
+	if (!data) {
+		return;
+	}
+	t_pdfrasreader* reader = pdfrasread_open_memory(PDFRAS_API_LEVEL, data, size);
+	if (!reader) {
+		printf("%s is not a valid PDF/raster file\n", fn);
+		free(data);
+		return;
+	}
+	const int passes = 50, factor = 8;
+	printf("-- 1/%d thumbnails of the pages of %s, %d times --\n", factor, fn, passes);
+	int p;
+	for (p = 0; p < pdfrasread_page_count(reader); p++) {
+		size_t stride = pdfrasread_reduced_row_size(reader, p, factor);
+		int height = (pdfrasread_page_height(reader, p) + factor - 1) / factor;
+		void* pixels = malloc(stride * height);
+		if (!pixels) {
+			break;
+		}
+		clock_t t0 = clock();
+		int i, ok = 1;
+		for (i = 0; ok && i < passes; i++) {
+			ok = pdfrasread_read_page_reduced(reader, p, factor, pixels, stride);
+		}
+		double secs = seconds_since(t0);
+		if (ok) {
+			double pixels_read = (double)pdfrasread_page_width(reader, p) * pdfrasread_page_height(reader, p) * passes;
+			printf("page %-3d %8.1f pages/s  %8.1f Mpixels/s\n", p,
+				secs > 0 ? passes / secs : 0.0, secs > 0 ? pixels_read / secs / 1e6 : 0.0);
+		}
+		free(pixels);
+	}
+	pdfrasread_destroy(reader);
+	free(data);
+}
+
+// Scroll a viewport down page p of a file and back up, reading it as regions,
+// with and without a decoded strip cache.
+static void bench_scroll(const char* fn, int p)
+{
+	size_t size;
+	char* data = read_file(fn, &size);
+	if (!data) {
+		return;
+	}
+	t_pdfrasreader* reader = pdfrasread_open_memory(PDFRAS_API_LEVEL, data, size);
+	if (!reader || p >= pdfrasread_page_count(reader)) {
+		printf("%s has no page %d\n", fn, p);
+		pdfrasread_destroy(reader);
+		free(data);
+		return;
+	}
+	int width = pdfrasread_page_width(reader, p), height = pdfrasread_page_height(reader, p);
+	int view = height / 4, step = height / 40;
+	size_t stride = pdfrasread_page_row_size(reader, p);
+	void* pixels = malloc(stride * view);
+	printf("-- scrolling a %d-row view down page %d of %s and back, %d rows at a time --\n", view, p, fn, step);
+	int cached;
+	for (cached = 0; pixels && cached <= 1; cached++) {
+		pdfrasread_set_strip_cache(reader, cached ? 64 * 1024 * 1024 : 0);
+		clock_t t0 = clock();
+		int y, views = 0, ok = 1;
+		for (y = 0; ok && y + view <= height; y += step, views++) {
+			ok = pdfrasread_read_region(reader, p, 0, y, width, view, pixels, stride);
+		}
+		for (y -= step; ok && y >= 0; y -= step, views++) {
+			ok = pdfrasread_read_region(reader, p, 0, y, width, view, pixels, stride);
+		}
+		double secs = seconds_since(t0);
+		if (ok) {
+			printf("%-8s %8.1f views/s\n", cached ? "cached" : "uncached", secs > 0 ? views / secs : 0.0);
+		}
+	}
+	pdfrasread_set_strip_cache(reader, 0);
+	free(pixels);
+	pdfrasread_destroy(reader);
+	free(data);
+}
+
+// Convert rows of pixels from one format to another, repeatedly.
+static void bench_convert(void)
+{
+	static const struct {
+		RasterPixelFormat	in;
+		RasterOutputFormat	out;
+		const char*			name;
+	} conversions[] = {
+		{ PDFRAS_BITONAL, PDFRAS_OUT_GRAY8, "bitonal -> gray8" },
+		{ PDFRAS_GRAY16, PDFRAS_OUT_GRAY8, "gray16 -> gray8" },
+		{ PDFRAS_GRAY8, PDFRAS_OUT_BGRA32, "gray8 -> BGRA32" },
+		{ PDFRAS_RGB24, PDFRAS_OUT_BGRA32, "RGB24 -> BGRA32" },
+		{ PDFRAS_RGB24, PDFRAS_OUT_GRAY8, "RGB24 -> gray8" },
+	};
+	const unsigned long width = 4096;
+	const int rows = 20000;
+	pduint8* src = (pduint8*)malloc(width * 6);
+	pduint8* dst = (pduint8*)malloc(width * 4);
+	if (!src || !dst) {
+		free(src);
+		free(dst);
+		return;
+	}
+	unsigned long i;
+	for (i = 0; i < width * 6; i++) {
+		src[i] = (pduint8)(i * 7);
+	}
+	printf("-- converting %d rows of %lu pixels --\n", rows, width);
+	size_t c;
+	for (c = 0; c < sizeof conversions / sizeof conversions[0]; c++) {
+		clock_t t0 = clock();
+		int r;
+		for (r = 0; r < rows; r++) {
+			pdfras_pixels_convert(dst, conversions[c].out, src, conversions[c].in, width);
+		}
+		double secs = seconds_since(t0);
+		printf("%-18s %8.1f Mpixels/s\n", conversions[c].name, secs > 0 ? (double)width * rows / secs / 1e6 : 0.0);
+	}
+	free(src);
+	free(dst);
+}
+
+// Turn a decoded bitonal page of width x height pixels a quarter turn, repeatedly,
+// 64 rows at a time as the reader does.
+static void bench_rotate(const pduint8* pixels, unsigned long width, unsigned long height)
+{
+	size_t stride = (width + 7) / 8, rotated_stride = (height + 7) / 8;
+	pduint8* rotated = (pduint8*)malloc(rotated_stride * width);
+	if (!rotated) {
+		return;
+	}
+	const int passes = 50;
+	printf("-- rotating it 90 degrees, %d times --\n", passes);
+	clock_t t0 = clock();
+	int i;
+	for (i = 0; i < passes; i++) {
+		unsigned long y;
+		for (y = 0; y < height; y += 64) {
+			unsigned rows = (height - y < 64) ? (unsigned)(height - y) : 64;
+			pdfras_pixels_rotate_band(rotated, rotated_stride, pixels + y * stride, stride, width, height, y, rows, 1, 90);
+		}
+	}
+	double secs = seconds_since(t0);
+	printf("%8.1f pages/s  %8.1f Mpixels/s\n",
+		secs > 0 ? passes / secs : 0.0,
+		secs > 0 ? (double)width * height * passes / secs / 1e6 : 0.0);
+	free(rotated);
+}
+
+// Decode a CCITT Group 4 page of width x height pixels, repeatedly.
+static void bench_ccitt(const char* fn, unsigned long width, unsigned long height)
+{
+	size_t size;
+	char* data = read_file(fn, &size);
+	if (!data) {
+		return;
+	}
+	size_t stride = (width + 7) / 8;
+	void* pixels = malloc(stride * height);
+	if (!pixels) {
+		free(data);
+		return;
+	}
+	const int passes = 200;
+	printf("-- CCITT G4 decode of %s (%lu x %lu), %d times --\n", fn, width, height, passes);
+	clock_t t0 = clock();
+	int i, ok = 1;
+	for (i = 0; i < passes; i++) {
+		ok &= pdfras_ccitt_g4_decode(data, size, width, height, pixels, stride);
+	}
+	double secs = seconds_since(t0);
+	if (!ok) {
+		printf("decoding FAILED\n");
+	}
+	else {
+		printf("%8.1f pages/s  %8.1f Mpixels/s\n",
+			secs > 0 ? passes / secs : 0.0,
+			secs > 0 ? (double)width * height * passes / secs / 1e6 : 0.0);
+		bench_rotate((const pduint8*)pixels, width, height);
+	}
+	free(pixels);
+	free(data);
+}
+
+int main(int argc, char* argv[])
+{
+	printf("pdfraster reader_bench\n");
+	bench_kernels();
+	bench_xref();
+	bench_open(argc > 1 ? argv[1] : "..\\reader_test\\valid1.pdf");
+	bench_reopen(argc > 1 ? argv[1] : "..\\reader_test\\valid1.pdf");
+	bench_scan_open(argc > 1 ? argv[1] : "..\\reader_test\\valid1.pdf");
+	bench_reduced(argc > 1 ? argv[1] : "..\\reader_test\\valid1.pdf");
+	bench_scroll(argc > 1 ? argv[1] : "..\\reader_test\\valid1.pdf", 3);
+	bench_convert();
+	bench_ccitt(argc > 2 ? argv[2] : "..\\demo_raster_encoder\\bw_ccitt_page.bin", 2521, 3279);
+	return 0;
+}
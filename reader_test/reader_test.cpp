@@ -3,9 +3,20 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include "..\pdfras_reader\pdfrasread_files.h"
+#include "..\pdfras_reader\pdfrasread_scan.h"
+#include "..\pdfras_reader\pdfrasread_async.h"
+#include "..\pdfras_reader\pdfrasread_ccitt.h"
+#include "..\pdfras_reader\pdfrasread_pixels.h"
+#include "..\pdfras_reader\pdfrasread_parallel.h"
+#include "..\pdfras_reader\pdfrasread_blockcache.h"
+#include "..\pdfras_reader\pdfrasread_readerpool.h"
 #include <assert.h>
 #include <direct.h>
+#include <string>
+#include <thread>
+#include <vector>
 
 void signature_tests()
 {
@@ -56,6 +67,15 @@ static size_t freader(void *source, pduint32 offset, size_t length, char *buffer
 	return fread(buffer, sizeof(pduint8), length, f);
 }
 
+static size_t freader64(void *source, pduint64 offset, size_t length, char *buffer)
+{
+	FILE* f = (FILE*)source;
+	if (0 != _fseeki64(f, offset, SEEK_SET)) {
+		return 0;
+	}
+	return fread(buffer, sizeof(pduint8), length, f);
+}
+
 static void fcloser(void* source)
 {
 	if (source) {
@@ -77,6 +97,34 @@ void create_destroy_tests()
 	// the source of a newly created reader is 0 (NULL)
 	assert(pdfrasread_source(reader) == NULL);
 
+	pdfrasread_destroy(reader);
+
+	// same with a 64-bit reader function
+	reader = pdfrasread_create64(PDFRAS_API_LEVEL, &freader64, &fcloser);
+	assert(reader != NULL);
+	assert(!pdfrasread_is_open(reader));
+	assert(pdfrasread_source(reader) == NULL);
+	pdfrasread_destroy(reader);
+
+	// invalid API levels are rejected
+	assert(NULL == pdfrasread_create(0, &freader, &fcloser));
+	assert(NULL == pdfrasread_create64(PDFRAS_API_LEVEL + 1, &freader64, &fcloser));
+	printf("passed\n");
+}
+
+void api_level1_tests()
+{
+	printf("-- API level 1 reader function --\n");
+	// a reader built on a 32-bit reader function still works
+	t_pdfrasreader* reader = pdfrasread_create(1, &freader, &fcloser);
+	assert(reader != NULL);
+	FILE* f = fopen("valid1.pdf", "rb");
+	assert(f != NULL);
+	assert(pdfrasread_open(reader, f));
+	assert(6 == pdfrasread_page_count(reader));
+	assert(2521 == pdfrasread_page_width(reader, 3));
+	assert(3279 == pdfrasread_page_height(reader, 3));
+	assert(pdfrasread_close(reader));
 	pdfrasread_destroy(reader);
 	printf("passed\n");
 }
@@ -173,19 +221,1777 @@ void strip_data_tests()
 	pduint8* rawstrip = (pduint8*)malloc(max_size);
 	assert(rawstrip != NULL);
 	for (int s = 0; s < strips; s++) {
-		//int h = pdfrasread_strip_height(reader, p, s);
-		//assert(h > 0);
-		//total_height += h;
+		int h = pdfrasread_strip_height(reader, p, s);
+		assert(h > 0);
+		total_height += h;
 		assert(total_height <= page_height);
 		size_t rcvd = pdfrasread_read_raw_strip(reader, p, s, rawstrip, max_size);
 		assert(rcvd <= max_size);
+		assert(rcvd == pdfrasread_strip_raw_size(reader, p, s));
 	}
-	//assert(total_height == page_height);
+	assert(total_height == page_height);
+	// strips past the end of the page don't exist
+	assert(0 == pdfrasread_strip_height(reader, p, strips));
+	assert(0 == pdfrasread_read_raw_strip(reader, p, strips, rawstrip, max_size));
 	free(rawstrip);
+	pdfrasread_destroy(reader);
 	printf("passed\n");
 } // strip_data_tests
 
 
+// check that strip views of reader match its raw strip reads
+static void check_strip_views(t_pdfrasreader* reader)
+{
+	int pages = pdfrasread_page_count(reader);
+	for (int p = 0; p < pages; p++) {
+		int strips = pdfrasread_strip_count(reader, p);
+		size_t max_size = pdfrasread_max_strip_size(reader, p);
+		char* rawstrip = (char*)malloc(max_size);
+		assert(rawstrip != NULL);
+		for (int s = 0; s < strips; s++) {
+			size_t len;
+			const void* view = pdfrasread_get_raw_strip_view(reader, p, s, &len);
+			assert(view != NULL);
+			assert(len == pdfrasread_read_raw_strip(reader, p, s, rawstrip, max_size));
+			assert(0 == memcmp(view, rawstrip, len));
+		}
+		free(rawstrip);
+	}
+}
+
+void memory_source_tests()
+{
+	printf("-- memory & mapped sources --\n");
+	// load our standard test file into memory
+	FILE* f = fopen("valid1.pdf", "rb");
+	assert(f != NULL);
+	fseek(f, 0, SEEK_END);
+	size_t size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	char* data = (char*)malloc(size);
+	assert(data != NULL);
+	assert(size == fread(data, 1, size, f));
+	fclose(f);
+
+	t_pdfrasreader* reader = pdfrasread_open_memory(PDFRAS_API_LEVEL, data, size);
+	assert(reader != NULL);
+	assert(6 == pdfrasread_page_count(reader));
+	assert(PDFRAS_RGB24 == pdfrasread_page_format(reader, 5));
+	check_strip_views(reader);
+	pdfrasread_destroy(reader);
+	// a truncated file doesn't open
+	assert(NULL == pdfrasread_open_memory(PDFRAS_API_LEVEL, data, size / 2));
+	free(data);
+
+	reader = pdfrasread_open_mapped_filename(PDFRAS_API_LEVEL, "valid1.pdf");
+	assert(reader != NULL);
+	assert(6 == pdfrasread_page_count(reader));
+	check_strip_views(reader);
+	pdfrasread_destroy(reader);
+	assert(NULL == pdfrasread_open_mapped_filename(PDFRAS_API_LEVEL, "exists.not"));
+
+	// FILE-based readers can't provide views
+	reader = pdfrasread_open_filename(PDFRAS_API_LEVEL, "valid1.pdf");
+	assert(reader != NULL);
+	size_t len;
+	assert(NULL == pdfrasread_get_raw_strip_view(reader, 0, 0, &len));
+	assert(0 == len);
+	pdfrasread_destroy(reader);
+	printf("passed\n");
+}
+
+static unsigned read_count;
+
+static size_t counting_reader(void *source, pduint64 offset, size_t length, char *buffer)
+{
+	read_count++;
+	return freader64(source, offset, length, buffer);
+}
+
+static int fsizer(void *source, pduint64 *psize)
+{
+	FILE* f = (FILE*)source;
+	if (0 != _fseeki64(f, 0, SEEK_END)) {
+		return FALSE;
+	}
+	*psize = _ftelli64(f);
+	return TRUE;
+}
+
+// open valid1.pdf and count the reads it takes to get the page count
+static unsigned count_open_reads(pdfras_fsizer sizefn)
+{
+	t_pdfrasreader* reader = pdfrasread_create64(PDFRAS_API_LEVEL, &counting_reader, &fcloser);
+	assert(reader != NULL);
+	pdfrasread_set_sizer(reader, sizefn);
+	FILE* f = fopen("valid1.pdf", "rb");
+	assert(f != NULL);
+	read_count = 0;
+	assert(pdfrasread_open(reader, f));
+	assert(6 == pdfrasread_page_count(reader));
+	unsigned reads = read_count;
+	pdfrasread_destroy(reader);
+	return reads;
+}
+
+void source_size_tests()
+{
+	printf("-- source size --\n");
+	unsigned probed = count_open_reads(NULL);
+	unsigned sized = count_open_reads(&fsizer);
+	// knowing the size, open doesn't need to probe for it
+	assert(sized < probed);
+	printf("passed\n");
+}
+
+void scan_tests()
+{
+	printf("-- byte scanning --\n");
+	// long enough to exercise the 16- and 32-byte loops
+	static const char text[] = "  \t\r\n\f\0         \r\n          /AVeryLongNameIndeed_ThatGoesOnAndOn_0123456789"
+		"<<(string text that is longer than thirty two bytes (with nesting) and \\ escapes)>>\x0B";
+	const size_t n = sizeof text - 1;
+	int level;
+	for (level = PDFRAS_SCAN_SCALAR; level <= PDFRAS_SCAN_AVX2; level++) {
+		if (pdfras_scan_select((RasterScanLevel)level) != level) {
+			// not supported on this CPU
+			continue;
+		}
+		// NUL is whitespace, VT is not
+		assert(28 == pdfras_scan_space(text, n));
+		assert(0 == pdfras_scan_space(text + 28, n - 28));
+		// regular chars run to the next delimiter
+		assert(0 == pdfras_scan_regular(text + 28, n - 28));
+		assert(46 == pdfras_scan_regular(text + 29, n - 29));
+		assert(0 == pdfras_scan_regular(text, n));
+		// string content runs to the next paren or backslash
+		assert(49 == pdfras_scan_string(text + 78, n - 78));
+		assert(12 == pdfras_scan_string(text + 128, n - 128));
+		// never past the end
+		assert(1 == pdfras_scan_regular(text + n - 1, 1));
+		assert(0 == pdfras_scan_space(text, 0));
+		// substrings, matching at the first byte, in the middle of a 32-byte block, past it
+		assert(0 == pdfras_scan_find(text, n, "  ", 2));
+		assert(29 == pdfras_scan_find(text, n, "AVery", 5));
+		assert(65 == pdfras_scan_find(text, n, "0123456789", 10));
+		assert(n - 2 == pdfras_scan_find(text, n, ">\x0B", 2));
+		// and not found
+		assert(n == pdfras_scan_find(text, n, "endstream", 9));
+		assert(n - 1 == pdfras_scan_find(text, n - 1, ">\x0B", 2));
+		assert(5 == pdfras_scan_find(text, 5, "AVery", 5));
+	}
+	pdfras_scan_select(PDFRAS_SCAN_AUTO);
+	printf("passed\n");
+}
+
+// open valid1.pdf in reader, look at every page, and return the number of window refills
+static unsigned long window_refills(t_pdfrasreader* reader)
+{
+	FILE* f = fopen("valid1.pdf", "rb");
+	assert(f != NULL);
+	assert(pdfrasread_open(reader, f));
+	assert(0 != pdfrasread_window_refills(reader));
+	assert(6 == pdfrasread_page_count(reader));
+	int p;
+	for (p = 0; p < 6; p++) {
+		assert(pdfrasread_strip_count(reader, p) > 0);
+	}
+	assert(2521 == pdfrasread_page_width(reader, 3));
+	unsigned long refills = pdfrasread_window_refills(reader);
+	// no changing the window while open
+	assert(!pdfrasread_set_window(reader, 4096, 4096));
+	assert(!pdfrasread_set_window_buffer(reader, NULL, 0));
+	pdfrasread_destroy(reader);
+	return refills;
+}
+
+void parse_window_tests()
+{
+	printf("-- parse window --\n");
+	t_pdfrasreader* reader = pdfrasread_create64(PDFRAS_API_LEVEL, &freader64, &fcloser);
+	assert(reader != NULL);
+	// invalid window sizes are rejected
+	assert(!pdfrasread_set_window(reader, 512, 4096));
+	assert(!pdfrasread_set_window(reader, 8192, 4096));
+	unsigned long adaptive = window_refills(reader);
+
+	// a small fixed window takes more reads
+	reader = pdfrasread_create64(PDFRAS_API_LEVEL, &freader64, &fcloser);
+	assert(reader != NULL);
+	assert(pdfrasread_set_window(reader, 1024, 1024));
+	unsigned long small = window_refills(reader);
+	assert(adaptive < small);
+
+	// caller-supplied window
+	static char window[8192];
+	reader = pdfrasread_create64(PDFRAS_API_LEVEL, &freader64, &fcloser);
+	assert(reader != NULL);
+	assert(!pdfrasread_set_window_buffer(reader, window, 1024));
+	assert(pdfrasread_set_window_buffer(reader, window, sizeof window));
+	// can't have a window bigger than the buffer
+	assert(!pdfrasread_set_window(reader, 4096, 2 * sizeof window));
+	window_refills(reader);
+	printf("passed\n");
+}
+
+// open valid1.pdf in the given mode, with a small window,
+// and count the reads it takes to get the width of page 0
+static unsigned count_first_page_reads(RasterOpenMode mode)
+{
+	t_pdfrasreader* reader = pdfrasread_create64(PDFRAS_API_LEVEL, &counting_reader, &fcloser);
+	assert(reader != NULL);
+	assert(pdfrasread_set_window(reader, 1024, 1024));
+	assert(pdfrasread_set_open_mode(reader, mode));
+	FILE* f = fopen("valid1.pdf", "rb");
+	assert(f != NULL);
+	read_count = 0;
+	assert(pdfrasread_open(reader, f));
+	assert(8 == pdfrasread_page_width(reader, 0));
+	unsigned reads = read_count;
+	pdfrasread_destroy(reader);
+	return reads;
+}
+
+void open_mode_tests()
+{
+	printf("-- open modes --\n");
+	t_pdfrasreader* eager = pdfrasread_open_filename(PDFRAS_API_LEVEL, "valid1.pdf");
+	assert(eager != NULL);
+	t_pdfrasreader* lazy = pdfrasread_create64(PDFRAS_API_LEVEL, &freader64, &fcloser);
+	assert(lazy != NULL);
+	assert(!pdfrasread_set_open_mode(lazy, (RasterOpenMode)99));
+	assert(pdfrasread_set_open_mode(lazy, PDFRAS_OPEN_LAZY));
+	FILE* f = fopen("valid1.pdf", "rb");
+	assert(f != NULL);
+	assert(pdfrasread_open(lazy, f));
+	// no changing the mode while open
+	assert(!pdfrasread_set_open_mode(lazy, PDFRAS_OPEN_EAGER));
+	int pages = pdfrasread_page_count(lazy);
+	assert(pages == pdfrasread_page_count(eager));
+	// pages found lazily, in any order, are the same pages
+	for (int p = pages - 1; p >= 0; p--) {
+		assert(pdfrasread_page_format(lazy, p) == pdfrasread_page_format(eager, p));
+		assert(pdfrasread_page_width(lazy, p) == pdfrasread_page_width(eager, p));
+		assert(pdfrasread_page_height(lazy, p) == pdfrasread_page_height(eager, p));
+		assert(pdfrasread_strip_count(lazy, p) == pdfrasread_strip_count(eager, p));
+		assert(pdfrasread_strip_raw_size(lazy, p, 0) == pdfrasread_strip_raw_size(eager, p, 0));
+	}
+	assert(0 == pdfrasread_page_width(lazy, pages));
+	pdfrasread_destroy(lazy);
+	pdfrasread_destroy(eager);
+
+	// looking at the first page, lazy open doesn't read every page object
+	assert(count_first_page_reads(PDFRAS_OPEN_LAZY) < count_first_page_reads(PDFRAS_OPEN_EAGER));
+	printf("passed\n");
+}
+
+// checksum of all strip data of a document, read through a cursor
+static unsigned long cursor_checksum(t_pdfrascursor* cursor)
+{
+	t_pdfrasreader* reader = pdfrasread_cursor_reader(cursor);
+	unsigned long sum = 0;
+	int pages = pdfrasread_page_count(reader);
+	for (int p = 0; p < pages; p++) {
+		int strips = pdfrasread_strip_count(reader, p);
+		for (int s = 0; s < strips; s++) {
+			size_t len;
+			const unsigned char* data = (const unsigned char*)pdfrasread_cursor_read_strip(cursor, p, s, &len);
+			assert(data != NULL);
+			assert(len == pdfrasread_strip_raw_size(reader, p, s));
+			for (size_t i = 0; i < len; i++) {
+				sum = sum * 31 + data[i];
+			}
+		}
+	}
+	return sum;
+}
+
+// read every strip of a shared reader from several threads at once
+static void check_shared_reader(t_pdfrasreader* reader)
+{
+	// can't have cursors until the reader is shared
+	assert(NULL == pdfrasread_cursor_create(reader));
+	assert(!pdfrasread_is_shared(reader));
+	assert(pdfrasread_share(reader));
+	assert(pdfrasread_is_shared(reader));
+	t_pdfrascursor* cursor = pdfrasread_cursor_create(reader);
+	assert(cursor != NULL);
+	unsigned long expected = cursor_checksum(cursor);
+	pdfrasread_cursor_destroy(cursor);
+
+	const int nthreads = 4;
+	std::vector<unsigned long> sums(nthreads);
+	std::vector<std::thread> threads;
+	for (int t = 0; t < nthreads; t++) {
+		threads.push_back(std::thread([reader, &sums, t]() {
+			t_pdfrascursor* cursor = pdfrasread_cursor_create(reader);
+			assert(cursor != NULL);
+			for (int pass = 0; pass < 10; pass++) {
+				sums[t] = cursor_checksum(cursor);
+			}
+			pdfrasread_cursor_destroy(cursor);
+		}));
+	}
+	for (int t = 0; t < nthreads; t++) {
+		threads[t].join();
+		assert(sums[t] == expected);
+	}
+	pdfrasread_destroy(reader);
+}
+
+void shared_reader_tests()
+{
+	printf("-- shared reader --\n");
+	check_shared_reader(pdfrasread_open_filename(PDFRAS_API_LEVEL, "valid1.pdf"));
+	check_shared_reader(pdfrasread_open_mapped_filename(PDFRAS_API_LEVEL, "valid1.pdf"));
+	// a reader that isn't open can't be shared
+	t_pdfrasreader* reader = pdfrasread_create64(PDFRAS_API_LEVEL, &freader64, &fcloser);
+	assert(reader != NULL);
+	assert(!pdfrasread_share(reader));
+	pdfrasread_destroy(reader);
+	printf("passed\n");
+}
+
+static unsigned readv_count;
+
+static size_t counting_readerv(void *source, pduint64 offset, const t_pdfrasiovec* iov, int iovcnt)
+{
+	readv_count++;
+	size_t total = 0;
+	for (int i = 0; i < iovcnt; i++) {
+		size_t n = freader64(source, offset + total, iov[i].len, (char*)iov[i].base);
+		total += n;
+		if (n < iov[i].len) {
+			break;
+		}
+	}
+	return total;
+}
+
+// read all strips of valid1.pdf with one pdfrasread_read_page_strips,
+// check them against pdfrasread_read_raw_strip, and return the number of source reads.
+static unsigned count_batch_reads(pdfras_freaderv readvfn)
+{
+	t_pdfrasreader* reader = pdfrasread_create64(PDFRAS_API_LEVEL, &counting_reader, &fcloser);
+	assert(reader != NULL);
+	pdfrasread_set_vreader(reader, readvfn);
+	FILE* f = fopen("valid1.pdf", "rb");
+	assert(f != NULL);
+	assert(pdfrasread_open(reader, f));
+	int pages = pdfrasread_page_count(reader);
+	int count = 0;
+	for (int p = 0; p < pages; p++) {
+		count += pdfrasread_strip_count(reader, p);
+	}
+	std::vector<t_pdfrasstripbuf> strips(count);
+	for (int i = 0, p = 0; p < pages; p++) {
+		for (int s = 0; s < pdfrasread_strip_count(reader, p); s++, i++) {
+			strips[i].bufsize = pdfrasread_strip_raw_size(reader, p, s);
+			strips[i].buffer = malloc(strips[i].bufsize);
+			assert(strips[i].buffer != NULL);
+		}
+	}
+	// wrong number of strip buffers
+	assert(!pdfrasread_read_page_strips(reader, 0, pages, &strips[0], count - 1));
+	// pages that don't exist
+	assert(!pdfrasread_read_page_strips(reader, 1, pages, &strips[0], count));
+	read_count = readv_count = 0;
+	assert(pdfrasread_read_page_strips(reader, 0, pages, &strips[0], count));
+	unsigned reads = read_count + readv_count;
+	for (int i = 0, p = 0; p < pages; p++) {
+		for (int s = 0; s < pdfrasread_strip_count(reader, p); s++, i++) {
+			char* raw = (char*)malloc(strips[i].bufsize);
+			assert(raw != NULL);
+			assert(strips[i].len == pdfrasread_read_raw_strip(reader, p, s, raw, strips[i].bufsize));
+			assert(0 == memcmp(raw, strips[i].buffer, strips[i].len));
+			free(raw);
+		}
+	}
+	// a buffer that's too small
+	strips[count - 1].bufsize--;
+	assert(!pdfrasread_read_page_strips(reader, pages - 1, 1, &strips[count - 1], 1));
+	for (int i = 0; i < count; i++) {
+		free(strips[i].buffer);
+	}
+	pdfrasread_destroy(reader);
+	return reads;
+}
+
+void batched_read_tests()
+{
+	printf("-- batched strip reads --\n");
+	// all the strips of valid1.pdf are close enough together to read in one go
+	assert(1 == count_batch_reads(NULL));
+	assert(1 == count_batch_reads(&counting_readerv));
+	assert(1 == readv_count);
+	printf("passed\n");
+}
+
+// Callbacks run on the reader's threads, so each request counts its own
+static void count_callback(void* cookie, t_pdfrasstripreq* req)
+{
+	// the request completes after its callback returns
+	assert(req->status == PDFRAS_REQ_PENDING);
+	++*(int*)cookie;
+}
+
+void async_tests()
+{
+	printf("-- asynchronous reads --\n");
+	t_pdfrasreader* reader = pdfrasread_open_filename(PDFRAS_API_LEVEL, "valid1.pdf");
+	assert(reader != NULL);
+	t_pdfrasasync* async = pdfrasread_async_create(reader, 3);
+	assert(async != NULL);
+	assert(pdfrasread_is_shared(reader));
+	int pages = pdfrasread_page_count(reader);
+	// queue the first strip of every page, then collect them
+	std::vector<t_pdfrasstripreq> reqs(pages);
+	std::vector<int> callbacks(pages + 1);
+	for (int p = 0; p < pages; p++) {
+		t_pdfrasstripreq& req = reqs[p];
+		memset(&req, 0, sizeof req);
+		req.page = p;
+		req.strip = 0;
+		req.bufsize = pdfrasread_max_strip_size(reader, p);
+		req.buffer = malloc(req.bufsize);
+		req.callback = &count_callback;
+		req.cookie = &callbacks[p];
+		assert(pdfrasread_async_submit(async, &req));
+	}
+	for (int p = 0; p < pages; p++) {
+		t_pdfrasstripreq& req = reqs[p];
+		assert(pdfrasread_async_complete(async, &req));
+		assert(pdfrasread_async_poll(async, &req));
+		assert(req.status == PDFRAS_REQ_DONE);
+		assert(callbacks[p] == 1);
+		char* raw = (char*)malloc(req.bufsize);
+		assert(req.len == pdfrasread_read_raw_strip(reader, p, 0, raw, req.bufsize));
+		assert(0 == memcmp(raw, req.buffer, req.len));
+		free(raw);
+	}
+	// a strip that doesn't exist
+	t_pdfrasstripreq bad = reqs[0];
+	bad.strip = 99;
+	bad.cookie = &callbacks[pages];
+	assert(pdfrasread_async_submit(async, &bad));
+	assert(!pdfrasread_async_complete(async, &bad));
+	assert(bad.status == PDFRAS_REQ_FAILED);
+	assert(callbacks[pages] == 1);
+
+	// prefetch pages, then read them
+	assert(!pdfrasread_will_need(async, pages));
+	for (int p = 0; p < pages; p++) {
+		assert(pdfrasread_will_need(async, p));
+		if (p + 1 < pages) {
+			assert(pdfrasread_will_need(async, p + 1));
+		}
+		t_pdfrasstripreq& req = reqs[p];
+		memset(req.buffer, 0, req.bufsize);
+		assert(req.len == pdfrasread_async_read_strip(async, p, 0, req.buffer, req.bufsize));
+		char* raw = (char*)malloc(req.bufsize);
+		assert(req.len == pdfrasread_read_raw_strip(reader, p, 0, raw, req.bufsize));
+		assert(0 == memcmp(raw, req.buffer, req.len));
+		free(raw);
+	}
+	pdfrasread_async_destroy(async);
+	for (int i = 0; i <= pages; i++) {
+		assert(callbacks[i] == 1);
+	}
+	for (int p = 0; p < pages; p++) {
+		free(reqs[p].buffer);
+	}
+	pdfrasread_destroy(reader);
+	printf("passed\n");
+}
+
+// Number of black (0) pixels in decoded bitonal rows, whose padding bits are 1
+static unsigned long count_black(const unsigned char* pixels, size_t size)
+{
+	unsigned long black = 0;
+	for (size_t i = 0; i < size; i++) {
+		for (int b = 0; b < 8; b++) {
+			black += !(pixels[i] & (0x80 >> b));
+		}
+	}
+	return black;
+}
+
+void strip_pixels_tests()
+{
+	printf("-- decoded strips --\n");
+	t_pdfrasreader* reader = pdfrasread_open_filename(PDFRAS_API_LEVEL, "valid1.pdf");
+	assert(reader != NULL);
+	// page 3 is a 2521 x 3279 bitonal scan, in one CCITT Group 4 strip
+	assert(PDFRAS_CCITTG4 == pdfrasread_strip_compression(reader, 3, 0));
+	size_t size = pdfrasread_strip_pixel_size(reader, 3, 0);
+	assert(size == 316 * 3279);
+	unsigned char* pixels = (unsigned char*)malloc(size);
+	assert(size == pdfrasread_read_strip_pixels(reader, 3, 0, pixels, size));
+	assert(333506 == count_black(pixels, size));
+	assert(0 == pdfrasread_read_strip_pixels(reader, 3, 0, pixels, size - 1));
+	// damaged data: the rows run out
+	size_t len = pdfrasread_strip_raw_size(reader, 3, 0);
+	unsigned char* raw = (unsigned char*)malloc(len);
+	assert(len == pdfrasread_read_raw_strip(reader, 3, 0, raw, len));
+	assert(pdfras_ccitt_g4_decode(raw, len, 2521, 3279, pixels, 316));
+	assert(!pdfras_ccitt_g4_decode(raw, len / 2, 2521, 3279, pixels, 316));
+	free(raw);
+	// uncompressed strips decode to their raw data
+	assert(PDFRAS_UNCOMPRESSED == pdfrasread_strip_compression(reader, 2, 0));
+	size_t rawsize = pdfrasread_strip_raw_size(reader, 2, 0);
+	raw = (unsigned char*)malloc(rawsize);
+	assert(rawsize == pdfrasread_read_raw_strip(reader, 2, 0, raw, rawsize));
+	assert(pdfrasread_strip_pixel_size(reader, 2, 0) == 107 * 1100);
+	assert(107 * 1100 == pdfrasread_read_strip_pixels(reader, 2, 0, pixels, size));
+	assert(0 == memcmp(raw, pixels, 107 * 1100));
+	free(raw);
+	// the reader doesn't decode JPEG
+	assert(PDFRAS_JPEG == pdfrasread_strip_compression(reader, 5, 0));
+	assert(0 == pdfrasread_read_strip_pixels(reader, 5, 0, pixels, size));
+	// (and there's no strip 1)
+	assert(PDFRAS_COMPRESSION_NULL == pdfrasread_strip_compression(reader, 5, 1));
+	pdfrasread_destroy(reader);
+
+	// same pixels through a cursor, from a mapped file
+	reader = pdfrasread_open_mapped_filename(PDFRAS_API_LEVEL, "valid1.pdf");
+	assert(reader != NULL);
+	assert(pdfrasread_share(reader));
+	t_pdfrascursor* cursor = pdfrasread_cursor_create(reader);
+	memset(pixels, 0, size);
+	assert(size == pdfrasread_cursor_read_strip_pixels(cursor, 3, 0, pixels, size));
+	assert(333506 == count_black(pixels, size));
+	pdfrasread_cursor_destroy(cursor);
+	pdfrasread_destroy(reader);
+	free(pixels);
+	printf("passed\n");
+}
+
+// Read page p row by row, n rows at a time, and check it against the decoded strips
+static void check_page_rows(t_pdfrasreader* reader, int p, int n)
+{
+	size_t row_size = pdfrasread_page_row_size(reader, p);
+	size_t page_size = row_size * pdfrasread_page_height(reader, p);
+	unsigned char* page = (unsigned char*)malloc(page_size);
+	size_t off = 0;
+	for (int s = 0; s < pdfrasread_strip_count(reader, p); s++) {
+		off += pdfrasread_read_strip_pixels(reader, p, s, page + off, page_size - off);
+	}
+	assert(off == page_size);
+	unsigned char* rows = (unsigned char*)malloc(row_size * n);
+	t_pdfrasrowiter* it = pdfrasread_page_row_begin(reader, p);
+	assert(it != NULL);
+	off = 0;
+	int got;
+	while ((got = pdfrasread_page_next_rows(it, n, rows, row_size * n)) > 0) {
+		assert(got <= n);
+		assert(0 == memcmp(page + off, rows, got * row_size));
+		off += got * row_size;
+	}
+	assert(got == 0);
+	assert(off == page_size);
+	pdfrasread_page_row_end(it);
+	free(rows);
+	free(page);
+}
+
+void page_rows_tests()
+{
+	printf("-- row iterators --\n");
+	t_pdfrasreader* reader = pdfrasread_open_filename(PDFRAS_API_LEVEL, "valid1.pdf");
+	assert(reader != NULL);
+	assert(316 == pdfrasread_page_row_size(reader, 3));
+	assert(175 * 3 == pdfrasread_page_row_size(reader, 4));
+	// uncompressed & CCITT pages, in chunks of various sizes
+	for (int n = 1; n <= 1000; n *= 7) {
+		check_page_rows(reader, 2, n);
+		check_page_rows(reader, 3, n);
+	}
+	check_page_rows(reader, 0, 3);
+	check_page_rows(reader, 1, 100);
+	// JPEG pages can't be read row by row
+	assert(NULL == pdfrasread_page_row_begin(reader, 5));
+	assert(NULL == pdfrasread_page_row_begin(reader, 6));
+	// a buffer too small for a row
+	t_pdfrasrowiter* it = pdfrasread_page_row_begin(reader, 3);
+	char row[316];
+	assert(-1 == pdfrasread_page_next_rows(it, 1, row, 315));
+	assert(1 == pdfrasread_page_next_rows(it, 2, row, 316));
+	pdfrasread_page_row_end(it);
+	pdfrasread_destroy(reader);
+	// from a mapped file, the CCITT data is decoded in place
+	reader = pdfrasread_open_mapped_filename(PDFRAS_API_LEVEL, "valid1.pdf");
+	assert(reader != NULL);
+	check_page_rows(reader, 3, 64);
+	pdfrasread_destroy(reader);
+	printf("passed\n");
+}
+
+// Gray value of pixel (x, y) of the page made by make_striped_file
+static unsigned char striped_pixel(int x, int y)
+{
+	return (unsigned char)(x + 3 * y);
+}
+
+// Write a one-page PDF/raster file to a temporary file: an 8-bit gray page width
+// pixels wide, in strips uncompressed strips of rows rows each.
+// The signature lines are copied from valid1.pdf.
+static FILE* make_striped_file(int width, int strips, int rows)
+{
+	FILE* valid = fopen("valid1.pdf", "rb");
+	assert(valid != NULL);
+	std::string pdf;
+	for (int eols = 0, ch; eols < 2 && (ch = fgetc(valid)) != EOF; ) {
+		pdf += (char)ch;
+		eols += (ch == '\n');
+	}
+	fclose(valid);
+	std::vector<size_t> offsets;
+	char text[256];
+	offsets.push_back(pdf.size());
+	pdf += "1 0 obj << /Type /Catalog /Pages 2 0 R >>\nendobj\n";
+	offsets.push_back(pdf.size());
+	pdf += "2 0 obj << /Type /Pages /Kids [ 3 0 R ] /Count 1 >>\nendobj\n";
+	offsets.push_back(pdf.size());
+	sprintf(text, "3 0 obj << /Type /Page /Parent 2 0 R /MediaBox [ 0 0 %d %d ] /Resources << /XObject << ", width, strips * rows);
+	pdf += text;
+	for (int s = 0; s < strips; s++) {
+		sprintf(text, "/strip%d %d 0 R ", s, 4 + s);
+		pdf += text;
+	}
+	pdf += ">> >> >>\nendobj\n";
+	for (int s = 0; s < strips; s++) {
+		offsets.push_back(pdf.size());
+		sprintf(text, "%d 0 obj << /Subtype /Image /Type /XObject /Width %d /Height %d /BitsPerComponent 8 "
+			"/ColorSpace /DeviceGray /Length %d >>stream\n", 4 + s, width, rows, width * rows);
+		pdf += text;
+		for (int y = s * rows; y < (s + 1) * rows; y++) {
+			for (int x = 0; x < width; x++) {
+				pdf += (char)striped_pixel(x, y);
+			}
+		}
+		pdf += "\nendstream\nendobj\n";
+	}
+	size_t xref = pdf.size();
+	sprintf(text, "xref\n0 %d\n0000000000 65535 f\r\n", (int)offsets.size() + 1);
+	pdf += text;
+	for (size_t i = 0; i < offsets.size(); i++) {
+		sprintf(text, "%010lu 00000 n\r\n", (unsigned long)offsets[i]);
+		pdf += text;
+	}
+	sprintf(text, "trailer\n<< /Root 1 0 R /Size %d >>\nstartxref\n%lu\n%%%%EOF\n", (int)offsets.size() + 1, (unsigned long)xref);
+	pdf += text;
+	FILE* f = tmpfile();
+	assert(f != NULL);
+	assert(pdf.size() == fwrite(pdf.data(), 1, pdf.size(), f));
+	return f;
+}
+
+void region_tests()
+{
+	printf("-- region reads --\n");
+	// a 100 x 400 page in 40 strips of 10 rows
+	t_pdfrasreader* reader = pdfrasread_create64(PDFRAS_API_LEVEL, &counting_reader, &fcloser);
+	assert(reader != NULL);
+	assert(pdfrasread_open(reader, make_striped_file(100, 40, 10)));
+	assert(40 == pdfrasread_strip_count(reader, 0));
+	assert(400 == pdfrasread_page_height(reader, 0));
+	// a 30 x 10 box across two strips takes two reads
+	unsigned char box[40 * 10];
+	read_count = 0;
+	assert(pdfrasread_read_region(reader, 0, 10, 195, 30, 10, box, 40));
+	assert(2 == read_count);
+	for (int y = 0; y < 10; y++) {
+		for (int x = 0; x < 30; x++) {
+			assert(box[y * 40 + x] == striped_pixel(10 + x, 195 + y));
+		}
+	}
+	// a band of whole rows, within one strip
+	unsigned char band[100 * 4];
+	read_count = 0;
+	assert(pdfrasread_read_region(reader, 0, 0, 392, 100, 4, band, 100));
+	assert(1 == read_count);
+	assert(band[0] == striped_pixel(0, 392) && band[399] == striped_pixel(99, 395));
+	// not inside the page, or rows overlapping
+	assert(!pdfrasread_read_region(reader, 0, 90, 0, 11, 1, band, 100));
+	assert(!pdfrasread_read_region(reader, 0, 0, 399, 1, 2, band, 100));
+	assert(!pdfrasread_read_region(reader, 0, 0, 0, 30, 2, band, 29));
+	pdfrasread_destroy(reader);
+
+	// a CCITT page, cropped at a column that's not on a byte boundary
+	reader = pdfrasread_open_filename(PDFRAS_API_LEVEL, "valid1.pdf");
+	assert(reader != NULL);
+	size_t size = pdfrasread_strip_pixel_size(reader, 3, 0);
+	unsigned char* page = (unsigned char*)malloc(size);
+	assert(size == pdfrasread_read_strip_pixels(reader, 3, 0, page, size));
+	const int x0 = 1013, y0 = 1500, w = 301, h = 200, stride = (w + 7) / 8;
+	unsigned char* region = (unsigned char*)malloc(stride * h);
+	assert(pdfrasread_read_region(reader, 3, x0, y0, w, h, region, stride));
+	for (int y = 0; y < h; y++) {
+		for (int x = 0; x < w; x++) {
+			int px = x0 + x;
+			int expected = (page[(y0 + y) * 316 + px / 8] >> (7 - px % 8)) & 1;
+			assert(((region[y * stride + x / 8] >> (7 - x % 8)) & 1) == expected);
+		}
+	}
+	// whole rows, decoded in place
+	free(region);
+	region = (unsigned char*)malloc(279 * 316);
+	assert(pdfrasread_read_region(reader, 3, 0, 3000, 2521, 279, region, 316));
+	assert(0 == memcmp(region, page + 3000 * 316, 279 * 316));
+	free(region);
+	free(page);
+	pdfrasread_destroy(reader);
+	printf("passed\n");
+}
+
+// Read page p reduced by factor, and check it against box averages of the decoded strips
+static void check_reduced(t_pdfrasreader* reader, int p, int factor)
+{
+	RasterPixelFormat format = pdfrasread_page_format(reader, p);
+	int width = pdfrasread_page_width(reader, p), height = pdfrasread_page_height(reader, p);
+	size_t row_size = pdfrasread_page_row_size(reader, p);
+	size_t page_size = row_size * height;
+	unsigned char* page = (unsigned char*)malloc(page_size);
+	size_t off = 0;
+	for (int s = 0; s < pdfrasread_strip_count(reader, p); s++) {
+		off += pdfrasread_read_strip_pixels(reader, p, s, page + off, page_size - off);
+	}
+	assert(off == page_size);
+	int rw = (width + factor - 1) / factor, rh = (height + factor - 1) / factor;
+	int channels = (format == PDFRAS_RGB24 || format == PDFRAS_RGB48) ? 3 : 1;
+	int wide = (format == PDFRAS_GRAY16 || format == PDFRAS_RGB48);
+	size_t stride = pdfrasread_reduced_row_size(reader, p, factor);
+	assert(stride == (size_t)rw * channels * (wide ? 2 : 1));
+	unsigned char* reduced = (unsigned char*)malloc(stride * rh);
+	assert(pdfrasread_read_page_reduced(reader, p, factor, reduced, stride));
+	for (int y = 0; y < rh; y++) {
+		for (int x = 0; x < rw; x++) {
+			for (int c = 0; c < channels; c++) {
+				unsigned long long total = 0, n = 0;
+				for (int v = y * factor; v < height && v < (y + 1) * factor; v++) {
+					const unsigned char* row = page + v * row_size;
+					for (int u = x * factor; u < width && u < (x + 1) * factor; u++, n++) {
+						if (format == PDFRAS_BITONAL) {
+							total += ((row[u / 8] >> (7 - u % 8)) & 1) * 255;
+						}
+						else if (wide) {
+							total += (row[2 * (u * channels + c)] << 8) | row[2 * (u * channels + c) + 1];
+						}
+						else {
+							total += row[u * channels + c];
+						}
+					}
+				}
+				unsigned expected = (unsigned)((total + n / 2) / n);
+				const unsigned char* px = reduced + y * stride;
+				if (wide) {
+					assert((unsigned)((px[2 * (x * channels + c)] << 8) | px[2 * (x * channels + c) + 1]) == expected);
+				}
+				else {
+					assert(px[x * channels + c] == expected);
+				}
+			}
+		}
+	}
+	free(reduced);
+	free(page);
+}
+
+void reduced_tests()
+{
+	printf("-- reduced-resolution reads --\n");
+	t_pdfrasreader* reader = pdfrasread_open_filename(PDFRAS_API_LEVEL, "valid1.pdf");
+	assert(reader != NULL);
+	assert(PDFRAS_GRAY8 == pdfrasread_reduced_format(reader, 3));
+	assert(PDFRAS_RGB24 == pdfrasread_reduced_format(reader, 4));
+	assert(316 == pdfrasread_reduced_row_size(reader, 3, 8));
+	// every format the reader decodes, by factors that do and don't divide the page
+	static const int factors[] = { 1, 2, 3, 4, 8, 13 };
+	for (int i = 0; i < 6; i++) {
+		for (int p = 0; p < 5; p++) {
+			check_reduced(reader, p, factors[i]);
+		}
+	}
+	check_reduced(reader, 3, 256);
+	check_reduced(reader, 1, 256);
+	// out of range, too narrow, or JPEG
+	unsigned char buf[316 * 410];
+	assert(0 == pdfrasread_reduced_row_size(reader, 3, 0));
+	assert(0 == pdfrasread_reduced_row_size(reader, 3, PDFRAS_REDUCE_MAX + 1));
+	assert(!pdfrasread_read_page_reduced(reader, 3, 8, buf, 315));
+	assert(!pdfrasread_read_page_reduced(reader, 5, 8, buf, 320));
+	pdfrasread_destroy(reader);
+	// a striped page, boxes spanning strips
+	reader = pdfrasread_create64(PDFRAS_API_LEVEL, &freader64, &fcloser);
+	assert(reader != NULL);
+	assert(pdfrasread_open(reader, make_striped_file(100, 40, 10)));
+	check_reduced(reader, 0, 3);
+	check_reduced(reader, 0, 16);
+	pdfrasread_destroy(reader);
+	printf("passed\n");
+}
+
+void xref_decode_tests()
+{
+	printf("-- xref decoding --\n");
+	static const char table[] =
+		"0000000000 65535 f\r\n"
+		"0000000017 00000 n\r\n"
+		"9876543210 00000 n \n"
+		"0000000000 00001 f \r"
+		"0001234567 00000 n\n\n";
+	pduint64 offsets[5];
+	// last entry has a bad EOL
+	assert(pdfras_scan_xref(table, 4, offsets));
+	assert(0 == offsets[0]);
+	assert(17 == offsets[1]);
+	assert(9876543210ULL == offsets[2]);
+	assert(0 == offsets[3]);
+	assert(!pdfras_scan_xref(table, 5, offsets));
+	// other damage
+	char entry[21];
+	strcpy(entry, "00000001x7 00000 n\r\n");
+	assert(!pdfras_scan_xref(entry, 1, offsets));
+	strcpy(entry, "0000000017 00001 n\r\n");
+	assert(!pdfras_scan_xref(entry, 1, offsets));		// in-use gen must be 0
+	strcpy(entry, "0000000017 000:0 f\r\n");
+	assert(!pdfras_scan_xref(entry, 1, offsets));
+	strcpy(entry, "0000000017 00000 x\r\n");
+	assert(!pdfras_scan_xref(entry, 1, offsets));
+	printf("passed\n");
+}
+
+// Sample c (0=R/gray, 1=G, 2=B) of pixel x of a decoded row, rounded to 8 bits
+static unsigned sample8(const unsigned char* row, RasterPixelFormat format, int x, int c)
+{
+	switch (format) {
+	case PDFRAS_BITONAL:
+		return ((row[x / 8] >> (7 - x % 8)) & 1) * 255;
+	case PDFRAS_GRAY8:
+		return row[x];
+	case PDFRAS_GRAY16:
+		return (((row[2 * x] << 8) | row[2 * x + 1]) * 255 + 32767) / 65535;
+	case PDFRAS_RGB24:
+		return row[3 * x + c];
+	default:
+		return (((row[6 * x + 2 * c] << 8) | row[6 * x + 2 * c + 1]) * 255 + 32767) / 65535;
+	}
+}
+
+// Read strip 0 of page p converted to out, with padded rows, and check it against the decoded strip
+static void check_converted(t_pdfrasreader* reader, int p, RasterOutputFormat out)
+{
+	RasterPixelFormat format = pdfrasread_page_format(reader, p);
+	int width = pdfrasread_page_width(reader, p), rows = pdfrasread_strip_height(reader, p, 0);
+	int rgb = (format == PDFRAS_RGB24 || format == PDFRAS_RGB48);
+	size_t size = pdfrasread_strip_pixel_size(reader, p, 0);
+	unsigned char* pixels = (unsigned char*)malloc(size);
+	assert(size == pdfrasread_read_strip_pixels(reader, p, 0, pixels, size));
+	size_t row_size = pdfrasread_page_row_size(reader, p);
+	size_t out_size = pdfrasread_converted_row_size(reader, p, out);
+	size_t stride = out_size + 5;
+	unsigned char* converted = (unsigned char*)malloc(stride * rows);
+	memset(converted, 0xCD, stride * rows);
+	assert(!pdfrasread_read_strip_converted(reader, p, 0, out, converted, out_size - 1));
+	assert(pdfrasread_read_strip_converted(reader, p, 0, out, converted, stride));
+	for (int y = 0; y < rows; y++) {
+		const unsigned char* row = pixels + y * row_size;
+		const unsigned char* px = converted + y * stride;
+		if (out == PDFRAS_OUT_NATIVE) {
+			assert(out_size == row_size);
+			assert(0 == memcmp(px, row, row_size));
+		}
+		for (int x = 0; out != PDFRAS_OUT_NATIVE && x < width; x++) {
+			unsigned r = sample8(row, format, x, 0);
+			unsigned g = rgb ? sample8(row, format, x, 1) : r;
+			unsigned b = rgb ? sample8(row, format, x, 2) : r;
+			switch (out) {
+			case PDFRAS_OUT_GRAY8:
+				assert(px[x] == (rgb ? (77 * r + 150 * g + 29 * b + 128) >> 8 : r));
+				break;
+			case PDFRAS_OUT_RGB24:
+				assert(px[3 * x] == r && px[3 * x + 1] == g && px[3 * x + 2] == b);
+				break;
+			default:
+				assert(px[4 * x] == b && px[4 * x + 1] == g && px[4 * x + 2] == r && px[4 * x + 3] == 255);
+				break;
+			}
+		}
+		// padding untouched
+		for (size_t i = out_size; i < stride; i++) {
+			assert(px[i] == 0xCD);
+		}
+	}
+	free(converted);
+	free(pixels);
+}
+
+void converted_tests()
+{
+	printf("-- converted strips --\n");
+	// every 16-bit value rounds to the nearest 8-bit one
+	static unsigned char wide[2 * 65536], narrow[65536];
+	for (int v = 0; v < 65536; v++) {
+		wide[2 * v] = (unsigned char)(v >> 8);
+		wide[2 * v + 1] = (unsigned char)v;
+	}
+	pdfras_pixels_convert(narrow, PDFRAS_OUT_GRAY8, wide, PDFRAS_GRAY16, 65536);
+	for (int v = 0; v < 65536; v++) {
+		assert(narrow[v] == (v * 255 + 32767) / 65535);
+	}
+	t_pdfrasreader* reader = pdfrasread_open_filename(PDFRAS_API_LEVEL, "valid1.pdf");
+	assert(reader != NULL);
+	assert(2521 * 4 == pdfrasread_converted_row_size(reader, 3, PDFRAS_OUT_BGRA32));
+	assert(316 == pdfrasread_converted_row_size(reader, 3, PDFRAS_OUT_NATIVE));
+	assert(0 == pdfrasread_converted_row_size(reader, 3, (RasterOutputFormat)9));
+	// every page format the reader decodes, to every output format
+	for (int p = 0; p < 5; p++) {
+		for (int out = PDFRAS_OUT_NATIVE; out <= PDFRAS_OUT_BGRA32; out++) {
+			check_converted(reader, p, (RasterOutputFormat)out);
+		}
+	}
+	pdfrasread_destroy(reader);
+	// CCITT decoded in place, from a mapped file
+	reader = pdfrasread_open_mapped_filename(PDFRAS_API_LEVEL, "valid1.pdf");
+	assert(reader != NULL);
+	check_converted(reader, 3, PDFRAS_OUT_RGB24);
+	check_converted(reader, 4, PDFRAS_OUT_GRAY8);
+	pdfrasread_destroy(reader);
+	printf("passed\n");
+}
+
+// Pixel x of a row of bpp-bit pixels, as a number
+static unsigned long long pixel_value(const unsigned char* row, int x, unsigned bpp)
+{
+	if (bpp == 1) {
+		return (row[x / 8] >> (7 - x % 8)) & 1;
+	}
+	unsigned long long v = 0;
+	for (unsigned i = 0; i < bpp / 8; i++) {
+		v = (v << 8) | row[x * (bpp / 8) + i];
+	}
+	return v;
+}
+
+// Check that rotated, rows stride bytes apart, is the width x height page
+// (rows row_size bytes apart) turned clockwise by degrees
+static void check_rotation(const unsigned char* page, size_t row_size, int width, int height, unsigned bpp,
+	const unsigned char* rotated, size_t stride, int degrees)
+{
+	int rw = (degrees % 180) ? height : width, rh = (degrees % 180) ? width : height;
+	for (int v = 0; v < rh; v++) {
+		for (int u = 0; u < rw; u++) {
+			int x = u, y = v;
+			switch (degrees) {
+			case 90:
+				x = v, y = height - 1 - u;
+				break;
+			case 180:
+				x = width - 1 - u, y = height - 1 - v;
+				break;
+			case 270:
+				x = width - 1 - v, y = u;
+				break;
+			}
+			assert(pixel_value(rotated + v * stride, u, bpp) == pixel_value(page + y * row_size, x, bpp));
+		}
+	}
+}
+
+// Rotate the top height rows of the decoded page p by each quarter turn, band rows at a time,
+// and check the results
+static void check_rotate_bands(t_pdfrasreader* reader, int p, int height, unsigned band)
+{
+	int width = pdfrasread_page_width(reader, p);
+	size_t row_size = pdfrasread_page_row_size(reader, p);
+	size_t size = pdfrasread_strip_pixel_size(reader, p, 0);
+	unsigned char* page = (unsigned char*)malloc(size);
+	assert(size == pdfrasread_read_strip_pixels(reader, p, 0, page, size));
+	unsigned bpp = (unsigned)(row_size * 8 / width);
+	if (pdfrasread_page_format(reader, p) == PDFRAS_BITONAL) {
+		bpp = 1;
+	}
+	size_t stride = ((size_t)(width > height ? width : height) * bpp + 7) / 8 + 3;
+	unsigned char* rotated = (unsigned char*)malloc(stride * (width > height ? width : height));
+	for (int degrees = 0; degrees < 360; degrees += 90) {
+		for (int y = 0; y < height; y += band) {
+			unsigned rows = (height - y < (int)band) ? height - y : band;
+			pdfras_pixels_rotate_band(rotated, stride, page + y * row_size, row_size, width, height, y, rows, bpp, degrees);
+		}
+		check_rotation(page, row_size, width, height, bpp, rotated, stride, degrees);
+	}
+	free(rotated);
+	free(page);
+}
+
+void rotated_tests()
+{
+	printf("-- rotated reads --\n");
+	t_pdfrasreader* reader = pdfrasread_open_filename(PDFRAS_API_LEVEL, "valid1.pdf");
+	assert(reader != NULL);
+	// bitonal, in 8-row blocks and not, with a partial block at the bottom
+	check_rotate_bands(reader, 3, 203, 64);
+	check_rotate_bands(reader, 3, 100, 13);
+	check_rotate_bands(reader, 2, 1100, 64);
+	// 8, 16 and 24 bits per pixel
+	check_rotate_bands(reader, 0, 11, 4);
+	check_rotate_bands(reader, 1, 512, 64);
+	check_rotate_bands(reader, 4, 100, 7);
+	// page 4 is RGB, turned 90 degrees: 100 pixels wide and 175 rows high
+	assert(100 * 3 == pdfrasread_rotated_row_size(reader, 4));
+	size_t size = pdfrasread_strip_pixel_size(reader, 4, 0);
+	unsigned char* page = (unsigned char*)malloc(size);
+	assert(size == pdfrasread_read_strip_pixels(reader, 4, 0, page, size));
+	unsigned char* rotated = (unsigned char*)malloc(304 * 175);
+	assert(!pdfrasread_read_page_rotated(reader, 4, rotated, 299));
+	assert(pdfrasread_read_page_rotated(reader, 4, rotated, 304));
+	check_rotation(page, 175 * 3, 175, 100, 24, rotated, 304, 90);
+	free(rotated);
+	free(page);
+	// page 3 isn't rotated
+	size = pdfrasread_strip_pixel_size(reader, 3, 0);
+	page = (unsigned char*)malloc(size);
+	rotated = (unsigned char*)malloc(size);
+	assert(316 == pdfrasread_rotated_row_size(reader, 3));
+	assert(size == pdfrasread_read_strip_pixels(reader, 3, 0, page, size));
+	assert(pdfrasread_read_page_rotated(reader, 3, rotated, 316));
+	assert(0 == memcmp(page, rotated, size));
+	free(rotated);
+	free(page);
+	// page 5 is JPEG
+	assert(!pdfrasread_read_page_rotated(reader, 5, NULL, 850 * 3));
+	pdfrasread_destroy(reader);
+	printf("passed\n");
+}
+
+// Write a copy of valid1.pdf to fn, with the first occurrence of from replaced by to
+static void edit_valid1(const char* fn, const char* from, const char* to)
+{
+	FILE* in = fopen("valid1.pdf", "rb");
+	assert(in != NULL);
+	std::string text;
+	char buf[4096];
+	size_t n;
+	while ((n = fread(buf, 1, sizeof buf, in)) > 0) {
+		text.append(buf, n);
+	}
+	fclose(in);
+	size_t at = text.find(from);
+	assert(at != std::string::npos);
+	text.replace(at, strlen(from), to);
+	FILE* out = fopen(fn, "wb");
+	assert(out != NULL);
+	assert(text.size() == fwrite(text.data(), 1, text.size(), out));
+	fclose(out);
+}
+
+// Pages handed out by pdfrasread_pool_decode_pages, checked against pdfrasread_read_strip_pixels
+struct t_pagecheck {
+	t_pdfrasreader*	reader;
+	int				next;			// page expected next
+};
+
+static void check_decoded_page(void* cookie, int p, const void* pixels, size_t size)
+{
+	t_pagecheck* check = (t_pagecheck*)cookie;
+	assert(p == check->next++);
+	assert(size == pdfrasread_page_row_size(check->reader, p) * pdfrasread_page_height(check->reader, p));
+	assert(1 == pdfrasread_strip_count(check->reader, p));
+	char* page = (char*)malloc(size);
+	assert(size == pdfrasread_read_strip_pixels(check->reader, p, 0, page, size));
+	assert(0 == memcmp(page, pixels, size));
+	free(page);
+}
+
+void parallel_tests()
+{
+	printf("-- parallel decoding --\n");
+	t_pdfraspool* pool = pdfrasread_pool_create(3);
+	assert(pool != NULL);
+	assert(3 == pdfrasread_pool_threads(pool));
+	// pages 0-4 of valid1.pdf, in order (page 3 is CCITT)
+	t_pdfrasreader* reader = pdfrasread_open_filename(PDFRAS_API_LEVEL, "valid1.pdf");
+	assert(reader != NULL);
+	t_pagecheck check = { reader, 0 };
+	assert(pdfrasread_pool_decode_pages(pool, reader, 0, 5, check_decoded_page, &check));
+	assert(5 == check.next);
+	assert(pdfrasread_is_shared(reader));
+	// page 5 is JPEG, which isn't decoded: the pages before it still are
+	check.next = 2;
+	assert(!pdfrasread_pool_decode_pages(pool, reader, 2, 4, check_decoded_page, &check));
+	assert(5 == check.next);
+	assert(!pdfrasread_pool_decode_pages(pool, reader, 5, 2, check_decoded_page, &check));
+	pdfrasread_destroy(reader);
+	// a page that can't be started, inside the window: 0 rows high. The pages before it are handed out.
+	edit_valid1("parallel_test.pdf", "/Height 100", "/Height 000");
+	reader = pdfrasread_open_filename(PDFRAS_API_LEVEL, "parallel_test.pdf");
+	assert(reader != NULL);
+	check.reader = reader;
+	check.next = 0;
+	assert(!pdfrasread_pool_decode_pages(pool, reader, 0, 5, check_decoded_page, &check));
+	assert(4 == check.next);
+	pdfrasread_destroy(reader);
+	remove("parallel_test.pdf");
+
+	// a 100 x 400 page in 40 strips of 10 rows, from memory
+	FILE* f = make_striped_file(100, 40, 10);
+	fseek(f, 0, SEEK_END);
+	size_t size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	char* data = (char*)malloc(size);
+	assert(size == fread(data, 1, size, f));
+	fclose(f);
+	reader = pdfrasread_open_memory(PDFRAS_API_LEVEL, data, size);
+	assert(reader != NULL);
+	unsigned char* page = (unsigned char*)malloc(100 * 400);
+	assert(!pdfrasread_pool_decode_page(pool, reader, 0, page, 100 * 400 - 1));
+	assert(!pdfrasread_pool_decode_page(pool, reader, 1, page, 100 * 400));
+	for (int pass = 0; pass < 10; pass++) {
+		memset(page, 0, 100 * 400);
+		assert(pdfrasread_pool_decode_page(pool, reader, 0, page, 100 * 400));
+		for (int y = 0; y < 400; y++) {
+			for (int x = 0; x < 100; x++) {
+				assert(page[y * 100 + x] == striped_pixel(x, y));
+			}
+		}
+	}
+	free(page);
+	pdfrasread_destroy(reader);
+	free(data);
+	pdfrasread_pool_destroy(pool);
+
+	// one thread per CPU
+	pool = pdfrasread_pool_create(0);
+	assert(pool != NULL);
+	assert(pdfrasread_pool_threads(pool) >= 1);
+	pdfrasread_pool_destroy(pool);
+	printf("passed\n");
+}
+
+void strip_cache_tests()
+{
+	printf("-- decoded strip cache --\n");
+	t_pdfrasreader* reader = pdfrasread_open_filename(PDFRAS_API_LEVEL, "valid1.pdf");
+	assert(reader != NULL);
+	size_t stride;
+	unsigned long rows;
+	// no cache, no pins
+	assert(NULL == pdfrasread_pin_strip(reader, 2, 0, PDFRAS_OUT_NATIVE, 1, &stride, &rows));
+	t_pdfrascachestats stats;
+	pdfrasread_strip_cache_stats(reader, &stats);
+	assert(stats.budget == 0 && stats.strips == 0);
+	assert(pdfrasread_set_strip_cache(reader, 16 * 1024 * 1024));
+	// a pinned strip is the decoded strip, and pinning it again finds it
+	size_t size = pdfrasread_strip_pixel_size(reader, 3, 0);
+	char* pixels = (char*)malloc(size);
+	assert(size == pdfrasread_read_strip_pixels(reader, 3, 0, pixels, size));
+	const void* pinned = pdfrasread_pin_strip(reader, 3, 0, PDFRAS_OUT_NATIVE, 1, &stride, &rows);
+	assert(pinned != NULL && stride == 316 && rows == 3279);
+	assert(0 == memcmp(pinned, pixels, size));
+	assert(pinned == pdfrasread_pin_strip(reader, 3, 0, PDFRAS_OUT_NATIVE, 1, &stride, &rows));
+	pdfrasread_strip_cache_stats(reader, &stats);
+	assert(stats.hits == 1 && stats.misses == 1 && stats.strips == 1 && stats.pinned == 1 && stats.bytes == size);
+	assert(!pdfrasread_set_strip_cache(reader, 0));
+	pdfrasread_unpin_strip(reader, pinned);
+	pdfrasread_unpin_strip(reader, pinned);
+	free(pixels);
+	// converted, and reduced: each is cached on its own
+	size = 2521 * 3279;
+	pixels = (char*)malloc(size);
+	assert(pdfrasread_read_strip_converted(reader, 3, 0, PDFRAS_OUT_GRAY8, pixels, 2521));
+	pinned = pdfrasread_pin_strip(reader, 3, 0, PDFRAS_OUT_GRAY8, 1, &stride, &rows);
+	assert(pinned != NULL && stride == 2521 && rows == 3279);
+	assert(0 == memcmp(pinned, pixels, size));
+	pdfrasread_unpin_strip(reader, pinned);
+	// pages of one strip reduce as a whole page does
+	size = pdfrasread_reduced_row_size(reader, 3, 8) * 410;
+	assert(pdfrasread_read_page_reduced(reader, 3, 8, pixels, pdfrasread_reduced_row_size(reader, 3, 8)));
+	pinned = pdfrasread_pin_strip(reader, 3, 0, PDFRAS_OUT_NATIVE, 8, &stride, &rows);
+	assert(pinned != NULL && stride == 316 && rows == 410);
+	assert(0 == memcmp(pinned, pixels, size));
+	pdfrasread_unpin_strip(reader, pinned);
+	const unsigned char* rgb = (const unsigned char*)pdfrasread_pin_strip(reader, 3, 0, PDFRAS_OUT_RGB24, 8, &stride, &rows);
+	assert(rgb != NULL && stride == 316 * 3 && rows == 410);
+	for (size_t i = 0; i < size; i++) {
+		assert(rgb[i * 3] == (unsigned char)pixels[i] && rgb[i * 3 + 2] == (unsigned char)pixels[i]);
+	}
+	pdfrasread_unpin_strip(reader, rgb);
+	assert(pdfrasread_read_page_reduced(reader, 1, 3, pixels, pdfrasread_reduced_row_size(reader, 1, 3)));
+	pinned = pdfrasread_pin_strip(reader, 1, 0, PDFRAS_OUT_NATIVE, 3, &stride, &rows);
+	assert(pinned != NULL && rows == 171);
+	assert(0 == memcmp(pinned, pixels, stride * rows));
+	pdfrasread_unpin_strip(reader, pinned);
+	free(pixels);
+	pdfrasread_strip_cache_stats(reader, &stats);
+	assert(stats.strips == 5 && stats.pinned == 0 && stats.misses == 5);
+	// JPEG strips aren't decoded, bad requests aren't cached
+	assert(NULL == pdfrasread_pin_strip(reader, 5, 0, PDFRAS_OUT_NATIVE, 1, &stride, &rows));
+	assert(NULL == pdfrasread_pin_strip(reader, 3, 1, PDFRAS_OUT_NATIVE, 1, &stride, &rows));
+	assert(NULL == pdfrasread_pin_strip(reader, 3, 0, PDFRAS_OUT_NATIVE, 0, &stride, &rows));
+	assert(NULL == pdfrasread_pin_strip(reader, 3, 0, (RasterOutputFormat)99, 1, &stride, &rows));
+	pdfrasread_strip_cache_stats(reader, &stats);
+	assert(stats.strips == 5 && stats.misses == 5);
+	// closing empties the cache, destroying removes it
+	pdfrasread_destroy(reader);
+
+	// a 100 x 400 page in 40 strips of 10 rows: 1000 bytes a strip, 5 of them in budget
+	reader = pdfrasread_create64(PDFRAS_API_LEVEL, &counting_reader, &fcloser);
+	assert(reader != NULL);
+	assert(pdfrasread_set_strip_cache(reader, 5000));
+	assert(pdfrasread_open(reader, make_striped_file(100, 40, 10)));
+	for (int s = 0; s < 10; s++) {
+		pinned = pdfrasread_pin_strip(reader, 0, s, PDFRAS_OUT_NATIVE, 1, &stride, &rows);
+		assert(pinned != NULL && stride == 100 && rows == 10);
+		assert(((const unsigned char*)pinned)[99] == striped_pixel(99, s * 10));
+		pdfrasread_unpin_strip(reader, pinned);
+	}
+	pdfrasread_strip_cache_stats(reader, &stats);
+	assert(stats.strips == 5 && stats.bytes == 5000 && stats.evictions == 5);
+	// the most recent strips are kept, the least recent dropped
+	pdfrasread_unpin_strip(reader, pdfrasread_pin_strip(reader, 0, 5, PDFRAS_OUT_NATIVE, 1, &stride, &rows));
+	pdfrasread_unpin_strip(reader, pdfrasread_pin_strip(reader, 0, 4, PDFRAS_OUT_NATIVE, 1, &stride, &rows));
+	pdfrasread_strip_cache_stats(reader, &stats);
+	assert(stats.hits == 1 && stats.misses == 11 && stats.evictions == 6);
+	// pinned strips go over budget until they're unpinned
+	const void* pins[8];
+	for (int s = 0; s < 8; s++) {
+		pins[s] = pdfrasread_pin_strip(reader, 0, 20 + s, PDFRAS_OUT_NATIVE, 1, &stride, &rows);
+		assert(pins[s] != NULL);
+	}
+	pdfrasread_strip_cache_stats(reader, &stats);
+	assert(stats.strips == 8 && stats.pinned == 8 && stats.bytes == 8000);
+	for (int s = 0; s < 8; s++) {
+		pdfrasread_unpin_strip(reader, pins[s]);
+	}
+	pdfrasread_strip_cache_stats(reader, &stats);
+	assert(stats.strips == 5 && stats.pinned == 0 && stats.bytes == 5000);
+	const unsigned char* strip = (const unsigned char*)pdfrasread_pin_strip(reader, 0, 27, PDFRAS_OUT_NATIVE, 1, &stride, &rows);
+	assert(strip != NULL && strip[0] == striped_pixel(0, 270));
+	pdfrasread_unpin_strip(reader, strip);
+	// region reads go through the cache: reading a region again reads nothing
+	assert(pdfrasread_set_strip_cache(reader, 100000));
+	unsigned char box[30 * 25];
+	read_count = 0;
+	assert(pdfrasread_read_region(reader, 0, 7, 33, 30, 25, box, 30));
+	unsigned reads = read_count;
+	assert(reads > 0);
+	memset(box, 0, sizeof box);
+	assert(pdfrasread_read_region(reader, 0, 7, 33, 30, 25, box, 30));
+	assert(read_count == reads);
+	for (int y = 0; y < 25; y++) {
+		for (int x = 0; x < 30; x++) {
+			assert(box[y * 30 + x] == striped_pixel(7 + x, 33 + y));
+		}
+	}
+	pdfrasread_strip_cache_stats(reader, &stats);
+	assert(stats.hits == 5 && stats.misses == 22);
+	assert(pdfrasread_close(reader));
+	pdfrasread_strip_cache_stats(reader, &stats);
+	assert(stats.strips == 0 && stats.bytes == 0 && stats.budget == 100000);
+	assert(pdfrasread_set_strip_cache(reader, 0));
+	pdfrasread_destroy(reader);
+	printf("passed\n");
+}
+
+// A source of 100000 bytes of pattern, in memory
+static unsigned char pattern_byte(pduint64 i)
+{
+	return (unsigned char)(i * 7 + (i >> 8));
+}
+
+static size_t pattern_reader(void *source, pduint64 offset, size_t length, char *buffer)
+{
+	const pduint64 size = 100000;
+	if (offset >= size) {
+		return 0;
+	}
+	if (length > size - offset) {
+		length = (size_t)(size - offset);
+	}
+	for (size_t i = 0; i < length; i++) {
+		buffer[i] = (char)pattern_byte(offset + i);
+	}
+	return length;
+}
+
+static void check_pattern_read(t_pdfrasblockcache* cache, pduint64 offset, size_t length, size_t expected)
+{
+	char* buffer = (char*)malloc(length ? length : 1);
+	assert(expected == pdfrasread_blockcache_read(cache, offset, length, buffer));
+	for (size_t i = 0; i < expected; i++) {
+		assert((unsigned char)buffer[i] == pattern_byte(offset + i));
+	}
+	free(buffer);
+}
+
+// Open valid1.pdf through a simulated-latency source (which can tell its size if sized),
+// and a block cache unless budget is 0, read all its strips, and return the number of
+// reads of the source. Set *open_reads to the number it took to open.
+static unsigned long remote_reads(size_t budget, bool sized, unsigned long* open_reads)
+{
+	FILE* f = fopen("valid1.pdf", "rb");
+	assert(f != NULL);
+	t_pdfraslatencysource* slow = pdfrasread_latency_source_create(&freader64, &fcloser, sized ? &fsizer : NULL, f, 1);
+	assert(slow != NULL);
+	t_pdfrasreader* reader;
+	if (budget) {
+		t_pdfrasblockcache* cache = pdfrasread_blockcache_create(&pdfrasread_latency_source_read, &pdfrasread_latency_source_close,
+			&pdfrasread_latency_source_size, slow, 0, budget);
+		assert(cache != NULL);
+		reader = pdfrasread_open_blockcache(PDFRAS_API_LEVEL, cache);
+	}
+	else {
+		reader = pdfrasread_create64(PDFRAS_API_LEVEL, &pdfrasread_latency_source_read, &pdfrasread_latency_source_close);
+		assert(reader != NULL);
+		pdfrasread_set_sizer(reader, &pdfrasread_latency_source_size);
+		assert(pdfrasread_open(reader, slow));
+	}
+	assert(reader != NULL);
+	assert(6 == pdfrasread_page_count(reader));
+	*open_reads = pdfrasread_latency_source_requests(slow);
+	for (int p = 0; p < 6; p++) {
+		size_t size = pdfrasread_strip_raw_size(reader, p, 0);
+		char* strip = (char*)malloc(size);
+		assert(size == pdfrasread_read_raw_strip(reader, p, 0, strip, size));
+		free(strip);
+	}
+	unsigned long reads = pdfrasread_latency_source_requests(slow);
+	pdfrasread_destroy(reader);
+	return reads;
+}
+
+void block_cache_tests()
+{
+	printf("-- block cache --\n");
+	t_pdfraslatencysource* slow = pdfrasread_latency_source_create(&pattern_reader, NULL, NULL, NULL, 0);
+	assert(slow != NULL);
+	// 4KB blocks, 16 of them
+	t_pdfrasblockcache* cache = pdfrasread_blockcache_create(&pdfrasread_latency_source_read, &pdfrasread_latency_source_close,
+		NULL, slow, 4000, 16 * 4096);
+	assert(cache != NULL);
+	pduint64 size;
+	assert(!pdfrasread_blockcache_size(cache, &size));
+	// a random read reads its block, a read in that block reads nothing
+	check_pattern_read(cache, 50000, 100, 100);
+	assert(1 == pdfrasread_latency_source_requests(slow));
+	check_pattern_read(cache, 50100, 100, 100);
+	assert(1 == pdfrasread_latency_source_requests(slow));
+	// reading on from there reads the missing blocks in one go, and the next two too
+	check_pattern_read(cache, 50200, 8000, 8000);
+	assert(2 == pdfrasread_latency_source_requests(slow));
+	check_pattern_read(cache, 15 * 4096, 2 * 4096, 2 * 4096);
+	assert(2 == pdfrasread_latency_source_requests(slow));
+	t_pdfrasblockstats stats;
+	pdfrasread_blockcache_stats(cache, &stats);
+	assert(stats.reads == 4 && stats.requests == 2 && stats.misses == 3 && stats.readaheads == 2 && stats.hits == 4);
+	assert(stats.bytes_served == 100 + 100 + 8000 + 2 * 4096);
+	assert(stats.bytes_fetched == 5 * 4096);
+	// a read past the end of the source finds its size
+	check_pattern_read(cache, 99990, 100, 10);
+	assert(pdfrasread_blockcache_size(cache, &size) && size == 100000);
+	check_pattern_read(cache, 100000, 10, 0);
+	check_pattern_read(cache, 99000, 2000, 1000);
+	assert(3 == pdfrasread_latency_source_requests(slow));
+	// a long read is one request, and pushes older blocks out
+	check_pattern_read(cache, 0, 60000, 60000);
+	assert(4 == pdfrasread_latency_source_requests(slow));
+	pdfrasread_blockcache_stats(cache, &stats);
+	assert(stats.evictions > 0);
+	check_pattern_read(cache, 50000, 100, 100);
+	assert(4 == pdfrasread_latency_source_requests(slow));
+	pdfrasread_blockcache_close(cache);
+
+	// opening valid1.pdf takes a handful of reads through a block cache
+	for (int sized = 0; sized <= 1; sized++) {
+		unsigned long open_direct, open_cached;
+		unsigned long direct = remote_reads(0, sized != 0, &open_direct);
+		unsigned long cached = remote_reads(1024 * 1024, sized != 0, &open_cached);
+		assert(open_cached < open_direct && cached < direct);
+	}
+	printf("passed\n");
+}
+
+void stats_tests()
+{
+	printf("-- reader stats --\n");
+	t_pdfrasstats stats;
+	assert(!pdfrasread_get_stats(NULL, &stats));
+	FILE* f = fopen("valid1.pdf", "rb");
+	assert(f != NULL);
+	t_pdfrasreader* reader = pdfrasread_create64(PDFRAS_API_LEVEL, &counting_reader, &fcloser);
+	assert(reader != NULL);
+	read_count = 0;
+	assert(pdfrasread_open(reader, f));
+	if (!pdfrasread_get_stats(reader, &stats)) {
+		// built with PDFRAS_NO_STATS
+		assert(stats.source_reads == 0 && stats.bytes_read == 0 && stats.tokens == 0);
+		pdfrasread_destroy(reader);
+		printf("passed (counters compiled out)\n");
+		return;
+	}
+	// every read of the source is counted, and opening parses the xref, trailer & page tree
+	assert(stats.source_reads == read_count);
+	assert(stats.bytes_read > 0 && stats.bytes_read <= 387259 * (pduint64)stats.source_reads);
+	assert(stats.refills == pdfrasread_window_refills(reader));
+	assert(stats.refills <= stats.source_reads);
+	assert(stats.tokens > 0 && stats.dict_lookups > 0 && stats.xref_lookups > 0);
+	// the root node, and the 6 pages
+	assert(stats.page_nodes >= 7);
+	pdfrasread_reset_stats(reader);
+	assert(pdfrasread_get_stats(reader, &stats));
+	assert(stats.source_reads == 0 && stats.bytes_read == 0 && stats.source_ns == 0 && stats.refills == 0);
+	assert(stats.tokens == 0 && stats.dict_lookups == 0 && stats.xref_lookups == 0 && stats.page_nodes == 0);
+	// once a page is indexed, reading a strip is one read and no parsing
+	size_t size = pdfrasread_strip_raw_size(reader, 3, 0);
+	assert(size > 0);
+	std::vector<char> strip(size);
+	pdfrasread_reset_stats(reader);
+	assert(size == pdfrasread_read_raw_strip(reader, 3, 0, strip.data(), size));
+	assert(pdfrasread_get_stats(reader, &stats));
+	assert(stats.source_reads == 1 && stats.bytes_read == size);
+	assert(stats.tokens == 0 && stats.dict_lookups == 0 && stats.xref_lookups == 0);
+	// a shared reader doesn't count
+	assert(pdfrasread_share(reader));
+	pdfrasread_reset_stats(reader);
+	assert(size == pdfrasread_read_raw_strip(reader, 3, 0, strip.data(), size));
+	assert(pdfrasread_get_stats(reader, &stats));
+	assert(stats.source_reads == 0);
+	pdfrasread_destroy(reader);
+	printf("passed\n");
+}
+
+// Copy valid1.pdf to fn, with extra blank lines after its %%EOF
+static void copy_valid1(const char* fn, int extra)
+{
+	FILE* in = fopen("valid1.pdf", "rb");
+	assert(in != NULL);
+	FILE* out = fopen(fn, "wb");
+	assert(out != NULL);
+	char buf[4096];
+	size_t n;
+	while ((n = fread(buf, 1, sizeof buf, in)) > 0) {
+		assert(n == fwrite(buf, 1, n, out));
+	}
+	while (extra-- > 0) {
+		fputc('\n', out);
+	}
+	fclose(out);
+	fclose(in);
+}
+
+void reader_pool_tests()
+{
+	printf("-- reader pool --\n");
+	const char* names[3] = { "pool_test_0.pdf", "pool_test_1.pdf", "pool_test_2.pdf" };
+	for (int i = 0; i < 3; i++) {
+		copy_valid1(names[i], 0);
+	}
+	assert(NULL == pdfrasread_readerpool_create(PDFRAS_API_LEVEL, 0, 1024 * 1024));
+	assert(NULL == pdfrasread_readerpool_create(PDFRAS_API_LEVEL + 1, 2, 1024 * 1024));
+	t_pdfrasreaderpool* pool = pdfrasread_readerpool_create(PDFRAS_API_LEVEL, 2, 64 * 1024 * 1024);
+	assert(pool != NULL);
+	assert(NULL == pdfrasread_readerpool_acquire(pool, "no_such_file.pdf"));
+	assert(NULL == pdfrasread_readerpool_acquire(pool, "bad_trailer1.pdf"));
+	// the first borrower opens the file, the next gets the same reader
+	t_pdfrasreader* r0 = pdfrasread_readerpool_acquire(pool, names[0]);
+	assert(r0 != NULL && pdfrasread_is_shared(r0) && 6 == pdfrasread_page_count(r0));
+	assert(r0 == pdfrasread_readerpool_acquire(pool, names[0]));
+	t_pdfrasreaderpoolstats stats;
+	pdfrasread_readerpool_stats(pool, &stats);
+	assert(stats.misses == 1 && stats.hits == 1 && stats.open == 1 && stats.lent == 1);
+	assert(stats.bytes == pdfrasread_memory_size(r0) && stats.bytes > 0);
+	pdfrasread_readerpool_release(pool, r0);
+	pdfrasread_readerpool_release(pool, r0);
+	pdfrasread_readerpool_stats(pool, &stats);
+	assert(stats.open == 1 && stats.lent == 0);
+	// past the limit, the least recently returned reader is closed
+	pdfrasread_readerpool_release(pool, pdfrasread_readerpool_acquire(pool, names[1]));
+	pdfrasread_readerpool_release(pool, pdfrasread_readerpool_acquire(pool, names[0]));
+	pdfrasread_readerpool_release(pool, pdfrasread_readerpool_acquire(pool, names[2]));
+	pdfrasread_readerpool_stats(pool, &stats);
+	assert(stats.misses == 3 && stats.hits == 2 && stats.evictions == 1 && stats.open == 2);
+	pdfrasread_readerpool_release(pool, pdfrasread_readerpool_acquire(pool, names[0]));
+	pdfrasread_readerpool_stats(pool, &stats);
+	assert(stats.misses == 3 && stats.hits == 3);
+	// readers lent out stay open, over the limit if need be
+	t_pdfrasreader* lent[3];
+	for (int i = 0; i < 3; i++) {
+		lent[i] = pdfrasread_readerpool_acquire(pool, names[i]);
+		assert(lent[i] != NULL);
+	}
+	pdfrasread_readerpool_stats(pool, &stats);
+	assert(stats.open == 3 && stats.lent == 3);
+	for (int i = 0; i < 3; i++) {
+		pdfrasread_readerpool_release(pool, lent[i]);
+	}
+	pdfrasread_readerpool_stats(pool, &stats);
+	assert(stats.open == 2 && stats.lent == 0);
+	// a changed file is opened again, while its old reader stays usable until it's returned
+	r0 = pdfrasread_readerpool_acquire(pool, names[0]);
+	assert(r0 != NULL);
+	copy_valid1(names[0], 16);
+	t_pdfrasreader* r1 = pdfrasread_readerpool_acquire(pool, names[0]);
+	assert(r1 != NULL && r1 != r0);
+	assert(6 == pdfrasread_page_count(r0) && pdfrasread_strip_raw_size(r0, 3, 0) == pdfrasread_strip_raw_size(r1, 3, 0));
+	pdfrasread_readerpool_stats(pool, &stats);
+	assert(stats.reopens == 1 && stats.lent == 2);
+	pdfrasread_readerpool_release(pool, r0);
+	assert(r1 == pdfrasread_readerpool_acquire(pool, names[0]));
+	pdfrasread_readerpool_release(pool, r1);
+	pdfrasread_readerpool_release(pool, r1);
+	// the old reader counted against the limit until it was returned, and closed then
+	pdfrasread_readerpool_stats(pool, &stats);
+	assert(stats.open == 1 && stats.lent == 0);
+	// many threads borrowing at once
+	t_pdfrasreaderpoolstats before = stats;
+	unsigned long acquires = stats.hits + stats.misses;
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 8; t++) {
+		threads.push_back(std::thread([pool, &names, t]() {
+			std::vector<char> strip;
+			for (int i = 0; i < 100; i++) {
+				t_pdfrasreader* reader = pdfrasread_readerpool_acquire(pool, names[(t + i) % 3]);
+				assert(reader != NULL && 6 == pdfrasread_page_count(reader));
+				size_t size = pdfrasread_strip_raw_size(reader, 3, 0);
+				strip.resize(size);
+				assert(size == pdfrasread_read_raw_strip(reader, 3, 0, strip.data(), size));
+				pdfrasread_readerpool_release(pool, reader);
+			}
+		}));
+	}
+	for (auto& thread : threads) {
+		thread.join();
+	}
+	pdfrasread_readerpool_stats(pool, &stats);
+	assert(stats.hits + stats.misses == acquires + 8 * 100);
+	assert(stats.open <= 2 && stats.lent == 0);
+	// the two files that weren't open missed at least once, and every reader closed was
+	// opened by a miss (two threads can miss the same file, and one of them then closes its own)
+	unsigned long misses = stats.misses - before.misses, evictions = stats.evictions - before.evictions;
+	assert(misses >= 2);
+	assert(evictions + stats.open <= misses + before.open);
+	pdfrasread_readerpool_destroy(pool);
+	// one caller: the least recently used readers are closed first
+	pool = pdfrasread_readerpool_create(PDFRAS_API_LEVEL, 2, 64 * 1024 * 1024);
+	assert(pool != NULL);
+	const int order[6] = { 0, 1, 0, 2, 1, 2 };
+	for (int i = 0; i < 6; i++) {
+		pdfrasread_readerpool_release(pool, pdfrasread_readerpool_acquire(pool, names[order[i]]));
+	}
+	// 0 and 1 miss, 0 hits, 2 misses and closes 1, 1 misses and closes 0, 2 hits
+	pdfrasread_readerpool_stats(pool, &stats);
+	assert(stats.hits == 2 && stats.misses == 4 && stats.evictions == 2 && stats.open == 2);
+	pdfrasread_readerpool_destroy(pool);
+	// with no memory to spare, no reader is kept once it's returned
+	pool = pdfrasread_readerpool_create(PDFRAS_API_LEVEL, 16, 1);
+	assert(pool != NULL);
+	pdfrasread_readerpool_release(pool, pdfrasread_readerpool_acquire(pool, names[1]));
+	pdfrasread_readerpool_stats(pool, &stats);
+	assert(stats.open == 0 && stats.evictions == 1 && stats.bytes == 0);
+	pdfrasread_readerpool_destroy(pool);
+	for (int i = 0; i < 3; i++) {
+		remove(names[i]);
+	}
+	printf("passed\n");
+}
+
+// Check that reader reads the same as a new reader of the named file
+static void check_same_document(t_pdfrasreader* reader, const char* fn)
+{
+	t_pdfrasreader* fresh = pdfrasread_open_filename(PDFRAS_API_LEVEL, fn);
+	assert(fresh != NULL);
+	int pages = pdfrasread_page_count(fresh);
+	assert(pages == pdfrasread_page_count(reader));
+	std::vector<char> a, b;
+	for (int p = 0; p < pages; p++) {
+		assert(pdfrasread_page_width(reader, p) == pdfrasread_page_width(fresh, p));
+		assert(pdfrasread_page_height(reader, p) == pdfrasread_page_height(fresh, p));
+		assert(pdfrasread_page_format(reader, p) == pdfrasread_page_format(fresh, p));
+		int strips = pdfrasread_strip_count(fresh, p);
+		assert(strips == pdfrasread_strip_count(reader, p));
+		for (int s = 0; s < strips; s++) {
+			size_t size = pdfrasread_strip_raw_size(fresh, p, s);
+			assert(size == pdfrasread_strip_raw_size(reader, p, s));
+			a.resize(size);
+			b.resize(size);
+			assert(size == pdfrasread_read_raw_strip(fresh, p, s, a.data(), size));
+			assert(size == pdfrasread_read_raw_strip(reader, p, s, b.data(), size));
+			assert(a == b);
+		}
+	}
+	pdfrasread_destroy(fresh);
+}
+
+void reopen_tests()
+{
+	printf("-- reopen --\n");
+	const char* files[2] = { "valid1.pdf", "3pages.pdf" };
+	t_pdfrasreader* reader = pdfrasread_create64(PDFRAS_API_LEVEL, &freader64, &fcloser);
+	assert(reader != NULL);
+	pdfrasread_set_sizer(reader, &fsizer);
+	assert(!pdfrasread_reopen(NULL, NULL));
+	// one reader reads one file after another, the same as a new reader of each
+	size_t memory[2] = { 0, 0 };
+	for (int round = 0; round < 2; round++) {
+		for (int i = 0; i < 2; i++) {
+			FILE* f = fopen(files[i], "rb");
+			assert(f != NULL);
+			assert(pdfrasread_reopen(reader, f));
+			check_same_document(reader, files[i]);
+		}
+		memory[round] = pdfrasread_memory_size(reader);
+	}
+	// and once it has read each of them, it doesn't need any more memory for them
+	assert(memory[1] == memory[0]);
+	// after a file fails to open, the next one opens
+	FILE* bad = fopen("bad_trailer1.pdf", "rb");
+	assert(bad != NULL);
+	assert(!pdfrasread_reopen(reader, bad));
+	assert(!pdfrasread_is_open(reader));
+	fclose(bad);
+	FILE* f = fopen("valid1.pdf", "rb");
+	assert(pdfrasread_open(reader, f));
+	check_same_document(reader, "valid1.pdf");
+	// and after one fails once its dictionaries have been indexed: its root isn't the catalog,
+	// and its trailer is where valid1's is, with the same keys in another order
+	edit_valid1("reopen_test.pdf", "<< /Root 2 0 R /Info 33 0 R /Size 33 >>", "<< /Info 33 0 R /Root 1 0 R /Size 33 >>");
+	bad = fopen("reopen_test.pdf", "rb");
+	assert(bad != NULL);
+	assert(!pdfrasread_reopen(reader, bad));
+	fclose(bad);
+	f = fopen("valid1.pdf", "rb");
+	assert(pdfrasread_reopen(reader, f));
+	check_same_document(reader, "valid1.pdf");
+	// a negative page count doesn't open, eagerly or lazily
+	edit_valid1("reopen_test.pdf", "/Count 6 >>", "/Count -9>>");
+	for (int lazy = 0; lazy < 2; lazy++) {
+		assert(pdfrasread_close(reader));
+		assert(pdfrasread_set_open_mode(reader, lazy ? PDFRAS_OPEN_LAZY : PDFRAS_OPEN_EAGER));
+		bad = fopen("reopen_test.pdf", "rb");
+		assert(bad != NULL);
+		assert(!pdfrasread_open(reader, bad));
+		fclose(bad);
+		f = fopen("valid1.pdf", "rb");
+		assert(pdfrasread_open(reader, f));
+	}
+	remove("reopen_test.pdf");
+	// lazy page lookup too
+	assert(pdfrasread_close(reader));
+	assert(pdfrasread_set_open_mode(reader, PDFRAS_OPEN_LAZY));
+	for (int i = 1; i >= 0; i--) {
+		f = fopen(files[i], "rb");
+		assert(pdfrasread_reopen(reader, f));
+		check_same_document(reader, files[i]);
+	}
+	pdfrasread_destroy(reader);
+	printf("passed\n");
+}
+
+// A source in memory, that checks its reads follow one another
+typedef struct {
+	const char*	data;
+	size_t		size;
+	pduint64	next;			// where a sequential read starts
+	bool		sequential;		// all reads since reset were
+	unsigned	reads;
+} t_tapesource;
+
+static size_t tape_reader(void *source, pduint64 offset, size_t length, char *buffer)
+{
+	t_tapesource* tape = (t_tapesource*)source;
+	if (offset != tape->next) {
+		tape->sequential = false;
+	}
+	tape->reads++;
+	if (offset >= tape->size) {
+		return 0;
+	}
+	if (length > tape->size - offset) {
+		length = (size_t)(tape->size - offset);
+	}
+	memcpy(buffer, tape->data + offset, length);
+	tape->next = offset + length;
+	return length;
+}
+
+static void tape_load(t_tapesource* tape, std::vector<char>& data, const char* fn)
+{
+	FILE* f = fopen(fn, "rb");
+	assert(f != NULL);
+	fseek(f, 0, SEEK_END);
+	data.resize(ftell(f));
+	fseek(f, 0, SEEK_SET);
+	assert(data.size() == fread(data.data(), 1, data.size(), f));
+	fclose(f);
+	tape->data = data.data();
+	tape->size = data.size();
+}
+
+static void tape_rewind(t_tapesource* tape)
+{
+	tape->next = 0;
+	tape->sequential = true;
+	tape->reads = 0;
+}
+
+void scan_open_tests()
+{
+	printf("-- sequential scan open --\n");
+	const char* files[2] = { "valid1.pdf", "3pages.pdf" };
+	for (int i = 0; i < 2; i++) {
+		std::vector<char> data;
+		t_tapesource tape;
+		tape_load(&tape, data, files[i]);
+		for (int small = 0; small < 2; small++) {
+			t_pdfrasreader* reader = pdfrasread_create64(PDFRAS_API_LEVEL, &tape_reader, NULL);
+			assert(reader != NULL);
+			assert(pdfrasread_set_open_mode(reader, PDFRAS_OPEN_SCAN));
+			if (small) {
+				// small chunks: headers and keywords straddle chunk boundaries
+				assert(pdfrasread_set_window(reader, 1024, 1024));
+			}
+			tape_rewind(&tape);
+			assert(pdfrasread_open(reader, &tape));
+			// open read the file once, front to back, in chunks of the window's largest size
+			assert(tape.sequential);
+			assert(tape.next == tape.size);
+			size_t chunk = small ? 1024 : PDFRAS_WINDOW_MAX;
+			assert(tape.reads <= (tape.size - 1) / (chunk - 64) + 2);
+			check_same_document(reader, files[i]);
+			pdfrasread_destroy(reader);
+		}
+	}
+	// a file whose xref table doesn't match its objects doesn't open
+	std::vector<char> data;
+	t_tapesource tape;
+	tape_load(&tape, data, "valid1.pdf");
+	std::string text(data.begin(), data.end());
+	size_t xref = text.rfind("\nxref");
+	assert(xref != std::string::npos);
+	// entries are 20 bytes, starting 2 lines from there: bump the offset of object 4
+	size_t entry = text.find('\n', text.find('\n', xref + 1) + 1) + 1 + 4 * 20;
+	assert(data[entry + 17] == 'n');
+	data[entry + 9] = (data[entry + 9] == '9') ? '8' : data[entry + 9] + 1;
+	t_pdfrasreader* reader = pdfrasread_create64(PDFRAS_API_LEVEL, &tape_reader, NULL);
+	assert(pdfrasread_set_open_mode(reader, PDFRAS_OPEN_SCAN));
+	tape_rewind(&tape);
+	assert(!pdfrasread_open(reader, &tape));
+	// which an eager open doesn't notice
+	assert(pdfrasread_set_open_mode(reader, PDFRAS_OPEN_EAGER));
+	tape_rewind(&tape);
+	assert(pdfrasread_open(reader, &tape));
+	pdfrasread_destroy(reader);
+	// nor does a file that ends in the middle of a stream
+	tape_load(&tape, data, "valid1.pdf");
+	tape.size = data.size() / 2;
+	reader = pdfrasread_create64(PDFRAS_API_LEVEL, &tape_reader, NULL);
+	assert(pdfrasread_set_open_mode(reader, PDFRAS_OPEN_SCAN));
+	tape_rewind(&tape);
+	assert(!pdfrasread_open(reader, &tape));
+	pdfrasread_destroy(reader);
+	printf("passed\n");
+}
+
 int main(int argc, char* argv[])
 {
 	printf("pdfraster reader_test\n");
@@ -193,10 +1999,33 @@ int main(int argc, char* argv[])
 	printf("cwd: %s\n", cwd);
 	free(cwd);
 	signature_tests();
+	scan_tests();
+	xref_decode_tests();
 	create_destroy_tests();
+	api_level1_tests();
 	page_count_tests();
 	page_info_tests();
 	strip_data_tests();
+	memory_source_tests();
+	source_size_tests();
+	parse_window_tests();
+	open_mode_tests();
+	shared_reader_tests();
+	batched_read_tests();
+	async_tests();
+	strip_pixels_tests();
+	page_rows_tests();
+	region_tests();
+	reduced_tests();
+	converted_tests();
+	rotated_tests();
+	parallel_tests();
+	strip_cache_tests();
+	block_cache_tests();
+	stats_tests();
+	reader_pool_tests();
+	reopen_tests();
+	scan_open_tests();
 	printf("Hit enter to exit:\n");
 	getchar();
 	return 0;